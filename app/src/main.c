@@ -12,6 +12,7 @@
 
 LOG_MODULE_REGISTER(main, CONFIG_APP_LOG_LEVEL);
 
+#if CONFIG_KSCAN_PER_KEY_CALLBACKS
 static void on_event(uint16_t key_index, bool pressed) {
     LOG_INF("Key %d %s", key_index, pressed ? "pressed" : "released");
 }
@@ -20,6 +21,7 @@ KSCAN_CB_DEFINE(main) = {
     .on_event = on_event,
     // .on_new_value = on_value_changed,
 };
+#endif // CONFIG_KSCAN_PER_KEY_CALLBACKS
 
 int main(void) {
 #if CONFIG_SOC_NRF5340_CPUAPP
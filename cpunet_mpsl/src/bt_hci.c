@@ -33,6 +33,10 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/logging/log_ctrl.h>
 
+#if CONFIG_LIB_YKB_TIMESLOT
+#include <lib/ykb_timeslot.h>
+#endif // CONFIG_LIB_YKB_TIMESLOT
+
 LOG_MODULE_REGISTER(hci_ipc, CONFIG_BT_LOG_LEVEL);
 
 BUILD_ASSERT(!IS_ENABLED(CONFIG_BT_CONN) ||
@@ -504,9 +508,77 @@ int bt_hci_init(void) {
     return 0;
 }
 
+#if CONFIG_LIB_YKB_TIMESLOT
+/* The split link timeslots are kept shorter than the BLE connection
+ * interval, which the controller only reports to the host. Pick it from the
+ * events on their way over.
+ */
+static void hci_evt_snoop(const struct net_buf *buf) {
+    const struct bt_hci_evt_hdr *hdr = (const void *)&buf->data[1];
+    uint16_t interval = 0;
+
+    if (buf->len < 1 + sizeof(*hdr) || buf->data[0] != HCI_IPC_EVT ||
+        hdr->len > buf->len - 1 - sizeof(*hdr)) {
+        return;
+    }
+
+    if (hdr->evt == BT_HCI_EVT_DISCONN_COMPLETE) {
+        timeslot_handler_set_ble_interval(0);
+        return;
+    }
+
+    if (hdr->evt != BT_HCI_EVT_LE_META_EVENT ||
+        hdr->len < sizeof(struct bt_hci_evt_le_meta_event)) {
+        return;
+    }
+
+    const uint8_t *params = &buf->data[1 + sizeof(*hdr)];
+    uint8_t subevent = params[0];
+    size_t len = hdr->len - sizeof(struct bt_hci_evt_le_meta_event);
+
+    params += sizeof(struct bt_hci_evt_le_meta_event);
+
+    switch (subevent) {
+    case BT_HCI_EVT_LE_CONN_COMPLETE:
+        if (len >= sizeof(struct bt_hci_evt_le_conn_complete)) {
+            const struct bt_hci_evt_le_conn_complete *evt =
+                (const void *)params;
+            interval = evt->status ? 0 : sys_le16_to_cpu(evt->interval);
+        }
+        break;
+    case BT_HCI_EVT_LE_ENH_CONN_COMPLETE:
+    case BT_HCI_EVT_LE_ENH_CONN_COMPLETE_V2:
+        /* V2 only appends fields */
+        if (len >= sizeof(struct bt_hci_evt_le_enh_conn_complete)) {
+            const struct bt_hci_evt_le_enh_conn_complete *evt =
+                (const void *)params;
+            interval = evt->status ? 0 : sys_le16_to_cpu(evt->interval);
+        }
+        break;
+    case BT_HCI_EVT_LE_CONN_UPDATE_COMPLETE:
+        if (len >= sizeof(struct bt_hci_evt_le_conn_update_complete)) {
+            const struct bt_hci_evt_le_conn_update_complete *evt =
+                (const void *)params;
+            interval = evt->status ? 0 : sys_le16_to_cpu(evt->interval);
+        }
+        break;
+    default:
+        return;
+    }
+
+    if (interval != 0) {
+        /* 1.25 ms units */
+        timeslot_handler_set_ble_interval((uint32_t)interval * 1250U);
+    }
+}
+#endif // CONFIG_LIB_YKB_TIMESLOT
+
 int bt_hci_process(void) {
     while (1) {
         struct net_buf *buf = k_fifo_get(&rx_queue, K_FOREVER);
+#if CONFIG_LIB_YKB_TIMESLOT
+        hci_evt_snoop(buf);
+#endif // CONFIG_LIB_YKB_TIMESLOT
         hci_ipc_send(buf, HCI_REGULAR_MSG);
     }
 
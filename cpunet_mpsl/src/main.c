@@ -14,27 +14,18 @@
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
-#define ESB_RPC_START_DELAY_MS 3000
-
-static void esb_rpc_start_thread(void *p1, void *p2, void *p3) {
-    ARG_UNUSED(p1);
-    ARG_UNUSED(p2);
-    ARG_UNUSED(p3);
-
-    k_sleep(K_MSEC(ESB_RPC_START_DELAY_MS));
-
-    int err = ykb_esb_rpc_start();
-    if (err) {
-        LOG_ERR("ykb_esb_rpc_start failed: %d", err);
-    }
-}
-
-K_THREAD_DEFINE(esb_rpc_start_thread_id, 1024, esb_rpc_start_thread, NULL,
-                NULL, NULL, K_PRIO_PREEMPT(8), 0, 0);
-
 int main(void) {
     while (true) {
         int err = bt_hci_init();
+
+        // nRF RPC shares the IPC instance bt_hci_init() opens, starting it
+        // from the same thread right after keeps the two from racing on it.
+        // Started even if HCI did not bind, ESB does not need BLE.
+        int rpc_err = ykb_esb_rpc_start();
+        if (rpc_err) {
+            LOG_ERR("ykb_esb_rpc_start failed: %d", rpc_err);
+        }
+
         if (err) {
             LOG_ERR("bt_hci_init failed: %d", err);
             k_sleep(K_MSEC(250));
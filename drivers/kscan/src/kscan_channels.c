@@ -23,6 +23,9 @@ struct kscan_channels_data {
     uint16_t *chan_idxs;
 
     uint16_t *values;
+
+    struct kscan_frame_state frame;
+    struct kscan_rate_stats rate_stats;
 };
 
 static K_MUTEX_DEFINE(kscan_mutex);
@@ -37,8 +40,6 @@ static void kscan_channels_thread(void *device, void *chan_idx, void *__) {
     struct kscan_channels_data *data = dev->data;
     const struct adc_dt_spec chan = cfg->channels[idx];
 
-    bool is_pressed = false;
-
     while (true) {
         uint16_t val = 0;
         int err = read_io_channel(&chan, &val);
@@ -47,27 +48,11 @@ static void kscan_channels_thread(void *device, void *chan_idx, void *__) {
                     chan.channel_id, err);
             return;
         }
-        STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-            if (callbacks->on_new_value) {
-                callbacks->on_new_value(cfg->idx_offset + idx, val);
-            }
-        }
-
         data->values[idx] = val;
-        if (val >= data->thresholds[idx] && !is_pressed) {
-            STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                if (callbacks->on_event) {
-                    callbacks->on_event(cfg->idx_offset + idx, true);
-                }
-            }
-            is_pressed = true;
-        } else if (val < data->thresholds[idx] && is_pressed) {
-            STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                if (callbacks->on_event) {
-                    callbacks->on_event(cfg->idx_offset + idx, false);
-                }
-            }
-            is_pressed = false;
+        if (kscan_frame_sweep_done(&data->frame, idx,
+                                   BIT_MASK(cfg->channels_count))) {
+            kscan_rate_stats_sweep(&data->rate_stats, dev, &data->frame,
+                                   data->threads, cfg->channels_count);
         }
         k_usleep(cfg->settle_us);
     }
@@ -204,8 +189,15 @@ static int kscan_channels_init(const struct device *dev) {
     enum {                                                                     \
         __kscan_channels_cnt__##inst = DT_INST_PROP_LEN(inst, io_channels)     \
     };                                                                         \
+    BUILD_ASSERT(__kscan_channels_cnt__##inst < 32,                            \
+                 "KScan Channels instance supports up to 31 channels");        \
     static uint16_t                                                            \
         __kscan_channels_values__##inst[__kscan_channels_cnt__##inst] = {0};   \
+    static uint16_t                                                            \
+        __kscan_channels_snapshot__##inst[__kscan_channels_cnt__##inst];       \
+    static uint32_t __kscan_channels_pressed__##inst[KSCAN_BITMAP_WORDS(       \
+        __kscan_channels_cnt__##inst)];                                        \
+    KSCAN_FILTER_DEFINE(__kscan_channels, inst, __kscan_channels_cnt__##inst); \
     static k_thread_stack_t                                                    \
         *__kscan_channels_stacks__##inst[__kscan_channels_cnt__##inst] = {     \
             DT_INST_FOREACH_PROP_ELEM(inst, io_channels,                       \
@@ -234,6 +226,17 @@ static int kscan_channels_init(const struct device *dev) {
         .stacks = __kscan_channels_stacks__##inst,                             \
         .chan_idxs = __kscan_channels_chan_idxs__##inst,                       \
         .values = __kscan_channels_values__##inst,                             \
+                                                                               \
+        .frame =                                                               \
+            {                                                                  \
+                .values = __kscan_channels_values__##inst,                     \
+                .snapshot = __kscan_channels_snapshot__##inst,                 \
+                .thresholds = __kscan_channels_tresholds__##inst,              \
+                .pressed = __kscan_channels_pressed__##inst,                   \
+                .filter = KSCAN_FILTER_INIT(__kscan_channels, inst),           \
+                .idx_offset = DT_INST_PROP(inst, idx_offset),                  \
+                .count = __kscan_channels_cnt__##inst,                         \
+            },                                                                 \
     };                                                                         \
                                                                                \
     DEVICE_DT_INST_DEFINE(                                                     \
@@ -1,5 +1,9 @@
 #include "kscan_common.h"
 
+#include <string.h>
+
+LOG_MODULE_REGISTER(kscan_common, CONFIG_KSCAN_LOG_LEVEL);
+
 int read_io_channel(const struct adc_dt_spec *spec, uint16_t *val) {
     uint16_t buf;
     struct adc_sequence sequence = {
@@ -14,3 +18,243 @@ int read_io_channel(const struct adc_dt_spec *spec, uint16_t *val) {
     *val = buf;
     return 0;
 }
+
+#if CONFIG_KSCAN_PER_KEY_CALLBACKS
+static void dispatch_per_key(const struct kscan_frame_state *state,
+                             const uint16_t *values, uint16_t word,
+                             uint32_t changed) {
+    uint16_t first = word * 32;
+    uint16_t last = MIN(first + 32, state->count);
+
+    for (uint16_t i = first; i < last; ++i) {
+        STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
+            if (callbacks->on_new_value) {
+                callbacks->on_new_value(state->idx_offset + i, values[i]);
+            }
+        }
+        if (!(changed & BIT(i - first))) {
+            continue;
+        }
+        bool pressed = (state->pressed[word] & BIT(i - first)) != 0;
+        STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
+            if (callbacks->on_event) {
+                callbacks->on_event(state->idx_offset + i, pressed);
+            }
+        }
+    }
+}
+#endif // CONFIG_KSCAN_PER_KEY_CALLBACKS
+
+static inline bool filter_enabled(const struct kscan_filter *filter) {
+    return filter->median || filter->ema_shift || filter->hysteresis;
+}
+
+// Counts edges a plain threshold comparison of the raw values would cause,
+// must run before the values are filtered
+static void filter_count_raw_edges(struct kscan_frame_state *state,
+                                   const uint16_t *values) {
+    struct kscan_filter *filter = &state->filter;
+
+    for (uint16_t word = 0; word < KSCAN_BITMAP_WORDS(state->count); ++word) {
+        uint16_t first = word * 32;
+        uint16_t last = MIN(first + 32, state->count);
+        uint32_t pressed = 0;
+
+        for (uint16_t i = first; i < last; ++i) {
+            pressed |= (uint32_t)(values[i] >= state->thresholds[i])
+                       << (i - first);
+        }
+        filter->raw_edges +=
+            __builtin_popcount(pressed ^ filter->raw_pressed[word]);
+        filter->raw_pressed[word] = pressed;
+    }
+}
+
+static void filter_apply(struct kscan_frame_state *state, uint16_t *values) {
+    struct kscan_filter *filter = &state->filter;
+
+    // Start from the first frame instead of zeros, so keys at rest do not
+    // ramp up through the thresholds
+    if (!filter->primed) {
+        for (uint16_t i = 0; i < state->count; ++i) {
+            if (filter->median) {
+                filter->median_history[0][i] = values[i];
+                filter->median_history[1][i] = values[i];
+            }
+            if (filter->ema_shift) {
+                filter->ema[i] = (int32_t)values[i] << KSCAN_FILTER_EMA_Q;
+            }
+        }
+        filter->primed = true;
+    }
+
+    if (filter->median) {
+        kscan_filter_median3(values, filter->median_history[0],
+                             filter->median_history[1], state->count);
+    }
+    if (filter->ema_shift) {
+        kscan_filter_ema(values, filter->ema, filter->ema_shift, state->count);
+    }
+}
+
+void kscan_frame_emit(struct kscan_frame_state *state) {
+    struct kscan_filter *filter = &state->filter;
+    uint16_t *values = state->values;
+
+    if (filter_enabled(filter)) {
+        values = filter->values;
+        memcpy(values, state->values, state->count * sizeof(uint16_t));
+        filter_count_raw_edges(state, values);
+        filter_apply(state, values);
+    } else if (state->snapshot) {
+        memcpy(state->snapshot, state->values,
+               state->count * sizeof(uint16_t));
+        values = state->snapshot;
+    }
+
+    for (uint16_t word = 0; word < KSCAN_BITMAP_WORDS(state->count); ++word) {
+        uint16_t first = word * 32;
+        uint16_t last = MIN(first + 32, state->count);
+        uint32_t prev = state->pressed[word];
+        uint32_t pressed = 0;
+
+        // Pressed keys release only below threshold - hysteresis
+        for (uint16_t i = first; i < last; ++i) {
+            uint16_t threshold = state->thresholds[i];
+            uint16_t release = threshold > filter->hysteresis
+                                   ? threshold - filter->hysteresis
+                                   : 0;
+            bool was_pressed = (prev & BIT(i - first)) != 0;
+
+            pressed |= (uint32_t)(values[i] >= (was_pressed ? release
+                                                            : threshold))
+                       << (i - first);
+        }
+
+        filter->edges += __builtin_popcount(pressed ^ prev);
+
+#if CONFIG_KSCAN_PER_KEY_CALLBACKS
+        uint32_t changed = pressed ^ prev;
+        state->pressed[word] = pressed;
+        dispatch_per_key(state, values, word, changed);
+#else
+        state->pressed[word] = pressed;
+#endif // CONFIG_KSCAN_PER_KEY_CALLBACKS
+    }
+
+    if (!filter_enabled(filter)) {
+        filter->raw_edges = filter->edges;
+    }
+
+    const struct kscan_frame frame = {
+        .values = values,
+        .pressed_bitmap = state->pressed,
+        .idx_offset = state->idx_offset,
+        .count = state->count,
+        .seq = state->seq++,
+        .timestamp = k_uptime_ticks(),
+    };
+
+    STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
+        if (callbacks->on_frame) {
+            callbacks->on_frame(&frame);
+        }
+    }
+}
+
+bool kscan_frame_sweep_done(struct kscan_frame_state *state,
+                            uint16_t thread_idx, atomic_val_t threads_mask) {
+    atomic_val_t done = atomic_or(&state->sweeps_done, BIT(thread_idx));
+    if ((done | BIT(thread_idx)) != threads_mask) {
+        return false;
+    }
+    // Another thread may finish its next sweep meanwhile, it only sets a bit
+    // which is already set, so the swap below can't fail because of it
+    if (!atomic_cas(&state->sweeps_done, threads_mask, 0)) {
+        return false;
+    }
+    kscan_frame_emit(state);
+    return true;
+}
+
+#if CONFIG_KSCAN_SCAN_RATE_REPORT
+static uint64_t threads_exec_cycles(struct k_thread *threads,
+                                    uint16_t threads_count) {
+    uint64_t cycles = 0;
+#if CONFIG_SCHED_THREAD_USAGE
+    for (uint16_t i = 0; i < threads_count; ++i) {
+        k_thread_runtime_stats_t rt_stats;
+        if (k_thread_runtime_stats_get(&threads[i], &rt_stats) == 0) {
+            cycles += rt_stats.execution_cycles;
+        }
+    }
+#else
+    ARG_UNUSED(threads);
+    ARG_UNUSED(threads_count);
+#endif // CONFIG_SCHED_THREAD_USAGE
+    return cycles;
+}
+#endif // CONFIG_KSCAN_SCAN_RATE_REPORT
+
+void kscan_rate_stats_sweep(struct kscan_rate_stats *stats,
+                            const struct device *dev,
+                            const struct kscan_frame_state *frame,
+                            struct k_thread *threads, uint16_t threads_count) {
+#if CONFIG_KSCAN_SCAN_RATE_REPORT
+    int64_t now = k_uptime_get();
+    uint32_t now_cycles = k_cycle_get_32();
+    if (stats->sweeps == 0) {
+        stats->window_start = now;
+        stats->max_period_cycles = 0;
+        stats->window_exec_cycles = threads_exec_cycles(threads, threads_count);
+        stats->window_raw_edges = frame->filter.raw_edges;
+        stats->window_edges = frame->filter.edges;
+        stats->window_isr_cycles = (uint32_t)atomic_get(&stats->isr_cycles);
+    } else {
+        stats->max_period_cycles = MAX(stats->max_period_cycles,
+                                       now_cycles - stats->last_sweep_cycles);
+    }
+    stats->last_sweep_cycles = now_cycles;
+    stats->sweeps++;
+
+    int64_t elapsed = now - stats->window_start;
+    if (elapsed < CONFIG_KSCAN_SCAN_RATE_REPORT_INTERVAL_MS) {
+        return;
+    }
+
+    // First sweep only opens the window, so it is not counted
+    uint32_t sweeps = stats->sweeps - 1;
+    uint32_t isr_cycles =
+        (uint32_t)atomic_get(&stats->isr_cycles) - stats->window_isr_cycles;
+    uint64_t exec_cycles = threads_exec_cycles(threads, threads_count) -
+                           stats->window_exec_cycles + isr_cycles;
+    uint64_t window_cycles =
+        (uint64_t)sys_clock_hw_cycles_per_sec() * elapsed / 1000;
+    bool usage = IS_ENABLED(CONFIG_SCHED_THREAD_USAGE) && window_cycles;
+    uint32_t cpu_permille =
+        usage ? (uint32_t)(exec_cycles * 1000 / window_cycles) : 0;
+    uint32_t isr_permille =
+        usage ? (uint32_t)((uint64_t)isr_cycles * 1000 / window_cycles) : 0;
+
+    uint32_t raw_edges = frame->filter.raw_edges - stats->window_raw_edges;
+    uint32_t edges = frame->filter.edges - stats->window_edges;
+
+    LOG_INF("'%s': %u sweeps/s, period %u us (max %u us), cpu %u.%u%% "
+            "(isr %u.%u%%)",
+            dev->name, (uint32_t)(sweeps * 1000LL / elapsed),
+            sweeps ? (uint32_t)(elapsed * 1000LL / sweeps) : 0,
+            k_cyc_to_us_ceil32(stats->max_period_cycles), cpu_permille / 10,
+            cpu_permille % 10, isr_permille / 10, isr_permille % 10);
+    LOG_INF("'%s': edges %u/s, unfiltered %u/s, %u suppressed", dev->name,
+            (uint32_t)(edges * 1000LL / elapsed),
+            (uint32_t)(raw_edges * 1000LL / elapsed),
+            raw_edges > edges ? raw_edges - edges : 0);
+    stats->sweeps = 0;
+#else
+    ARG_UNUSED(stats);
+    ARG_UNUSED(dev);
+    ARG_UNUSED(frame);
+    ARG_UNUSED(threads);
+    ARG_UNUSED(threads_count);
+#endif // CONFIG_KSCAN_SCAN_RATE_REPORT
+}
@@ -7,9 +7,148 @@
 #include <zephyr/drivers/adc.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
 
 #include <drivers/kscan.h>
 
 int read_io_channel(const struct adc_dt_spec *spec, uint16_t *val);
 
+// Per-key filter stage run over every frame before thresholding, configured
+// per instance in devicetree (see kscan.yaml). Disabled stages cost nothing.
+struct kscan_filter {
+    // Filtered copy of the frame, so driver values always stay raw
+    uint16_t *values;
+    // Raw samples of the two previous frames, only with median enabled.
+    // Word aligned and padded to an even length for the SIMD kernel.
+    uint16_t *median_history[2];
+    // Filtered values in KSCAN_FILTER_EMA_Q fixed point, only with EMA
+    int32_t *ema;
+    // Unfiltered threshold comparison of the previous frame
+    uint32_t *raw_pressed;
+
+    bool median;
+    uint8_t ema_shift;
+    uint16_t hysteresis;
+    bool primed;
+
+    // Edges the unfiltered values would have caused and edges emitted
+    uint32_t raw_edges;
+    uint32_t edges;
+};
+
+#define KSCAN_FILTER_EMA_Q 8U
+
+// 3-tap median of values with the two previous raw frames, shifts history
+void kscan_filter_median3(uint16_t *values, uint16_t *history1,
+                          uint16_t *history2, uint16_t count);
+// First order low-pass with 1/2^shift coefficient
+void kscan_filter_ema(uint16_t *values, int32_t *ema, uint8_t shift,
+                      uint16_t count);
+
+#define KSCAN_FILTER_ENABLED(inst)                                             \
+    (DT_INST_PROP(inst, filter_median) ||                                      \
+     DT_INST_PROP(inst, filter_ema_shift) || DT_INST_PROP(inst, hysteresis))
+#define KSCAN_FILTER_VALUES_LEN(inst, count)                                   \
+    (KSCAN_FILTER_ENABLED(inst) ? (count) : 1)
+#define KSCAN_FILTER_MEDIAN_LEN(inst, count)                                   \
+    (DT_INST_PROP(inst, filter_median) ? ROUND_UP(count, 2) : 1)
+#define KSCAN_FILTER_EMA_LEN(inst, count)                                      \
+    (DT_INST_PROP(inst, filter_ema_shift) ? (count) : 1)
+
+// Defines filter buffers of an instance, prefix is the driver array prefix
+#define KSCAN_FILTER_DEFINE(prefix, inst, count)                               \
+    static uint16_t                                                            \
+        prefix##_filter_values__##inst[KSCAN_FILTER_VALUES_LEN(inst, count)];  \
+    static uint16_t __aligned(4) prefix##_filter_median__##inst                \
+        [2][KSCAN_FILTER_MEDIAN_LEN(inst, count)];                             \
+    static int32_t                                                             \
+        prefix##_filter_ema__##inst[KSCAN_FILTER_EMA_LEN(inst, count)];        \
+    static uint32_t                                                            \
+        prefix##_filter_raw_pressed__##inst[KSCAN_BITMAP_WORDS(count)]
+
+#define KSCAN_FILTER_INIT(prefix, inst)                                        \
+    {                                                                          \
+        .values = prefix##_filter_values__##inst,                              \
+        .median_history = {prefix##_filter_median__##inst[0],                  \
+                           prefix##_filter_median__##inst[1]},                 \
+        .ema = prefix##_filter_ema__##inst,                                    \
+        .raw_pressed = prefix##_filter_raw_pressed__##inst,                    \
+        .median = DT_INST_PROP(inst, filter_median),                           \
+        .ema_shift = DT_INST_PROP(inst, filter_ema_shift),                     \
+        .hysteresis = DT_INST_PROP(inst, hysteresis),                          \
+    }
+
+// Frame bookkeeping shared by all KScan drivers. Drivers write raw samples
+// into values and call kscan_frame_emit() once all keys were sampled. values
+// stay raw, frames carry the filtered copy if filtering is enabled.
+struct kscan_frame_state {
+    uint16_t *values;
+    // Copy of values handed to subscribers, only needed if values can be
+    // written by other threads while the frame is being dispatched.
+    // NULL otherwise. Unused with filtering, the filtered copy is taken
+    // instead.
+    uint16_t *snapshot;
+    const uint16_t *thresholds;
+    uint32_t *pressed;
+
+    struct kscan_filter filter;
+
+    uint16_t idx_offset;
+    uint16_t count;
+    uint32_t seq;
+
+    // Sweeps done in current frame, one bit per scanning thread
+    atomic_t sweeps_done;
+};
+
+// Filters the values, compares them against thresholds, updates the pressed
+// bitmap and dispatches the frame to every KScan callback.
+void kscan_frame_emit(struct kscan_frame_state *state);
+
+// For drivers with several scanning threads: marks sweep of thread_idx as
+// done and emits the frame once every thread of threads_mask is done.
+// Returns true if the frame was emitted by this call.
+bool kscan_frame_sweep_done(struct kscan_frame_state *state,
+                            uint16_t thread_idx, atomic_val_t threads_mask);
+
+// Sweep counter used for the periodic scan rate report
+struct kscan_rate_stats {
+    int64_t window_start;
+    uint32_t sweeps;
+    uint32_t last_sweep_cycles;
+    uint32_t max_period_cycles;
+    uint64_t window_exec_cycles;
+    uint32_t window_raw_edges;
+    uint32_t window_edges;
+    // Cycles spent in ISRs of the instance, see kscan_rate_stats_isr()
+    atomic_t isr_cycles;
+    uint32_t window_isr_cycles;
+};
+
+// Adds cycles spent scanning in ISR context, e.g. in ADC callbacks, which
+// the thread runtime stats charge to whatever thread was interrupted.
+// Callable from ISRs.
+static inline void kscan_rate_stats_isr(struct kscan_rate_stats *stats,
+                                        uint32_t cycles) {
+#if CONFIG_KSCAN_SCAN_RATE_REPORT
+    (void)atomic_add(&stats->isr_cycles, (atomic_val_t)cycles);
+#else
+    ARG_UNUSED(stats);
+    ARG_UNUSED(cycles);
+#endif // CONFIG_KSCAN_SCAN_RATE_REPORT
+}
+
+// Should be called once per complete sweep over all keys of the instance.
+// Logs achieved sweep rate, average and worst sweep period, CPU usage of
+// the scanning threads and key edges before and after filtering every
+// CONFIG_KSCAN_SCAN_RATE_REPORT_INTERVAL_MS if CONFIG_KSCAN_SCAN_RATE_REPORT
+// is enabled, no-op otherwise.
+// CPU usage is only available with CONFIG_SCHED_THREAD_USAGE. It includes
+// ISR time reported through kscan_rate_stats_isr(), but not the time the
+// ADC driver itself spends in its ISR.
+void kscan_rate_stats_sweep(struct kscan_rate_stats *stats,
+                            const struct device *dev,
+                            const struct kscan_frame_state *frame,
+                            struct k_thread *threads, uint16_t threads_count);
+
 #endif // __KSCAN_COMMON_H_
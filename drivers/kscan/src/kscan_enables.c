@@ -24,6 +24,9 @@ struct kscan_enables_data {
 
     struct k_thread thread;
     k_thread_stack_t *stack;
+
+    struct kscan_frame_state frame;
+    struct kscan_rate_stats rate_stats;
 };
 
 static K_MUTEX_DEFINE(kscan_mutex);
@@ -48,9 +51,6 @@ static void kscan_enables_thread(void *kscan_dev, void *_, void *__) {
         }
     }
 
-    bool is_pressed[cfg->key_amount];
-    memset(is_pressed, 0, sizeof(is_pressed));
-
     while (true) {
         for (uint16_t i = 0; i < cfg->key_amount; ++i) {
             const struct gpio_dt_spec *en = &cfg->enables[i];
@@ -75,27 +75,7 @@ static void kscan_enables_thread(void *kscan_dev, void *_, void *__) {
                 }
                 return;
             }
-            STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                if (callbacks->on_new_value) {
-                    callbacks->on_new_value(cfg->idx_offset + i, val);
-                }
-            }
             data->values[i] = val;
-            if (val >= data->thresholds[i] && !is_pressed[i]) {
-                STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                    if (callbacks->on_event) {
-                        callbacks->on_event(cfg->idx_offset + i, true);
-                    }
-                }
-                is_pressed[i] = true;
-            } else if (val < data->thresholds[i] && is_pressed[i]) {
-                STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                    if (callbacks->on_event) {
-                        callbacks->on_event(cfg->idx_offset + i, false);
-                    }
-                }
-                is_pressed[i] = false;
-            }
 
             err = gpio_pin_set_dt(en, 0);
             if (err) {
@@ -104,6 +84,9 @@ static void kscan_enables_thread(void *kscan_dev, void *_, void *__) {
                 return;
             }
         }
+        kscan_frame_emit(&data->frame);
+        kscan_rate_stats_sweep(&data->rate_stats, dev, &data->frame,
+                               &data->thread, 1);
     }
 }
 
@@ -231,6 +214,10 @@ static int kscan_enables_init(const struct device *dev) {
                                                                                \
     static uint16_t __kscan_enables_values__##inst[DT_INST_PROP_LEN(           \
         inst, enable_gpios)] = {0};                                            \
+    static uint32_t __kscan_enables_pressed__##inst[KSCAN_BITMAP_WORDS(        \
+        DT_INST_PROP_LEN(inst, enable_gpios))];                                \
+    KSCAN_FILTER_DEFINE(__kscan_enables, inst,                                 \
+                        DT_INST_PROP_LEN(inst, enable_gpios));                 \
                                                                                \
     static const struct kscan_enables_config __kscan_enables_config__##inst =  \
         {                                                                      \
@@ -247,6 +234,16 @@ static int kscan_enables_init(const struct device *dev) {
         .stack = __kscan_enables_thread_stack__##inst,                         \
         .values = __kscan_enables_values__##inst,                              \
         .thresholds = __kscan_enables_thresholds__##inst,                      \
+                                                                               \
+        .frame =                                                               \
+            {                                                                  \
+                .values = __kscan_enables_values__##inst,                      \
+                .thresholds = __kscan_enables_thresholds__##inst,              \
+                .pressed = __kscan_enables_pressed__##inst,                    \
+                .filter = KSCAN_FILTER_INIT(__kscan_enables, inst),            \
+                .idx_offset = DT_INST_PROP(inst, idx_offset),                  \
+                .count = DT_INST_PROP_LEN(inst, enable_gpios),                 \
+            },                                                                 \
     };                                                                         \
                                                                                \
     DEVICE_DT_INST_DEFINE(                                                     \
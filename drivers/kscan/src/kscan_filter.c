@@ -0,0 +1,71 @@
+#include "kscan_common.h"
+
+#include <string.h>
+
+#if defined(__ARM_FEATURE_SIMD32) && __ARM_FEATURE_SIMD32
+#include <arm_acle.h>
+#define KSCAN_FILTER_SIMD32 1
+#endif
+
+static inline uint16_t median3(uint16_t a, uint16_t b, uint16_t c) {
+    return MAX(MIN(a, b), MIN(MAX(a, b), c));
+}
+
+#if KSCAN_FILTER_SIMD32
+// USUB16 sets a GE flag pair for every halfword where a >= b, SEL then
+// picks the halfwords of its first operand where the flags are set
+static inline uint32_t max_u16x2(uint32_t a, uint32_t b) {
+    (void)__usub16(a, b);
+    return __sel(a, b);
+}
+
+static inline uint32_t min_u16x2(uint32_t a, uint32_t b) {
+    (void)__usub16(a, b);
+    return __sel(b, a);
+}
+#endif // KSCAN_FILTER_SIMD32
+
+void kscan_filter_median3(uint16_t *values, uint16_t *history1,
+                          uint16_t *history2, uint16_t count) {
+    uint16_t i = 0;
+
+#if KSCAN_FILTER_SIMD32
+    // Two keys per iteration, values may be unaligned so it goes through
+    // memcpy, history is word aligned
+    uint32_t *h1 = (uint32_t *)history1;
+    uint32_t *h2 = (uint32_t *)history2;
+
+    for (; i + 1 < count; i += 2) {
+        uint32_t x;
+        memcpy(&x, &values[i], sizeof(x));
+
+        uint32_t prev = h1[i / 2];
+        uint32_t lo = min_u16x2(x, prev);
+        uint32_t hi = max_u16x2(x, prev);
+        uint32_t med = max_u16x2(lo, min_u16x2(hi, h2[i / 2]));
+
+        h2[i / 2] = prev;
+        h1[i / 2] = x;
+        memcpy(&values[i], &med, sizeof(med));
+    }
+#endif // KSCAN_FILTER_SIMD32
+
+    for (; i < count; ++i) {
+        uint16_t x = values[i];
+
+        values[i] = median3(x, history1[i], history2[i]);
+        history2[i] = history1[i];
+        history1[i] = x;
+    }
+}
+
+void kscan_filter_ema(uint16_t *values, int32_t *ema, uint8_t shift,
+                      uint16_t count) {
+    for (uint16_t i = 0; i < count; ++i) {
+        int32_t target = (int32_t)values[i] << KSCAN_FILTER_EMA_Q;
+
+        ema[i] += (target - ema[i]) >> shift;
+        values[i] = (uint16_t)((ema[i] + BIT(KSCAN_FILTER_EMA_Q - 1)) >>
+                               KSCAN_FILTER_EMA_Q);
+    }
+}
@@ -8,6 +8,19 @@ LOG_MODULE_REGISTER(kscan_muxes, CONFIG_KSCAN_LOG_LEVEL);
 
 #define KSCAN_THRESHOLD_INACTIVE UINT16_MAX
 
+// Indexes of the scan-mode devicetree enum
+enum kscan_muxes_scan_mode {
+    KSCAN_MUXES_SCAN_PER_MUX = 0,
+    KSCAN_MUXES_SCAN_BATCHED = 1,
+    KSCAN_MUXES_SCAN_ADC_ASYNC = 2,
+};
+
+static const char *const kscan_muxes_scan_mode_names[] = {
+    [KSCAN_MUXES_SCAN_PER_MUX] = "per-mux",
+    [KSCAN_MUXES_SCAN_BATCHED] = "batched",
+    [KSCAN_MUXES_SCAN_ADC_ASYNC] = "adc-async",
+};
+
 struct kscan_muxes_config {
     const struct adc_dt_spec *channels;
     const uint16_t channels_count;
@@ -16,10 +29,12 @@ struct kscan_muxes_config {
     const uint16_t key_amount;
 
     const struct device **muxes;
+    const uint16_t *mux_channels;
     const uint16_t muxes_count;
 
     const uint32_t settle_us;
 
+    const enum kscan_muxes_scan_mode scan_mode;
 };
 
 struct kscan_muxes_data {
@@ -29,6 +44,17 @@ struct kscan_muxes_data {
     struct k_thread *threads;
     k_thread_stack_t **stacks;
     uint16_t *chan_idxs;
+    uint16_t threads_count;
+
+    struct kscan_frame_state frame;
+    struct kscan_rate_stats rate_stats;
+
+#if CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN
+    uint16_t max_mux_channels;
+    uint32_t async_switch_cycles;
+    // First mux switch error of the sampling callback, ends the scan
+    int async_err;
+#endif // CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN
 };
 
 static K_MUTEX_DEFINE(kscan_mutex);
@@ -68,9 +94,6 @@ static void kscan_muxes_thread(void *kscan_dev, void *chan_index, void *_) {
         return;
     }
 
-    bool is_pressed[mux_channels];
-    memset(is_pressed, 0, sizeof(is_pressed));
-
     int err = 0;
     int lerr = 0;
 
@@ -96,31 +119,7 @@ static void kscan_muxes_thread(void *kscan_dev, void *chan_index, void *_) {
                         chan.channel_id, err);
                 goto cleanup;
             }
-            uint16_t kscan_offset = chan_offset + i;
-            STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                if (callbacks->on_new_value) {
-                    callbacks->on_new_value(cfg->idx_offset + kscan_offset,
-                                            val);
-                }
-            }
-            data->values[kscan_offset] = val;
-            if (val >= data->thresholds[kscan_offset] && !is_pressed[i]) {
-                STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                    if (callbacks->on_event) {
-                        callbacks->on_event(cfg->idx_offset + kscan_offset,
-                                            true);
-                    }
-                }
-                is_pressed[i] = true;
-            } else if (val < data->thresholds[kscan_offset] && is_pressed[i]) {
-                STRUCT_SECTION_FOREACH(kscan_cb, callbacks) {
-                    if (callbacks->on_event) {
-                        callbacks->on_event(cfg->idx_offset + kscan_offset,
-                                            false);
-                    }
-                }
-                is_pressed[i] = false;
-            }
+            data->values[chan_offset + i] = val;
             err = mux_select_next(mux);
             if (err < 0) {
                 LOG_ERR("[%d] Unable to select next channel of the mux '%s'",
@@ -129,6 +128,11 @@ static void kscan_muxes_thread(void *kscan_dev, void *chan_index, void *_) {
             }
             k_usleep(cfg->settle_us);
         }
+        if (kscan_frame_sweep_done(&data->frame, chan_idx,
+                                   BIT_MASK(data->threads_count))) {
+            kscan_rate_stats_sweep(&data->rate_stats, dev, &data->frame,
+                                   data->threads, data->threads_count);
+        }
     }
 
 cleanup:
@@ -139,6 +143,280 @@ cleanup:
     return;
 }
 
+// ADC puts samples of a sequence into the buffer in ascending channel id
+// order, so mux indexes are sorted the same way
+static void kscan_muxes_sample_order(const struct kscan_muxes_config *cfg,
+                                     uint16_t *order) {
+    for (uint16_t i = 0; i < cfg->muxes_count; ++i) {
+        uint16_t j = i;
+        while (j > 0 && cfg->channels[order[j - 1]].channel_id >
+                            cfg->channels[i].channel_id) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+}
+
+// Error path of the single-thread scan modes, same as a per-mux thread does
+// for its own mux
+static void kscan_muxes_disable_all(const struct kscan_muxes_config *cfg) {
+    for (uint16_t i = 0; i < cfg->muxes_count; ++i) {
+        int err = mux_disable(cfg->muxes[i]);
+        if (err < 0) {
+            LOG_WRN("Unable to disable mux '%s' (err %d)", cfg->muxes[i]->name,
+                    err);
+        }
+    }
+}
+
+// Single thread for all muxes: every step selects the same channel index on
+// each mux, waits settle time once and converts all io-channels in a single
+// ADC sequence
+static void kscan_muxes_batched_thread(void *kscan_dev, void *_, void *__) {
+    LOG_INF("Starting KScan MUXes batched thread");
+
+    const struct device *dev = kscan_dev;
+    const struct kscan_muxes_config *cfg = dev->config;
+    struct kscan_muxes_data *data = dev->data;
+
+    const uint16_t muxes_count = cfg->muxes_count;
+    const uint16_t *mux_channels = cfg->mux_channels;
+
+    uint16_t chan_offsets[muxes_count];
+    uint16_t max_channels = 0;
+    uint16_t chan_offset = 0;
+    for (uint16_t i = 0; i < muxes_count; ++i) {
+        chan_offsets[i] = chan_offset;
+        chan_offset += mux_channels[i];
+        max_channels = MAX(max_channels, mux_channels[i]);
+    }
+
+    uint16_t order[muxes_count];
+    kscan_muxes_sample_order(cfg, order);
+
+    uint16_t buf[muxes_count];
+    struct adc_sequence sequence = {
+        .buffer = buf,
+    };
+    int err = adc_sequence_init_dt(&cfg->channels[0], &sequence);
+    if (err < 0) {
+        LOG_ERR("Unable to init ADC sequence (err %d)", err);
+        goto cleanup;
+    }
+
+    while (true) {
+        for (uint16_t step = 0; step < max_channels; ++step) {
+            uint32_t channels_mask = 0;
+            uint16_t samples = 0;
+            for (uint16_t i = 0; i < muxes_count; ++i) {
+                if (step >= mux_channels[i]) {
+                    continue;
+                }
+                err = mux_select(cfg->muxes[i], step);
+                if (err < 0) {
+                    LOG_ERR("Unable to select channel %u on mux '%s' (err %d)",
+                            step, cfg->muxes[i]->name, err);
+                    goto cleanup;
+                }
+                channels_mask |= BIT(cfg->channels[i].channel_id);
+                samples++;
+            }
+
+            k_usleep(cfg->settle_us);
+
+            sequence.channels = channels_mask;
+            sequence.buffer_size = samples * sizeof(uint16_t);
+            err = adc_read(cfg->channels[0].dev, &sequence);
+            if (err < 0) {
+                LOG_ERR("Could not read ADC sequence 0x%x (%d)", channels_mask,
+                        err);
+                goto cleanup;
+            }
+
+            uint16_t sample = 0;
+            for (uint16_t i = 0; i < muxes_count; ++i) {
+                uint16_t mux_idx = order[i];
+                if (step >= mux_channels[mux_idx]) {
+                    continue;
+                }
+                data->values[chan_offsets[mux_idx] + step] = buf[sample++];
+            }
+        }
+        kscan_frame_emit(&data->frame);
+        kscan_rate_stats_sweep(&data->rate_stats, dev, &data->frame,
+                               data->threads, data->threads_count);
+    }
+
+cleanup:
+    kscan_muxes_disable_all(cfg);
+}
+
+#if CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN
+
+// Called from the ADC driver in interrupt context once a sampling of all
+// io-channels is done, so every sampling costs CPU time here. Switches the
+// muxes to the channel of the next sampling, which the driver's kernel timer
+// starts after settle-us, so muxes do not wait their own settle time here.
+// After the last sampling of a frame the muxes are wrapped back to the first
+// channel. A failed switch finishes the frame early and ends the scan.
+static enum adc_action
+kscan_muxes_async_sampling_done(const struct device *adc,
+                                const struct adc_sequence *sequence,
+                                uint16_t sampling_index) {
+    ARG_UNUSED(adc);
+
+    uint32_t start = k_cycle_get_32();
+    const struct device *dev = sequence->options->user_data;
+    const struct kscan_muxes_config *cfg = dev->config;
+    struct kscan_muxes_data *data = dev->data;
+
+    uint16_t next = sampling_index + 1;
+    if (next >= data->max_mux_channels) {
+        next = 0;
+    }
+    for (uint16_t i = 0; i < cfg->muxes_count; ++i) {
+        int err =
+            mux_select(cfg->muxes[i], next < cfg->mux_channels[i] ? next : 0);
+        if (err < 0) {
+            data->async_err = err;
+            return ADC_ACTION_FINISH;
+        }
+    }
+    data->async_switch_cycles = k_cycle_get_32();
+    kscan_rate_stats_isr(&data->rate_stats, data->async_switch_cycles - start);
+
+    return ADC_ACTION_CONTINUE;
+}
+
+// Thread which only wakes up once per frame: restarts the conversion into
+// the other half of the double buffer and processes the completed frame
+static void kscan_muxes_async_thread(void *kscan_dev, void *_, void *__) {
+    LOG_INF("Starting KScan MUXes async thread");
+
+    const struct device *dev = kscan_dev;
+    const struct kscan_muxes_config *cfg = dev->config;
+    struct kscan_muxes_data *data = dev->data;
+
+    const uint16_t muxes_count = cfg->muxes_count;
+    const uint16_t steps = data->max_mux_channels;
+    const struct device *adc = cfg->channels[0].dev;
+
+    uint16_t chan_offsets[muxes_count];
+    uint16_t chan_offset = 0;
+    uint32_t channels_mask = 0;
+    for (uint16_t i = 0; i < muxes_count; ++i) {
+        chan_offsets[i] = chan_offset;
+        chan_offset += cfg->mux_channels[i];
+        channels_mask |= BIT(cfg->channels[i].channel_id);
+    }
+
+    uint16_t order[muxes_count];
+    kscan_muxes_sample_order(cfg, order);
+
+    uint16_t frames[2][steps * muxes_count];
+    struct k_poll_signal signals[2];
+    struct adc_sequence sequences[2];
+    const struct adc_sequence_options options = {
+        .interval_us = cfg->settle_us,
+        .callback = kscan_muxes_async_sampling_done,
+        .user_data = (void *)dev,
+        .extra_samplings = steps - 1,
+    };
+
+    int err;
+    for (uint8_t i = 0; i < 2; ++i) {
+        k_poll_signal_init(&signals[i]);
+        sequences[i] = (struct adc_sequence){
+            .options = &options,
+            .buffer = frames[i],
+            .buffer_size = sizeof(frames[i]),
+        };
+        err = adc_sequence_init_dt(&cfg->channels[0], &sequences[i]);
+        if (err < 0) {
+            LOG_ERR("Unable to init ADC sequence (err %d)", err);
+            goto cleanup;
+        }
+        sequences[i].channels = channels_mask;
+    }
+
+    for (uint16_t i = 0; i < muxes_count; ++i) {
+        err = mux_select(cfg->muxes[i], 0);
+        if (err < 0) {
+            LOG_ERR("Unable to select first channel on mux '%s' (err %d)",
+                    cfg->muxes[i]->name, err);
+            goto cleanup;
+        }
+    }
+    k_usleep(cfg->settle_us);
+
+    uint8_t cur = 0;
+    err = adc_read_async(adc, &sequences[cur], &signals[cur]);
+    if (err < 0) {
+        LOG_ERR("Unable to start ADC frame (err %d)", err);
+        goto cleanup;
+    }
+
+    while (true) {
+        struct k_poll_event event = K_POLL_EVENT_INITIALIZER(
+            K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &signals[cur]);
+        k_poll(&event, 1, K_FOREVER);
+
+        unsigned int signaled;
+        int result;
+        k_poll_signal_check(&signals[cur], &signaled, &result);
+        k_poll_signal_reset(&signals[cur]);
+        if (result < 0) {
+            LOG_ERR("ADC frame failed (err %d)", result);
+            goto cleanup;
+        }
+        if (data->async_err < 0) {
+            LOG_ERR("Unable to switch muxes between samplings (err %d)",
+                    data->async_err);
+            goto cleanup;
+        }
+
+        // Muxes were wrapped to the first channel by the last sampling
+        // callback, make sure they settled before starting the next frame.
+        // Usually they did while the thread was woken up, otherwise sleep,
+        // which may take up to a tick longer.
+        uint32_t since_switch =
+            k_cyc_to_us_floor32(k_cycle_get_32() - data->async_switch_cycles);
+        if (since_switch < cfg->settle_us) {
+            k_usleep(cfg->settle_us - since_switch);
+        }
+
+        uint8_t next = cur ^ 1;
+        err = adc_read_async(adc, &sequences[next], &signals[next]);
+        if (err < 0) {
+            LOG_ERR("Unable to start ADC frame (err %d)", err);
+            goto cleanup;
+        }
+
+        const uint16_t *frame = frames[cur];
+        for (uint16_t step = 0; step < steps; ++step) {
+            const uint16_t *sampling = &frame[step * muxes_count];
+            for (uint16_t i = 0; i < muxes_count; ++i) {
+                uint16_t mux_idx = order[i];
+                if (step >= cfg->mux_channels[mux_idx]) {
+                    continue;
+                }
+                data->values[chan_offsets[mux_idx] + step] = sampling[i];
+            }
+        }
+        kscan_frame_emit(&data->frame);
+        kscan_rate_stats_sweep(&data->rate_stats, dev, &data->frame,
+                               data->threads, data->threads_count);
+
+        cur = next;
+    }
+
+cleanup:
+    kscan_muxes_disable_all(cfg);
+}
+
+#endif // CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN
+
 static int kscan_muxes_set_thresholds(const struct device *dev,
                                       uint16_t *thresholds) {
     if (!thresholds) {
@@ -146,13 +424,13 @@ static int kscan_muxes_set_thresholds(const struct device *dev,
     }
     struct kscan_muxes_data *data = dev->data;
     const struct kscan_muxes_config *cfg = dev->config;
-    for (size_t i = 0; i < cfg->channels_count; ++i) {
+    for (size_t i = 0; i < data->threads_count; ++i) {
         k_thread_suspend(&data->threads[i]);
     }
     k_mutex_lock(&kscan_mutex, K_FOREVER);
     memcpy(data->thresholds, thresholds, cfg->key_amount * sizeof(uint16_t));
     k_mutex_unlock(&kscan_mutex);
-    for (size_t i = 0; i < cfg->channels_count; ++i) {
+    for (size_t i = 0; i < data->threads_count; ++i) {
         k_thread_resume(&data->threads[i]);
     }
     return 0;
@@ -245,14 +523,53 @@ static int kscan_muxes_init(const struct device *dev) {
             return -ENODEV;
         }
         LOG_DBG("Successfully set up ADC channel %d", adc_spec->channel_id);
+        if (cfg->scan_mode != KSCAN_MUXES_SCAN_PER_MUX &&
+            adc_spec->dev != cfg->channels[0].dev) {
+            LOG_ERR("%s scan requires all io-channels on the same ADC",
+                    kscan_muxes_scan_mode_names[cfg->scan_mode]);
+            return -EINVAL;
+        }
     }
 
-    LOG_INF("KScan (MUXes) ready: %u MUXes", cfg->muxes_count);
+    LOG_INF("KScan (MUXes) ready: %u MUXes, %s scan", cfg->muxes_count,
+            kscan_muxes_scan_mode_names[cfg->scan_mode]);
 
     for (uint16_t i = 0; i < cfg->key_amount; ++i) {
         data->thresholds[i] = KSCAN_THRESHOLD_INACTIVE;
     }
 
+    // Only per-mux threads write values while another thread dispatches
+    if (cfg->scan_mode != KSCAN_MUXES_SCAN_PER_MUX) {
+        data->frame.snapshot = NULL;
+    }
+
+#if CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN
+    if (cfg->scan_mode == KSCAN_MUXES_SCAN_ADC_ASYNC) {
+        for (uint16_t i = 0; i < cfg->muxes_count; ++i) {
+            data->max_mux_channels =
+                MAX(data->max_mux_channels, cfg->mux_channels[i]);
+        }
+        data->threads_count = 1;
+        k_thread_create(&data->threads[0], data->stacks[0],
+                        CONFIG_KSCAN_MUXES_THREAD_STACK_SIZE,
+                        kscan_muxes_async_thread, (void *)dev, NULL, NULL,
+                        CONFIG_KSCAN_MUXES_THREAD_PRIORITY, 0, K_NO_WAIT);
+        k_thread_name_set(&data->threads[0], "kscan_mux_async");
+        return 0;
+    }
+#endif // CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN
+
+    if (cfg->scan_mode == KSCAN_MUXES_SCAN_BATCHED) {
+        data->threads_count = 1;
+        k_thread_create(&data->threads[0], data->stacks[0],
+                        CONFIG_KSCAN_MUXES_THREAD_STACK_SIZE,
+                        kscan_muxes_batched_thread, (void *)dev, NULL, NULL,
+                        CONFIG_KSCAN_MUXES_THREAD_PRIORITY, 0, K_NO_WAIT);
+        k_thread_name_set(&data->threads[0], "kscan_mux_batch");
+        return 0;
+    }
+
+    data->threads_count = cfg->muxes_count;
     for (uint16_t i = 0; i < cfg->muxes_count; ++i) {
         k_thread_create(&data->threads[i], data->stacks[i],
                         CONFIG_KSCAN_MUXES_THREAD_STACK_SIZE,
@@ -271,6 +588,9 @@ static int kscan_muxes_init(const struct device *dev) {
 #define KSCAN_MUXES_CHANNELS_SUM(inst)                                         \
     DT_INST_FOREACH_PROP_ELEM_SEP(inst, muxes, MUX_CHANNELS_ELEM, (+))
 
+#define MUX_CHANNELS_ELEM_AND_COMMA(node_id, prop, idx)                        \
+    MUX_CHANNELS_ELEM(node_id, prop, idx),
+
 #define ADC_SPEC_AND_COMMA(node_id, prop, idx)                                 \
     ADC_DT_SPEC_GET_BY_IDX(node_id, idx),
 
@@ -299,6 +619,13 @@ static int kscan_muxes_init(const struct device *dev) {
     BUILD_ASSERT(DT_INST_PROP_LEN(inst, io_channels) ==                        \
                      DT_INST_PROP_LEN(inst, muxes),                            \
                  "io-channels and muxes must have same length");               \
+    BUILD_ASSERT(DT_INST_PROP_LEN(inst, muxes) < 32,                           \
+                 "KScan MUXes instance supports up to 31 muxes");              \
+    BUILD_ASSERT(IS_ENABLED(CONFIG_KSCAN_MUXES_ADC_ASYNC_SCAN) ||              \
+                     DT_INST_ENUM_IDX(inst, scan_mode) !=                      \
+                         KSCAN_MUXES_SCAN_ADC_ASYNC,                           \
+                 "scan-mode \"adc-async\" requires "                           \
+                 "KSCAN_MUXES_ADC_ASYNC_SCAN");                                \
     static const struct adc_dt_spec __kscan_muxes_adc_channels__##inst[] = {   \
                                                                                \
         DT_INST_FOREACH_PROP_ELEM(inst, io_channels, ADC_SPEC_AND_COMMA)};     \
@@ -306,6 +633,9 @@ static int kscan_muxes_init(const struct device *dev) {
     static const struct device *__kscan_muxes_muxes__##inst[] = {              \
         DT_INST_FOREACH_PROP_ELEM(inst, muxes, MUX_DEV_AND_COMMA)};            \
                                                                                \
+    static const uint16_t __kscan_muxes_mux_channels__##inst[] = {             \
+        DT_INST_FOREACH_PROP_ELEM(inst, muxes, MUX_CHANNELS_ELEM_AND_COMMA)};  \
+                                                                               \
     static uint16_t                                                            \
         __kscan_muxes_data_thresholds__##inst[KSCAN_MUXES_CHANNELS_SUM(inst)] = {0}; \
                                                                                \
@@ -323,18 +653,26 @@ static int kscan_muxes_init(const struct device *dev) {
                                       THREAD_STACK_REFERENCE_IDX_AND_COMMA)};  \
     static uint16_t                                                            \
         __kscan_muxes_values__##inst[KSCAN_MUXES_CHANNELS_SUM(inst)] = {0};    \
+    static uint16_t                                                            \
+        __kscan_muxes_snapshot__##inst[KSCAN_MUXES_CHANNELS_SUM(inst)];        \
+    static uint32_t __kscan_muxes_pressed__##inst[KSCAN_BITMAP_WORDS(         \
+        KSCAN_MUXES_CHANNELS_SUM(inst))];                                      \
+    KSCAN_FILTER_DEFINE(__kscan_muxes, inst, KSCAN_MUXES_CHANNELS_SUM(inst));  \
                                                                                \
     static const struct kscan_muxes_config __kscan_muxes_config__##inst = {    \
         .channels = __kscan_muxes_adc_channels__##inst,                        \
         .channels_count = DT_INST_PROP_LEN(inst, io_channels),                 \
                                                                                \
         .muxes = (const struct device **)__kscan_muxes_muxes__##inst,          \
+        .mux_channels = __kscan_muxes_mux_channels__##inst,                    \
         .muxes_count = DT_INST_PROP_LEN(inst, muxes),                          \
                                                                                \
         .idx_offset = DT_INST_PROP(inst, idx_offset),                          \
         .key_amount = (uint16_t)(KSCAN_MUXES_CHANNELS_SUM(inst)),              \
                                                                                \
         .settle_us = DT_INST_PROP(inst, settle_us),                            \
+                                                                               \
+        .scan_mode = DT_INST_ENUM_IDX(inst, scan_mode),                        \
     };                                                                         \
     static struct kscan_muxes_data __kscan_muxes_data__##inst = {              \
         .thresholds = __kscan_muxes_data_thresholds__##inst,                   \
@@ -343,6 +681,17 @@ static int kscan_muxes_init(const struct device *dev) {
         .threads = __kscan_muxes_threads__##inst,                              \
         .stacks = __kscan_muxes_stacks__##inst,                                \
         .chan_idxs = __kscan_muxes_chan_idxs__##inst,                          \
+                                                                               \
+        .frame =                                                               \
+            {                                                                  \
+                .values = __kscan_muxes_values__##inst,                        \
+                .snapshot = __kscan_muxes_snapshot__##inst,                    \
+                .thresholds = __kscan_muxes_data_thresholds__##inst,           \
+                .pressed = __kscan_muxes_pressed__##inst,                      \
+                .filter = KSCAN_FILTER_INIT(__kscan_muxes, inst),              \
+                .idx_offset = DT_INST_PROP(inst, idx_offset),                  \
+                .count = KSCAN_MUXES_CHANNELS_SUM(inst),                       \
+            },                                                                 \
     };                                                                         \
                                                                                \
     DEVICE_DT_INST_DEFINE(                                                     \
@@ -44,8 +44,10 @@ static int drive_bits(const struct mux_gpio_config *cfg, uint32_t pattern) {
     return 0;
 }
 
+// Never in interrupt context, a caller switching from there paces the use of
+// the mux itself, e.g. kscan-muxes "adc-async" with its sampling interval
 static inline void settle_delay(uint32_t settle_us) {
-    if (settle_us) {
+    if (settle_us && !k_is_in_isr()) {
         k_busy_wait(settle_us);
     }
 }
@@ -4,9 +4,27 @@
 
 LOG_MODULE_REGISTER(splitlink_esb_ptx, CONFIG_SPLITLINK_LOG_LEVEL);
 
-#define SPLITLINK_ESB_INIT_DELAY_MS 5000
 #define SPLITLINK_ESB_RETRY_DELAY_MS 2000
 
+NET_BUF_POOL_DEFINE(splitlink_esb_rx_pool, CONFIG_SPLITLINK_YKB_ESB_RX_BUFFERS,
+                    CONFIG_ESB_MAX_PAYLOAD_LENGTH, 0, NULL);
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+// Messages reassembled on the net core, with their transfer id as user data
+NET_BUF_POOL_DEFINE(splitlink_esb_msg_pool,
+                    CONFIG_SPLITLINK_YKB_ESB_MSG_BUFFERS,
+                    CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE, sizeof(uint8_t), NULL);
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+
+// Data just went out, so the next alive packet is not needed as soon
+static void alive_postpone(struct splitlink_data *dev_data) {
+    // If alive work is pending then we cancel it and reschedule
+    if (k_work_delayable_is_pending(&dev_data->alive_work.d_work)) {
+        k_work_cancel_delayable(&dev_data->alive_work.d_work);
+        k_work_schedule(&dev_data->alive_work.d_work,
+                        K_MSEC(CONFIG_SPLITLINK_YKB_ESB_PTX_ALIVE_DELAY));
+    }
+}
+
 static int splitlink_ykb_esb_send(const struct device *dev, uint8_t *data,
                                   size_t data_len) {
     if (data_len == 0 || data == NULL) {
@@ -37,18 +55,48 @@ static int splitlink_ykb_esb_send(const struct device *dev, uint8_t *data,
 
     int err = ykb_esb_send(&packet);
     if (!err) {
-        // Hopefully the packet got sent, we need to delay alive packets.
-        // If alive work is pending then we cancel it and reschedule
-        if (k_work_delayable_is_pending(&dev_data->alive_work.d_work)) {
-            k_work_cancel_delayable(&dev_data->alive_work.d_work);
-            k_work_schedule(&dev_data->alive_work.d_work,
-                            K_MSEC(CONFIG_SPLITLINK_YKB_ESB_PTX_ALIVE_DELAY));
-        }
+        alive_postpone(dev_data);
     }
 
     return err;
 }
 
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+static int splitlink_ykb_esb_send_msg(const struct device *dev, uint8_t id,
+                                      uint8_t flags, const uint8_t *data,
+                                      size_t data_len) {
+    if (data_len > CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE) {
+        LOG_ERR("Message length is too high (%u > %u)", data_len,
+                CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE);
+        return -EINVAL;
+    }
+
+    struct splitlink_data *dev_data = dev->data;
+    if (!dev_data->ready) {
+        LOG_DBG("Not ready");
+        return -EBUSY;
+    }
+    if (!dev_data->connected) {
+        LOG_ERR("Not connected");
+        return -EBUSY;
+    }
+
+    ykb_esb_msg_t msg = {
+        .id = id,
+        .flags = flags,
+        .len = data_len,
+        .data = data,
+    };
+
+    int err = ykb_esb_send_msg(&msg);
+    if (!err) {
+        alive_postpone(dev_data);
+    }
+
+    return err;
+}
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+
 static void alive_work_handler(struct k_work *work) {
     struct delayable_device_work *alive_work =
         CONTAINER_OF(work, struct delayable_device_work, d_work.work);
@@ -69,6 +117,7 @@ static void connect_work_handler(struct k_work *work) {
     struct device_work *dev_work = CONTAINER_OF(work, struct device_work, work);
 
     // We set the 'connected' before calling this work
+    LOG_INF("Connected, uptime %u ms", k_uptime_get_32());
 
     STRUCT_SECTION_FOREACH(splitlink_cb, callback) {
         if (callback->connect_cb) {
@@ -95,24 +144,81 @@ static void disconnect_work_handler(struct k_work *work) {
 static void receiving_work_handler(struct k_work *work) {
     struct receiving_device_work *dev_work =
         CONTAINER_OF(work, struct receiving_device_work, work);
+    struct net_buf *buf;
 
-    STRUCT_SECTION_FOREACH(splitlink_cb, callback) {
-        if (callback->on_receive_cb) {
-            callback->on_receive_cb(dev_work->dev, dev_work->data,
-                                    dev_work->data_len);
+    while ((buf = k_fifo_get(&dev_work->fifo, K_NO_WAIT)) != NULL) {
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+        if (net_buf_pool_get(buf->pool_id) == &splitlink_esb_msg_pool) {
+            uint8_t id = *(uint8_t *)net_buf_user_data(buf);
+
+            STRUCT_SECTION_FOREACH(splitlink_cb, callback) {
+                if (callback->on_msg_cb && (callback->msg_ids & BIT(id))) {
+                    callback->on_msg_cb(dev_work->dev, id, buf);
+                }
+            }
+            net_buf_unref(buf);
+            continue;
         }
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+        STRUCT_SECTION_FOREACH(splitlink_cb, callback) {
+            if (callback->on_receive_cb) {
+                callback->on_receive_cb(dev_work->dev, buf->data, buf->len);
+            }
+        }
+        net_buf_unref(buf);
+    }
+}
+
+// Called from the ESB event, every packet gets its own buffer so none is
+// overwritten before the work item got to it
+static void receiving_work_queue(struct receiving_device_work *dev_work,
+                                 const uint8_t *data, size_t data_len) {
+    struct net_buf *buf = net_buf_alloc(&splitlink_esb_rx_pool, K_NO_WAIT);
+    if (!buf) {
+        LOG_WRN("No RX buffer, dropping packet");
+        return;
+    }
+
+    net_buf_add_mem(buf, data, data_len);
+    k_fifo_put(&dev_work->fifo, buf);
+    k_work_submit(&dev_work->work);
+}
+
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+// Queued behind the packets received before it, in the same fifo
+static void receiving_work_queue_msg(struct receiving_device_work *dev_work,
+                                     const ykb_esb_event_t *event) {
+    if (event->data_length > CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE ||
+        event->msg_id >= 32) {
+        LOG_WRN("Invalid message %u, len %u", event->msg_id,
+                event->data_length);
+        return;
+    }
+
+    struct net_buf *buf = net_buf_alloc(&splitlink_esb_msg_pool, K_NO_WAIT);
+    if (!buf) {
+        LOG_WRN("No message buffer, dropping message %u", event->msg_id);
+        return;
     }
+
+    *(uint8_t *)net_buf_user_data(buf) = event->msg_id;
+    net_buf_add_mem(buf, event->buf, event->data_length);
+    k_fifo_put(&dev_work->fifo, buf);
+    k_work_submit(&dev_work->work);
 }
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
 
 static void on_esb_callback(ykb_esb_event_t *event, void *user_ptr) {
     const struct device *dev = user_ptr;
     struct splitlink_data *dev_data = dev->data;
     if (event->evt_type == YKB_ESB_EVT_RX && event->data_length > 2 &&
         event->buf[0] == FLAG_DATA) {
-        dev_data->receiving_work.data_len = event->data_length - 1;
-        memcpy(dev_data->receiving_work.data, &event->buf[1],
-               event->data_length - 1);
-        k_work_submit(&dev_data->receiving_work.work);
+        receiving_work_queue(&dev_data->receiving_work, &event->buf[1],
+                             event->data_length - 1);
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+    } else if (event->evt_type == YKB_ESB_EVT_RX_MSG) {
+        receiving_work_queue_msg(&dev_data->receiving_work, event);
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
     } else if (event->evt_type == YKB_ESB_EVT_TX_SUCCESS) {
         // If not connected, we got a connection now
         if (!dev_data->connected) {
@@ -147,18 +253,35 @@ static void init_work_handler(struct k_work *work) {
            sizeof(esb_cfg.base_addr_0));
     memcpy(esb_cfg.base_addr_1, &cfg->esb_default_address[4],
            sizeof(esb_cfg.base_addr_1));
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+    esb_cfg.msg_prefix = FLAG_DATA;
+    STRUCT_SECTION_FOREACH(splitlink_cb, callback) {
+        if (callback->on_msg_cb) {
+            esb_cfg.msg_ids |= callback->msg_ids;
+        }
+    }
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
 
     int err = ykb_esb_init(&esb_cfg, on_esb_callback);
     if (err) {
-        LOG_WRN("YKB ESB init deferred (%d), retrying", err);
+        LOG_WRN("YKB ESB init failed (%d), retrying", err);
         k_work_schedule(&data->init_work.d_work,
                         K_MSEC(SPLITLINK_ESB_RETRY_DELAY_MS));
     } else {
         data->ready = true;
-        LOG_INF("Init work handler OK");
+        LOG_INF("ESB ready, uptime %u ms", k_uptime_get_32());
+        // First alive packet right away, it is what connects the link
+        k_work_reschedule(&data->alive_work.d_work, K_NO_WAIT);
     }
 }
 
+static void on_esb_ready(void *user_ptr) {
+    const struct device *dev = user_ptr;
+    struct splitlink_data *data = dev->data;
+
+    k_work_reschedule(&data->init_work.d_work, K_NO_WAIT);
+}
+
 static int splitlink_esb_init(const struct device *dev) {
     struct splitlink_data *data = dev->data;
 
@@ -168,26 +291,28 @@ static int splitlink_esb_init(const struct device *dev) {
     data->disconnect_work.dev = dev;
     data->receiving_work.dev = dev;
 
-    // Don't know how to fix that yet, but for some reason ESB only
-    // initializes after some delay and panics somewhere in rpmsg_virtio
     k_work_init_delayable(&data->init_work.d_work, init_work_handler);
-    k_work_schedule(&data->init_work.d_work,
-                    K_MSEC(SPLITLINK_ESB_INIT_DELAY_MS));
 
     k_work_init_delayable(&data->disconnect_work.d_work,
                           disconnect_work_handler);
     k_work_init(&data->connect_work.work, connect_work_handler);
     k_work_init(&data->receiving_work.work, receiving_work_handler);
+    k_fifo_init(&data->receiving_work.fifo);
 
+    // Alive packets start once ESB is initialized
     k_work_init_delayable(&data->alive_work.d_work, alive_work_handler);
-    k_work_schedule(&data->alive_work.d_work,
-                    K_MSEC(CONFIG_SPLITLINK_YKB_ESB_PTX_ALIVE_DELAY));
+
+    // ESB is brought up as soon as its backend can take it
+    ykb_esb_set_ready_callback(on_esb_ready, (void *)dev);
 
     return 0;
 }
 
 DEVICE_API(splitlink, splitlink_esb_api) = {
     .send = splitlink_ykb_esb_send,
+#if CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
+    .send_msg = splitlink_ykb_esb_send_msg,
+#endif // CONFIG_SPLITLINK_YKB_ESB_NET_FRAMING
 };
 
 #define SPLITLINK_YKB_ESB_PTX_DEFINE(inst)                                     \
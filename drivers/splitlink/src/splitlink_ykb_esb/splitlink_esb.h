@@ -5,6 +5,7 @@
 #include <zephyr/devicetree.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/net_buf.h>
 
 #include <drivers/splitlink.h>
 
@@ -26,11 +27,14 @@ struct device_work {
     const struct device *dev;
 };
 
+// Received packets and messages wait in fifo as net_bufs, the payload is
+// copied once out of the ESB event. Packets are handed to the callbacks in
+// place, messages as the net_buf itself, which a callback may keep
+// referenced.
 struct receiving_device_work {
     struct k_work work;
     const struct device *dev;
-    uint8_t data[CONFIG_ESB_MAX_PAYLOAD_LENGTH];
-    uint16_t data_len;
+    struct k_fifo fifo;
 };
 
 struct splitlink_data {
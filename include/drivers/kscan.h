@@ -4,11 +4,40 @@
 #include <stdbool.h>
 
 #include <zephyr/device.h>
+#include <zephyr/sys/util.h>
 #include <zephyr/toolchain.h>
 
+// Amount of uint32_t words needed for a pressed bitmap of count keys
+#define KSCAN_BITMAP_WORDS(count) DIV_ROUND_UP(count, 32)
+
+// Snapshot of every key managed by a KScan instance, delivered once per
+// completed sweep. Pointers are only valid during the callback.
+struct kscan_frame {
+    // Latest ADC value of each key after the filter stage, count elements
+    const uint16_t *values;
+    // Bit i is set if key idx_offset + i is pressed,
+    // KSCAN_BITMAP_WORDS(count) elements
+    const uint32_t *pressed_bitmap;
+    // Index offset of the first key of the frame
+    uint16_t idx_offset;
+    uint16_t count;
+    // Incremented by the KScan instance on every frame
+    uint32_t seq;
+    // k_uptime_ticks() at the moment the sweep was completed
+    int64_t timestamp;
+};
+
+static inline bool kscan_frame_key_pressed(const struct kscan_frame *frame,
+                                           uint16_t i) {
+    return (frame->pressed_bitmap[i / 32] & BIT(i % 32)) != 0;
+}
+
 struct kscan_cb {
+    void (*on_frame)(const struct kscan_frame *frame);
+#if CONFIG_KSCAN_PER_KEY_CALLBACKS
     void (*on_event)(uint16_t index, bool pressed);
     void (*on_new_value)(uint16_t index, uint16_t value);
+#endif // CONFIG_KSCAN_PER_KEY_CALLBACKS
 };
 
 #define KSCAN_CB_DEFINE(name)                                                  \
@@ -51,7 +80,7 @@ __syscall int kscan_get_key_amount(const struct device *dev);
 // Returns idx_offset on success, negative value otherwise
 __syscall int kscan_get_idx_offset(const struct device *dev);
 
-// Get current ADC values for each managed key.
+// Get current raw ADC values for each managed key, before the filter stage.
 // Caller must allocate values array of size get_key_amount()
 //
 // Returns 0 on success, negative value otherwise
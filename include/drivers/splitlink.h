@@ -1,7 +1,10 @@
 #ifndef __DRIVERS_SPLITLINK_H_
 #define __DRIVERS_SPLITLINK_H_
 
+#include <errno.h>
+
 #include <zephyr/device.h>
+#include <zephyr/net_buf.h>
 #include <zephyr/toolchain.h>
 
 #if CONFIG_SPLITLINK_YKB_ESB
@@ -15,6 +18,13 @@
 struct splitlink_cb {
     void (*on_receive_cb)(const struct device *dev, uint8_t *data,
                           size_t data_len);
+    // Whole messages of the transfer ids set in msg_ids, with
+    // CONFIG_SPLITLINK_MSG. Their packets never reach on_receive_cb. msg is
+    // the driver buffer the message was reassembled in, a callback keeps it
+    // past its return with net_buf_ref() and drops it with net_buf_unref().
+    void (*on_msg_cb)(const struct device *dev, uint8_t id,
+                      struct net_buf *msg);
+    uint32_t msg_ids;
     void (*connect_cb)(const struct device *dev);
     void (*disconnect_cb)(const struct device *dev);
 };
@@ -24,6 +34,9 @@ struct splitlink_cb {
 
 __subsystem struct splitlink_driver_api {
     int (*send)(const struct device *dev, uint8_t *data, size_t data_len);
+    int (*send_rt)(const struct device *dev, uint8_t *data, size_t data_len);
+    int (*send_msg)(const struct device *dev, uint8_t id, uint8_t flags,
+                    const uint8_t *data, size_t data_len);
 };
 
 __syscall int splitlink_send(const struct device *dev, uint8_t *data,
@@ -35,6 +48,44 @@ static inline int z_impl_splitlink_send(const struct device *dev, uint8_t *data,
     return DEVICE_API_GET(splitlink, dev)->send(dev, data, data_len);
 }
 
+// Sends data ahead of the packets queued with splitlink_send(), replacing
+// the previous packet sent this way if it did not go out yet. For packets
+// which only matter until a newer one exists, like ACKs. Same as
+// splitlink_send() where the driver keeps a single queue.
+__syscall int splitlink_send_rt(const struct device *dev, uint8_t *data,
+                                size_t data_len);
+
+static inline int z_impl_splitlink_send_rt(const struct device *dev,
+                                           uint8_t *data, size_t data_len) {
+    __ASSERT_NO_MSG(DEVICE_API_IS(splitlink, dev));
+    const struct splitlink_driver_api *api = DEVICE_API_GET(splitlink, dev);
+
+    if (!api->send_rt) {
+        return api->send(dev, data, data_len);
+    }
+    return api->send_rt(dev, data, data_len);
+}
+
+// Sends data as one ykb_protocol transfer with the given id and type_flags,
+// split into packets by the driver. Same on the air as sending the packets
+// one by one with splitlink_send(). -ENOSYS without CONFIG_SPLITLINK_MSG.
+__syscall int splitlink_send_msg(const struct device *dev, uint8_t id,
+                                 uint8_t flags, const uint8_t *data,
+                                 size_t data_len);
+
+static inline int z_impl_splitlink_send_msg(const struct device *dev,
+                                            uint8_t id, uint8_t flags,
+                                            const uint8_t *data,
+                                            size_t data_len) {
+    __ASSERT_NO_MSG(DEVICE_API_IS(splitlink, dev));
+    const struct splitlink_driver_api *api = DEVICE_API_GET(splitlink, dev);
+
+    if (!api->send_msg) {
+        return -ENOSYS;
+    }
+    return api->send_msg(dev, id, flags, data, data_len);
+}
+
 #include <syscalls/splitlink.h>
 
 #endif // __DRIVERS_SPLITLINK_H_
@@ -46,6 +46,8 @@ typedef struct __packed {
     const bool usb_connect_kbd : 1;
     const bool usb_connect_mouse : 1;
     const bool usb_connect_vendor : 1;
+    // Compact framing, selected through the vendor feature report
+    const bool usb_connect_vendor_compact : 1;
 
 } device_features;
 
@@ -92,6 +94,7 @@ typedef struct __packed {
         FEATURE(usb_connect_kbd, CONFIG_USB_CONNECT_KBD),                      \
         FEATURE(usb_connect_mouse, CONFIG_USB_CONNECT_MOUSE),                  \
         FEATURE(usb_connect_vendor, CONFIG_USB_CONNECT_VENDOR),                \
+        FEATURE(usb_connect_vendor_compact, CONFIG_USB_CONNECT_VENDOR),        \
     }
 
 #endif // YKB_FEATURES_H
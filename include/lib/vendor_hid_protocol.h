@@ -27,6 +27,12 @@ enum response_type {
     RESPONSE_ERROR = 255U,
 };
 
+// Byte 0 of the feature report which selects the framing
+enum vendor_hid_framing {
+    VENDOR_HID_FRAMING_REGULAR = 0U,
+    VENDOR_HID_FRAMING_COMPACT = 1U,
+};
+
 #define MAX_PACKET_LEN (sizeof(kb_settings_t))
 
 typedef struct __packed {
@@ -49,11 +55,29 @@ typedef struct {
     vendor_hid_send_packet_cb_t send_packet;
     void *user_data;
     bool busy;
+    // Transport guarantees integrity and ordering, compact framing allowed
+    bool reliable;
+    // Framing selected by the host, for requests and responses
+    bool compact;
 } vendor_hid_protocol_ctx_t;
 
+// Requests and responses use the regular ykb_protocol framing until the host
+// selects another one with vendor_hid_protocol_set_framing()
 int vendor_hid_protocol_init(vendor_hid_protocol_ctx_t *ctx,
                              vendor_hid_send_packet_cb_t send_packet,
-                             void *user_data);
+                             void *user_data, bool reliable);
+
+// Compact framing is only allowed on a reliable transport. Drops a partially
+// received request, -EBUSY while a response is being sent.
+int vendor_hid_protocol_set_framing(vendor_hid_protocol_ctx_t *ctx,
+                                    enum vendor_hid_framing framing);
+
+enum vendor_hid_framing
+vendor_hid_protocol_get_framing(const vendor_hid_protocol_ctx_t *ctx);
+
+// Drops a partially received request and goes back to the regular framing,
+// e.g. when the transport went away
+void vendor_hid_protocol_reset(vendor_hid_protocol_ctx_t *ctx);
 
 int vendor_hid_protocol_parse(vendor_hid_protocol_ctx_t *ctx,
                               const uint8_t *data, size_t len);
@@ -0,0 +1,299 @@
+#ifndef YKB_CHUNK_SYNC_H
+#define YKB_CHUNK_SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Synchronization of a fixed size binary image, e.g. a settings struct,
+// between two peers.
+//
+// The image is cut into equally sized chunks, the last one may be shorter.
+// The receiving peer describes what it has with a manifest: the image size,
+// the hash of the whole image and the hash of every chunk. The sending peer
+// compares that against its own image and answers with a patch carrying only
+// the chunks whose hash differs, plus the hash the whole image must have
+// once patched.
+//
+// manifest: [header][chunk_count x uint32_t chunk hash]
+// summary : [header]
+// patch   : [header][chunk_count x (uint16_t index, chunk bytes)]
+//
+// A summary is the manifest header alone. It costs a single hash when both
+// images already match, a mismatch is answered with an empty patch, which
+// fails to apply and so asks the receiving peer for its full manifest.
+//
+// Multi-byte fields are native-endian and unaligned, same as ykb_protocol.h.
+
+#ifdef __GNUC__
+#define YKB_CHUNK_SYNC_PACKED __attribute__((__packed__))
+#elif defined(_MSC_VER)
+#define YKB_CHUNK_SYNC_PACKED
+#pragma pack(push, 1)
+#else
+#define YKB_CHUNK_SYNC_PACKED
+#endif
+
+#ifndef YKB_CHUNK_SYNC_STATIC
+#define YKB_CHUNK_SYNC_STATIC static inline
+#endif
+
+typedef struct YKB_CHUNK_SYNC_PACKED {
+    uint32_t size;
+    uint32_t hash;
+    uint16_t chunk_size;
+    uint16_t chunk_count;
+} ykb_chunk_sync_manifest_header_t;
+
+typedef struct YKB_CHUNK_SYNC_PACKED {
+    uint32_t size;
+    // Hash of the whole image after the patch is applied
+    uint32_t hash;
+    uint16_t chunk_size;
+    // Amount of chunks carried by the patch
+    uint16_t chunk_count;
+} ykb_chunk_sync_patch_header_t;
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
+#define YKB_CHUNK_SYNC_CHUNK_COUNT(size, chunk_size)                           \
+    (((size) + (chunk_size) - 1U) / (chunk_size))
+#define YKB_CHUNK_SYNC_MANIFEST_SIZE(size, chunk_size)                         \
+    (sizeof(ykb_chunk_sync_manifest_header_t) +                                \
+     YKB_CHUNK_SYNC_CHUNK_COUNT(size, chunk_size) * sizeof(uint32_t))
+#define YKB_CHUNK_SYNC_SUMMARY_SIZE sizeof(ykb_chunk_sync_manifest_header_t)
+// Largest patch, every chunk changed
+#define YKB_CHUNK_SYNC_PATCH_MAX_SIZE(size, chunk_size)                        \
+    (sizeof(ykb_chunk_sync_patch_header_t) +                                   \
+     YKB_CHUNK_SYNC_CHUNK_COUNT(size, chunk_size) * sizeof(uint16_t) + (size))
+
+typedef enum {
+    YKB_CHUNK_SYNC_ERROR_NULL = -1,
+    YKB_CHUNK_SYNC_ERROR_BUFFER_TOO_SMALL = -2,
+    YKB_CHUNK_SYNC_ERROR_BAD_LENGTH = -3,
+    YKB_CHUNK_SYNC_ERROR_IMAGE_MISMATCH = -4,
+    YKB_CHUNK_SYNC_ERROR_BAD_INDEX = -5,
+    YKB_CHUNK_SYNC_ERROR_HASH_MISMATCH = -6,
+} ykb_chunk_sync_error_t;
+
+// 32-bit FNV-1a, only meant to spot changed chunks
+YKB_CHUNK_SYNC_STATIC uint32_t ykb_chunk_sync_hash(const uint8_t *data,
+                                                   size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0u; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+YKB_CHUNK_SYNC_STATIC uint32_t ykb_chunk_sync_chunk_len(uint32_t size,
+                                                        uint16_t chunk_size,
+                                                        uint16_t index) {
+    uint32_t offset = (uint32_t)index * chunk_size;
+
+    return size - offset < chunk_size ? size - offset : chunk_size;
+}
+
+// Writes the manifest of image into out. Returns its length or a negative
+// error.
+YKB_CHUNK_SYNC_STATIC int
+ykb_chunk_sync_manifest_build(const uint8_t *image, uint32_t size,
+                              uint16_t chunk_size, uint8_t *out,
+                              uint32_t out_size) {
+    if (image == NULL || out == NULL || chunk_size == 0u) {
+        return YKB_CHUNK_SYNC_ERROR_NULL;
+    }
+
+    uint16_t count = (uint16_t)YKB_CHUNK_SYNC_CHUNK_COUNT(size, chunk_size);
+    uint32_t len = YKB_CHUNK_SYNC_MANIFEST_SIZE(size, chunk_size);
+
+    if (out_size < len) {
+        return YKB_CHUNK_SYNC_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    ykb_chunk_sync_manifest_header_t header = {
+        .size = size,
+        .hash = ykb_chunk_sync_hash(image, size),
+        .chunk_size = chunk_size,
+        .chunk_count = count,
+    };
+    memcpy(out, &header, sizeof(header));
+
+    uint8_t *hashes = &out[sizeof(header)];
+    for (uint16_t i = 0u; i < count; i++) {
+        uint32_t hash = ykb_chunk_sync_hash(
+            &image[(uint32_t)i * chunk_size],
+            ykb_chunk_sync_chunk_len(size, chunk_size, i));
+
+        memcpy(&hashes[i * sizeof(hash)], &hash, sizeof(hash));
+    }
+
+    return (int)len;
+}
+
+// Writes the summary of image into out. Returns its length or a negative
+// error.
+YKB_CHUNK_SYNC_STATIC int ykb_chunk_sync_summary_build(const uint8_t *image,
+                                                       uint32_t size,
+                                                       uint16_t chunk_size,
+                                                       uint8_t *out,
+                                                       uint32_t out_size) {
+    if (image == NULL || out == NULL || chunk_size == 0u) {
+        return YKB_CHUNK_SYNC_ERROR_NULL;
+    }
+
+    if (out_size < YKB_CHUNK_SYNC_SUMMARY_SIZE) {
+        return YKB_CHUNK_SYNC_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    ykb_chunk_sync_manifest_header_t header = {
+        .size = size,
+        .hash = ykb_chunk_sync_hash(image, size),
+        .chunk_size = chunk_size,
+        .chunk_count =
+            (uint16_t)YKB_CHUNK_SYNC_CHUNK_COUNT(size, chunk_size),
+    };
+    memcpy(out, &header, sizeof(header));
+
+    return (int)sizeof(header);
+}
+
+// Writes a patch which turns the image described by manifest into image.
+// Every chunk is sent if manifest is NULL or describes a different layout,
+// none if it is a summary which does not match. Returns the patch length, 0
+// if the images already match, or a negative error.
+YKB_CHUNK_SYNC_STATIC int
+ykb_chunk_sync_patch_build(const uint8_t *image, uint32_t size,
+                           uint16_t chunk_size, const uint8_t *manifest,
+                           uint32_t manifest_len, uint8_t *out,
+                           uint32_t out_size) {
+    if (image == NULL || out == NULL || chunk_size == 0u) {
+        return YKB_CHUNK_SYNC_ERROR_NULL;
+    }
+
+    if (out_size < YKB_CHUNK_SYNC_PATCH_MAX_SIZE(size, chunk_size)) {
+        return YKB_CHUNK_SYNC_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    uint16_t count = (uint16_t)YKB_CHUNK_SYNC_CHUNK_COUNT(size, chunk_size);
+    uint32_t image_hash = ykb_chunk_sync_hash(image, size);
+    const uint8_t *peer_hashes = NULL;
+    bool summary = false;
+
+    if (manifest != NULL &&
+        (manifest_len == YKB_CHUNK_SYNC_MANIFEST_SIZE(size, chunk_size) ||
+         manifest_len == YKB_CHUNK_SYNC_SUMMARY_SIZE)) {
+        ykb_chunk_sync_manifest_header_t peer;
+
+        memcpy(&peer, manifest, sizeof(peer));
+        if (peer.size == size && peer.chunk_size == chunk_size &&
+            peer.chunk_count == count) {
+            if (peer.hash == image_hash) {
+                return 0;
+            }
+            summary = manifest_len == YKB_CHUNK_SYNC_SUMMARY_SIZE;
+            peer_hashes = &manifest[sizeof(peer)];
+        }
+    }
+
+    ykb_chunk_sync_patch_header_t header = {
+        .size = size,
+        .hash = image_hash,
+        .chunk_size = chunk_size,
+        .chunk_count = 0u,
+    };
+    uint32_t pos = sizeof(header);
+
+    for (uint16_t i = 0u; i < count && !summary; i++) {
+        const uint8_t *chunk = &image[(uint32_t)i * chunk_size];
+        uint32_t chunk_len = ykb_chunk_sync_chunk_len(size, chunk_size, i);
+
+        if (peer_hashes != NULL) {
+            uint32_t peer_hash;
+
+            memcpy(&peer_hash, &peer_hashes[i * sizeof(peer_hash)],
+                   sizeof(peer_hash));
+            if (peer_hash == ykb_chunk_sync_hash(chunk, chunk_len)) {
+                continue;
+            }
+        }
+
+        memcpy(&out[pos], &i, sizeof(i));
+        pos += sizeof(i);
+        memcpy(&out[pos], chunk, chunk_len);
+        pos += chunk_len;
+        header.chunk_count++;
+    }
+
+    memcpy(out, &header, sizeof(header));
+
+    return (int)pos;
+}
+
+// Applies a patch onto image in place. The image is left patched even when
+// the resulting hash does not match, its manifest then tells the peer what
+// is still missing.
+YKB_CHUNK_SYNC_STATIC int ykb_chunk_sync_patch_apply(uint8_t *image,
+                                                     uint32_t size,
+                                                     const uint8_t *patch,
+                                                     uint32_t len) {
+    if (image == NULL || patch == NULL) {
+        return YKB_CHUNK_SYNC_ERROR_NULL;
+    }
+
+    ykb_chunk_sync_patch_header_t header;
+
+    if (len < sizeof(header)) {
+        return YKB_CHUNK_SYNC_ERROR_BAD_LENGTH;
+    }
+    memcpy(&header, patch, sizeof(header));
+
+    if (header.size != size || header.chunk_size == 0u) {
+        return YKB_CHUNK_SYNC_ERROR_IMAGE_MISMATCH;
+    }
+
+    uint16_t count =
+        (uint16_t)YKB_CHUNK_SYNC_CHUNK_COUNT(size, header.chunk_size);
+    uint32_t pos = sizeof(header);
+
+    for (uint16_t n = 0u; n < header.chunk_count; n++) {
+        uint16_t index;
+
+        if (len - pos < sizeof(index)) {
+            return YKB_CHUNK_SYNC_ERROR_BAD_LENGTH;
+        }
+        memcpy(&index, &patch[pos], sizeof(index));
+        pos += sizeof(index);
+
+        if (index >= count) {
+            return YKB_CHUNK_SYNC_ERROR_BAD_INDEX;
+        }
+
+        uint32_t chunk_len =
+            ykb_chunk_sync_chunk_len(size, header.chunk_size, index);
+        if (len - pos < chunk_len) {
+            return YKB_CHUNK_SYNC_ERROR_BAD_LENGTH;
+        }
+        memcpy(&image[(uint32_t)index * header.chunk_size], &patch[pos],
+               chunk_len);
+        pos += chunk_len;
+    }
+
+    if (pos != len) {
+        return YKB_CHUNK_SYNC_ERROR_BAD_LENGTH;
+    }
+
+    if (ykb_chunk_sync_hash(image, size) != header.hash) {
+        return YKB_CHUNK_SYNC_ERROR_HASH_MISMATCH;
+    }
+
+    return 0;
+}
+
+#endif // YKB_CHUNK_SYNC_H
@@ -7,19 +7,36 @@
 typedef enum {
     YKB_ESB_EVT_TX_SUCCESS,
     YKB_ESB_EVT_TX_FAIL,
-    YKB_ESB_EVT_RX
+    YKB_ESB_EVT_RX,
+    // Whole message reassembled on the net core, see ykb_esb_send_msg()
+    YKB_ESB_EVT_RX_MSG,
+    // The net core could not queue a payload or message, buf holds the
+    // int32_t error and msg_id the id of the message. Only on the nRF5340
+    // app core, where sending does not wait for the net core.
+    YKB_ESB_EVT_TX_ERROR
 } ykb_esb_event_type_t;
 typedef enum { YKB_ESB_MODE_PTX, YKB_ESB_MODE_PRX } ykb_esb_mode_t;
+// How the PRX hands out ACK payloads, the PTX sends everything in order
+typedef enum {
+    // In order and without loss, queued behind each other
+    YKB_ESB_CLASS_BULK,
+    // PRX ACK payloads ahead of bulk ones, only the latest one not sent yet
+    // goes out. Same as bulk on the PTX.
+    YKB_ESB_CLASS_RT
+} ykb_esb_class_t;
 
 typedef struct {
     ykb_esb_event_type_t evt_type;
     uint8_t *buf;
     uint32_t data_length;
+    // Transfer id of a YKB_ESB_EVT_RX_MSG
+    uint8_t msg_id;
 } ykb_esb_event_t;
 
 typedef struct {
     uint8_t data[CONFIG_ESB_MAX_PAYLOAD_LENGTH];
     uint32_t len;
+    ykb_esb_class_t cls;
 } ykb_esb_data_t;
 
 typedef struct {
@@ -27,14 +44,41 @@ typedef struct {
     void *user_ptr;
     uint8_t base_addr_0[4];
     uint8_t base_addr_1[4];
+    // Payloads starting with msg_prefix carry ykb_protocol packets. Those of
+    // transfers with their id bit set in msg_ids are reassembled on the net
+    // core and arrive as a single YKB_ESB_EVT_RX_MSG, 0 passes everything
+    // on as is.
+    uint8_t msg_prefix;
+    uint32_t msg_ids;
 } ykb_esb_config_t;
 
+// Whole ykb_protocol transfer, split into payloads by the net core
+typedef struct {
+    uint8_t id;
+    // ykb_protocol type_flags of the transfer, without the per packet flags
+    uint8_t flags;
+    uint16_t len;
+    const uint8_t *data;
+} ykb_esb_msg_t;
+
 typedef void (*ykb_esb_callback_t)(ykb_esb_event_t *event, void *user_ptr);
+typedef void (*ykb_esb_ready_callback_t)(void *user_ptr);
+
+// Calls callback once ykb_esb_init() can be called, right away if it already
+// can. On the nRF5340 app core that is when nRF RPC to the net core is bound.
+void ykb_esb_set_ready_callback(ykb_esb_ready_callback_t callback,
+                                void *user_ptr);
 
 int ykb_esb_init(ykb_esb_config_t *config, ykb_esb_callback_t callback);
 
+// On the nRF5340 app core this returns once tx_packet is on its way to the
+// net core, see YKB_ESB_EVT_TX_ERROR
 int ykb_esb_send(ykb_esb_data_t *tx_packet);
 
+// Sends msg as one transfer, each payload starting with msg_prefix. Only
+// on the nRF5340 app core, where it saves an IPC message per fragment.
+int ykb_esb_send_msg(const ykb_esb_msg_t *msg);
+
 int ykb_esb_rpc_start(void);
 
 #endif // __LIB_YKB_ESB_H_
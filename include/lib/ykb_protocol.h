@@ -33,13 +33,20 @@
 // bit  2    : START
 // bit  3    : END
 // bit  4    : ACK_REQ
-// bit  5    : RESERVED
-// bit  6    : RESERVED
-// bit  7    : RESERVED
+// bit  5..7 : SEQ, counts transfers so a retransmission is never mistaken
+//              for the next transfer on the same id
 #define YKB_PROTOCOL_TYPE_MASK 0x03u
 #define YKB_PROTOCOL_FLAG_START 0x04u
 #define YKB_PROTOCOL_FLAG_END 0x08u
 #define YKB_PROTOCOL_FLAG_ACK_REQ 0x10u
+// Flags which differ between the packets of one transfer
+#define YKB_PROTOCOL_PACKET_FLAGS                                              \
+    (YKB_PROTOCOL_FLAG_START | YKB_PROTOCOL_FLAG_END |                         \
+     YKB_PROTOCOL_FLAG_ACK_REQ)
+#define YKB_PROTOCOL_SEQ_MASK 0xE0u
+#define YKB_PROTOCOL_SEQ_SHIFT 5u
+#define YKB_PROTOCOL_SEQ(seq)                                                  \
+    ((uint8_t)(((seq) << YKB_PROTOCOL_SEQ_SHIFT) & YKB_PROTOCOL_SEQ_MASK))
 
 typedef enum {
     YKB_PROTOCOL_TYPE_DATA = 0u,
@@ -92,6 +99,54 @@ typedef struct YKB_PACKED {
     uint8_t payload[YKB_PROTOCOL_MAX_PAYLOAD_SIZE];
 } ykb_protocol_packet_t;
 
+// Payload of a YKB_PROTOCOL_TYPE_ACK packet, followed by a bitmap where bit n
+// tells packet base + n was received. The ACK packet itself is a single
+// packet transfer on the id of the transfer it acknowledges, with the SEQ of
+// that transfer.
+typedef struct YKB_PACKED {
+    uint16_t total_len;
+    uint16_t packet_count;
+    // Every packet below base was received
+    uint16_t base;
+} ykb_protocol_ack_header_t;
+
+#define YKB_PROTOCOL_PACKET_COUNT(total_len)                                   \
+    ((total_len) == 0u ? 1u                                                    \
+                       : ((total_len) + YKB_PROTOCOL_MAX_PAYLOAD_SIZE - 1u) /  \
+                             YKB_PROTOCOL_MAX_PAYLOAD_SIZE)
+// Size of a received_bitmap covering any transfer of up to total_len bytes
+#define YKB_PROTOCOL_BITMAP_SIZE(total_len)                                    \
+    ((YKB_PROTOCOL_PACKET_COUNT(total_len) + 7u) / 8u)
+
+#define YKB_PROTOCOL_ACK_BITMAP_MAX_SIZE                                       \
+    (YKB_PROTOCOL_MAX_PAYLOAD_SIZE - sizeof(ykb_protocol_ack_header_t))
+// Largest selective repeat window an ACK can describe
+#define YKB_PROTOCOL_ACK_WINDOW_MAX (8u * YKB_PROTOCOL_ACK_BITMAP_MAX_SIZE)
+
+BUILD_ASSERT(YKB_PROTOCOL_MAX_PAYLOAD_SIZE > sizeof(ykb_protocol_ack_header_t),
+             "YKB_PROTOCOL_MAX_PACKET_SIZE too small for ACK packets.");
+
+// Compact framing, for transports which already guarantee integrity and
+// ordering, e.g. USB. Packets only carry type_flags and transfer_id and are
+// filled up with payload, the START packet also carries the transfer
+// length and the CRC16 of the whole transfer, checked once it is complete.
+// type_flags has the layout above, ACK_REQ and SEQ are unused.
+typedef struct YKB_PACKED {
+    uint8_t type_flags;
+    uint8_t transfer_id;
+} ykb_protocol_compact_header_t;
+
+typedef struct YKB_PACKED {
+    ykb_protocol_compact_header_t header;
+    uint16_t total_len;
+    uint16_t crc;
+} ykb_protocol_compact_start_header_t;
+
+#define YKB_PROTOCOL_COMPACT_START_PAYLOAD_SIZE                                \
+    (YKB_PROTOCOL_MAX_PACKET_SIZE - sizeof(ykb_protocol_compact_start_header_t))
+#define YKB_PROTOCOL_COMPACT_PAYLOAD_SIZE                                      \
+    (YKB_PROTOCOL_MAX_PACKET_SIZE - sizeof(ykb_protocol_compact_header_t))
+
 typedef struct {
     const uint8_t *data;
     uint16_t total_len;
@@ -122,17 +177,50 @@ typedef struct {
 
     uint8_t *received_bitmap;
     size_t received_bitmap_size;
+
+    // Compact framing: CRC16 the whole transfer must have
+    uint16_t checksum;
 } ykb_protocol_rx_state_t;
 
 #ifdef _MSC_VER
 #pragma pack(pop)
 #endif
 
-YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update(uint16_t crc,
-                                                       const uint8_t *data,
-                                                       size_t length) {
-    const uint16_t polynomial = 0xA001u;
+// CRC-16/MODBUS (reflected 0x8005, i.e. 0xA001), every backend below gives
+// the same result. Pick one by defining YKB_PROTOCOL_CRC16_BACKEND before
+// including this header, Zephyr builds take it from Kconfig.
+//
+// BITWISE   : 8 iterations per byte, no table
+// NIBBLE    : 2 lookups per byte, 32 byte table
+// SLICING_4 : 4 bytes per step, 2 KiB of tables
+// SLICING_8 : 8 bytes per step, 4 KiB of tables
+// EXTERNAL  : ykb_protocol_crc16_external_update() is provided elsewhere,
+//             e.g. by a CRC peripheral driver
+#define YKB_PROTOCOL_CRC16_BITWISE 0
+#define YKB_PROTOCOL_CRC16_NIBBLE 1
+#define YKB_PROTOCOL_CRC16_SLICING_4 2
+#define YKB_PROTOCOL_CRC16_SLICING_8 3
+#define YKB_PROTOCOL_CRC16_EXTERNAL 4
+
+#ifndef YKB_PROTOCOL_CRC16_BACKEND
+#if defined(CONFIG_YKB_PROTOCOL_CRC16_BITWISE)
+#define YKB_PROTOCOL_CRC16_BACKEND YKB_PROTOCOL_CRC16_BITWISE
+#elif defined(CONFIG_YKB_PROTOCOL_CRC16_NIBBLE)
+#define YKB_PROTOCOL_CRC16_BACKEND YKB_PROTOCOL_CRC16_NIBBLE
+#elif defined(CONFIG_YKB_PROTOCOL_CRC16_SLICING_8)
+#define YKB_PROTOCOL_CRC16_BACKEND YKB_PROTOCOL_CRC16_SLICING_8
+#elif defined(CONFIG_YKB_PROTOCOL_CRC16_EXTERNAL)
+#define YKB_PROTOCOL_CRC16_BACKEND YKB_PROTOCOL_CRC16_EXTERNAL
+#else
+#define YKB_PROTOCOL_CRC16_BACKEND YKB_PROTOCOL_CRC16_SLICING_4
+#endif
+#endif // YKB_PROTOCOL_CRC16_BACKEND
+
+#define YKB_PROTOCOL_CRC16_POLYNOMIAL 0xA001u
 
+// Reference implementation, kept for every backend to verify against
+YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update_bitwise(
+    uint16_t crc, const uint8_t *data, size_t length) {
     if (data == NULL || length == 0u) {
         return crc;
     }
@@ -141,7 +229,7 @@ YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update(uint16_t crc,
         crc ^= (uint16_t)data[i];
         for (uint8_t bit = 0; bit < 8u; bit++) {
             if ((crc & 0x0001u) != 0u) {
-                crc = (uint16_t)((crc >> 1u) ^ polynomial);
+                crc = (uint16_t)((crc >> 1u) ^ YKB_PROTOCOL_CRC16_POLYNOMIAL);
             } else {
                 crc = (uint16_t)(crc >> 1u);
             }
@@ -151,6 +239,376 @@ YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update(uint16_t crc,
     return crc;
 }
 
+#if YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_NIBBLE
+static const uint16_t ykb_protocol_crc16_nibble_table[16] = {
+    0x0000u, 0xCC01u, 0xD801u, 0x1400u, 0xF001u, 0x3C00u, 0x2800u, 0xE401u,
+    0xA001u, 0x6C00u, 0x7800u, 0xB401u, 0x5000u, 0x9C01u, 0x8801u, 0x4400u,
+};
+
+YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update_nibble(
+    uint16_t crc, const uint8_t *data, size_t length) {
+    if (data == NULL) {
+        return crc;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i];
+        crc = (uint16_t)((crc >> 4u) ^
+                         ykb_protocol_crc16_nibble_table[crc & 0x0Fu]);
+        crc = (uint16_t)((crc >> 4u) ^
+                         ykb_protocol_crc16_nibble_table[crc & 0x0Fu]);
+    }
+
+    return crc;
+}
+#endif // YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_NIBBLE
+
+#if YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_SLICING_4 ||              \
+    YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_SLICING_8
+#if YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_SLICING_8
+#define YKB_PROTOCOL_CRC16_SLICES 8u
+#else
+#define YKB_PROTOCOL_CRC16_SLICES 4u
+#endif
+
+// table[0] is the plain byte table, table[n][i] is the CRC of byte i
+// followed by n zero bytes
+static const uint16_t ykb_protocol_crc16_slicing_table
+    [YKB_PROTOCOL_CRC16_SLICES][256] = {
+    {
+        0x0000u, 0xC0C1u, 0xC181u, 0x0140u, 0xC301u, 0x03C0u, 0x0280u, 0xC241u,
+        0xC601u, 0x06C0u, 0x0780u, 0xC741u, 0x0500u, 0xC5C1u, 0xC481u, 0x0440u,
+        0xCC01u, 0x0CC0u, 0x0D80u, 0xCD41u, 0x0F00u, 0xCFC1u, 0xCE81u, 0x0E40u,
+        0x0A00u, 0xCAC1u, 0xCB81u, 0x0B40u, 0xC901u, 0x09C0u, 0x0880u, 0xC841u,
+        0xD801u, 0x18C0u, 0x1980u, 0xD941u, 0x1B00u, 0xDBC1u, 0xDA81u, 0x1A40u,
+        0x1E00u, 0xDEC1u, 0xDF81u, 0x1F40u, 0xDD01u, 0x1DC0u, 0x1C80u, 0xDC41u,
+        0x1400u, 0xD4C1u, 0xD581u, 0x1540u, 0xD701u, 0x17C0u, 0x1680u, 0xD641u,
+        0xD201u, 0x12C0u, 0x1380u, 0xD341u, 0x1100u, 0xD1C1u, 0xD081u, 0x1040u,
+        0xF001u, 0x30C0u, 0x3180u, 0xF141u, 0x3300u, 0xF3C1u, 0xF281u, 0x3240u,
+        0x3600u, 0xF6C1u, 0xF781u, 0x3740u, 0xF501u, 0x35C0u, 0x3480u, 0xF441u,
+        0x3C00u, 0xFCC1u, 0xFD81u, 0x3D40u, 0xFF01u, 0x3FC0u, 0x3E80u, 0xFE41u,
+        0xFA01u, 0x3AC0u, 0x3B80u, 0xFB41u, 0x3900u, 0xF9C1u, 0xF881u, 0x3840u,
+        0x2800u, 0xE8C1u, 0xE981u, 0x2940u, 0xEB01u, 0x2BC0u, 0x2A80u, 0xEA41u,
+        0xEE01u, 0x2EC0u, 0x2F80u, 0xEF41u, 0x2D00u, 0xEDC1u, 0xEC81u, 0x2C40u,
+        0xE401u, 0x24C0u, 0x2580u, 0xE541u, 0x2700u, 0xE7C1u, 0xE681u, 0x2640u,
+        0x2200u, 0xE2C1u, 0xE381u, 0x2340u, 0xE101u, 0x21C0u, 0x2080u, 0xE041u,
+        0xA001u, 0x60C0u, 0x6180u, 0xA141u, 0x6300u, 0xA3C1u, 0xA281u, 0x6240u,
+        0x6600u, 0xA6C1u, 0xA781u, 0x6740u, 0xA501u, 0x65C0u, 0x6480u, 0xA441u,
+        0x6C00u, 0xACC1u, 0xAD81u, 0x6D40u, 0xAF01u, 0x6FC0u, 0x6E80u, 0xAE41u,
+        0xAA01u, 0x6AC0u, 0x6B80u, 0xAB41u, 0x6900u, 0xA9C1u, 0xA881u, 0x6840u,
+        0x7800u, 0xB8C1u, 0xB981u, 0x7940u, 0xBB01u, 0x7BC0u, 0x7A80u, 0xBA41u,
+        0xBE01u, 0x7EC0u, 0x7F80u, 0xBF41u, 0x7D00u, 0xBDC1u, 0xBC81u, 0x7C40u,
+        0xB401u, 0x74C0u, 0x7580u, 0xB541u, 0x7700u, 0xB7C1u, 0xB681u, 0x7640u,
+        0x7200u, 0xB2C1u, 0xB381u, 0x7340u, 0xB101u, 0x71C0u, 0x7080u, 0xB041u,
+        0x5000u, 0x90C1u, 0x9181u, 0x5140u, 0x9301u, 0x53C0u, 0x5280u, 0x9241u,
+        0x9601u, 0x56C0u, 0x5780u, 0x9741u, 0x5500u, 0x95C1u, 0x9481u, 0x5440u,
+        0x9C01u, 0x5CC0u, 0x5D80u, 0x9D41u, 0x5F00u, 0x9FC1u, 0x9E81u, 0x5E40u,
+        0x5A00u, 0x9AC1u, 0x9B81u, 0x5B40u, 0x9901u, 0x59C0u, 0x5880u, 0x9841u,
+        0x8801u, 0x48C0u, 0x4980u, 0x8941u, 0x4B00u, 0x8BC1u, 0x8A81u, 0x4A40u,
+        0x4E00u, 0x8EC1u, 0x8F81u, 0x4F40u, 0x8D01u, 0x4DC0u, 0x4C80u, 0x8C41u,
+        0x4400u, 0x84C1u, 0x8581u, 0x4540u, 0x8701u, 0x47C0u, 0x4680u, 0x8641u,
+        0x8201u, 0x42C0u, 0x4380u, 0x8341u, 0x4100u, 0x81C1u, 0x8081u, 0x4040u,
+    },
+    {
+        0x0000u, 0x9001u, 0x6001u, 0xF000u, 0xC002u, 0x5003u, 0xA003u, 0x3002u,
+        0xC007u, 0x5006u, 0xA006u, 0x3007u, 0x0005u, 0x9004u, 0x6004u, 0xF005u,
+        0xC00Du, 0x500Cu, 0xA00Cu, 0x300Du, 0x000Fu, 0x900Eu, 0x600Eu, 0xF00Fu,
+        0x000Au, 0x900Bu, 0x600Bu, 0xF00Au, 0xC008u, 0x5009u, 0xA009u, 0x3008u,
+        0xC019u, 0x5018u, 0xA018u, 0x3019u, 0x001Bu, 0x901Au, 0x601Au, 0xF01Bu,
+        0x001Eu, 0x901Fu, 0x601Fu, 0xF01Eu, 0xC01Cu, 0x501Du, 0xA01Du, 0x301Cu,
+        0x0014u, 0x9015u, 0x6015u, 0xF014u, 0xC016u, 0x5017u, 0xA017u, 0x3016u,
+        0xC013u, 0x5012u, 0xA012u, 0x3013u, 0x0011u, 0x9010u, 0x6010u, 0xF011u,
+        0xC031u, 0x5030u, 0xA030u, 0x3031u, 0x0033u, 0x9032u, 0x6032u, 0xF033u,
+        0x0036u, 0x9037u, 0x6037u, 0xF036u, 0xC034u, 0x5035u, 0xA035u, 0x3034u,
+        0x003Cu, 0x903Du, 0x603Du, 0xF03Cu, 0xC03Eu, 0x503Fu, 0xA03Fu, 0x303Eu,
+        0xC03Bu, 0x503Au, 0xA03Au, 0x303Bu, 0x0039u, 0x9038u, 0x6038u, 0xF039u,
+        0x0028u, 0x9029u, 0x6029u, 0xF028u, 0xC02Au, 0x502Bu, 0xA02Bu, 0x302Au,
+        0xC02Fu, 0x502Eu, 0xA02Eu, 0x302Fu, 0x002Du, 0x902Cu, 0x602Cu, 0xF02Du,
+        0xC025u, 0x5024u, 0xA024u, 0x3025u, 0x0027u, 0x9026u, 0x6026u, 0xF027u,
+        0x0022u, 0x9023u, 0x6023u, 0xF022u, 0xC020u, 0x5021u, 0xA021u, 0x3020u,
+        0xC061u, 0x5060u, 0xA060u, 0x3061u, 0x0063u, 0x9062u, 0x6062u, 0xF063u,
+        0x0066u, 0x9067u, 0x6067u, 0xF066u, 0xC064u, 0x5065u, 0xA065u, 0x3064u,
+        0x006Cu, 0x906Du, 0x606Du, 0xF06Cu, 0xC06Eu, 0x506Fu, 0xA06Fu, 0x306Eu,
+        0xC06Bu, 0x506Au, 0xA06Au, 0x306Bu, 0x0069u, 0x9068u, 0x6068u, 0xF069u,
+        0x0078u, 0x9079u, 0x6079u, 0xF078u, 0xC07Au, 0x507Bu, 0xA07Bu, 0x307Au,
+        0xC07Fu, 0x507Eu, 0xA07Eu, 0x307Fu, 0x007Du, 0x907Cu, 0x607Cu, 0xF07Du,
+        0xC075u, 0x5074u, 0xA074u, 0x3075u, 0x0077u, 0x9076u, 0x6076u, 0xF077u,
+        0x0072u, 0x9073u, 0x6073u, 0xF072u, 0xC070u, 0x5071u, 0xA071u, 0x3070u,
+        0x0050u, 0x9051u, 0x6051u, 0xF050u, 0xC052u, 0x5053u, 0xA053u, 0x3052u,
+        0xC057u, 0x5056u, 0xA056u, 0x3057u, 0x0055u, 0x9054u, 0x6054u, 0xF055u,
+        0xC05Du, 0x505Cu, 0xA05Cu, 0x305Du, 0x005Fu, 0x905Eu, 0x605Eu, 0xF05Fu,
+        0x005Au, 0x905Bu, 0x605Bu, 0xF05Au, 0xC058u, 0x5059u, 0xA059u, 0x3058u,
+        0xC049u, 0x5048u, 0xA048u, 0x3049u, 0x004Bu, 0x904Au, 0x604Au, 0xF04Bu,
+        0x004Eu, 0x904Fu, 0x604Fu, 0xF04Eu, 0xC04Cu, 0x504Du, 0xA04Du, 0x304Cu,
+        0x0044u, 0x9045u, 0x6045u, 0xF044u, 0xC046u, 0x5047u, 0xA047u, 0x3046u,
+        0xC043u, 0x5042u, 0xA042u, 0x3043u, 0x0041u, 0x9040u, 0x6040u, 0xF041u,
+    },
+    {
+        0x0000u, 0xC051u, 0xC0A1u, 0x00F0u, 0xC141u, 0x0110u, 0x01E0u, 0xC1B1u,
+        0xC281u, 0x02D0u, 0x0220u, 0xC271u, 0x03C0u, 0xC391u, 0xC361u, 0x0330u,
+        0xC501u, 0x0550u, 0x05A0u, 0xC5F1u, 0x0440u, 0xC411u, 0xC4E1u, 0x04B0u,
+        0x0780u, 0xC7D1u, 0xC721u, 0x0770u, 0xC6C1u, 0x0690u, 0x0660u, 0xC631u,
+        0xCA01u, 0x0A50u, 0x0AA0u, 0xCAF1u, 0x0B40u, 0xCB11u, 0xCBE1u, 0x0BB0u,
+        0x0880u, 0xC8D1u, 0xC821u, 0x0870u, 0xC9C1u, 0x0990u, 0x0960u, 0xC931u,
+        0x0F00u, 0xCF51u, 0xCFA1u, 0x0FF0u, 0xCE41u, 0x0E10u, 0x0EE0u, 0xCEB1u,
+        0xCD81u, 0x0DD0u, 0x0D20u, 0xCD71u, 0x0CC0u, 0xCC91u, 0xCC61u, 0x0C30u,
+        0xD401u, 0x1450u, 0x14A0u, 0xD4F1u, 0x1540u, 0xD511u, 0xD5E1u, 0x15B0u,
+        0x1680u, 0xD6D1u, 0xD621u, 0x1670u, 0xD7C1u, 0x1790u, 0x1760u, 0xD731u,
+        0x1100u, 0xD151u, 0xD1A1u, 0x11F0u, 0xD041u, 0x1010u, 0x10E0u, 0xD0B1u,
+        0xD381u, 0x13D0u, 0x1320u, 0xD371u, 0x12C0u, 0xD291u, 0xD261u, 0x1230u,
+        0x1E00u, 0xDE51u, 0xDEA1u, 0x1EF0u, 0xDF41u, 0x1F10u, 0x1FE0u, 0xDFB1u,
+        0xDC81u, 0x1CD0u, 0x1C20u, 0xDC71u, 0x1DC0u, 0xDD91u, 0xDD61u, 0x1D30u,
+        0xDB01u, 0x1B50u, 0x1BA0u, 0xDBF1u, 0x1A40u, 0xDA11u, 0xDAE1u, 0x1AB0u,
+        0x1980u, 0xD9D1u, 0xD921u, 0x1970u, 0xD8C1u, 0x1890u, 0x1860u, 0xD831u,
+        0xE801u, 0x2850u, 0x28A0u, 0xE8F1u, 0x2940u, 0xE911u, 0xE9E1u, 0x29B0u,
+        0x2A80u, 0xEAD1u, 0xEA21u, 0x2A70u, 0xEBC1u, 0x2B90u, 0x2B60u, 0xEB31u,
+        0x2D00u, 0xED51u, 0xEDA1u, 0x2DF0u, 0xEC41u, 0x2C10u, 0x2CE0u, 0xECB1u,
+        0xEF81u, 0x2FD0u, 0x2F20u, 0xEF71u, 0x2EC0u, 0xEE91u, 0xEE61u, 0x2E30u,
+        0x2200u, 0xE251u, 0xE2A1u, 0x22F0u, 0xE341u, 0x2310u, 0x23E0u, 0xE3B1u,
+        0xE081u, 0x20D0u, 0x2020u, 0xE071u, 0x21C0u, 0xE191u, 0xE161u, 0x2130u,
+        0xE701u, 0x2750u, 0x27A0u, 0xE7F1u, 0x2640u, 0xE611u, 0xE6E1u, 0x26B0u,
+        0x2580u, 0xE5D1u, 0xE521u, 0x2570u, 0xE4C1u, 0x2490u, 0x2460u, 0xE431u,
+        0x3C00u, 0xFC51u, 0xFCA1u, 0x3CF0u, 0xFD41u, 0x3D10u, 0x3DE0u, 0xFDB1u,
+        0xFE81u, 0x3ED0u, 0x3E20u, 0xFE71u, 0x3FC0u, 0xFF91u, 0xFF61u, 0x3F30u,
+        0xF901u, 0x3950u, 0x39A0u, 0xF9F1u, 0x3840u, 0xF811u, 0xF8E1u, 0x38B0u,
+        0x3B80u, 0xFBD1u, 0xFB21u, 0x3B70u, 0xFAC1u, 0x3A90u, 0x3A60u, 0xFA31u,
+        0xF601u, 0x3650u, 0x36A0u, 0xF6F1u, 0x3740u, 0xF711u, 0xF7E1u, 0x37B0u,
+        0x3480u, 0xF4D1u, 0xF421u, 0x3470u, 0xF5C1u, 0x3590u, 0x3560u, 0xF531u,
+        0x3300u, 0xF351u, 0xF3A1u, 0x33F0u, 0xF241u, 0x3210u, 0x32E0u, 0xF2B1u,
+        0xF181u, 0x31D0u, 0x3120u, 0xF171u, 0x30C0u, 0xF091u, 0xF061u, 0x3030u,
+    },
+    {
+        0x0000u, 0xFC01u, 0xB801u, 0x4400u, 0x3001u, 0xCC00u, 0x8800u, 0x7401u,
+        0x6002u, 0x9C03u, 0xD803u, 0x2402u, 0x5003u, 0xAC02u, 0xE802u, 0x1403u,
+        0xC004u, 0x3C05u, 0x7805u, 0x8404u, 0xF005u, 0x0C04u, 0x4804u, 0xB405u,
+        0xA006u, 0x5C07u, 0x1807u, 0xE406u, 0x9007u, 0x6C06u, 0x2806u, 0xD407u,
+        0xC00Bu, 0x3C0Au, 0x780Au, 0x840Bu, 0xF00Au, 0x0C0Bu, 0x480Bu, 0xB40Au,
+        0xA009u, 0x5C08u, 0x1808u, 0xE409u, 0x9008u, 0x6C09u, 0x2809u, 0xD408u,
+        0x000Fu, 0xFC0Eu, 0xB80Eu, 0x440Fu, 0x300Eu, 0xCC0Fu, 0x880Fu, 0x740Eu,
+        0x600Du, 0x9C0Cu, 0xD80Cu, 0x240Du, 0x500Cu, 0xAC0Du, 0xE80Du, 0x140Cu,
+        0xC015u, 0x3C14u, 0x7814u, 0x8415u, 0xF014u, 0x0C15u, 0x4815u, 0xB414u,
+        0xA017u, 0x5C16u, 0x1816u, 0xE417u, 0x9016u, 0x6C17u, 0x2817u, 0xD416u,
+        0x0011u, 0xFC10u, 0xB810u, 0x4411u, 0x3010u, 0xCC11u, 0x8811u, 0x7410u,
+        0x6013u, 0x9C12u, 0xD812u, 0x2413u, 0x5012u, 0xAC13u, 0xE813u, 0x1412u,
+        0x001Eu, 0xFC1Fu, 0xB81Fu, 0x441Eu, 0x301Fu, 0xCC1Eu, 0x881Eu, 0x741Fu,
+        0x601Cu, 0x9C1Du, 0xD81Du, 0x241Cu, 0x501Du, 0xAC1Cu, 0xE81Cu, 0x141Du,
+        0xC01Au, 0x3C1Bu, 0x781Bu, 0x841Au, 0xF01Bu, 0x0C1Au, 0x481Au, 0xB41Bu,
+        0xA018u, 0x5C19u, 0x1819u, 0xE418u, 0x9019u, 0x6C18u, 0x2818u, 0xD419u,
+        0xC029u, 0x3C28u, 0x7828u, 0x8429u, 0xF028u, 0x0C29u, 0x4829u, 0xB428u,
+        0xA02Bu, 0x5C2Au, 0x182Au, 0xE42Bu, 0x902Au, 0x6C2Bu, 0x282Bu, 0xD42Au,
+        0x002Du, 0xFC2Cu, 0xB82Cu, 0x442Du, 0x302Cu, 0xCC2Du, 0x882Du, 0x742Cu,
+        0x602Fu, 0x9C2Eu, 0xD82Eu, 0x242Fu, 0x502Eu, 0xAC2Fu, 0xE82Fu, 0x142Eu,
+        0x0022u, 0xFC23u, 0xB823u, 0x4422u, 0x3023u, 0xCC22u, 0x8822u, 0x7423u,
+        0x6020u, 0x9C21u, 0xD821u, 0x2420u, 0x5021u, 0xAC20u, 0xE820u, 0x1421u,
+        0xC026u, 0x3C27u, 0x7827u, 0x8426u, 0xF027u, 0x0C26u, 0x4826u, 0xB427u,
+        0xA024u, 0x5C25u, 0x1825u, 0xE424u, 0x9025u, 0x6C24u, 0x2824u, 0xD425u,
+        0x003Cu, 0xFC3Du, 0xB83Du, 0x443Cu, 0x303Du, 0xCC3Cu, 0x883Cu, 0x743Du,
+        0x603Eu, 0x9C3Fu, 0xD83Fu, 0x243Eu, 0x503Fu, 0xAC3Eu, 0xE83Eu, 0x143Fu,
+        0xC038u, 0x3C39u, 0x7839u, 0x8438u, 0xF039u, 0x0C38u, 0x4838u, 0xB439u,
+        0xA03Au, 0x5C3Bu, 0x183Bu, 0xE43Au, 0x903Bu, 0x6C3Au, 0x283Au, 0xD43Bu,
+        0xC037u, 0x3C36u, 0x7836u, 0x8437u, 0xF036u, 0x0C37u, 0x4837u, 0xB436u,
+        0xA035u, 0x5C34u, 0x1834u, 0xE435u, 0x9034u, 0x6C35u, 0x2835u, 0xD434u,
+        0x0033u, 0xFC32u, 0xB832u, 0x4433u, 0x3032u, 0xCC33u, 0x8833u, 0x7432u,
+        0x6031u, 0x9C30u, 0xD830u, 0x2431u, 0x5030u, 0xAC31u, 0xE831u, 0x1430u,
+    },
+#if YKB_PROTOCOL_CRC16_SLICES == 8u
+    {
+        0x0000u, 0xC03Du, 0xC079u, 0x0044u, 0xC0F1u, 0x00CCu, 0x0088u, 0xC0B5u,
+        0xC1E1u, 0x01DCu, 0x0198u, 0xC1A5u, 0x0110u, 0xC12Du, 0xC169u, 0x0154u,
+        0xC3C1u, 0x03FCu, 0x03B8u, 0xC385u, 0x0330u, 0xC30Du, 0xC349u, 0x0374u,
+        0x0220u, 0xC21Du, 0xC259u, 0x0264u, 0xC2D1u, 0x02ECu, 0x02A8u, 0xC295u,
+        0xC781u, 0x07BCu, 0x07F8u, 0xC7C5u, 0x0770u, 0xC74Du, 0xC709u, 0x0734u,
+        0x0660u, 0xC65Du, 0xC619u, 0x0624u, 0xC691u, 0x06ACu, 0x06E8u, 0xC6D5u,
+        0x0440u, 0xC47Du, 0xC439u, 0x0404u, 0xC4B1u, 0x048Cu, 0x04C8u, 0xC4F5u,
+        0xC5A1u, 0x059Cu, 0x05D8u, 0xC5E5u, 0x0550u, 0xC56Du, 0xC529u, 0x0514u,
+        0xCF01u, 0x0F3Cu, 0x0F78u, 0xCF45u, 0x0FF0u, 0xCFCDu, 0xCF89u, 0x0FB4u,
+        0x0EE0u, 0xCEDDu, 0xCE99u, 0x0EA4u, 0xCE11u, 0x0E2Cu, 0x0E68u, 0xCE55u,
+        0x0CC0u, 0xCCFDu, 0xCCB9u, 0x0C84u, 0xCC31u, 0x0C0Cu, 0x0C48u, 0xCC75u,
+        0xCD21u, 0x0D1Cu, 0x0D58u, 0xCD65u, 0x0DD0u, 0xCDEDu, 0xCDA9u, 0x0D94u,
+        0x0880u, 0xC8BDu, 0xC8F9u, 0x08C4u, 0xC871u, 0x084Cu, 0x0808u, 0xC835u,
+        0xC961u, 0x095Cu, 0x0918u, 0xC925u, 0x0990u, 0xC9ADu, 0xC9E9u, 0x09D4u,
+        0xCB41u, 0x0B7Cu, 0x0B38u, 0xCB05u, 0x0BB0u, 0xCB8Du, 0xCBC9u, 0x0BF4u,
+        0x0AA0u, 0xCA9Du, 0xCAD9u, 0x0AE4u, 0xCA51u, 0x0A6Cu, 0x0A28u, 0xCA15u,
+        0xDE01u, 0x1E3Cu, 0x1E78u, 0xDE45u, 0x1EF0u, 0xDECDu, 0xDE89u, 0x1EB4u,
+        0x1FE0u, 0xDFDDu, 0xDF99u, 0x1FA4u, 0xDF11u, 0x1F2Cu, 0x1F68u, 0xDF55u,
+        0x1DC0u, 0xDDFDu, 0xDDB9u, 0x1D84u, 0xDD31u, 0x1D0Cu, 0x1D48u, 0xDD75u,
+        0xDC21u, 0x1C1Cu, 0x1C58u, 0xDC65u, 0x1CD0u, 0xDCEDu, 0xDCA9u, 0x1C94u,
+        0x1980u, 0xD9BDu, 0xD9F9u, 0x19C4u, 0xD971u, 0x194Cu, 0x1908u, 0xD935u,
+        0xD861u, 0x185Cu, 0x1818u, 0xD825u, 0x1890u, 0xD8ADu, 0xD8E9u, 0x18D4u,
+        0xDA41u, 0x1A7Cu, 0x1A38u, 0xDA05u, 0x1AB0u, 0xDA8Du, 0xDAC9u, 0x1AF4u,
+        0x1BA0u, 0xDB9Du, 0xDBD9u, 0x1BE4u, 0xDB51u, 0x1B6Cu, 0x1B28u, 0xDB15u,
+        0x1100u, 0xD13Du, 0xD179u, 0x1144u, 0xD1F1u, 0x11CCu, 0x1188u, 0xD1B5u,
+        0xD0E1u, 0x10DCu, 0x1098u, 0xD0A5u, 0x1010u, 0xD02Du, 0xD069u, 0x1054u,
+        0xD2C1u, 0x12FCu, 0x12B8u, 0xD285u, 0x1230u, 0xD20Du, 0xD249u, 0x1274u,
+        0x1320u, 0xD31Du, 0xD359u, 0x1364u, 0xD3D1u, 0x13ECu, 0x13A8u, 0xD395u,
+        0xD681u, 0x16BCu, 0x16F8u, 0xD6C5u, 0x1670u, 0xD64Du, 0xD609u, 0x1634u,
+        0x1760u, 0xD75Du, 0xD719u, 0x1724u, 0xD791u, 0x17ACu, 0x17E8u, 0xD7D5u,
+        0x1540u, 0xD57Du, 0xD539u, 0x1504u, 0xD5B1u, 0x158Cu, 0x15C8u, 0xD5F5u,
+        0xD4A1u, 0x149Cu, 0x14D8u, 0xD4E5u, 0x1450u, 0xD46Du, 0xD429u, 0x1414u,
+    },
+    {
+        0x0000u, 0xD101u, 0xE201u, 0x3300u, 0x8401u, 0x5500u, 0x6600u, 0xB701u,
+        0x4801u, 0x9900u, 0xAA00u, 0x7B01u, 0xCC00u, 0x1D01u, 0x2E01u, 0xFF00u,
+        0x9002u, 0x4103u, 0x7203u, 0xA302u, 0x1403u, 0xC502u, 0xF602u, 0x2703u,
+        0xD803u, 0x0902u, 0x3A02u, 0xEB03u, 0x5C02u, 0x8D03u, 0xBE03u, 0x6F02u,
+        0x6007u, 0xB106u, 0x8206u, 0x5307u, 0xE406u, 0x3507u, 0x0607u, 0xD706u,
+        0x2806u, 0xF907u, 0xCA07u, 0x1B06u, 0xAC07u, 0x7D06u, 0x4E06u, 0x9F07u,
+        0xF005u, 0x2104u, 0x1204u, 0xC305u, 0x7404u, 0xA505u, 0x9605u, 0x4704u,
+        0xB804u, 0x6905u, 0x5A05u, 0x8B04u, 0x3C05u, 0xED04u, 0xDE04u, 0x0F05u,
+        0xC00Eu, 0x110Fu, 0x220Fu, 0xF30Eu, 0x440Fu, 0x950Eu, 0xA60Eu, 0x770Fu,
+        0x880Fu, 0x590Eu, 0x6A0Eu, 0xBB0Fu, 0x0C0Eu, 0xDD0Fu, 0xEE0Fu, 0x3F0Eu,
+        0x500Cu, 0x810Du, 0xB20Du, 0x630Cu, 0xD40Du, 0x050Cu, 0x360Cu, 0xE70Du,
+        0x180Du, 0xC90Cu, 0xFA0Cu, 0x2B0Du, 0x9C0Cu, 0x4D0Du, 0x7E0Du, 0xAF0Cu,
+        0xA009u, 0x7108u, 0x4208u, 0x9309u, 0x2408u, 0xF509u, 0xC609u, 0x1708u,
+        0xE808u, 0x3909u, 0x0A09u, 0xDB08u, 0x6C09u, 0xBD08u, 0x8E08u, 0x5F09u,
+        0x300Bu, 0xE10Au, 0xD20Au, 0x030Bu, 0xB40Au, 0x650Bu, 0x560Bu, 0x870Au,
+        0x780Au, 0xA90Bu, 0x9A0Bu, 0x4B0Au, 0xFC0Bu, 0x2D0Au, 0x1E0Au, 0xCF0Bu,
+        0xC01Fu, 0x111Eu, 0x221Eu, 0xF31Fu, 0x441Eu, 0x951Fu, 0xA61Fu, 0x771Eu,
+        0x881Eu, 0x591Fu, 0x6A1Fu, 0xBB1Eu, 0x0C1Fu, 0xDD1Eu, 0xEE1Eu, 0x3F1Fu,
+        0x501Du, 0x811Cu, 0xB21Cu, 0x631Du, 0xD41Cu, 0x051Du, 0x361Du, 0xE71Cu,
+        0x181Cu, 0xC91Du, 0xFA1Du, 0x2B1Cu, 0x9C1Du, 0x4D1Cu, 0x7E1Cu, 0xAF1Du,
+        0xA018u, 0x7119u, 0x4219u, 0x9318u, 0x2419u, 0xF518u, 0xC618u, 0x1719u,
+        0xE819u, 0x3918u, 0x0A18u, 0xDB19u, 0x6C18u, 0xBD19u, 0x8E19u, 0x5F18u,
+        0x301Au, 0xE11Bu, 0xD21Bu, 0x031Au, 0xB41Bu, 0x651Au, 0x561Au, 0x871Bu,
+        0x781Bu, 0xA91Au, 0x9A1Au, 0x4B1Bu, 0xFC1Au, 0x2D1Bu, 0x1E1Bu, 0xCF1Au,
+        0x0011u, 0xD110u, 0xE210u, 0x3311u, 0x8410u, 0x5511u, 0x6611u, 0xB710u,
+        0x4810u, 0x9911u, 0xAA11u, 0x7B10u, 0xCC11u, 0x1D10u, 0x2E10u, 0xFF11u,
+        0x9013u, 0x4112u, 0x7212u, 0xA313u, 0x1412u, 0xC513u, 0xF613u, 0x2712u,
+        0xD812u, 0x0913u, 0x3A13u, 0xEB12u, 0x5C13u, 0x8D12u, 0xBE12u, 0x6F13u,
+        0x6016u, 0xB117u, 0x8217u, 0x5316u, 0xE417u, 0x3516u, 0x0616u, 0xD717u,
+        0x2817u, 0xF916u, 0xCA16u, 0x1B17u, 0xAC16u, 0x7D17u, 0x4E17u, 0x9F16u,
+        0xF014u, 0x2115u, 0x1215u, 0xC314u, 0x7415u, 0xA514u, 0x9614u, 0x4715u,
+        0xB815u, 0x6914u, 0x5A14u, 0x8B15u, 0x3C14u, 0xED15u, 0xDE15u, 0x0F14u,
+    },
+    {
+        0x0000u, 0xC010u, 0xC023u, 0x0033u, 0xC045u, 0x0055u, 0x0066u, 0xC076u,
+        0xC089u, 0x0099u, 0x00AAu, 0xC0BAu, 0x00CCu, 0xC0DCu, 0xC0EFu, 0x00FFu,
+        0xC111u, 0x0101u, 0x0132u, 0xC122u, 0x0154u, 0xC144u, 0xC177u, 0x0167u,
+        0x0198u, 0xC188u, 0xC1BBu, 0x01ABu, 0xC1DDu, 0x01CDu, 0x01FEu, 0xC1EEu,
+        0xC221u, 0x0231u, 0x0202u, 0xC212u, 0x0264u, 0xC274u, 0xC247u, 0x0257u,
+        0x02A8u, 0xC2B8u, 0xC28Bu, 0x029Bu, 0xC2EDu, 0x02FDu, 0x02CEu, 0xC2DEu,
+        0x0330u, 0xC320u, 0xC313u, 0x0303u, 0xC375u, 0x0365u, 0x0356u, 0xC346u,
+        0xC3B9u, 0x03A9u, 0x039Au, 0xC38Au, 0x03FCu, 0xC3ECu, 0xC3DFu, 0x03CFu,
+        0xC441u, 0x0451u, 0x0462u, 0xC472u, 0x0404u, 0xC414u, 0xC427u, 0x0437u,
+        0x04C8u, 0xC4D8u, 0xC4EBu, 0x04FBu, 0xC48Du, 0x049Du, 0x04AEu, 0xC4BEu,
+        0x0550u, 0xC540u, 0xC573u, 0x0563u, 0xC515u, 0x0505u, 0x0536u, 0xC526u,
+        0xC5D9u, 0x05C9u, 0x05FAu, 0xC5EAu, 0x059Cu, 0xC58Cu, 0xC5BFu, 0x05AFu,
+        0x0660u, 0xC670u, 0xC643u, 0x0653u, 0xC625u, 0x0635u, 0x0606u, 0xC616u,
+        0xC6E9u, 0x06F9u, 0x06CAu, 0xC6DAu, 0x06ACu, 0xC6BCu, 0xC68Fu, 0x069Fu,
+        0xC771u, 0x0761u, 0x0752u, 0xC742u, 0x0734u, 0xC724u, 0xC717u, 0x0707u,
+        0x07F8u, 0xC7E8u, 0xC7DBu, 0x07CBu, 0xC7BDu, 0x07ADu, 0x079Eu, 0xC78Eu,
+        0xC881u, 0x0891u, 0x08A2u, 0xC8B2u, 0x08C4u, 0xC8D4u, 0xC8E7u, 0x08F7u,
+        0x0808u, 0xC818u, 0xC82Bu, 0x083Bu, 0xC84Du, 0x085Du, 0x086Eu, 0xC87Eu,
+        0x0990u, 0xC980u, 0xC9B3u, 0x09A3u, 0xC9D5u, 0x09C5u, 0x09F6u, 0xC9E6u,
+        0xC919u, 0x0909u, 0x093Au, 0xC92Au, 0x095Cu, 0xC94Cu, 0xC97Fu, 0x096Fu,
+        0x0AA0u, 0xCAB0u, 0xCA83u, 0x0A93u, 0xCAE5u, 0x0AF5u, 0x0AC6u, 0xCAD6u,
+        0xCA29u, 0x0A39u, 0x0A0Au, 0xCA1Au, 0x0A6Cu, 0xCA7Cu, 0xCA4Fu, 0x0A5Fu,
+        0xCBB1u, 0x0BA1u, 0x0B92u, 0xCB82u, 0x0BF4u, 0xCBE4u, 0xCBD7u, 0x0BC7u,
+        0x0B38u, 0xCB28u, 0xCB1Bu, 0x0B0Bu, 0xCB7Du, 0x0B6Du, 0x0B5Eu, 0xCB4Eu,
+        0x0CC0u, 0xCCD0u, 0xCCE3u, 0x0CF3u, 0xCC85u, 0x0C95u, 0x0CA6u, 0xCCB6u,
+        0xCC49u, 0x0C59u, 0x0C6Au, 0xCC7Au, 0x0C0Cu, 0xCC1Cu, 0xCC2Fu, 0x0C3Fu,
+        0xCDD1u, 0x0DC1u, 0x0DF2u, 0xCDE2u, 0x0D94u, 0xCD84u, 0xCDB7u, 0x0DA7u,
+        0x0D58u, 0xCD48u, 0xCD7Bu, 0x0D6Bu, 0xCD1Du, 0x0D0Du, 0x0D3Eu, 0xCD2Eu,
+        0xCEE1u, 0x0EF1u, 0x0EC2u, 0xCED2u, 0x0EA4u, 0xCEB4u, 0xCE87u, 0x0E97u,
+        0x0E68u, 0xCE78u, 0xCE4Bu, 0x0E5Bu, 0xCE2Du, 0x0E3Du, 0x0E0Eu, 0xCE1Eu,
+        0x0FF0u, 0xCFE0u, 0xCFD3u, 0x0FC3u, 0xCFB5u, 0x0FA5u, 0x0F96u, 0xCF86u,
+        0xCF79u, 0x0F69u, 0x0F5Au, 0xCF4Au, 0x0F3Cu, 0xCF2Cu, 0xCF1Fu, 0x0F0Fu,
+    },
+    {
+        0x0000u, 0xCCC1u, 0xD981u, 0x1540u, 0xF301u, 0x3FC0u, 0x2A80u, 0xE641u,
+        0xA601u, 0x6AC0u, 0x7F80u, 0xB341u, 0x5500u, 0x99C1u, 0x8C81u, 0x4040u,
+        0x0C01u, 0xC0C0u, 0xD580u, 0x1941u, 0xFF00u, 0x33C1u, 0x2681u, 0xEA40u,
+        0xAA00u, 0x66C1u, 0x7381u, 0xBF40u, 0x5901u, 0x95C0u, 0x8080u, 0x4C41u,
+        0x1802u, 0xD4C3u, 0xC183u, 0x0D42u, 0xEB03u, 0x27C2u, 0x3282u, 0xFE43u,
+        0xBE03u, 0x72C2u, 0x6782u, 0xAB43u, 0x4D02u, 0x81C3u, 0x9483u, 0x5842u,
+        0x1403u, 0xD8C2u, 0xCD82u, 0x0143u, 0xE702u, 0x2BC3u, 0x3E83u, 0xF242u,
+        0xB202u, 0x7EC3u, 0x6B83u, 0xA742u, 0x4103u, 0x8DC2u, 0x9882u, 0x5443u,
+        0x3004u, 0xFCC5u, 0xE985u, 0x2544u, 0xC305u, 0x0FC4u, 0x1A84u, 0xD645u,
+        0x9605u, 0x5AC4u, 0x4F84u, 0x8345u, 0x6504u, 0xA9C5u, 0xBC85u, 0x7044u,
+        0x3C05u, 0xF0C4u, 0xE584u, 0x2945u, 0xCF04u, 0x03C5u, 0x1685u, 0xDA44u,
+        0x9A04u, 0x56C5u, 0x4385u, 0x8F44u, 0x6905u, 0xA5C4u, 0xB084u, 0x7C45u,
+        0x2806u, 0xE4C7u, 0xF187u, 0x3D46u, 0xDB07u, 0x17C6u, 0x0286u, 0xCE47u,
+        0x8E07u, 0x42C6u, 0x5786u, 0x9B47u, 0x7D06u, 0xB1C7u, 0xA487u, 0x6846u,
+        0x2407u, 0xE8C6u, 0xFD86u, 0x3147u, 0xD706u, 0x1BC7u, 0x0E87u, 0xC246u,
+        0x8206u, 0x4EC7u, 0x5B87u, 0x9746u, 0x7107u, 0xBDC6u, 0xA886u, 0x6447u,
+        0x6008u, 0xACC9u, 0xB989u, 0x7548u, 0x9309u, 0x5FC8u, 0x4A88u, 0x8649u,
+        0xC609u, 0x0AC8u, 0x1F88u, 0xD349u, 0x3508u, 0xF9C9u, 0xEC89u, 0x2048u,
+        0x6C09u, 0xA0C8u, 0xB588u, 0x7949u, 0x9F08u, 0x53C9u, 0x4689u, 0x8A48u,
+        0xCA08u, 0x06C9u, 0x1389u, 0xDF48u, 0x3909u, 0xF5C8u, 0xE088u, 0x2C49u,
+        0x780Au, 0xB4CBu, 0xA18Bu, 0x6D4Au, 0x8B0Bu, 0x47CAu, 0x528Au, 0x9E4Bu,
+        0xDE0Bu, 0x12CAu, 0x078Au, 0xCB4Bu, 0x2D0Au, 0xE1CBu, 0xF48Bu, 0x384Au,
+        0x740Bu, 0xB8CAu, 0xAD8Au, 0x614Bu, 0x870Au, 0x4BCBu, 0x5E8Bu, 0x924Au,
+        0xD20Au, 0x1ECBu, 0x0B8Bu, 0xC74Au, 0x210Bu, 0xEDCAu, 0xF88Au, 0x344Bu,
+        0x500Cu, 0x9CCDu, 0x898Du, 0x454Cu, 0xA30Du, 0x6FCCu, 0x7A8Cu, 0xB64Du,
+        0xF60Du, 0x3ACCu, 0x2F8Cu, 0xE34Du, 0x050Cu, 0xC9CDu, 0xDC8Du, 0x104Cu,
+        0x5C0Du, 0x90CCu, 0x858Cu, 0x494Du, 0xAF0Cu, 0x63CDu, 0x768Du, 0xBA4Cu,
+        0xFA0Cu, 0x36CDu, 0x238Du, 0xEF4Cu, 0x090Du, 0xC5CCu, 0xD08Cu, 0x1C4Du,
+        0x480Eu, 0x84CFu, 0x918Fu, 0x5D4Eu, 0xBB0Fu, 0x77CEu, 0x628Eu, 0xAE4Fu,
+        0xEE0Fu, 0x22CEu, 0x378Eu, 0xFB4Fu, 0x1D0Eu, 0xD1CFu, 0xC48Fu, 0x084Eu,
+        0x440Fu, 0x88CEu, 0x9D8Eu, 0x514Fu, 0xB70Eu, 0x7BCFu, 0x6E8Fu, 0xA24Eu,
+        0xE20Eu, 0x2ECFu, 0x3B8Fu, 0xF74Eu, 0x110Fu, 0xDDCEu, 0xC88Eu, 0x044Fu,
+    },
+#endif // YKB_PROTOCOL_CRC16_SLICES == 8u
+};
+
+YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update_slicing(
+    uint16_t crc, const uint8_t *data, size_t length) {
+    const uint16_t(*table)[256] = ykb_protocol_crc16_slicing_table;
+
+    if (data == NULL) {
+        return crc;
+    }
+
+    // The first two bytes of a step fold into the CRC itself, the others
+    // only need the table of their distance to the end of the step
+    while (length >= YKB_PROTOCOL_CRC16_SLICES) {
+        crc ^= (uint16_t)(data[0] | ((uint16_t)data[1] << 8u));
+#if YKB_PROTOCOL_CRC16_SLICES == 8u
+        crc = (uint16_t)(table[7][crc & 0xFFu] ^ table[6][crc >> 8u] ^
+                         table[5][data[2]] ^ table[4][data[3]] ^
+                         table[3][data[4]] ^ table[2][data[5]] ^
+                         table[1][data[6]] ^ table[0][data[7]]);
+#else
+        crc = (uint16_t)(table[3][crc & 0xFFu] ^ table[2][crc >> 8u] ^
+                         table[1][data[2]] ^ table[0][data[3]]);
+#endif
+        data += YKB_PROTOCOL_CRC16_SLICES;
+        length -= YKB_PROTOCOL_CRC16_SLICES;
+    }
+
+    while (length-- > 0u) {
+        crc = (uint16_t)((crc >> 8u) ^ table[0][(crc ^ *data++) & 0xFFu]);
+    }
+
+    return crc;
+}
+#endif // YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_SLICING_*
+
+#if YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_EXTERNAL
+// Continues crc over data, must match ykb_protocol_crc16_update_bitwise()
+uint16_t ykb_protocol_crc16_external_update(uint16_t crc, const uint8_t *data,
+                                            size_t length);
+#endif // YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_EXTERNAL
+
+YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16_update(uint16_t crc,
+                                                       const uint8_t *data,
+                                                       size_t length) {
+    if (data == NULL || length == 0u) {
+        return crc;
+    }
+
+#if YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_NIBBLE
+    return ykb_protocol_crc16_update_nibble(crc, data, length);
+#elif YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_SLICING_4 ||            \
+    YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_SLICING_8
+    return ykb_protocol_crc16_update_slicing(crc, data, length);
+#elif YKB_PROTOCOL_CRC16_BACKEND == YKB_PROTOCOL_CRC16_EXTERNAL
+    return ykb_protocol_crc16_external_update(crc, data, length);
+#else
+    return ykb_protocol_crc16_update_bitwise(crc, data, length);
+#endif
+}
+
 YKB_PROTOCOL_STATIC uint16_t ykb_protocol_crc16(const uint8_t *data,
                                                 size_t length) {
     return ykb_protocol_crc16_update(0xFFFFu, data, length);
@@ -289,8 +747,7 @@ YKB_PROTOCOL_STATIC void ykb_protocol_tx_init(ykb_protocol_tx_state_t *tx,
     tx->packet_count = ykb_protocol_calc_packet_count(total_len);
     tx->next_packet_idx = 0u;
     tx->type_flags_base =
-        (uint8_t)(type_flags_base &
-                  (uint8_t)~(YKB_PROTOCOL_FLAG_START | YKB_PROTOCOL_FLAG_END));
+        (uint8_t)(type_flags_base & (uint8_t)~YKB_PROTOCOL_PACKET_FLAGS);
 }
 
 YKB_PROTOCOL_STATIC bool
@@ -298,28 +755,24 @@ ykb_protocol_tx_has_more(const ykb_protocol_tx_state_t *tx) {
     return (tx != NULL) && (tx->next_packet_idx < tx->packet_count);
 }
 
+// Builds packet idx of the transfer, in any order. Does not advance tx.
 YKB_PROTOCOL_STATIC bool
-ykb_protocol_tx_build_packet(ykb_protocol_tx_state_t *tx,
-                             ykb_protocol_packet_t *out_packet) {
-    uint16_t idx;
+ykb_protocol_tx_build_packet_at(const ykb_protocol_tx_state_t *tx,
+                                uint16_t idx, uint8_t extra_flags,
+                                ykb_protocol_packet_t *out_packet) {
     uint16_t payload_len;
     uint8_t type_flags;
 
-    if (tx == NULL || out_packet == NULL) {
-        return false;
-    }
-
-    if (!ykb_protocol_tx_has_more(tx)) {
+    if (tx == NULL || out_packet == NULL || idx >= tx->packet_count) {
         return false;
     }
 
     memset(out_packet, 0, sizeof(*out_packet));
 
-    idx = tx->next_packet_idx;
     payload_len = ykb_protocol_payload_len_for_index(tx->total_len, idx,
                                                      tx->packet_count);
 
-    type_flags = tx->type_flags_base;
+    type_flags = (uint8_t)(tx->type_flags_base | extra_flags);
     if (idx == 0u) {
         type_flags |= YKB_PROTOCOL_FLAG_START;
     }
@@ -336,11 +789,36 @@ ykb_protocol_tx_build_packet(ykb_protocol_tx_state_t *tx,
     out_packet->header.total_len = tx->total_len;
 
     if (payload_len > 0u && tx->data != NULL) {
-        memcpy(out_packet->payload, &tx->data[tx->offset], payload_len);
-        tx->offset = (uint16_t)(tx->offset + payload_len);
+        memcpy(out_packet->payload,
+               &tx->data[(uint32_t)idx * YKB_PROTOCOL_MAX_PAYLOAD_SIZE],
+               payload_len);
     }
 
     out_packet->header.crc = ykb_protocol_compute_packet_crc(out_packet);
+
+    return true;
+}
+
+YKB_PROTOCOL_STATIC bool
+ykb_protocol_tx_build_packet(ykb_protocol_tx_state_t *tx,
+                             ykb_protocol_packet_t *out_packet) {
+    if (tx == NULL || out_packet == NULL) {
+        return false;
+    }
+
+    if (!ykb_protocol_tx_has_more(tx)) {
+        return false;
+    }
+
+    if (!ykb_protocol_tx_build_packet_at(tx, tx->next_packet_idx, 0u,
+                                         out_packet)) {
+        return false;
+    }
+
+    tx->offset = (uint16_t)(tx->offset +
+                            ykb_protocol_payload_len_for_index(
+                                tx->total_len, tx->next_packet_idx,
+                                tx->packet_count));
     tx->next_packet_idx++;
 
     return true;
@@ -360,6 +838,7 @@ YKB_PROTOCOL_STATIC void ykb_protocol_rx_reset(ykb_protocol_rx_state_t *rx) {
     rx->received_count = 0u;
     rx->next_expected_packet_idx = 0u;
     rx->type_flags_base = 0u;
+    rx->checksum = 0u;
 
     ykb_protocol_bitmap_clear_all(rx->received_bitmap,
                                   rx->received_bitmap_size);
@@ -414,9 +893,8 @@ YKB_PROTOCOL_STATIC ykb_protocol_rx_result_t ykb_protocol_rx_begin_transfer(
     rx->packet_count = packet->header.packet_count;
     rx->received_count = 0u;
     rx->next_expected_packet_idx = 0u;
-    rx->type_flags_base =
-        (uint8_t)(packet->header.type_flags &
-                  (uint8_t)~(YKB_PROTOCOL_FLAG_START | YKB_PROTOCOL_FLAG_END));
+    rx->type_flags_base = (uint8_t)(packet->header.type_flags &
+                                    (uint8_t)~YKB_PROTOCOL_PACKET_FLAGS);
 
     return YKB_PROTOCOL_RX_RESULT_ACCEPTED;
 }
@@ -473,8 +951,7 @@ YKB_PROTOCOL_STATIC ykb_protocol_rx_result_t ykb_protocol_rx_push_packet(
         }
     } else {
         packet_type_flags_base = (uint8_t)(packet->header.type_flags &
-                                           (uint8_t)~(YKB_PROTOCOL_FLAG_START |
-                                                      YKB_PROTOCOL_FLAG_END));
+                                           (uint8_t)~YKB_PROTOCOL_PACKET_FLAGS);
 
         if (rx->transfer_id != packet->header.transfer_id ||
             rx->total_len != packet->header.total_len ||
@@ -558,4 +1035,644 @@ ykb_protocol_rx_collect_missing(const ykb_protocol_rx_state_t *rx,
     return count;
 }
 
+// Selective repeat
+//
+// The sender keeps up to a window of packets in flight and sets ACK_REQ on
+// the last one it can send. The receiver answers ACK_REQ, and every
+// completed transfer, with an ACK carrying its received bitmap. The sender
+// then retransmits only the packets the ACK reports missing. Without an ACK
+// before the retransmission timeout the first missing packet is probed
+// again with ACK_REQ and the timeout backs off until new data is acked.
+//
+// The probe goes out twice. With losses above 50% per round trip a single
+// probe fails more often than not, and doubling timeouts then stall longer
+// than anything the retransmissions cost.
+#define YKB_PROTOCOL_ARQ_PROBE_COPIES 2u
+
+// Builds an ACK telling every packet below base was received, plus those
+// set in received_bitmap, which is indexed by packet and may be NULL.
+// Returns the length of the ACK packet, 0 on error.
+YKB_PROTOCOL_STATIC uint16_t ykb_protocol_ack_build(
+    ykb_protocol_packet_t *out_packet, uint8_t transfer_id,
+    uint8_t type_flags_base, uint16_t total_len, uint16_t packet_count,
+    uint16_t base, const uint8_t *received_bitmap) {
+    ykb_protocol_ack_header_t ack;
+    uint16_t window;
+    uint16_t payload_len;
+
+    if (out_packet == NULL) {
+        return 0u;
+    }
+
+    memset(out_packet, 0, sizeof(*out_packet));
+
+    ack.total_len = total_len;
+    ack.packet_count = packet_count;
+    ack.base = base;
+    memcpy(out_packet->payload, &ack, sizeof(ack));
+
+    window = (uint16_t)(packet_count - base);
+    if (received_bitmap == NULL) {
+        window = 0u;
+    } else if (window > YKB_PROTOCOL_ACK_WINDOW_MAX) {
+        window = YKB_PROTOCOL_ACK_WINDOW_MAX;
+    }
+
+    uint8_t *bitmap = &out_packet->payload[sizeof(ack)];
+    for (uint16_t n = 0u; n < window; n++) {
+        if (ykb_protocol_bitmap_test(received_bitmap, (uint16_t)(base + n))) {
+            ykb_protocol_bitmap_set(bitmap, n);
+        }
+    }
+    payload_len = (uint16_t)(sizeof(ack) + (window + 7u) / 8u);
+
+    out_packet->header.version = YKB_PROTOCOL_VERSION;
+    out_packet->header.type_flags =
+        (uint8_t)(YKB_PROTOCOL_TYPE_ACK | YKB_PROTOCOL_FLAG_START |
+                  YKB_PROTOCOL_FLAG_END |
+                  (type_flags_base & YKB_PROTOCOL_SEQ_MASK));
+    out_packet->header.transfer_id = transfer_id;
+    out_packet->header.packet_idx = 0u;
+    out_packet->header.packet_count = 1u;
+    out_packet->header.total_len = payload_len;
+    out_packet->header.crc = ykb_protocol_compute_packet_crc(out_packet);
+
+    return (uint16_t)(YKB_PROTOCOL_HEADER_SIZE + payload_len);
+}
+
+// ACK of the transfer in rx, which must track out-of-order packets
+YKB_PROTOCOL_STATIC uint16_t
+ykb_protocol_rx_build_ack(const ykb_protocol_rx_state_t *rx,
+                          ykb_protocol_packet_t *out_packet) {
+    uint16_t base = 0u;
+
+    if (rx == NULL || !rx->active || !rx->allow_out_of_order ||
+        rx->received_bitmap == NULL) {
+        return 0u;
+    }
+
+    if (rx->complete) {
+        base = rx->packet_count;
+    } else {
+        while (base < rx->packet_count &&
+               ykb_protocol_bitmap_test(rx->received_bitmap, base)) {
+            base++;
+        }
+    }
+
+    return ykb_protocol_ack_build(out_packet, rx->transfer_id,
+                                  rx->type_flags_base, rx->total_len,
+                                  rx->packet_count, base,
+                                  rx->received_bitmap);
+}
+
+// Retransmission timeout, kept across transfers so every transfer starts
+// with what the previous ones learned about the link. Backoff is not kept,
+// see ykb_protocol_arq_rtt_restore().
+typedef struct {
+    // Scaled by 8 and 4, so the gains don't round away on millisecond RTTs
+    uint32_t srtt_x8;
+    uint32_t rttvar_x4;
+    uint32_t rto_ms;
+    uint32_t rto_init_ms;
+    uint32_t rto_min_ms;
+    uint32_t rto_max_ms;
+    bool sampled;
+} ykb_protocol_arq_rtt_t;
+
+YKB_PROTOCOL_STATIC void ykb_protocol_arq_rtt_init(ykb_protocol_arq_rtt_t *rtt,
+                                                   uint32_t rto_init_ms,
+                                                   uint32_t rto_min_ms,
+                                                   uint32_t rto_max_ms) {
+    if (rtt == NULL) {
+        return;
+    }
+
+    memset(rtt, 0, sizeof(*rtt));
+    rtt->rto_min_ms = rto_min_ms;
+    rtt->rto_max_ms = rto_max_ms;
+    rtt->rto_init_ms = rto_init_ms < rto_min_ms   ? rto_min_ms
+                       : rto_init_ms > rto_max_ms ? rto_max_ms
+                                                  : rto_init_ms;
+    rtt->rto_ms = rtt->rto_init_ms;
+}
+
+// Drops any backoff and goes back to the RTO the estimator gives, or the
+// initial one before the first sample (RFC 6298 section 5.7)
+YKB_PROTOCOL_STATIC void
+ykb_protocol_arq_rtt_restore(ykb_protocol_arq_rtt_t *rtt) {
+    uint32_t rto;
+
+    if (!rtt->sampled) {
+        rtt->rto_ms = rtt->rto_init_ms;
+        return;
+    }
+
+    // srtt + max(G, 4 * rttvar) with a clock granularity G of 1 ms
+    rto = rtt->srtt_x8 / 8u + (rtt->rttvar_x4 > 0u ? rtt->rttvar_x4 : 1u);
+    rtt->rto_ms = rto < rtt->rto_min_ms   ? rtt->rto_min_ms
+                  : rto > rtt->rto_max_ms ? rtt->rto_max_ms
+                                          : rto;
+}
+
+// RFC 6298 style estimator, srtt gain 1/8 and rttvar gain 1/4
+YKB_PROTOCOL_STATIC void
+ykb_protocol_arq_rtt_sample(ykb_protocol_arq_rtt_t *rtt, uint32_t sample_ms) {
+    if (!rtt->sampled) {
+        rtt->srtt_x8 = sample_ms * 8u;
+        rtt->rttvar_x4 = sample_ms * 2u;
+        rtt->sampled = true;
+    } else {
+        uint32_t srtt = rtt->srtt_x8 / 8u;
+        uint32_t err = sample_ms > srtt ? sample_ms - srtt : srtt - sample_ms;
+
+        rtt->rttvar_x4 = rtt->rttvar_x4 - rtt->rttvar_x4 / 4u + err;
+        rtt->srtt_x8 = rtt->srtt_x8 - rtt->srtt_x8 / 8u + sample_ms;
+    }
+
+    ykb_protocol_arq_rtt_restore(rtt);
+}
+
+YKB_PROTOCOL_STATIC void
+ykb_protocol_arq_rtt_backoff(ykb_protocol_arq_rtt_t *rtt) {
+    rtt->rto_ms = rtt->rto_ms >= rtt->rto_max_ms / 2u ? rtt->rto_max_ms
+                                                      : rtt->rto_ms * 2u;
+}
+
+typedef struct {
+    ykb_protocol_tx_state_t tx;
+    ykb_protocol_arq_rtt_t *rtt;
+
+    uint8_t *acked;
+    size_t acked_size;
+
+    uint16_t window;
+    // Lowest packet not acknowledged yet
+    uint16_t base;
+    // Lowest packet never sent
+    uint16_t next_new;
+    // Packets in [resend_idx, resend_end) are retransmitted unless acked
+    uint16_t resend_idx;
+    uint16_t resend_end;
+
+    // Packet which carried the last ACK_REQ
+    uint16_t poll_idx;
+    uint32_t poll_sent_at;
+    bool poll_retransmitted;
+    bool awaiting_ack;
+    // Probe copies left to send
+    uint8_t probe;
+
+    uint8_t retries;
+    uint8_t max_retries;
+
+    bool complete;
+    bool failed;
+
+    // Statistics
+    uint16_t packets_sent;
+    uint16_t retransmissions;
+} ykb_protocol_arq_tx_t;
+
+YKB_PROTOCOL_STATIC bool ykb_protocol_arq_tx_init(
+    ykb_protocol_arq_tx_t *arq, const void *data, uint16_t total_len,
+    uint8_t transfer_id, uint8_t type_flags_base, uint8_t *acked,
+    size_t acked_size, uint16_t window, uint8_t max_retries,
+    ykb_protocol_arq_rtt_t *rtt) {
+    if (arq == NULL || acked == NULL || rtt == NULL || window == 0u ||
+        window > YKB_PROTOCOL_ACK_WINDOW_MAX) {
+        return false;
+    }
+
+    memset(arq, 0, sizeof(*arq));
+    ykb_protocol_tx_init(&arq->tx, data, total_len, transfer_id,
+                         type_flags_base);
+
+    if (acked_size < ykb_protocol_bitmap_size_bytes(arq->tx.packet_count)) {
+        return false;
+    }
+
+    // A backoff belongs to the transfer which timed out
+    ykb_protocol_arq_rtt_restore(rtt);
+    arq->rtt = rtt;
+    arq->acked = acked;
+    arq->acked_size = acked_size;
+    arq->window = window;
+    arq->max_retries = max_retries;
+    ykb_protocol_bitmap_clear_all(acked, acked_size);
+
+    return true;
+}
+
+YKB_PROTOCOL_STATIC bool
+ykb_protocol_arq_tx_is_done(const ykb_protocol_arq_tx_t *arq) {
+    return arq->complete || arq->failed;
+}
+
+// Moves resend_idx onto the next packet which still needs a retransmission
+YKB_PROTOCOL_STATIC bool
+ykb_protocol_arq_tx_resend_pending(ykb_protocol_arq_tx_t *arq) {
+    while (arq->resend_idx < arq->resend_end &&
+           ykb_protocol_bitmap_test(arq->acked, arq->resend_idx)) {
+        arq->resend_idx++;
+    }
+
+    return arq->resend_idx < arq->resend_end;
+}
+
+YKB_PROTOCOL_STATIC bool
+ykb_protocol_arq_tx_new_allowed(const ykb_protocol_arq_tx_t *arq) {
+    return arq->next_new < arq->tx.packet_count &&
+           (uint32_t)arq->next_new < (uint32_t)arq->base + arq->window;
+}
+
+// Checks the retransmission timeout, call before asking for packets
+YKB_PROTOCOL_STATIC void ykb_protocol_arq_tx_poll(ykb_protocol_arq_tx_t *arq,
+                                                  uint32_t now_ms) {
+    if (ykb_protocol_arq_tx_is_done(arq) || !arq->awaiting_ack) {
+        return;
+    }
+
+    if ((int32_t)(now_ms - arq->poll_sent_at) <
+        (int32_t)arq->rtt->rto_ms) {
+        return;
+    }
+
+    arq->awaiting_ack = false;
+    if (arq->retries >= arq->max_retries) {
+        arq->failed = true;
+        return;
+    }
+    arq->retries++;
+    ykb_protocol_arq_rtt_backoff(arq->rtt);
+    arq->probe = YKB_PROTOCOL_ARQ_PROBE_COPIES;
+}
+
+// Builds the next packet to send, if the window allows one. Returns false
+// while waiting for an ACK or once the transfer is done.
+YKB_PROTOCOL_STATIC bool
+ykb_protocol_arq_tx_next(ykb_protocol_arq_tx_t *arq, uint32_t now_ms,
+                         ykb_protocol_packet_t *out_packet) {
+    uint16_t idx;
+    bool retransmit = true;
+    bool ack_req;
+
+    if (arq == NULL || out_packet == NULL ||
+        ykb_protocol_arq_tx_is_done(arq)) {
+        return false;
+    }
+
+    if (arq->probe > 0u) {
+        arq->probe--;
+        idx = arq->base;
+        ack_req = true;
+    } else {
+        if (ykb_protocol_arq_tx_resend_pending(arq)) {
+            idx = arq->resend_idx++;
+        } else if (ykb_protocol_arq_tx_new_allowed(arq)) {
+            idx = arq->next_new++;
+            retransmit = false;
+        } else {
+            return false;
+        }
+
+        ack_req = !ykb_protocol_arq_tx_resend_pending(arq) &&
+                  !ykb_protocol_arq_tx_new_allowed(arq);
+    }
+
+    if (!ykb_protocol_tx_build_packet_at(
+            &arq->tx, idx, ack_req ? YKB_PROTOCOL_FLAG_ACK_REQ : 0u,
+            out_packet)) {
+        arq->failed = true;
+        return false;
+    }
+
+    arq->packets_sent++;
+    if (retransmit) {
+        arq->retransmissions++;
+    }
+
+    if (ack_req) {
+        arq->poll_idx = idx;
+        arq->poll_sent_at = now_ms;
+        arq->poll_retransmitted = retransmit;
+        arq->awaiting_ack = true;
+    }
+
+    return true;
+}
+
+// Milliseconds until the sender needs attention again: 0 when a packet can
+// go out now, UINT32_MAX when done
+YKB_PROTOCOL_STATIC uint32_t
+ykb_protocol_arq_tx_wait_ms(ykb_protocol_arq_tx_t *arq, uint32_t now_ms) {
+    if (ykb_protocol_arq_tx_is_done(arq)) {
+        return UINT32_MAX;
+    }
+
+    if (arq->probe > 0u || ykb_protocol_arq_tx_resend_pending(arq) ||
+        ykb_protocol_arq_tx_new_allowed(arq)) {
+        return 0u;
+    }
+
+    if (!arq->awaiting_ack) {
+        return UINT32_MAX;
+    }
+
+    int32_t left = (int32_t)(arq->poll_sent_at + arq->rtt->rto_ms - now_ms);
+
+    return left > 0 ? (uint32_t)left : 0u;
+}
+
+// Applies an ACK packet. Returns YKB_PROTOCOL_RX_RESULT_COMPLETE once every
+// packet is acknowledged, YKB_PROTOCOL_RX_RESULT_ACCEPTED otherwise, or a
+// negative error for ACKs of other transfers.
+YKB_PROTOCOL_STATIC ykb_protocol_rx_result_t
+ykb_protocol_arq_tx_on_ack(ykb_protocol_arq_tx_t *arq,
+                           const ykb_protocol_packet_t *packet,
+                           uint32_t now_ms) {
+    ykb_protocol_ack_header_t ack;
+    uint16_t old_base;
+    uint16_t window;
+
+    if (arq == NULL || packet == NULL) {
+        return YKB_PROTOCOL_RX_ERROR_NULL;
+    }
+
+    if (!ykb_protocol_is_header_valid(&packet->header) ||
+        ykb_protocol_get_type(packet->header.type_flags) !=
+            YKB_PROTOCOL_TYPE_ACK ||
+        packet->header.total_len < sizeof(ack)) {
+        return YKB_PROTOCOL_RX_ERROR_BAD_TYPE;
+    }
+
+    if (ykb_protocol_compute_packet_crc(packet) != packet->header.crc) {
+        return YKB_PROTOCOL_RX_ERROR_PACKET_CRC;
+    }
+
+    memcpy(&ack, packet->payload, sizeof(ack));
+
+    if (packet->header.transfer_id != arq->tx.transfer_id ||
+        (packet->header.type_flags & YKB_PROTOCOL_SEQ_MASK) !=
+            (arq->tx.type_flags_base & YKB_PROTOCOL_SEQ_MASK) ||
+        ack.total_len != arq->tx.total_len ||
+        ack.packet_count != arq->tx.packet_count ||
+        ack.base > arq->tx.packet_count) {
+        return YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH;
+    }
+
+    if (ykb_protocol_arq_tx_is_done(arq)) {
+        return arq->complete ? YKB_PROTOCOL_RX_RESULT_COMPLETE
+                             : YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH;
+    }
+
+    for (uint16_t i = arq->base; i < ack.base; i++) {
+        ykb_protocol_bitmap_set(arq->acked, i);
+    }
+
+    window = (uint16_t)((packet->header.total_len - sizeof(ack)) * 8u);
+    for (uint16_t n = 0u; n < window && ack.base + n < arq->tx.packet_count;
+         n++) {
+        if (ykb_protocol_bitmap_test(&packet->payload[sizeof(ack)], n)) {
+            ykb_protocol_bitmap_set(arq->acked, (uint16_t)(ack.base + n));
+        }
+    }
+
+    old_base = arq->base;
+    while (arq->base < arq->tx.packet_count &&
+           ykb_protocol_bitmap_test(arq->acked, arq->base)) {
+        arq->base++;
+    }
+
+    // New data got through, so the link works again. Karn keeps probes from
+    // sampling, so this is the only way down from a backed off RTO.
+    if (arq->base != old_base) {
+        ykb_protocol_arq_rtt_restore(arq->rtt);
+    }
+
+    // Nothing is sent between an ACK_REQ packet and its ACK or timeout, so
+    // an ACK which saw it tells every packet missing by now was lost
+    if (arq->awaiting_ack &&
+        (ack.base > arq->poll_idx ||
+         ykb_protocol_bitmap_test(arq->acked, arq->poll_idx))) {
+        // Karn: a retransmitted poll gives no usable sample
+        if (!arq->poll_retransmitted) {
+            ykb_protocol_arq_rtt_sample(arq->rtt, now_ms - arq->poll_sent_at);
+        }
+        arq->awaiting_ack = false;
+        arq->probe = 0u;
+        arq->retries = 0u;
+        arq->resend_idx = arq->base;
+        arq->resend_end = arq->next_new;
+    }
+
+    if (arq->base == arq->tx.packet_count) {
+        arq->complete = true;
+        arq->awaiting_ack = false;
+        return YKB_PROTOCOL_RX_RESULT_COMPLETE;
+    }
+
+    return YKB_PROTOCOL_RX_RESULT_ACCEPTED;
+}
+
+// Tells whether packet, received with length len, is an intact packet of
+// the regular framing
+YKB_PROTOCOL_STATIC bool
+ykb_protocol_packet_is_valid(const ykb_protocol_packet_t *packet, size_t len) {
+    if (packet == NULL || len < YKB_PROTOCOL_HEADER_SIZE) {
+        return false;
+    }
+
+    if (!ykb_protocol_is_header_valid(&packet->header)) {
+        return false;
+    }
+
+    if (len < (size_t)YKB_PROTOCOL_HEADER_SIZE +
+                  ykb_protocol_payload_len_for_index(
+                      packet->header.total_len, packet->header.packet_idx,
+                      packet->header.packet_count)) {
+        return false;
+    }
+
+    return ykb_protocol_compute_packet_crc(packet) == packet->header.crc;
+}
+
+YKB_PROTOCOL_STATIC uint16_t
+ykb_protocol_compact_calc_packet_count(uint16_t total_len) {
+    if (total_len <= YKB_PROTOCOL_COMPACT_START_PAYLOAD_SIZE) {
+        return 1u;
+    }
+
+    uint16_t rest =
+        (uint16_t)(total_len - YKB_PROTOCOL_COMPACT_START_PAYLOAD_SIZE);
+
+    return (uint16_t)(1u + (rest + YKB_PROTOCOL_COMPACT_PAYLOAD_SIZE - 1u) /
+                               YKB_PROTOCOL_COMPACT_PAYLOAD_SIZE);
+}
+
+YKB_PROTOCOL_STATIC void
+ykb_protocol_compact_tx_init(ykb_protocol_tx_state_t *tx, const void *data,
+                             uint16_t total_len, uint8_t transfer_id,
+                             uint8_t type_flags_base) {
+    if (tx == NULL) {
+        return;
+    }
+
+    ykb_protocol_tx_init(tx, data, total_len, transfer_id, type_flags_base);
+    tx->packet_count = ykb_protocol_compact_calc_packet_count(total_len);
+}
+
+// Builds the next packet into out, which must hold
+// YKB_PROTOCOL_MAX_PACKET_SIZE bytes. Returns the packet length, 0 once the
+// transfer is done.
+YKB_PROTOCOL_STATIC uint16_t
+ykb_protocol_compact_tx_build_packet(ykb_protocol_tx_state_t *tx,
+                                     uint8_t *out) {
+    ykb_protocol_compact_header_t header;
+    uint16_t header_len;
+    uint16_t payload_len;
+    uint16_t capacity;
+
+    if (tx == NULL || out == NULL || !ykb_protocol_tx_has_more(tx)) {
+        return 0u;
+    }
+
+    header.type_flags = tx->type_flags_base;
+    header.transfer_id = tx->transfer_id;
+
+    if (tx->next_packet_idx == 0u) {
+        ykb_protocol_compact_start_header_t start = {
+            .header = header,
+            .total_len = tx->total_len,
+            .crc = ykb_protocol_crc16(tx->data, tx->total_len),
+        };
+
+        start.header.type_flags |= YKB_PROTOCOL_FLAG_START;
+        header = start.header;
+        memcpy(out, &start, sizeof(start));
+        header_len = sizeof(start);
+        capacity = YKB_PROTOCOL_COMPACT_START_PAYLOAD_SIZE;
+    } else {
+        header_len = sizeof(header);
+        capacity = YKB_PROTOCOL_COMPACT_PAYLOAD_SIZE;
+    }
+
+    payload_len = (uint16_t)(tx->total_len - tx->offset);
+    if (payload_len > capacity) {
+        payload_len = capacity;
+    }
+
+    if (tx->next_packet_idx == (uint16_t)(tx->packet_count - 1u)) {
+        header.type_flags |= YKB_PROTOCOL_FLAG_END;
+    }
+    // type_flags leads both header layouts
+    out[0] = header.type_flags;
+
+    if (payload_len > 0u && tx->data != NULL) {
+        memcpy(&out[header_len], &tx->data[tx->offset], payload_len);
+    }
+
+    tx->offset = (uint16_t)(tx->offset + payload_len);
+    tx->next_packet_idx++;
+
+    return (uint16_t)(header_len + payload_len);
+}
+
+// In-order counterpart of ykb_protocol_compact_tx_build_packet(). A START
+// packet always begins a new transfer, dropping an unfinished one.
+YKB_PROTOCOL_STATIC ykb_protocol_rx_result_t
+ykb_protocol_compact_rx_push_packet(ykb_protocol_rx_state_t *rx,
+                                    const uint8_t *data, size_t len) {
+    ykb_protocol_compact_header_t header;
+    size_t header_len;
+    uint16_t payload_len;
+    uint16_t capacity;
+
+    if (rx == NULL || data == NULL) {
+        return YKB_PROTOCOL_RX_ERROR_NULL;
+    }
+
+    if (len < sizeof(header)) {
+        return YKB_PROTOCOL_RX_ERROR_BAD_TOTAL_LEN;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (ykb_protocol_get_type(header.type_flags) != YKB_PROTOCOL_TYPE_DATA) {
+        return YKB_PROTOCOL_RX_ERROR_BAD_TYPE;
+    }
+
+    if (ykb_protocol_has_flag(header.type_flags, YKB_PROTOCOL_FLAG_START)) {
+        ykb_protocol_compact_start_header_t start;
+
+        if (len < sizeof(start)) {
+            return YKB_PROTOCOL_RX_ERROR_BAD_TOTAL_LEN;
+        }
+        memcpy(&start, data, sizeof(start));
+
+        ykb_protocol_rx_reset(rx);
+        if (start.total_len > rx->capacity) {
+            return YKB_PROTOCOL_RX_ERROR_BUFFER_TOO_SMALL;
+        }
+
+        rx->active = true;
+        rx->transfer_id = header.transfer_id;
+        rx->total_len = start.total_len;
+        rx->checksum = start.crc;
+        rx->packet_count =
+            ykb_protocol_compact_calc_packet_count(start.total_len);
+        rx->type_flags_base = (uint8_t)(header.type_flags &
+                                        (uint8_t)~YKB_PROTOCOL_PACKET_FLAGS);
+
+        header_len = sizeof(start);
+        capacity = YKB_PROTOCOL_COMPACT_START_PAYLOAD_SIZE;
+    } else {
+        if (!rx->active || rx->complete) {
+            return YKB_PROTOCOL_RX_ERROR_OUT_OF_ORDER;
+        }
+
+        if (rx->transfer_id != header.transfer_id ||
+            rx->type_flags_base !=
+                (uint8_t)(header.type_flags &
+                          (uint8_t)~YKB_PROTOCOL_PACKET_FLAGS)) {
+            return YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH;
+        }
+
+        header_len = sizeof(header);
+        capacity = YKB_PROTOCOL_COMPACT_PAYLOAD_SIZE;
+    }
+
+    payload_len = (uint16_t)(rx->total_len - rx->received_bytes);
+    if (payload_len > capacity) {
+        payload_len = capacity;
+    }
+
+    if (len < header_len + payload_len) {
+        return YKB_PROTOCOL_RX_ERROR_BAD_TOTAL_LEN;
+    }
+
+    if (payload_len > 0u) {
+        memcpy(&rx->buffer[rx->received_bytes], &data[header_len],
+               payload_len);
+    }
+
+    rx->received_bytes = (uint16_t)(rx->received_bytes + payload_len);
+    rx->received_count++;
+    rx->next_expected_packet_idx++;
+
+    if (rx->received_count < rx->packet_count) {
+        return YKB_PROTOCOL_RX_RESULT_ACCEPTED;
+    }
+
+    if (!ykb_protocol_has_flag(header.type_flags, YKB_PROTOCOL_FLAG_END)) {
+        return YKB_PROTOCOL_RX_ERROR_BAD_PACKET_COUNT;
+    }
+
+    if (ykb_protocol_crc16(rx->buffer, rx->total_len) != rx->checksum) {
+        return YKB_PROTOCOL_RX_ERROR_PACKET_CRC;
+    }
+
+    rx->complete = true;
+    return YKB_PROTOCOL_RX_RESULT_COMPLETE;
+}
+
 #endif // YKB_PROTOCOL_H
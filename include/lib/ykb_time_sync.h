@@ -0,0 +1,235 @@
+#ifndef YKB_TIME_SYNC_H
+#define YKB_TIME_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Maps timestamps of the other half onto the local clock.
+//
+// Every transfer carries the remote time it was sent at. Its delay, local
+// arrival time minus remote send time, is the clock offset plus the time the
+// transfer spent in queues and on air. The fastest transfer of a window only
+// carries the offset and the shortest possible trip, so the lowest delay of
+// every window is kept and a line is fitted through the last
+// YKB_TIME_SYNC_POINTS of them. Its slope is the drift between the crystals
+// of both halves, queueing noise above the lower envelope does not move it.
+//
+// Mapped times are early by the shortest trip, which is the same for every
+// transfer. Latencies are therefore reported above the fastest transfer,
+// which is what tells a delayed transfer from a fresh one.
+//
+// Times are in µs and wrap at 32 bits, differences must stay below 2^31.
+//
+// No Zephyr dependencies, so recorded timestamps can be replayed on a host.
+
+#ifndef YKB_TIME_SYNC_STATIC
+#define YKB_TIME_SYNC_STATIC static inline
+#endif
+
+#define YKB_TIME_SYNC_POINTS 8
+#define YKB_TIME_SYNC_BUCKETS 16
+// Latencies below this go into the first histogram bucket, every further
+// bucket doubles the limit
+#define YKB_TIME_SYNC_BUCKET0_US 128U
+// A delay this far off the fitted line means the other half restarted
+#define YKB_TIME_SYNC_RESET_US 1000000
+// Drift beyond this is noise of a fit over too short a time
+#define YKB_TIME_SYNC_MAX_DRIFT_PPB 1000000
+
+typedef struct {
+    // Length of the windows the lowest delay is taken from
+    uint32_t window_us;
+    // Transfers arriving later than this count as stale
+    uint32_t stale_us;
+} ykb_time_sync_config_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t stale;
+    // Restarts of the other half detected from its timestamps
+    uint32_t resets;
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    // Bucket i counts latencies below YKB_TIME_SYNC_BUCKET0_US << i, the
+    // last bucket also everything above
+    uint32_t latency_hist[YKB_TIME_SYNC_BUCKETS];
+} ykb_time_sync_stats_t;
+
+typedef struct {
+    uint32_t remote_us;
+    uint32_t delay_us;
+} ykb_time_sync_point_t;
+
+typedef struct {
+    ykb_time_sync_config_t config;
+    ykb_time_sync_stats_t stats;
+
+    // Lowest delay of the running window
+    ykb_time_sync_point_t window_min;
+    uint32_t window_start_us;
+    bool window_open;
+
+    // Window minima, oldest first once the ring wrapped
+    ykb_time_sync_point_t points[YKB_TIME_SYNC_POINTS];
+    uint8_t point_count;
+    uint8_t point_next;
+
+    // Fitted line, the delay at ref_remote_us and its slope
+    bool synced;
+    uint32_t ref_remote_us;
+    uint32_t ref_delay_us;
+    int32_t drift_ppb;
+} ykb_time_sync_t;
+
+typedef struct {
+    // Send time mapped onto the local clock
+    uint32_t sent_us;
+    uint32_t latency_us;
+    bool stale;
+} ykb_time_sync_result_t;
+
+YKB_TIME_SYNC_STATIC void
+ykb_time_sync_init(ykb_time_sync_t *ts, const ykb_time_sync_config_t *config) {
+    *ts = (ykb_time_sync_t){
+        .config = *config,
+        .stats.latency_min_us = UINT32_MAX,
+    };
+}
+
+// Forgets the estimate but keeps the stats, e.g. on disconnect
+YKB_TIME_SYNC_STATIC void ykb_time_sync_reset(ykb_time_sync_t *ts) {
+    ykb_time_sync_stats_t stats = ts->stats;
+    ykb_time_sync_config_t config = ts->config;
+
+    ykb_time_sync_init(ts, &config);
+    ts->stats = stats;
+}
+
+YKB_TIME_SYNC_STATIC uint32_t
+ykb_time_sync_delay(const ykb_time_sync_t *ts, uint32_t remote_us) {
+    int64_t elapsed = (int32_t)(remote_us - ts->ref_remote_us);
+
+    return ts->ref_delay_us +
+           (uint32_t)(int32_t)(elapsed * ts->drift_ppb / 1000000000);
+}
+
+YKB_TIME_SYNC_STATIC uint32_t
+ykb_time_sync_to_local(const ykb_time_sync_t *ts, uint32_t remote_us) {
+    return remote_us + ykb_time_sync_delay(ts, remote_us);
+}
+
+// Least squares line through the window minima, relative to the newest one
+YKB_TIME_SYNC_STATIC void ykb_time_sync_fit(ykb_time_sync_t *ts) {
+    const ykb_time_sync_point_t *ref =
+        &ts->points[(ts->point_next + YKB_TIME_SYNC_POINTS - 1U) %
+                    YKB_TIME_SYNC_POINTS];
+    double sx = 0, sd = 0, sxx = 0, sxd = 0;
+    double n = ts->point_count;
+
+    for (uint8_t i = 0; i < ts->point_count; ++i) {
+        double x = (int32_t)(ts->points[i].remote_us - ref->remote_us);
+        double d = (int32_t)(ts->points[i].delay_us - ref->delay_us);
+
+        sx += x;
+        sd += d;
+        sxx += x * x;
+        sxd += x * d;
+    }
+
+    double var = n * sxx - sx * sx;
+    double slope = var > 0 ? (n * sxd - sx * sd) / var : 0;
+    double drift = slope * 1e9;
+
+    if (drift > YKB_TIME_SYNC_MAX_DRIFT_PPB) {
+        drift = YKB_TIME_SYNC_MAX_DRIFT_PPB;
+    } else if (drift < -YKB_TIME_SYNC_MAX_DRIFT_PPB) {
+        drift = -YKB_TIME_SYNC_MAX_DRIFT_PPB;
+    }
+
+    // Line at the newest point, which the next transfers are closest to
+    double offset = (sd - slope * sx) / n;
+
+    ts->ref_remote_us = ref->remote_us;
+    ts->ref_delay_us = ref->delay_us + (uint32_t)(int32_t)offset;
+    ts->drift_ppb = (int32_t)drift;
+    ts->synced = true;
+}
+
+YKB_TIME_SYNC_STATIC void ykb_time_sync_push_point(ykb_time_sync_t *ts) {
+    ts->points[ts->point_next] = ts->window_min;
+    ts->point_next = (ts->point_next + 1U) % YKB_TIME_SYNC_POINTS;
+    if (ts->point_count < YKB_TIME_SYNC_POINTS) {
+        ts->point_count++;
+    }
+    ykb_time_sync_fit(ts);
+}
+
+YKB_TIME_SYNC_STATIC uint8_t ykb_time_sync_bucket(uint32_t latency_us) {
+    uint8_t bucket = 0;
+
+    for (uint32_t limit = YKB_TIME_SYNC_BUCKET0_US;
+         latency_us >= limit && bucket < YKB_TIME_SYNC_BUCKETS - 1U;
+         limit <<= 1) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+// Feeds a transfer sent at remote_us which arrived at local_us
+YKB_TIME_SYNC_STATIC void ykb_time_sync_sample(ykb_time_sync_t *ts,
+                                               uint32_t remote_us,
+                                               uint32_t local_us,
+                                               ykb_time_sync_result_t *out) {
+    uint32_t delay = local_us - remote_us;
+
+    if (ts->synced) {
+        int32_t off = (int32_t)(delay - ykb_time_sync_delay(ts, remote_us));
+
+        if (off > YKB_TIME_SYNC_RESET_US || off < -YKB_TIME_SYNC_RESET_US) {
+            ykb_time_sync_reset(ts);
+            ts->stats.resets++;
+        }
+    }
+
+    if (!ts->window_open) {
+        ts->window_open = true;
+        ts->window_start_us = local_us;
+        ts->window_min = (ykb_time_sync_point_t){remote_us, delay};
+    } else if ((int32_t)(delay - ts->window_min.delay_us) < 0) {
+        ts->window_min = (ykb_time_sync_point_t){remote_us, delay};
+    }
+
+    if (ts->point_count == 0U) {
+        // Nothing fitted yet, go with the lowest delay so far
+        ts->ref_remote_us = ts->window_min.remote_us;
+        ts->ref_delay_us = ts->window_min.delay_us;
+        ts->synced = true;
+    }
+    if ((int32_t)(local_us - ts->window_start_us) >=
+        (int32_t)ts->config.window_us) {
+        ykb_time_sync_push_point(ts);
+        ts->window_open = false;
+    }
+
+    out->sent_us = ykb_time_sync_to_local(ts, remote_us);
+    int32_t latency = (int32_t)(local_us - out->sent_us);
+    out->latency_us = latency > 0 ? (uint32_t)latency : 0U;
+    out->stale = out->latency_us > ts->config.stale_us;
+
+    ykb_time_sync_stats_t *stats = &ts->stats;
+
+    stats->samples++;
+    if (out->stale) {
+        stats->stale++;
+    }
+    if (out->latency_us < stats->latency_min_us) {
+        stats->latency_min_us = out->latency_us;
+    }
+    if (out->latency_us > stats->latency_max_us) {
+        stats->latency_max_us = out->latency_us;
+    }
+    stats->latency_hist[ykb_time_sync_bucket(out->latency_us)]++;
+}
+
+#endif // YKB_TIME_SYNC_H
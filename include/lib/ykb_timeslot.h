@@ -1,9 +1,22 @@
 #ifndef __LIB_YKB_TIMESLOT_H_
 #define __LIB_YKB_TIMESLOT_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <lib/ykb_timeslot_policy.h>
+
 typedef enum { APP_TS_STARTED, APP_TS_STOPPED } timeslot_callback_type_t;
 typedef void (*timeslot_callback_t)(timeslot_callback_type_t type);
 
-void timeslot_handler_init(timeslot_callback_t callback);
+// A receiver keeps its slots extended while idle, see ykb_timeslot_policy.h
+void timeslot_handler_init(timeslot_callback_t callback, bool receiver);
+
+// Inputs of the slot sizing policy, safe to call from any context
+void timeslot_handler_report_pending(uint16_t pending);
+void timeslot_handler_report_activity(void);
+void timeslot_handler_set_ble_interval(uint32_t interval_us);
+
+void timeslot_handler_get_stats(ykb_timeslot_policy_stats_t *stats);
 
 #endif // __LIB_YKB_TIMESLOT_H_
@@ -0,0 +1,196 @@
+#ifndef YKB_TIMESLOT_POLICY_H
+#define YKB_TIMESLOT_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sizing of the MPSL timeslots the split link radio runs in.
+//
+// The radio shares the net core with the BLE controller. A slot kept
+// extended while nothing moves takes air time from BLE, a slot that is too
+// short or comes too rarely delays the split link. Near the end of every slot
+// the policy looks at the ESB demand, the split link latency target and the
+// BLE connection interval and decides how long the next slot is, whether it
+// follows right away as an extension or after a gap as a new request, and at
+// which priority it is requested.
+//
+// While payloads move the slot is extended, back to back slots cost no
+// request overhead. Once the link went idle the next slot follows after a
+// gap. A receiver has no say in when its peer sends, so a policy configured
+// to keep listening extends its slots regardless and only BLE takes the
+// radio from it.
+//
+// No Zephyr dependencies, so policies can be replayed on a host.
+
+#ifndef YKB_TIMESLOT_POLICY_STATIC
+#define YKB_TIMESLOT_POLICY_STATIC static inline
+#endif
+
+typedef struct {
+    // Shortest and longest slot or extension
+    uint32_t min_length_us;
+    uint32_t max_length_us;
+    // Air time of one queued payload, including retransmits and ACK
+    uint32_t payload_us;
+    // Longest the radio stays off while the link is idle
+    uint32_t latency_target_us;
+    // Air time left to BLE within every connection interval
+    uint32_t ble_margin_us;
+    // Idle slots after which the slot is not extended any more
+    uint8_t idle_slots;
+    // Extend even while idle, for a receiver which must be listening
+    // whenever its peer sends
+    bool keep_listening;
+    // Failed requests in a row after which slots are requested at high
+    // priority, 0 never escalates
+    uint8_t escalate_after;
+} ykb_timeslot_policy_config_t;
+
+typedef struct {
+    // Payloads waiting to be sent
+    uint16_t pending;
+    // Payloads sent or received since the previous decision
+    uint16_t activity;
+    // BLE connection interval, 0 without a connection
+    uint32_t ble_interval_us;
+} ykb_timeslot_policy_input_t;
+
+typedef struct {
+    uint32_t length_us;
+    // Extend the running slot, otherwise end it and request the next one
+    bool extend;
+    // Radio off time between the end of this slot and the next, 0 requests
+    // the next slot as early as possible
+    uint32_t gap_us;
+    bool high_priority;
+} ykb_timeslot_policy_decision_t;
+
+typedef struct {
+    uint32_t granted;
+    uint32_t extended;
+    // Failed extensions and blocked or cancelled requests
+    uint32_t failed;
+    // Radio time held, and the part of it in which payloads moved
+    uint64_t granted_us;
+    uint64_t busy_us;
+} ykb_timeslot_policy_stats_t;
+
+typedef struct {
+    ykb_timeslot_policy_config_t config;
+    ykb_timeslot_policy_stats_t stats;
+    // Slot or extension running right now
+    uint32_t length_us;
+    uint8_t idle_slots;
+    uint8_t failed_requests;
+} ykb_timeslot_policy_t;
+
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_init(ykb_timeslot_policy_t *policy,
+                         const ykb_timeslot_policy_config_t *config) {
+    *policy = (ykb_timeslot_policy_t){
+        .config = *config,
+        .length_us = config->min_length_us,
+    };
+}
+
+// Long enough for the queued payloads, short enough to leave BLE a gap in
+// every connection interval
+YKB_TIMESLOT_POLICY_STATIC uint32_t
+ykb_timeslot_policy_length(const ykb_timeslot_policy_t *policy,
+                           const ykb_timeslot_policy_input_t *in) {
+    const ykb_timeslot_policy_config_t *cfg = &policy->config;
+    uint32_t length =
+        cfg->min_length_us + (uint32_t)in->pending * cfg->payload_us;
+
+    if (length > cfg->max_length_us) {
+        length = cfg->max_length_us;
+    }
+
+    if (in->ble_interval_us > cfg->ble_margin_us &&
+        length > in->ble_interval_us - cfg->ble_margin_us) {
+        length = in->ble_interval_us - cfg->ble_margin_us;
+    }
+
+    return length < cfg->min_length_us ? cfg->min_length_us : length;
+}
+
+YKB_TIMESLOT_POLICY_STATIC bool
+ykb_timeslot_policy_escalated(const ykb_timeslot_policy_t *policy) {
+    return policy->config.escalate_after != 0u &&
+           policy->failed_requests >= policy->config.escalate_after;
+}
+
+// Called near the end of every slot or extension
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_decide(ykb_timeslot_policy_t *policy,
+                           const ykb_timeslot_policy_input_t *in,
+                           ykb_timeslot_policy_decision_t *out) {
+    if (in->activity != 0u) {
+        policy->stats.busy_us += policy->length_us;
+    }
+
+    if (in->activity != 0u || in->pending != 0u) {
+        policy->idle_slots = 0u;
+    } else if (policy->idle_slots < UINT8_MAX) {
+        policy->idle_slots++;
+    }
+
+    out->length_us = ykb_timeslot_policy_length(policy, in);
+    out->extend = policy->config.keep_listening ||
+                  policy->idle_slots < policy->config.idle_slots;
+    out->gap_us = out->extend ? 0u : policy->config.latency_target_us;
+    out->high_priority = ykb_timeslot_policy_escalated(policy);
+}
+
+// Request made outside of a slot, e.g. after one was blocked
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_request(const ykb_timeslot_policy_t *policy,
+                            const ykb_timeslot_policy_input_t *in,
+                            ykb_timeslot_policy_decision_t *out) {
+    out->length_us = ykb_timeslot_policy_length(policy, in);
+    out->extend = false;
+    out->gap_us = 0u;
+    out->high_priority = ykb_timeslot_policy_escalated(policy);
+}
+
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_on_granted(ykb_timeslot_policy_t *policy,
+                               uint32_t length_us) {
+    policy->stats.granted++;
+    policy->stats.granted_us += length_us;
+    policy->length_us = length_us;
+    policy->failed_requests = 0u;
+}
+
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_on_extended(ykb_timeslot_policy_t *policy,
+                                uint32_t length_us) {
+    policy->stats.extended++;
+    policy->stats.granted_us += length_us;
+    policy->length_us = length_us;
+}
+
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_on_extend_failed(ykb_timeslot_policy_t *policy) {
+    policy->stats.failed++;
+}
+
+YKB_TIMESLOT_POLICY_STATIC void
+ykb_timeslot_policy_on_request_failed(ykb_timeslot_policy_t *policy) {
+    policy->stats.failed++;
+    if (policy->failed_requests < UINT8_MAX) {
+        policy->failed_requests++;
+    }
+}
+
+// Share of the held radio time in which payloads moved, in permille
+YKB_TIMESLOT_POLICY_STATIC uint16_t
+ykb_timeslot_policy_utilization(const ykb_timeslot_policy_stats_t *stats) {
+    if (stats->granted_us == 0u) {
+        return 0u;
+    }
+
+    return (uint16_t)(stats->busy_us * 1000u / stats->granted_us);
+}
+
+#endif // YKB_TIMESLOT_POLICY_H
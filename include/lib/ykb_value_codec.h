@@ -0,0 +1,350 @@
+#ifndef YKB_VALUE_CODEC_H
+#define YKB_VALUE_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Compact encoding of a stream of key value sweeps.
+//
+// Every frame starts with a two byte header. A keyframe carries all values,
+// a delta frame carries a change bitmap with one bit per key followed by the
+// values of the keys marked in it. Values are packed to 10 bits, LSB first.
+//
+// keyframe: [flags][seq][packed values of all keys]
+// delta   : [flags][seq][bitmap][packed values of changed keys]
+//
+// A key goes into a delta once its value moved more than the dead band away
+// from the value the decoder last got. Sequence numbers only advance on
+// frames which are actually produced, the decoder drops deltas after a gap
+// until the next keyframe brings it back in sync.
+
+#define YKB_VALUE_CODEC_VALUE_BITS 10U
+#define YKB_VALUE_CODEC_VALUE_MAX ((1U << YKB_VALUE_CODEC_VALUE_BITS) - 1U)
+
+#define YKB_VALUE_CODEC_FLAG_KEYFRAME 0x01u
+
+#ifdef __GNUC__
+#define YKB_VALUE_CODEC_PACKED __attribute__((__packed__))
+#elif defined(_MSC_VER)
+#define YKB_VALUE_CODEC_PACKED
+#pragma pack(push, 1)
+#else
+#define YKB_VALUE_CODEC_PACKED
+#endif
+
+#ifndef YKB_VALUE_CODEC_STATIC
+#define YKB_VALUE_CODEC_STATIC static inline
+#endif
+
+typedef struct YKB_VALUE_CODEC_PACKED {
+    uint8_t flags;
+    uint8_t seq;
+} ykb_value_codec_header_t;
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
+#define YKB_VALUE_CODEC_HEADER_SIZE ((uint16_t)sizeof(ykb_value_codec_header_t))
+#define YKB_VALUE_CODEC_BITMAP_SIZE(count) (((count) + 7U) / 8U)
+#define YKB_VALUE_CODEC_PACKED_SIZE(count)                                     \
+    (((count) * YKB_VALUE_CODEC_VALUE_BITS + 7U) / 8U)
+#define YKB_VALUE_CODEC_KEYFRAME_SIZE(count)                                   \
+    (YKB_VALUE_CODEC_HEADER_SIZE + YKB_VALUE_CODEC_PACKED_SIZE(count))
+// Largest frame for the given key count, a delta with every key changed
+#define YKB_VALUE_CODEC_MAX_SIZE(count)                                        \
+    (YKB_VALUE_CODEC_HEADER_SIZE + YKB_VALUE_CODEC_BITMAP_SIZE(count) +        \
+     YKB_VALUE_CODEC_PACKED_SIZE(count))
+
+typedef enum {
+    YKB_VALUE_CODEC_ERROR_NULL = -1,
+    YKB_VALUE_CODEC_ERROR_BUFFER_TOO_SMALL = -2,
+    YKB_VALUE_CODEC_ERROR_BAD_LENGTH = -3,
+    YKB_VALUE_CODEC_ERROR_BAD_BITMAP = -4,
+    YKB_VALUE_CODEC_ERROR_NOT_SYNCED = -5,
+    YKB_VALUE_CODEC_ERROR_SEQ_GAP = -6,
+} ykb_value_codec_error_t;
+
+typedef struct {
+    // Values as the decoder knows them
+    uint16_t *ref;
+    uint16_t count;
+    uint16_t deadband;
+    // Sweeps between keyframes, 0 sends keyframes only when forced
+    uint16_t keyframe_interval;
+    uint16_t since_keyframe;
+    uint8_t seq;
+    bool keyframe_pending;
+} ykb_value_codec_encoder_t;
+
+typedef struct {
+    uint16_t *values;
+    uint16_t count;
+    uint8_t seq;
+    bool synced;
+} ykb_value_codec_decoder_t;
+
+typedef struct {
+    uint8_t *data;
+    uint16_t pos;
+    uint32_t acc;
+    uint8_t bits;
+} ykb_value_codec_writer_t;
+
+typedef struct {
+    const uint8_t *data;
+    uint16_t len;
+    uint16_t pos;
+    uint32_t acc;
+    uint8_t bits;
+} ykb_value_codec_reader_t;
+
+YKB_VALUE_CODEC_STATIC void
+ykb_value_codec_write(ykb_value_codec_writer_t *w, uint16_t value) {
+    w->acc |= (uint32_t)(value & YKB_VALUE_CODEC_VALUE_MAX) << w->bits;
+    w->bits += YKB_VALUE_CODEC_VALUE_BITS;
+    while (w->bits >= 8u) {
+        w->data[w->pos++] = (uint8_t)w->acc;
+        w->acc >>= 8u;
+        w->bits -= 8u;
+    }
+}
+
+YKB_VALUE_CODEC_STATIC void
+ykb_value_codec_write_flush(ykb_value_codec_writer_t *w) {
+    if (w->bits > 0u) {
+        w->data[w->pos++] = (uint8_t)w->acc;
+        w->acc = 0u;
+        w->bits = 0u;
+    }
+}
+
+YKB_VALUE_CODEC_STATIC bool ykb_value_codec_read(ykb_value_codec_reader_t *r,
+                                                 uint16_t *value) {
+    while (r->bits < YKB_VALUE_CODEC_VALUE_BITS) {
+        if (r->pos >= r->len) {
+            return false;
+        }
+        r->acc |= (uint32_t)r->data[r->pos++] << r->bits;
+        r->bits += 8u;
+    }
+
+    *value = (uint16_t)(r->acc & YKB_VALUE_CODEC_VALUE_MAX);
+    r->acc >>= YKB_VALUE_CODEC_VALUE_BITS;
+    r->bits -= YKB_VALUE_CODEC_VALUE_BITS;
+
+    return true;
+}
+
+YKB_VALUE_CODEC_STATIC void
+ykb_value_codec_encoder_init(ykb_value_codec_encoder_t *enc, uint16_t *ref,
+                             uint16_t count, uint16_t deadband,
+                             uint16_t keyframe_interval) {
+    if (enc == NULL || ref == NULL) {
+        return;
+    }
+
+    memset(enc, 0, sizeof(*enc));
+    memset(ref, 0, count * sizeof(uint16_t));
+    enc->ref = ref;
+    enc->count = count;
+    enc->deadband = deadband;
+    enc->keyframe_interval = keyframe_interval;
+    enc->keyframe_pending = true;
+}
+
+// Makes the next frame a keyframe, e.g. after a frame could not be sent
+YKB_VALUE_CODEC_STATIC void
+ykb_value_codec_encoder_resync(ykb_value_codec_encoder_t *enc) {
+    if (enc != NULL) {
+        enc->keyframe_pending = true;
+    }
+}
+
+// Encodes one sweep of values into out. Returns the frame length, 0 if no
+// key changed enough to be worth a frame, or a negative error.
+YKB_VALUE_CODEC_STATIC int
+ykb_value_codec_encode(ykb_value_codec_encoder_t *enc, const uint16_t *values,
+                       uint8_t *out, uint16_t out_size) {
+    if (enc == NULL || enc->ref == NULL || values == NULL || out == NULL) {
+        return YKB_VALUE_CODEC_ERROR_NULL;
+    }
+
+    if (out_size < YKB_VALUE_CODEC_MAX_SIZE(enc->count)) {
+        return YKB_VALUE_CODEC_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    enc->since_keyframe++;
+    if (enc->keyframe_interval != 0u &&
+        enc->since_keyframe >= enc->keyframe_interval) {
+        enc->keyframe_pending = true;
+    }
+
+    ykb_value_codec_writer_t w = {.data = out};
+    ykb_value_codec_header_t *header = (ykb_value_codec_header_t *)out;
+    w.pos = YKB_VALUE_CODEC_HEADER_SIZE;
+
+    if (enc->keyframe_pending) {
+        for (uint16_t i = 0u; i < enc->count; i++) {
+            uint16_t v = values[i] > YKB_VALUE_CODEC_VALUE_MAX
+                             ? YKB_VALUE_CODEC_VALUE_MAX
+                             : values[i];
+            enc->ref[i] = v;
+            ykb_value_codec_write(&w, v);
+        }
+        ykb_value_codec_write_flush(&w);
+
+        header->flags = YKB_VALUE_CODEC_FLAG_KEYFRAME;
+        enc->keyframe_pending = false;
+        enc->since_keyframe = 0u;
+    } else {
+        uint8_t *bitmap = &out[w.pos];
+        uint16_t changed = 0u;
+
+        memset(bitmap, 0, YKB_VALUE_CODEC_BITMAP_SIZE(enc->count));
+        w.pos += YKB_VALUE_CODEC_BITMAP_SIZE(enc->count);
+
+        for (uint16_t i = 0u; i < enc->count; i++) {
+            uint16_t v = values[i] > YKB_VALUE_CODEC_VALUE_MAX
+                             ? YKB_VALUE_CODEC_VALUE_MAX
+                             : values[i];
+            uint16_t diff =
+                v > enc->ref[i] ? v - enc->ref[i] : enc->ref[i] - v;
+
+            if (diff <= enc->deadband) {
+                continue;
+            }
+            enc->ref[i] = v;
+            bitmap[i / 8u] |= (uint8_t)(1u << (i % 8u));
+            ykb_value_codec_write(&w, v);
+            changed++;
+        }
+
+        if (changed == 0u) {
+            return 0;
+        }
+        ykb_value_codec_write_flush(&w);
+
+        header->flags = 0u;
+    }
+
+    header->seq = enc->seq++;
+
+    return w.pos;
+}
+
+YKB_VALUE_CODEC_STATIC void
+ykb_value_codec_decoder_init(ykb_value_codec_decoder_t *dec, uint16_t *values,
+                             uint16_t count) {
+    if (dec == NULL || values == NULL) {
+        return;
+    }
+
+    memset(dec, 0, sizeof(*dec));
+    memset(values, 0, count * sizeof(uint16_t));
+    dec->values = values;
+    dec->count = count;
+}
+
+// Drops the reconstructed values, deltas are ignored until a keyframe
+YKB_VALUE_CODEC_STATIC void
+ykb_value_codec_decoder_reset(ykb_value_codec_decoder_t *dec) {
+    if (dec == NULL || dec->values == NULL) {
+        return;
+    }
+
+    memset(dec->values, 0, dec->count * sizeof(uint16_t));
+    dec->synced = false;
+}
+
+// Applies one frame to the decoder values. Keys whose value changed are
+// marked in the optional changed bitmap, which is cleared first. Returns the
+// amount of changed keys or a negative error, values are left untouched on
+// error.
+YKB_VALUE_CODEC_STATIC int
+ykb_value_codec_decode(ykb_value_codec_decoder_t *dec, const uint8_t *data,
+                       uint16_t len, uint8_t *changed_bitmap) {
+    if (dec == NULL || dec->values == NULL || data == NULL) {
+        return YKB_VALUE_CODEC_ERROR_NULL;
+    }
+
+    if (len < YKB_VALUE_CODEC_HEADER_SIZE) {
+        return YKB_VALUE_CODEC_ERROR_BAD_LENGTH;
+    }
+
+    const ykb_value_codec_header_t *header =
+        (const ykb_value_codec_header_t *)data;
+    bool keyframe = (header->flags & YKB_VALUE_CODEC_FLAG_KEYFRAME) != 0u;
+    uint16_t bitmap_size = YKB_VALUE_CODEC_BITMAP_SIZE(dec->count);
+    const uint8_t *bitmap = NULL;
+    uint16_t present = dec->count;
+
+    if (!keyframe) {
+        if (!dec->synced) {
+            return YKB_VALUE_CODEC_ERROR_NOT_SYNCED;
+        }
+        if ((uint8_t)(dec->seq + 1u) != header->seq) {
+            dec->synced = false;
+            return YKB_VALUE_CODEC_ERROR_SEQ_GAP;
+        }
+        if (len < YKB_VALUE_CODEC_HEADER_SIZE + bitmap_size) {
+            return YKB_VALUE_CODEC_ERROR_BAD_LENGTH;
+        }
+
+        bitmap = &data[YKB_VALUE_CODEC_HEADER_SIZE];
+        present = 0u;
+        for (uint16_t i = 0u; i < bitmap_size; i++) {
+            present += (uint16_t)__builtin_popcount(bitmap[i]);
+        }
+
+        // Bits past the last key must be clear
+        if ((dec->count % 8u) != 0u &&
+            (bitmap[bitmap_size - 1u] >> (dec->count % 8u)) != 0u) {
+            return YKB_VALUE_CODEC_ERROR_BAD_BITMAP;
+        }
+    }
+
+    uint16_t payload_pos =
+        YKB_VALUE_CODEC_HEADER_SIZE + (keyframe ? 0u : bitmap_size);
+
+    if (len != payload_pos + YKB_VALUE_CODEC_PACKED_SIZE(present)) {
+        return YKB_VALUE_CODEC_ERROR_BAD_LENGTH;
+    }
+
+    if (changed_bitmap != NULL) {
+        memset(changed_bitmap, 0, bitmap_size);
+    }
+
+    ykb_value_codec_reader_t r = {.data = data, .len = len, .pos = payload_pos};
+    int changed = 0;
+
+    for (uint16_t i = 0u; i < dec->count; i++) {
+        uint16_t v;
+
+        if (bitmap != NULL &&
+            (bitmap[i / 8u] & (uint8_t)(1u << (i % 8u))) == 0u) {
+            continue;
+        }
+        if (!ykb_value_codec_read(&r, &v)) {
+            // Unreachable after the length check
+            return YKB_VALUE_CODEC_ERROR_BAD_LENGTH;
+        }
+        if (dec->values[i] == v) {
+            continue;
+        }
+        dec->values[i] = v;
+        if (changed_bitmap != NULL) {
+            changed_bitmap[i / 8u] |= (uint8_t)(1u << (i % 8u));
+        }
+        changed++;
+    }
+
+    dec->seq = header->seq;
+    dec->synced = true;
+
+    return changed;
+}
+
+#endif // YKB_VALUE_CODEC_H
@@ -16,6 +16,11 @@ struct bt_connect_cb {
 
 void bt_connect_send_kb_report(const hid_kb_report_t *report);
 
+// Sends the NKRO report, or the boot report to peers in boot protocol mode
+// and when NKRO is disabled. Both reports must describe the same keys.
+void bt_connect_send_kb_nkro_report(const hid_kb_nkro_report_t *nkro,
+                                    const hid_kb_report_t *boot);
+
 void bt_connect_send_mouse_report(const hid_mouse_report_t *report);
 
 bool bt_connect_can_send_kb_report(void);
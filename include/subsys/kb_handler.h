@@ -4,11 +4,88 @@
 #include <subsys/kb_settings.h>
 #include <subsys/usb_connect.h>
 
+#include <lib/ykb_time_sync.h>
+
 #include <zephyr/sys/iterable_sections.h>
 #include <zephyr/toolchain.h>
 
 void kb_handler_get_values(uint16_t *values, uint16_t count);
 
+struct kb_handler_stats {
+    // Value updates overwritten before the core thread drained them
+    uint32_t values_coalesced;
+    // Key edges overwritten before the core thread drained them
+    uint32_t edges_coalesced;
+    // Presses or releases which landed on another one of the same kind the
+    // core thread had not seen yet, only one tap per key and drain is replayed
+    uint32_t edges_dropped;
+    // Amount of times the core thread was woken up
+    uint32_t wakeups;
+    // Splitlink slave value frames which could not be applied, mostly
+    // deltas received after a lost frame and before the next keyframe
+    uint32_t slave_frames_dropped;
+    // Slave key edges which happened before a local edge already processed,
+    // see CONFIG_KB_HANDLER_SPLITLINK_MERGE_WINDOW_US
+    uint32_t slave_edges_late;
+};
+
+void kb_handler_get_stats(struct kb_handler_stats *stats);
+
+#if CONFIG_KB_HANDLER_SPLITLINK
+enum kb_handler_splitlink_class {
+    // Key events and values, sent ahead of any bulk fragment
+    KB_HANDLER_SPLITLINK_CLASS_RT,
+    // Settings, paced into the airtime real-time traffic leaves
+    KB_HANDLER_SPLITLINK_CLASS_BULK,
+    KB_HANDLER_SPLITLINK_CLASS_COUNT,
+};
+
+struct kb_handler_splitlink_stats {
+    // Transfers fully handed to the link
+    uint32_t transfers;
+    uint32_t packets;
+    // Transfers refused because the previous one of the slot was not out yet
+    uint32_t rejected;
+    // Transfers abandoned on a link error
+    uint32_t failed;
+    // Transfers queued right now and the most seen at once
+    uint32_t depth;
+    uint32_t max_depth;
+    // Time from queueing a transfer until its last fragment was sent
+    uint32_t latency_avg_us;
+    uint32_t latency_max_us;
+    // Received transfers handed to their consumer
+    uint32_t rx_transfers;
+    // Received packets dropped for lack of a free slot or buffer, or
+    // transfers dropped because a newer one was handed on already
+    uint32_t rx_dropped;
+    // Unfinished received transfers given up for a newer one
+    uint32_t rx_evicted;
+};
+
+void kb_handler_get_splitlink_stats(enum kb_handler_splitlink_class cls,
+                                    struct kb_handler_splitlink_stats *stats);
+
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC && CONFIG_KB_HANDLER_SPLITLINK_MASTER
+struct kb_handler_splitlink_time_stats {
+    // Slave clock mapped onto the master clock yet
+    bool synced;
+    // Master clock rate relative to the slave clock
+    int32_t drift_ppb;
+    // One-way latency of slave real-time transfers above the fastest one
+    ykb_time_sync_stats_t latency;
+};
+
+void kb_handler_get_splitlink_time_stats(
+    struct kb_handler_splitlink_time_stats *stats);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC &&
+       // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+#endif // CONFIG_KB_HANDLER_SPLITLINK
+
+// Forgets the learned calibration, keys relearn it from their next values.
+// Does nothing if CONFIG_KB_HANDLER_CALIBRATION is disabled.
+void kb_handler_calibration_reset(void);
+
 int kb_handler_get_default_thresholds(uint16_t *buffer);
 
 int kb_handler_get_default_keymap_layer1(uint8_t *buffer);
@@ -17,4 +94,6 @@ int kb_handler_get_default_keymap_layer3(uint8_t *buffer);
 
 int kb_handler_get_default_mouseemu(kb_mouseemu_settings_t *buffer);
 
+int kb_handler_get_default_rapid_trigger(kb_rapid_trigger_settings_t *buffer);
+
 #endif // __SUBSYS_KB_HANDLER_H_
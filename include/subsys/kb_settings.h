@@ -20,6 +20,11 @@ typedef enum {
     KB_MODE_MOUSESIM = 2U,
 } kb_mode_t;
 
+typedef enum {
+    KB_REPORT_MODE_6KRO = 0U,
+    KB_REPORT_MODE_NKRO = 1U,
+} kb_report_mode_t;
+
 typedef enum {
     KB_MOUSEEMU_DIRECTION_4_WAY = 0U,
     KB_MOUSEEMU_DIRECTION_8_WAY = 1U,
@@ -29,12 +34,30 @@ typedef enum {
 #define KB_MOUSEEMU_SCROLL_KEYS_MAX 2U
 #define KB_MOUSEEMU_BUTTON_KEYS_MAX 3U
 
+// Rapid trigger keys ignore the threshold once actuated: they release after
+// travelling up by release_sensitivity from the deepest point and press again
+// after travelling down by press_sensitivity from the shallowest point, until
+// the value falls into the top dead zone. Values within the bottom dead zone
+// (measured from the key maximum) are treated as fully pressed.
+typedef struct {
+    bool enabled[TOTAL_KEY_COUNT];
+    uint16_t press_sensitivity[TOTAL_KEY_COUNT];
+    uint16_t release_sensitivity[TOTAL_KEY_COUNT];
+    uint16_t top_deadzone[TOTAL_KEY_COUNT];
+    uint16_t bottom_deadzone[TOTAL_KEY_COUNT];
+} kb_rapid_trigger_settings_t;
+
 typedef struct {
     uint8_t low_threshold;
     uint8_t crit_threshold;
     uint16_t thread_sleep_ms;
 } kb_battsense_settings_t;
 
+enum kb_handler_transport_priority {
+    KBH_TRANSPORT_PRIO_USB = 0U,
+    KBH_TRANSPORT_PRIO_BT = 1U,
+};
+
 #if CONFIG_YKB_BACKLIGHT
 
 #ifndef CONFIG_KB_SETTINGS_YKB_BL_SCRIPT_STORAGE_LEN
@@ -53,11 +76,6 @@ typedef struct {
     (CONFIG_KB_SETTINGS_YKB_BL_SCRIPT_STORAGE_LEN /                            \
      KB_SETTINGS_YKB_BL_SCRIPT_MIN_LEN)
 
-enum kb_handler_transport_priority {
-    KBH_TRANSPORT_PRIO_USB = 0U,
-    KBH_TRANSPORT_PRIO_BT = 1U,
-};
-
 typedef struct {
     bool on;
     uint16_t active_script_index;
@@ -109,10 +127,15 @@ typedef struct {
 
     kb_mouseemu_settings_t mouseemu;
 
+    kb_rapid_trigger_settings_t rapid_trigger;
+
     kb_battsense_settings_t battsense;
 
     enum kb_handler_transport_priority kbh_prio;
 
+    // NKRO falls back to the boot report where the host does not support it
+    kb_report_mode_t report_mode;
+
 #if CONFIG_YKB_BACKLIGHT
     ykb_backlight_settings_t backlight;
 #endif // CONFIG_YKB_BACKLIGHT
@@ -18,6 +18,16 @@ typedef struct __packed {
     uint8_t keys[6];
 } hid_kb_report_t;
 
+// NKRO report covers keyboard usages up to 0xDF with one bit each, the
+// modifiers 0xE0 - 0xE7 are reported in mods like in the boot report
+#define HID_KB_NKRO_USAGE_MAX 0xDFU
+#define HID_KB_NKRO_BITMAP_SIZE ((HID_KB_NKRO_USAGE_MAX + 1U) / 8U)
+
+typedef struct __packed {
+    uint8_t mods;
+    uint8_t bitmap[HID_KB_NKRO_BITMAP_SIZE];
+} hid_kb_nkro_report_t;
+
 typedef struct __packed {
     uint8_t buttons;
     int8_t x;
@@ -30,6 +40,10 @@ void usb_connect_handle_wakeup(void);
 bool usb_connect_can_send_kb_report(void);
 bool usb_connect_can_send_mouse_report(void);
 void usb_connect_send_kb_report(const hid_kb_report_t *report);
+// Sends the NKRO report, or the boot report if NKRO is disabled or the host
+// selected the boot protocol. Both reports must describe the same keys.
+void usb_connect_send_kb_nkro_report(const hid_kb_nkro_report_t *nkro,
+                                     const hid_kb_report_t *boot);
 void usb_connect_send_mouse_report(const hid_mouse_report_t *report);
 
 #endif // LIB_USB_CONNECT_H
@@ -38,6 +38,47 @@ static int vendor_hid_protocol_set_settings(const kb_settings_t *settings) {
     return err;
 }
 
+static void send_robust(vendor_hid_protocol_ctx_t *ctx, const uint8_t *data,
+                        uint16_t len) {
+    ykb_protocol_tx_state_t tx;
+    ykb_protocol_tx_init(&tx, data, len, 0, YKB_PROTOCOL_TYPE_DATA);
+
+    ykb_protocol_packet_t packet;
+    while (ykb_protocol_tx_has_more(&tx)) {
+        if (!ykb_protocol_tx_build_packet(&tx, &packet)) {
+            LOG_ERR("ykb_protocol_tx_build_packet failed");
+            break;
+        }
+
+        uint16_t payload_len = ykb_protocol_payload_len_for_index(
+            tx.total_len, packet.header.packet_idx, tx.packet_count);
+        size_t packet_len = sizeof(packet.header) + payload_len;
+
+        int err = ctx->send_packet((const uint8_t *)&packet, packet_len,
+                                    ctx->user_data);
+        if (err) {
+            LOG_ERR("send_packet failed: %d", err);
+            break;
+        }
+    }
+}
+
+static void send_compact(vendor_hid_protocol_ctx_t *ctx, const uint8_t *data,
+                         uint16_t len) {
+    ykb_protocol_tx_state_t tx;
+    ykb_protocol_compact_tx_init(&tx, data, len, 0, YKB_PROTOCOL_TYPE_DATA);
+
+    uint8_t packet[YKB_PROTOCOL_MAX_PACKET_SIZE];
+    uint16_t packet_len;
+    while ((packet_len = ykb_protocol_compact_tx_build_packet(&tx, packet))) {
+        int err = ctx->send_packet(packet, packet_len, ctx->user_data);
+        if (err) {
+            LOG_ERR("send_packet failed: %d", err);
+            break;
+        }
+    }
+}
+
 static void response_work_handler(struct k_work *work) {
     vendor_hid_protocol_ctx_t *ctx =
         CONTAINER_OF(work, vendor_hid_protocol_ctx_t, response_work);
@@ -91,26 +132,10 @@ static void response_work_handler(struct k_work *work) {
         break;
     }
 
-    ykb_protocol_tx_state_t tx;
-    ykb_protocol_tx_init(&tx, data, len, 0, YKB_PROTOCOL_TYPE_DATA);
-
-    ykb_protocol_packet_t packet;
-    while (ykb_protocol_tx_has_more(&tx)) {
-        if (!ykb_protocol_tx_build_packet(&tx, &packet)) {
-            LOG_ERR("ykb_protocol_tx_build_packet failed");
-            break;
-        }
-
-        uint16_t payload_len = ykb_protocol_payload_len_for_index(
-            tx.total_len, packet.header.packet_idx, tx.packet_count);
-        size_t packet_len = sizeof(packet.header) + payload_len;
-
-        int err = ctx->send_packet((const uint8_t *)&packet, packet_len,
-                                   ctx->user_data);
-        if (err) {
-            LOG_ERR("send_packet failed: %d", err);
-            break;
-        }
+    if (ctx->compact) {
+        send_compact(ctx, data, len);
+    } else {
+        send_robust(ctx, data, len);
     }
 
     ykb_protocol_rx_reset(&ctx->rx);
@@ -119,7 +144,7 @@ static void response_work_handler(struct k_work *work) {
 
 int vendor_hid_protocol_init(vendor_hid_protocol_ctx_t *ctx,
                              vendor_hid_send_packet_cb_t send_packet,
-                             void *user_data) {
+                             void *user_data, bool reliable) {
     if (!ctx || !send_packet) {
         return -EINVAL;
     }
@@ -127,6 +152,7 @@ int vendor_hid_protocol_init(vendor_hid_protocol_ctx_t *ctx,
     memset(ctx, 0, sizeof(*ctx));
     ctx->send_packet = send_packet;
     ctx->user_data = user_data;
+    ctx->reliable = reliable;
 
     ykb_protocol_rx_init(&ctx->rx, ctx->rx_buffer, sizeof(ctx->rx_buffer),
                          false, NULL, 0);
@@ -135,6 +161,57 @@ int vendor_hid_protocol_init(vendor_hid_protocol_ctx_t *ctx,
     return 0;
 }
 
+int vendor_hid_protocol_set_framing(vendor_hid_protocol_ctx_t *ctx,
+                                    enum vendor_hid_framing framing) {
+    if (!ctx) {
+        return -EINVAL;
+    }
+
+    switch (framing) {
+    case VENDOR_HID_FRAMING_REGULAR:
+        break;
+    case VENDOR_HID_FRAMING_COMPACT:
+        if (!ctx->reliable) {
+            return -ENOTSUP;
+        }
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    if (ctx->busy) {
+        return -EBUSY;
+    }
+
+    ykb_protocol_rx_reset(&ctx->rx);
+    ctx->compact = framing == VENDOR_HID_FRAMING_COMPACT;
+    LOG_INF("%s framing", ctx->compact ? "Compact" : "Regular");
+
+    return 0;
+}
+
+enum vendor_hid_framing
+vendor_hid_protocol_get_framing(const vendor_hid_protocol_ctx_t *ctx) {
+    return ctx->compact ? VENDOR_HID_FRAMING_COMPACT
+                        : VENDOR_HID_FRAMING_REGULAR;
+}
+
+void vendor_hid_protocol_reset(vendor_hid_protocol_ctx_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    // The next host may not know about the framing feature report. A
+    // response still being sent goes out to nobody either way.
+    ctx->compact = false;
+
+    if (ctx->busy) {
+        return;
+    }
+
+    ykb_protocol_rx_reset(&ctx->rx);
+}
+
 int vendor_hid_protocol_parse(vendor_hid_protocol_ctx_t *ctx,
                               const uint8_t *data, size_t len) {
     if (!ctx || !data) {
@@ -146,15 +223,22 @@ int vendor_hid_protocol_parse(vendor_hid_protocol_ctx_t *ctx,
         return -EBUSY;
     }
 
-    if (len < sizeof(ykb_protocol_header_t)) {
+    const ykb_protocol_packet_t *packet = (const ykb_protocol_packet_t *)data;
+
+    ykb_protocol_rx_result_t res;
+    if (ctx->compact) {
+        res = ykb_protocol_compact_rx_push_packet(&ctx->rx, data, len);
+    } else if (len < sizeof(ykb_protocol_header_t)) {
         LOG_ERR("Packet too short: %u", (unsigned)len);
         return -EMSGSIZE;
+    } else {
+        res = ykb_protocol_rx_push_packet(&ctx->rx, packet);
     }
 
-    ykb_protocol_rx_result_t res =
-        ykb_protocol_rx_push_packet(&ctx->rx, (const ykb_protocol_packet_t *)data);
     if (res < 0) {
-        LOG_ERR("ykb_protocol_rx_push_packet: %d", res);
+        LOG_ERR("%s rx_push_packet: %d", ctx->compact ? "compact" : "ykb",
+                res);
+        ykb_protocol_rx_reset(&ctx->rx);
         return (int)res;
     }
 
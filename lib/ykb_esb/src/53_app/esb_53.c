@@ -1,11 +1,13 @@
 #include <stdint.h>
 #include <zephyr/init.h>
+#include <zephyr/ipc/ipc_service.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/types.h>
 
 #include <lib/ykb_esb.h>
 
+#include "../esb_ipc.h"
 #include "../esb_rpc_ids.h"
 
 #include <mdk/nrf.h>
@@ -50,14 +52,30 @@ NRF_RPC_GROUP_DEFINE_NOWAIT(esb_group, "esb_group_id", &esb_group_tr, NULL,
 static ykb_esb_callback_t m_callback;
 static ykb_esb_config_t m_config;
 static ykb_esb_event_t m_event;
-static uint8_t m_rx_buf[CONFIG_ESB_MAX_PAYLOAD_LENGTH];
 static bool rpc_initialized;
 static bool rpc_bound;
+static bool esb_initialized;
+static uint16_t m_evt_batch_seq;
 
+static ykb_esb_ready_callback_t m_ready_callback;
+static void *m_ready_user_ptr;
+static struct k_spinlock m_ready_lock;
+
+// Called from the nRF RPC thread once the net core answered the handshake
 static void rpc_bound_handler(const struct nrf_rpc_group *group) {
     ARG_UNUSED(group);
 
+    k_spinlock_key_t key = k_spin_lock(&m_ready_lock);
+    ykb_esb_ready_callback_t callback = m_ready_callback;
+    void *user_ptr = m_ready_user_ptr;
     rpc_bound = true;
+    k_spin_unlock(&m_ready_lock, key);
+
+    LOG_INF("nRF RPC bound, uptime %u ms", k_uptime_get_32());
+
+    if (callback) {
+        callback(user_ptr);
+    }
 }
 
 /* - Pull an error code from the RPC CBOR buffer
@@ -130,107 +148,104 @@ static int rpc_esb_init(void) {
     }
 }
 
-static int rpc_esb_tx(ykb_esb_data_t *packet) {
-    int32_t err;
-    int err_rpc;
-    struct nrf_rpc_cbor_ctx ctx;
-    size_t packet_len = sizeof(ykb_esb_data_t);
+static struct ipc_ept m_evt_ept;
+static bool m_evt_ept_bound;
 
-    NRF_RPC_CBOR_ALLOC(&esb_group, ctx, CBOR_BUF_SIZE + packet_len);
+/* Payloads and messages go out in one IPC message each, built here */
+static K_MUTEX_DEFINE(m_tx_mutex);
+static uint8_t m_tx_buf[sizeof(struct esb_ipc_tx_hdr) +
+                        MAX(CONFIG_ESB_MAX_PAYLOAD_LENGTH,
+                            CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE)];
 
-    /* Serialize the `config` struct to a byte array, encode it and place it
-     * in the CBOR buffer.
-     *
-     * We play fast and loose with the memory layout because we assume that
-     * the other core's FW was compiled with the exact same toolchain and
-     * compiler options, resulting in the same memory layout on the other
-     * side.
-     *
-     * Note: a gotcha is that the `zcbor_` APIs return `true` on success,
-     * whereas almost all zephyr (and other NCS) APIs return a `0` on success.
-     */
-    if (!zcbor_bstr_encode_ptr(ctx.zs, (const uint8_t *)packet, packet_len)) {
-        return -EINVAL;
+/* Hands data to the net core without waiting for it, errors of the net core
+ * come back as YKB_ESB_EVT_TX_ERROR. Fails here only if the IPC has no room.
+ */
+static int ipc_esb_tx(const struct esb_ipc_tx_hdr *hdr, const uint8_t *data) {
+    if (!m_evt_ept_bound) {
+        return -EAGAIN;
     }
 
-    LOG_DBG("RPC ESB TX cmd: Byte 0: %x", packet->data[0]);
+    k_mutex_lock(&m_tx_mutex, K_FOREVER);
+    memcpy(m_tx_buf, hdr, sizeof(*hdr));
+    memcpy(&m_tx_buf[sizeof(*hdr)], data, hdr->len);
+    int err = ipc_service_send(&m_evt_ept, m_tx_buf, sizeof(*hdr) + hdr->len);
+    k_mutex_unlock(&m_tx_mutex);
 
-    err_rpc = nrf_rpc_cbor_cmd(&esb_group, RPC_COMMAND_ESB_TX, &ctx,
-                               rpc_rsp_handler, &err);
-
-    /* Return a fixed error code if the RPC transport had an error. Else,
-     * return the result of the API called on the other core.
-     */
-    if (err_rpc) {
-        return -EINVAL;
-    } else {
+    if (err < 0) {
+        LOG_DBG("ESB TX IPC send failed: %d", err);
         return err;
     }
+
+    return 0;
 }
 
-static void rpc_esb_event_handler(const struct nrf_rpc_group *group,
-                                  struct nrf_rpc_cbor_ctx *ctx,
-                                  void *handler_data) {
-    int err;
-    uint32_t rx_payload_length = 0;
-    struct zcbor_string zst;
-    int evt_type;
+/* Dispatches a batch of ESB events sent by the net core. The payloads point
+ * into the IPC buffer, which is released once this returns, the application
+ * copies what it keeps.
+ */
+static void evt_ept_recv(const void *data, size_t len, void *priv) {
+    ARG_UNUSED(priv);
 
-    /* Try pulling the error code. */
-    err = decode_error(group, ctx, handler_data);
+    const uint8_t *batch = data;
+    struct esb_ipc_batch_hdr batch_hdr;
 
-    if (err || !zcbor_uint32_decode(ctx->zs, &evt_type)) {
-        err = -EBADMSG;
+    if (len < sizeof(batch_hdr)) {
+        LOG_ERR("ESB event batch too short: %u", len);
+        return;
     }
+    memcpy(&batch_hdr, batch, sizeof(batch_hdr));
 
-    if (err || !zcbor_uint32_decode(ctx->zs, &rx_payload_length)) {
-        err = -EBADMSG;
+    if (batch_hdr.seq != m_evt_batch_seq) {
+        LOG_WRN("Lost %u ESB event batches",
+                (uint16_t)(batch_hdr.seq - m_evt_batch_seq));
     }
+    m_evt_batch_seq = batch_hdr.seq + 1;
 
-    if (rx_payload_length > 0) {
-        // An RX payload is included in the message. Try to parse it.
-        if (err || !zcbor_bstr_decode(ctx->zs, &zst)) {
-            err = -EBADMSG;
-        }
+    if (batch_hdr.dropped) {
+        LOG_WRN("Net core dropped %u ESB events", batch_hdr.dropped);
+    }
 
-        if (zst.len != rx_payload_length) {
-            LOG_ERR("struct size mismatch: expect %d got %d", rx_payload_length,
-                    zst.len);
-            err = -EMSGSIZE;
-        }
+    if (!m_callback) {
+        return;
+    }
 
-        if (!err) {
-            memcpy(m_rx_buf, zst.value, zst.len);
-            LOG_DBG("decoding ok: rx_payload length %i", rx_payload_length);
-        } else {
-            LOG_ERR("%s: decoding error %d", __func__, err);
+    size_t pos = sizeof(batch_hdr);
+    struct esb_ipc_evt_hdr hdr;
+    const uint8_t *payload;
+    uint8_t count = 0;
+
+    while (esb_ipc_batch_next(batch, len, &pos, &hdr, &payload)) {
+        if (hdr.type == YKB_ESB_EVT_TX_ERROR) {
+            LOG_DBG("ESB TX (id %u) failed on the net core", hdr.id);
         }
+        m_event.evt_type = hdr.type;
+        m_event.buf = hdr.len > 0 ? (uint8_t *)payload : NULL;
+        m_event.data_length = hdr.len;
+        m_event.msg_id = hdr.id;
+        m_callback(&m_event, m_config.user_ptr);
+        count++;
     }
 
-    // LOG_INF("evt_type %i, p_rx_payload length %i", evt_type,
-    // rx_payload_length);
-
-    nrf_rpc_cbor_decoding_done(&esb_group, ctx);
+    if (count != batch_hdr.count || pos != len) {
+        LOG_ERR("Malformed ESB event batch: %u of %u events", count,
+                batch_hdr.count);
+    }
+}
 
-    /* Notify the app new data has been received. */
-    if (!err) {
-        // LOG_DBG("decoding ok: rx_payload length %i", rx_payload_length);
+static void evt_ept_bound(void *priv) {
+    ARG_UNUSED(priv);
 
-        // Call the event handler registered by the application
-        m_event.evt_type = evt_type;
-        m_event.buf = m_rx_buf;
-        m_event.data_length = rx_payload_length;
-        m_callback(&m_event, m_config.user_ptr);
-    } else {
-        LOG_ERR("%s: decoding error %d", __func__, err);
-    }
+    m_evt_ept_bound = true;
 }
 
-/* Register the RX event handler (function above). This will be sent from the
- * other side whenever we are in async mode and a packet has been received.
- */
-NRF_RPC_CBOR_EVT_DECODER(esb_group, rx_cb_handler, RPC_EVENT_ESB_CB,
-                         rpc_esb_event_handler, NULL);
+static struct ipc_ept_cfg m_evt_ept_cfg = {
+    .name = ESB_IPC_EPT_NAME,
+    .cb =
+        {
+            .bound = evt_ept_bound,
+            .received = evt_ept_recv,
+        },
+};
 
 /* Initialize nRF RPC right after kernel boots, but before the application is
  * run.
@@ -260,6 +275,40 @@ static int serialization_init(void) {
     return 0;
 }
 
+// After every POST_KERNEL init, so bt_enable() is done bringing up the IPC
+// instance nRF RPC shares with the HCI endpoint
+static int esb_rpc_sys_init(void) {
+    int err = serialization_init();
+    if (err) {
+        LOG_ERR("nRF RPC init failed: %d", err);
+        return 0;
+    }
+
+    // ESB events come over their own endpoint, see esb_ipc.h
+    err = ipc_service_register_endpoint(DEVICE_DT_GET(DT_NODELABEL(ipc0)),
+                                        &m_evt_ept, &m_evt_ept_cfg);
+    if (err) {
+        LOG_ERR("ESB event endpoint register failed: %d", err);
+    }
+
+    return 0;
+}
+
+SYS_INIT(esb_rpc_sys_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+void ykb_esb_set_ready_callback(ykb_esb_ready_callback_t callback,
+                                void *user_ptr) {
+    k_spinlock_key_t key = k_spin_lock(&m_ready_lock);
+    m_ready_callback = callback;
+    m_ready_user_ptr = user_ptr;
+    bool bound = rpc_bound;
+    k_spin_unlock(&m_ready_lock, key);
+
+    if (bound && callback) {
+        callback(user_ptr);
+    }
+}
+
 int ykb_esb_init(ykb_esb_config_t *config, ykb_esb_callback_t callback) {
     int err = serialization_init();
     if (err) {
@@ -274,10 +323,42 @@ int ykb_esb_init(ykb_esb_config_t *config, ykb_esb_callback_t callback) {
     if (err < 0) {
         return err;
     }
+    esb_initialized = true;
     return 0;
 }
 
 int ykb_esb_send(ykb_esb_data_t *tx_packet) {
-    //
-    return rpc_esb_tx(tx_packet);
+    // Commands sent before the transport is up end in rpmsg_virtio
+    if (!esb_initialized) {
+        return -EAGAIN;
+    }
+    if (tx_packet->len > CONFIG_ESB_MAX_PAYLOAD_LENGTH) {
+        return -EMSGSIZE;
+    }
+
+    struct esb_ipc_tx_hdr hdr = {
+        .type = ESB_IPC_TX_PAYLOAD,
+        .cls = tx_packet->cls,
+        .len = tx_packet->len,
+    };
+
+    return ipc_esb_tx(&hdr, tx_packet->data);
+}
+
+int ykb_esb_send_msg(const ykb_esb_msg_t *msg) {
+    if (!esb_initialized) {
+        return -EAGAIN;
+    }
+    if (msg->len > CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE) {
+        return -EMSGSIZE;
+    }
+
+    struct esb_ipc_tx_hdr hdr = {
+        .type = ESB_IPC_TX_MSG,
+        .id = msg->id,
+        .flags = msg->flags,
+        .len = msg->len,
+    };
+
+    return ipc_esb_tx(&hdr, msg->data);
 }
@@ -1,11 +1,17 @@
 #include <zephyr/init.h>
+#include <zephyr/ipc/ipc_service.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/types.h>
 
+#include "../esb_ipc.h"
 #include "../esb_rpc_ids.h"
 #include <lib/ykb_esb.h>
 
+/* Messages go over the air as ykb_protocol packets behind msg_prefix */
+#define YKB_PROTOCOL_MAX_PACKET_SIZE (CONFIG_ESB_MAX_PAYLOAD_LENGTH - 1)
+#include <lib/ykb_protocol.h>
+
 #include <esb.h>
 #include <mdk/nrf.h>
 
@@ -25,56 +31,337 @@ NRF_RPC_IPC_TRANSPORT(esb_group_tr, DEVICE_DT_GET(DT_NODELABEL(ipc0)),
 NRF_RPC_GROUP_DEFINE_NOWAIT(esb_group, "esb_group_id", &esb_group_tr, NULL,
                             NULL, NULL, NULL, false);
 
-static void rpc_esb_event_send(uint32_t evt_type, uint8_t *rx_payload_buf,
-                               uint32_t rx_payload_length);
+BUILD_ASSERT(CONFIG_LIB_YKB_ESB_IPC_BATCH_SIZE >=
+                 sizeof(struct esb_ipc_batch_hdr) +
+                     sizeof(struct esb_ipc_evt_hdr) +
+                     MAX(CONFIG_ESB_MAX_PAYLOAD_LENGTH,
+                         CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE),
+             "LIB_YKB_ESB_IPC_BATCH_SIZE does not fit the largest event");
 
-static void work_send_evt_tx_success_func(struct k_work *item);
-static void work_send_evt_tx_fail_func(struct k_work *item);
-static void work_send_evt_rx_received_func(struct k_work *item);
+static void evt_send_work_handler(struct k_work *work);
 
-K_WORK_DEFINE(m_work_send_evt_tx_success, work_send_evt_tx_success_func);
-K_WORK_DEFINE(m_work_send_evt_tx_fail, work_send_evt_tx_fail_func);
-K_WORK_DEFINE(m_work_send_evt_rx_received, work_send_evt_rx_received_func);
+/* Filled from the ESB event handler, drained by evt_send_work, see
+ * esb_ipc.h
+ */
+static uint8_t m_evt_ring_buf[CONFIG_LIB_YKB_ESB_IPC_RING_SIZE];
+static struct esb_ipc_ring m_evt_ring = {
+    .buf = m_evt_ring_buf,
+    .size = sizeof(m_evt_ring_buf),
+};
+static K_WORK_DELAYABLE_DEFINE(m_evt_send_work, evt_send_work_handler);
+
+static struct ipc_ept m_evt_ept;
+static bool m_evt_ept_bound;
+static uint8_t m_evt_batch_buf[CONFIG_LIB_YKB_ESB_IPC_BATCH_SIZE];
+static struct esb_ipc_batch m_evt_batch = {
+    .buf = m_evt_batch_buf,
+    .size = sizeof(m_evt_batch_buf),
+    .max_events = CONFIG_LIB_YKB_ESB_IPC_BATCH_EVENTS,
+};
 
-static uint8_t *last_rx_buf;
-static uint32_t last_rx_length;
 static bool rpc_initialized;
+static bool evt_ept_registered;
+
+/* Transfers of the ids in m_msg_ids are reassembled here and handed to the
+ * app core whole, see ykb_esb_send_msg(). The contexts are only touched from
+ * the ESB event handler.
+ */
+struct msg_rx_ctx {
+    ykb_protocol_rx_state_t rx;
+    bool used;
+    uint8_t id;
+    /* Order the transfers started in, the oldest gives way first */
+    uint32_t started;
+    uint8_t data[CONFIG_LIB_YKB_ESB_MSG_MAX_SIZE];
+};
+
+static struct msg_rx_ctx m_msg_rx_ctxs[CONFIG_LIB_YKB_ESB_MSG_RX_CONTEXTS];
+static uint32_t m_msg_rx_started;
+static uint8_t m_msg_prefix;
+static uint32_t m_msg_ids;
+
+static void evt_put(const struct esb_ipc_evt_hdr *hdr, const uint8_t *payload) {
+    LOG_DBG("ESB event %u, len %u", hdr->type, hdr->len);
+
+    if (!esb_ipc_ring_put(&m_evt_ring, hdr, payload)) {
+        return;
+    }
+
+    k_work_schedule(&m_evt_send_work, K_NO_WAIT);
+}
+
+static void msg_rx_put(uint8_t id, const uint8_t *data, uint16_t len) {
+    struct esb_ipc_evt_hdr hdr = {
+        .type = YKB_ESB_EVT_RX_MSG,
+        .id = id,
+        .len = len,
+    };
+
+    evt_put(&hdr, data);
+}
+
+static struct msg_rx_ctx *msg_rx_ctx_find(uint8_t id) {
+    for (size_t i = 0; i < ARRAY_SIZE(m_msg_rx_ctxs); ++i) {
+        if (m_msg_rx_ctxs[i].used && m_msg_rx_ctxs[i].id == id) {
+            return &m_msg_rx_ctxs[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Takes a free context, or the one of the oldest unfinished transfer */
+static struct msg_rx_ctx *msg_rx_ctx_start(uint8_t id) {
+    struct msg_rx_ctx *ctx = NULL;
+
+    for (size_t i = 0; i < ARRAY_SIZE(m_msg_rx_ctxs); ++i) {
+        struct msg_rx_ctx *cur = &m_msg_rx_ctxs[i];
+
+        if (!cur->used) {
+            ctx = cur;
+            break;
+        }
+        if (!ctx || (int32_t)(cur->started - ctx->started) < 0) {
+            ctx = cur;
+        }
+    }
+
+    if (ctx->used) {
+        LOG_DBG("Message %u evicted by %u", ctx->id, id);
+    }
+
+    ctx->used = true;
+    ctx->id = id;
+    ctx->started = m_msg_rx_started++;
+    ykb_protocol_rx_init(&ctx->rx, ctx->data, sizeof(ctx->data), false, NULL,
+                         0);
+
+    return ctx;
+}
+
+/* Reassembles payloads carrying a message fragment, returns false for every
+ * other payload, which goes to the app core as is.
+ */
+static bool msg_rx_push(const uint8_t *data, uint32_t len) {
+    if (m_msg_ids == 0 || len < 1 + YKB_PROTOCOL_HEADER_SIZE ||
+        data[0] != m_msg_prefix) {
+        return false;
+    }
+
+    const ykb_protocol_packet_t *packet =
+        (const ykb_protocol_packet_t *)&data[1];
+    const ykb_protocol_header_t *header = &packet->header;
+    uint8_t id = header->transfer_id;
+
+    if (ykb_protocol_get_type(header->type_flags) != YKB_PROTOCOL_TYPE_DATA ||
+        id >= 32 || !(m_msg_ids & BIT(id)) ||
+        !ykb_protocol_is_header_valid(header)) {
+        return false;
+    }
+
+    uint16_t payload_len = ykb_protocol_payload_len_for_index(
+        header->total_len, header->packet_idx, header->packet_count);
+
+    if (len - 1 < (uint32_t)YKB_PROTOCOL_HEADER_SIZE + payload_len) {
+        return false;
+    }
+
+    struct msg_rx_ctx *ctx = msg_rx_ctx_find(id);
+
+    /* Most messages fit a single payload, they skip the copy into a context
+     * and replace whatever transfer of the id was unfinished
+     */
+    if (header->packet_count == 1) {
+        if (ctx) {
+            ctx->used = false;
+        }
+        if (ykb_protocol_compute_packet_crc(packet) != header->crc) {
+            LOG_DBG("Message %u CRC mismatch", id);
+            return true;
+        }
+        msg_rx_put(id, packet->payload, header->total_len);
+        return true;
+    }
+
+    ykb_protocol_rx_result_t res = YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH;
+
+    if (ctx) {
+        res = ykb_protocol_rx_push_packet(&ctx->rx, packet);
+        if (res == YKB_PROTOCOL_RX_ERROR_OUT_OF_ORDER &&
+            header->packet_idx < ctx->rx.next_expected_packet_idx) {
+            /* Sent again after a failed TX, already have it */
+            return true;
+        }
+    }
+
+    if (res == YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH ||
+        res == YKB_PROTOCOL_RX_ERROR_OUT_OF_ORDER) {
+        /* A newer transfer of the id started, the unfinished one would only
+         * be stale by the time it completes
+         */
+        if (ctx) {
+            ctx->used = false;
+        }
+        ctx = msg_rx_ctx_start(id);
+        res = ykb_protocol_rx_push_packet(&ctx->rx, packet);
+    }
+
+    if (res < 0) {
+        LOG_DBG("Message %u dropped: %d", id, res);
+        ctx->used = false;
+        return true;
+    }
+
+    if (res == YKB_PROTOCOL_RX_RESULT_COMPLETE) {
+        msg_rx_put(id, ctx->data, ctx->rx.total_len);
+        ctx->used = false;
+    }
+
+    return true;
+}
 
 void on_esb_callback(ykb_esb_event_t *event, void *user_data) {
-    switch (event->evt_type) {
-    case YKB_ESB_EVT_TX_SUCCESS:
-        LOG_INF("ESB TX success");
-        k_work_submit(&m_work_send_evt_tx_success);
-        break;
-    case YKB_ESB_EVT_TX_FAIL:
-        LOG_INF("ESB TX failed");
-        k_work_submit(&m_work_send_evt_tx_fail);
-        break;
-    case YKB_ESB_EVT_RX:
-        LOG_INF("ESB RX: 0x%.2x-0x%.2x-0x%.2x-0x%.2x", event->buf[0],
-                event->buf[1], event->buf[2], event->buf[3]);
-        last_rx_buf = event->buf;
-        last_rx_length = event->data_length;
-        k_work_submit(&m_work_send_evt_rx_received);
-        break;
-    default:
-        LOG_ERR("Unknown APP ESB event!");
-        break;
+    bool rx = event->evt_type == YKB_ESB_EVT_RX;
+
+    if (rx && msg_rx_push(event->buf, event->data_length)) {
+        return;
+    }
+
+    struct esb_ipc_evt_hdr hdr = {
+        .type = event->evt_type,
+        .len = rx ? event->data_length : 0,
+    };
+
+    evt_put(&hdr, event->buf);
+}
+
+/* Splits a message into payloads and queues them all. A failure part way
+ * leaves an unfinished transfer, which the receiver drops.
+ */
+static int msg_tx(uint8_t id, uint8_t flags, const uint8_t *data,
+                  uint16_t len) {
+    ykb_protocol_tx_state_t tx;
+    ykb_esb_data_t payload = {.cls = YKB_ESB_CLASS_BULK};
+    ykb_protocol_packet_t *packet = (ykb_protocol_packet_t *)&payload.data[1];
+
+    ykb_protocol_tx_init(&tx, data, len, id, flags);
+
+    while (ykb_protocol_tx_has_more(&tx)) {
+        uint16_t idx = tx.next_packet_idx;
+
+        if (!ykb_protocol_tx_build_packet(&tx, packet)) {
+            return -EINVAL;
+        }
+
+        payload.data[0] = m_msg_prefix;
+        payload.len = 1 + YKB_PROTOCOL_HEADER_SIZE +
+                      ykb_protocol_payload_len_for_index(len, idx,
+                                                         tx.packet_count);
+
+        int err = ykb_esb_send(&payload);
+        if (err) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+/* Sends everything queued, one IPC message and so one doorbell per batch. A
+ * batch the IPC had no buffer for is kept and sent again later.
+ */
+static void evt_send_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+
+    if (!m_evt_ept_bound) {
+        return;
+    }
+
+    while (esb_ipc_batch_ready(&m_evt_batch, &m_evt_ring)) {
+        int err =
+            ipc_service_send(&m_evt_ept, m_evt_batch.buf, m_evt_batch.len);
+        if (err == -ENOMEM || err == -EBUSY) {
+            k_work_schedule(&m_evt_send_work, K_MSEC(1));
+            return;
+        }
+        if (err < 0) {
+            LOG_ERR("ESB event batch send failed: %d", err);
+        }
+
+        esb_ipc_batch_sent(&m_evt_batch);
     }
 }
 
-static void work_send_evt_tx_success_func(struct k_work *item) {
-    rpc_esb_event_send(YKB_ESB_EVT_TX_SUCCESS, 0, 0);
+/* Errors of data from the app core are the only events not put from the ESB
+ * event handler, locking out interrupts keeps the ring single producer
+ */
+static void tx_error_put(uint8_t id, int32_t err) {
+    struct esb_ipc_evt_hdr hdr = {
+        .type = YKB_ESB_EVT_TX_ERROR,
+        .id = id,
+        .len = sizeof(err),
+    };
+    unsigned int key = irq_lock();
+
+    evt_put(&hdr, (const uint8_t *)&err);
+    irq_unlock(key);
 }
 
-static void work_send_evt_tx_fail_func(struct k_work *item) {
-    rpc_esb_event_send(YKB_ESB_EVT_TX_FAIL, 0, 0);
+/* Payloads and messages to send, see esb_ipc.h. The data stays in the IPC
+ * buffer until this returns.
+ */
+static void tx_ept_recv(const void *data, size_t len, void *priv) {
+    ARG_UNUSED(priv);
+
+    struct esb_ipc_tx_hdr hdr;
+    const uint8_t *payload = (const uint8_t *)data + sizeof(hdr);
+    int err;
+
+    if (len < sizeof(hdr)) {
+        LOG_ERR("ESB TX message too short: %u", len);
+        return;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (len - sizeof(hdr) != hdr.len) {
+        err = -EBADMSG;
+    } else if (hdr.type == ESB_IPC_TX_MSG) {
+        err = msg_tx(hdr.id, hdr.flags, payload, hdr.len);
+    } else if (hdr.len > CONFIG_ESB_MAX_PAYLOAD_LENGTH) {
+        err = -EMSGSIZE;
+    } else {
+        ykb_esb_data_t tx_payload = {
+            .len = hdr.len,
+            .cls = hdr.cls,
+        };
+
+        memcpy(tx_payload.data, payload, hdr.len);
+        err = ykb_esb_send(&tx_payload);
+    }
+
+    if (err < 0) {
+        LOG_DBG("ESB TX %u (id %u) failed: %d", hdr.type, hdr.id, err);
+        tx_error_put(hdr.id, err);
+    }
 }
 
-static void work_send_evt_rx_received_func(struct k_work *item) {
-    rpc_esb_event_send(YKB_ESB_EVT_RX, last_rx_buf, last_rx_length);
+static void evt_ept_bound(void *priv) {
+    ARG_UNUSED(priv);
+
+    m_evt_ept_bound = true;
+    /* Events queued before the app core was listening */
+    k_work_schedule(&m_evt_send_work, K_NO_WAIT);
 }
 
+static struct ipc_ept_cfg m_evt_ept_cfg = {
+    .name = ESB_IPC_EPT_NAME,
+    .cb =
+        {
+            .bound = evt_ept_bound,
+            .received = tx_ept_recv,
+        },
+};
+
 static int decode_struct(struct nrf_rpc_cbor_ctx *ctx, void *struct_ptr,
                          size_t expected_size) {
     struct zcbor_string zst;
@@ -149,6 +436,11 @@ static void rpc_esb_init_handler(const struct nrf_rpc_group *group,
         LOG_DBG("ykb_esb_init. Mode %i", config.mode);
         // Null the user_ptr just in case
         config.user_ptr = NULL;
+        m_msg_prefix = config.msg_prefix;
+        m_msg_ids = config.msg_ids;
+        for (size_t i = 0; i < ARRAY_SIZE(m_msg_rx_ctxs); ++i) {
+            m_msg_rx_ctxs[i].used = false;
+        }
         err = ykb_esb_init(&config, on_esb_callback);
         if (err) {
             LOG_ERR("ykb_esb init failed (err %d)", err);
@@ -159,80 +451,8 @@ static void rpc_esb_init_handler(const struct nrf_rpc_group *group,
     rpc_rsp(err);
 }
 
-static void rpc_esb_tx_handler(const struct nrf_rpc_group *group,
-                               struct nrf_rpc_cbor_ctx *ctx,
-                               void *handler_data) {
-    int err = 0;
-    ykb_esb_data_t tx_payload;
-
-    if (decode_struct(ctx, &tx_payload, sizeof(tx_payload))) {
-        LOG_DBG("decoding ykb_esb_data_t struct failed");
-        err = -EBADMSG;
-    }
-
-    nrf_rpc_cbor_decoding_done(&esb_group, ctx);
-
-    if (!err) {
-        LOG_INF("Send TX packet, data 0 0x%.2x, len %i", tx_payload.data[0],
-                tx_payload.len);
-        err = ykb_esb_send(&tx_payload);
-        if (err < 0) {
-            LOG_ERR("ykb_esb_send: error %i", err);
-        }
-    }
-
-    rpc_rsp(err);
-}
-
-/* This is the callback passed to the esb_simple API, which
- * then calls the RPC remote callback (sends an event).
- *
- * On the remote (app core), the rpc event will then call
- * the function stored in p_rx_cb_remote.
- */
-static void rpc_esb_event_send(uint32_t evt_type, uint8_t *rx_buf,
-                               uint32_t rx_length) {
-    int err = 0;
-    struct nrf_rpc_cbor_ctx ctx;
-
-    NRF_RPC_CBOR_ALLOC(&esb_group, ctx,
-                       CBOR_BUF_SIZE + sizeof(err) + sizeof(evt_type) +
-                           sizeof(uint32_t) + rx_length);
-
-    /* Always encode the error */
-    if (!zcbor_int32_put(ctx.zs, err)) {
-        err = -EINVAL;
-    }
-
-    if (err || !zcbor_uint32_put(ctx.zs, evt_type)) {
-        err = -EINVAL;
-    }
-
-    if (err || !zcbor_uint32_put(ctx.zs, rx_length)) {
-        err = -EINVAL;
-    }
-
-    if (rx_length > 0) {
-        if (err || !zcbor_bstr_encode_ptr(ctx.zs, rx_buf, rx_length)) {
-            err = -EINVAL;
-        }
-    }
-
-    if (!err) {
-        err = nrf_rpc_cbor_evt(&esb_group, RPC_EVENT_ESB_CB, &ctx);
-    }
-
-    if (!err) {
-        LOG_DBG("evt send ok");
-    } else {
-        LOG_DBG("evt send err %d", err);
-    }
-}
-
 NRF_RPC_CBOR_CMD_DECODER(esb_group, rpc_esb_init, RPC_COMMAND_ESB_INIT,
                          rpc_esb_init_handler, NULL);
-NRF_RPC_CBOR_CMD_DECODER(esb_group, rpc_esb_tx, RPC_COMMAND_ESB_TX,
-                         rpc_esb_tx_handler, NULL);
 
 static void err_handler(const struct nrf_rpc_err_report *report) {
     LOG_ERR("nRF RPC error %d. Enable nRF RPC logs for details.", report->code);
@@ -242,19 +462,28 @@ static void err_handler(const struct nrf_rpc_err_report *report) {
 int ykb_esb_rpc_start(void) {
     int err;
 
-    if (rpc_initialized) {
-        return 0;
-    }
+    if (!rpc_initialized) {
+        LOG_DBG("nRF RPC init begin");
 
-    LOG_DBG("nRF RPC init begin");
+        err = nrf_rpc_init(err_handler);
+        if (err) {
+            return -EINVAL;
+        }
 
-    err = nrf_rpc_init(err_handler);
-    if (err) {
-        return -EINVAL;
+        LOG_INF("nRF RPC init ok, uptime %u ms", k_uptime_get_32());
+        rpc_initialized = true;
     }
 
-    LOG_DBG("nRF RPC init ok");
-    rpc_initialized = true;
+    if (!evt_ept_registered) {
+        /* The instance is open by now, nRF RPC shares it */
+        err = ipc_service_register_endpoint(DEVICE_DT_GET(DT_NODELABEL(ipc0)),
+                                            &m_evt_ept, &m_evt_ept_cfg);
+        if (err) {
+            LOG_ERR("ESB event endpoint register failed: %d", err);
+            return err;
+        }
+        evt_ept_registered = true;
+    }
 
     return 0;
 }
@@ -0,0 +1,236 @@
+#ifndef __ESB_IPC_H
+#define __ESB_IPC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* ESB events from the net core to the app core travel over their own IPC
+ * endpoint instead of one nRF RPC CBOR message each. One IPC message carries
+ * a batch:
+ *
+ * [batch header][event header][payload][event header][payload]...
+ *
+ * Payloads and messages to send go the other way over the same endpoint,
+ * one IPC message each, and the app core does not wait for the net core:
+ *
+ * [tx header][data]
+ *
+ * Those the net core could not queue come back as an event of type
+ * YKB_ESB_EVT_TX_ERROR with the id of the message and the int32_t error as
+ * payload.
+ *
+ * Both sides are built from the same tree, so the layout is shared as is,
+ * same as the structs sent over nRF RPC.
+ */
+
+#define ESB_IPC_EPT_NAME "ykb_esb_ept"
+
+enum esb_ipc_tx_type {
+    /* A single ESB payload, see ykb_esb_send() */
+    ESB_IPC_TX_PAYLOAD,
+    /* A message the net core splits into payloads, see ykb_esb_send_msg() */
+    ESB_IPC_TX_MSG,
+};
+
+struct __attribute__((__packed__)) esb_ipc_tx_hdr {
+    uint8_t type;
+    /* ykb_esb_class_t of a payload */
+    uint8_t cls;
+    /* Transfer id and ykb_protocol type_flags of a message */
+    uint8_t id;
+    uint8_t flags;
+    uint16_t len;
+};
+
+struct __attribute__((__packed__)) esb_ipc_batch_hdr {
+    /* Incremented for every batch, a gap means batches were lost */
+    uint16_t seq;
+    uint8_t count;
+    /* Events the net core had no room for since the previous batch */
+    uint8_t dropped;
+};
+
+struct __attribute__((__packed__)) esb_ipc_evt_hdr {
+    uint8_t type;
+    /* Transfer id of a reassembled message */
+    uint8_t id;
+    uint16_t len;
+};
+
+/* Walks the events of a batch. Returns false once the batch is exhausted or
+ * malformed, *pos starts after the batch header.
+ */
+static inline bool esb_ipc_batch_next(const uint8_t *batch, size_t batch_len,
+                                      size_t *pos, struct esb_ipc_evt_hdr *hdr,
+                                      const uint8_t **payload) {
+    if (batch_len - *pos < sizeof(*hdr)) {
+        return false;
+    }
+
+    memcpy(hdr, &batch[*pos], sizeof(*hdr));
+    if (batch_len - *pos - sizeof(*hdr) < hdr->len) {
+        return false;
+    }
+
+    *payload = &batch[*pos + sizeof(*hdr)];
+    *pos += sizeof(*hdr) + hdr->len;
+
+    return true;
+}
+
+/* Events waiting on the net core for the next batch. Filled from the ESB
+ * event handler and drained by the send work: one producer which only moves
+ * tail, one consumer which only moves head, so the ring needs no lock. The
+ * producer puts the header and payload of an event before it publishes
+ * tail. head == tail is empty, so one byte of buf always stays free.
+ */
+struct esb_ipc_ring {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;
+    uint32_t tail;
+    /* Events the ring had no room for since the previous batch */
+    uint32_t dropped;
+};
+
+/* Batch on its way to the app core. A batch the IPC had no buffer for is
+ * kept in buf and sent again.
+ */
+struct esb_ipc_batch {
+    uint8_t *buf;
+    size_t size;
+    /* 0 while no batch is kept */
+    size_t len;
+    uint16_t seq;
+    uint8_t max_events;
+};
+
+static inline void esb_ipc_ring_init(struct esb_ipc_ring *r, uint8_t *buf,
+                                     uint32_t size) {
+    *r = (struct esb_ipc_ring){.buf = buf, .size = size};
+}
+
+static inline void esb_ipc_batch_init(struct esb_ipc_batch *b, uint8_t *buf,
+                                      size_t size, uint8_t max_events) {
+    *b = (struct esb_ipc_batch){
+        .buf = buf,
+        .size = size,
+        .max_events = max_events,
+    };
+}
+
+static inline uint32_t esb_ipc_ring_wrap(const struct esb_ipc_ring *r,
+                                         uint32_t at) {
+    return at < r->size ? at : at - r->size;
+}
+
+static inline uint32_t esb_ipc_ring_used(const struct esb_ipc_ring *r,
+                                         uint32_t head, uint32_t tail) {
+    return tail >= head ? tail - head : r->size - head + tail;
+}
+
+/* Returns the index after the data */
+static inline uint32_t esb_ipc_ring_write(struct esb_ipc_ring *r, uint32_t at,
+                                          const uint8_t *data, uint32_t len) {
+    uint32_t first = len < r->size - at ? len : r->size - at;
+
+    memcpy(&r->buf[at], data, first);
+    memcpy(r->buf, &data[first], len - first);
+
+    return esb_ipc_ring_wrap(r, at + len);
+}
+
+/* Returns the index after the data */
+static inline uint32_t esb_ipc_ring_read(const struct esb_ipc_ring *r,
+                                         uint32_t at, uint8_t *data,
+                                         uint32_t len) {
+    uint32_t first = len < r->size - at ? len : r->size - at;
+
+    memcpy(data, &r->buf[at], first);
+    memcpy(&data[first], r->buf, len - first);
+
+    return esb_ipc_ring_wrap(r, at + len);
+}
+
+/* Producer side. Returns false if the event was dropped, the drop is
+ * reported by the next batch.
+ */
+static inline bool esb_ipc_ring_put(struct esb_ipc_ring *r,
+                                    const struct esb_ipc_evt_hdr *hdr,
+                                    const uint8_t *payload) {
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = r->tail;
+
+    if (r->size - 1 - esb_ipc_ring_used(r, head, tail) <
+        sizeof(*hdr) + hdr->len) {
+        __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    tail = esb_ipc_ring_write(r, tail, (const uint8_t *)hdr, sizeof(*hdr));
+    if (hdr->len != 0) {
+        tail = esb_ipc_ring_write(r, tail, payload, hdr->len);
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/* Consumer side. Returns true if there is a batch to send, the one kept or
+ * a new one with whole events from the ring, up to the batch size or
+ * max_events.
+ */
+static inline bool esb_ipc_batch_ready(struct esb_ipc_batch *b,
+                                       struct esb_ipc_ring *r) {
+    if (b->len != 0) {
+        return true;
+    }
+
+    uint32_t dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    struct esb_ipc_batch_hdr batch_hdr = {
+        .seq = b->seq,
+        .dropped = (uint8_t)(dropped < UINT8_MAX ? dropped : UINT8_MAX),
+    };
+    uint32_t head = r->head;
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    size_t len = sizeof(batch_hdr);
+
+    /* Drops past what one header holds are reported by the next batch */
+    __atomic_fetch_sub(&r->dropped, batch_hdr.dropped, __ATOMIC_RELAXED);
+
+    while (batch_hdr.count < b->max_events) {
+        struct esb_ipc_evt_hdr hdr;
+
+        if (esb_ipc_ring_used(r, head, tail) < sizeof(hdr)) {
+            break;
+        }
+        esb_ipc_ring_read(r, head, (uint8_t *)&hdr, sizeof(hdr));
+        if (b->size - len < sizeof(hdr) + hdr.len) {
+            break;
+        }
+
+        head = esb_ipc_ring_read(r, head, &b->buf[len], sizeof(hdr) + hdr.len);
+        len += sizeof(hdr) + hdr.len;
+        batch_hdr.count++;
+    }
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+    if (batch_hdr.count == 0 && batch_hdr.dropped == 0) {
+        return false;
+    }
+
+    memcpy(b->buf, &batch_hdr, sizeof(batch_hdr));
+    b->len = len;
+
+    return true;
+}
+
+/* The batch went out, or failed for good */
+static inline void esb_ipc_batch_sent(struct esb_ipc_batch *b) {
+    b->len = 0;
+    b->seq++;
+}
+
+#endif
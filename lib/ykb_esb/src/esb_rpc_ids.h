@@ -1,15 +1,11 @@
 #ifndef __ESB_RPC_IDS_H
 #define __ESB_RPC_IDS_H
 
-/* The command and event IDs need to be the same for both RPC sides. */
+/* The command IDs need to be the same for both RPC sides. */
 
 enum rpc_command {
     RPC_COMMAND_ESB_INIT = 0x01,
-    RPC_COMMAND_ESB_TX = 0x02,
-};
-
-enum rpc_event {
-    RPC_EVENT_ESB_CB = 0x01,
+    /* Data to send goes over the ESB endpoint, see esb_ipc.h */
 };
 
 #endif
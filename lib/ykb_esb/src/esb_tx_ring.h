@@ -0,0 +1,138 @@
+#ifndef __ESB_TX_RING_H
+#define __ESB_TX_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Bookkeeping of the payloads ykb_esb.c hands to the ESB TX FIFO. The
+ * payloads themselves live in the caller's arrays, this only tracks which
+ * are queued, loaded and acknowledged, so it can be checked on the host
+ * against a model of the FIFO.
+ *
+ * PTX: payloads we initiate. PRX: bulk ACK payloads, ESB hands them out in
+ * order, one with the ACK of every new packet from the PTX.
+ *
+ * Ring descriptors are written in place by the producer and stay in the
+ * ring until ESB reports them acknowledged:
+ *   tail    .. written : loaded into the ESB TX FIFO, waiting for their ACK
+ *   written .. head    : queued, not loaded yet
+ * Indices run freely, the caller wraps them into its array.
+ *
+ * PRX real-time ACK payload, latest wins: a newer payload replaces the one
+ * not loaded yet. It is loaded ahead of the queued bulk payloads, behind
+ * those already in the TX FIFO. Flushing the FIFO to get it out sooner
+ * would drop the payload already attached to the ACK in flight.
+ */
+struct esb_tx_ring {
+    uint32_t size;
+    uint32_t head;
+    uint32_t written;
+    uint32_t tail;
+
+    /* Waiting to be loaded into the TX FIFO */
+    bool rt_pending;
+    /* In the TX FIFO, waiting for the PTX to confirm its ACK */
+    bool rt_loaded;
+    /* Bulk payloads in the TX FIFO ahead of the loaded real-time one */
+    uint32_t rt_ahead;
+};
+
+static inline void esb_tx_ring_init(struct esb_tx_ring *r, uint32_t size) {
+    *r = (struct esb_tx_ring){.size = size};
+}
+
+/* Payloads not acknowledged yet, loaded or not */
+static inline uint32_t esb_tx_ring_unacked(const struct esb_tx_ring *r) {
+    return r->head - r->tail + r->rt_pending + r->rt_loaded;
+}
+
+/* Payloads in the TX FIFO */
+static inline uint32_t esb_tx_ring_loaded(const struct esb_tx_ring *r) {
+    return r->written - r->tail + r->rt_loaded;
+}
+
+/* Claims the next bulk descriptor, false if the ring is full. The caller
+ * fills descriptor *idx before anything is loaded again.
+ */
+static inline bool esb_tx_ring_push(struct esb_tx_ring *r, uint32_t *idx) {
+    if (r->head - r->tail == r->size) {
+        return false;
+    }
+    *idx = r->head++;
+    return true;
+}
+
+/* The real-time payload was replaced with a newer one */
+static inline void esb_tx_ring_push_rt(struct esb_tx_ring *r) {
+    r->rt_pending = true;
+}
+
+/* Tells whether the real-time payload is next to load */
+static inline bool esb_tx_ring_rt_next(const struct esb_tx_ring *r) {
+    return r->rt_pending && !r->rt_loaded;
+}
+
+/* The real-time payload went into the TX FIFO */
+static inline void esb_tx_ring_rt_written(struct esb_tx_ring *r) {
+    r->rt_ahead = r->written - r->tail;
+    r->rt_loaded = true;
+    r->rt_pending = false;
+}
+
+/* Tells whether a bulk payload is next to load with at most depth of them
+ * in the TX FIFO, and which
+ */
+static inline bool esb_tx_ring_next(const struct esb_tx_ring *r,
+                                    uint32_t depth, uint32_t *idx) {
+    if (r->written == r->head || r->written - r->tail >= depth) {
+        return false;
+    }
+    *idx = r->written;
+    return true;
+}
+
+/* The bulk payload esb_tx_ring_next() named went into the TX FIFO */
+static inline void esb_tx_ring_written(struct esb_tx_ring *r) {
+    r->written++;
+}
+
+/* Releases the n oldest loaded payloads, in the order they sit in the TX
+ * FIFO
+ */
+static inline void esb_tx_ring_release(struct esb_tx_ring *r, uint32_t n) {
+    while (n--) {
+        if (r->rt_loaded && r->rt_ahead == 0) {
+            r->rt_loaded = false;
+        } else if (r->tail != r->written) {
+            r->tail++;
+            if (r->rt_loaded) {
+                r->rt_ahead--;
+            }
+        } else {
+            break;
+        }
+    }
+}
+
+/* The TX FIFO was emptied with left payloads still in it. It held exactly
+ * the loaded payloads which were not acknowledged, so all loaded before
+ * them are released.
+ */
+static inline void esb_tx_ring_flushed(struct esb_tx_ring *r, uint32_t left) {
+    uint32_t loaded = esb_tx_ring_loaded(r);
+
+    esb_tx_ring_release(r, loaded > left ? loaded - left : 0);
+}
+
+/* Marks every unacknowledged payload for loading again, after the FIFO was
+ * flushed or the radio was torn down at the end of a timeslot
+ */
+static inline void esb_tx_ring_rewind(struct esb_tx_ring *r) {
+    r->written = r->tail;
+    if (r->rt_loaded) {
+        r->rt_loaded = false;
+        r->rt_pending = true;
+    }
+}
+
+#endif
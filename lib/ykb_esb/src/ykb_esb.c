@@ -2,6 +2,8 @@
 
 #include <lib/ykb_timeslot.h>
 
+#include "esb_tx_ring.h"
+
 #include <esb.h>
 
 #include <stdint.h>
@@ -23,43 +25,49 @@ static bool m_active;
 static uint8_t m_base_addr_0[4];
 static uint8_t m_base_addr_1[4];
 
-/* ------------------------- PTX TX queue ---------------------------- */
-/* Used only for PTX "initiated" transmissions. */
-K_MSGQ_DEFINE(m_msgq_tx_payloads, sizeof(struct esb_payload), 8, 4);
+/* ------------------------- TX ring --------------------------------- */
+/* Descriptors are written in place by ykb_esb_send(), see esb_tx_ring.h for
+ * their life cycle. Ring indices wrap through TX_RING_IDX().
+ */
+#define TX_RING_SIZE CONFIG_LIB_YKB_ESB_TX_QUEUE_SIZE
+#define TX_RING_IDX(i) ((i) % TX_RING_SIZE)
+#define PTX_BURST MIN(CONFIG_LIB_YKB_ESB_PTX_BURST, CONFIG_ESB_TX_FIFO_SIZE)
+#define PRX_ACK_DEPTH                                                          \
+    MIN(CONFIG_LIB_YKB_ESB_PRX_ACK_DEPTH, CONFIG_ESB_TX_FIFO_SIZE - 1)
+
+static struct esb_payload m_tx_ring[TX_RING_SIZE];
+/* PRX real-time ACK payload, latest wins */
+static struct esb_payload m_prx_rt;
+static struct esb_tx_ring m_tx = {.size = TX_RING_SIZE};
+static struct k_spinlock m_tx_lock;
 
 /* ------------------------- RX buffer ------------------------------- */
 static struct esb_payload rx_payload;
 
-/* ------------------------- PRX ACK cache (Pattern A) --------------- */
-
-static struct esb_payload m_prx_ack_cache;
-static bool m_prx_ack_cache_valid;
-
 /* ------------------------- Forward decls --------------------------- */
 
 static int clocks_start(void);
 static int esb_initialize(ykb_esb_mode_t mode);
 static void on_timeslot_start_stop(timeslot_callback_type_t type);
 
-static int ptx_kick_next_from_msgq(void);
-
-static void prx_preload_cached_ack(void);
-static void prx_set_cached_ack_from_data(const uint8_t *data, size_t len);
+static void tx_fill_fifo(void);
+static void tx_on_tx_success(void);
+static void tx_flush_fifo(void);
+static void tx_rewind(void);
 
 /* ------------------------- ESB event handler ----------------------- */
 
 static void event_handler(struct esb_evt const *event) {
-    static struct esb_payload tmp_payload;
-
     switch (event->evt_id) {
 
     case ESB_EVENT_TX_SUCCESS:
         LOG_DBG("ESB_EVENT_TX_SUCCESS");
+#if CONFIG_LIB_YKB_ESB_MPSL
+        timeslot_handler_report_activity();
+#endif // CONFIG_LIB_YKB_ESB_MPSL
 
-        /* PTX: pop the item we previously peeked */
-        if (m_config.mode == YKB_ESB_MODE_PTX) {
-            (void)k_msgq_get(&m_msgq_tx_payloads, &tmp_payload, K_NO_WAIT);
-        }
+        /* Release the acknowledged descriptor */
+        tx_on_tx_success();
 
         /* Many ESB implementations deliver ACK payload to RX FIFO after TX. */
         while (esb_read_rx_payload(&rx_payload) == 0) {
@@ -73,20 +81,19 @@ static void event_handler(struct esb_evt const *event) {
         m_event.data_length = 0;
         m_callback(&m_event, m_config.user_ptr);
 
-        /* PTX: send next queued payload */
-        if (m_config.mode == YKB_ESB_MODE_PTX) {
-            (void)ptx_kick_next_from_msgq();
-        }
+        /* Top the TX FIFO up with queued payloads */
+        tx_fill_fifo();
 
         break;
 
     case ESB_EVENT_TX_FAILED:
         LOG_DBG("ESB_EVENT_TX_FAILED");
 
-        if (m_config.mode == YKB_ESB_MODE_PTX) {
-            /* Flush and retry later; your original behavior. */
-            esb_flush_tx();
-            (void)ptx_kick_next_from_msgq();
+        /* Unless a merged TX_SUCCESS event already restarted the radio */
+        if (m_config.mode == YKB_ESB_MODE_PTX && esb_is_idle()) {
+            /* Flush and retry every unacknowledged payload in order */
+            tx_flush_fifo();
+            tx_fill_fifo();
         }
 
         m_event.evt_type = YKB_ESB_EVT_TX_FAIL;
@@ -95,6 +102,9 @@ static void event_handler(struct esb_evt const *event) {
         break;
 
     case ESB_EVENT_RX_RECEIVED:
+#if CONFIG_LIB_YKB_ESB_MPSL
+        timeslot_handler_report_activity();
+#endif // CONFIG_LIB_YKB_ESB_MPSL
         while (esb_read_rx_payload(&rx_payload) == 0) {
             LOG_DBG("RX len=%u", rx_payload.length);
 
@@ -103,6 +113,11 @@ static void event_handler(struct esb_evt const *event) {
             m_event.data_length = rx_payload.length;
             m_callback(&m_event, m_config.user_ptr);
         }
+
+        /* PRX: have the next ACK payload ready for the next packet */
+        if (m_config.mode == YKB_ESB_MODE_PRX) {
+            tx_fill_fifo();
+        }
         break;
 
     default:
@@ -144,62 +159,6 @@ static int clocks_start(void) {
     return 0;
 }
 
-/* -------------------- PRX cached ACK payload helpers ---------------- */
-
-static void prx_preload_cached_ack(void) {
-    if (m_config.mode != YKB_ESB_MODE_PRX) {
-        return;
-    }
-    if (!m_prx_ack_cache_valid) {
-        return;
-    }
-
-    /* "Latest wins": clear ESB TX FIFO and preload one payload. */
-    esb_flush_tx();
-
-    int ret = esb_write_payload(&m_prx_ack_cache);
-    LOG_DBG("PRX preload ack: ret=%d len=%u", ret, m_prx_ack_cache.length);
-
-    /* If ret < 0, you can log; retry will happen on next resume/update. */
-}
-
-static void prx_set_cached_ack_from_data(const uint8_t *data, size_t len) {
-    if (m_config.mode != YKB_ESB_MODE_PRX) {
-        return;
-    }
-
-    if (!data || len > sizeof(m_prx_ack_cache.data)) {
-        return;
-    }
-
-    m_prx_ack_cache.pipe = 0;
-    m_prx_ack_cache.noack = false;
-    m_prx_ack_cache.length = (uint8_t)len;
-    memcpy(m_prx_ack_cache.data, data, len);
-    m_prx_ack_cache_valid = true;
-
-    if (m_active) {
-        prx_preload_cached_ack();
-    }
-}
-
-/* Optional public helper:
- * If you want to explicitly set the PRX ACK payload from the app, expose this
- * in your header. If you don't want a new API, see ykb_esb_send() PRX handling
- * below.
- */
-int ykb_esb_prx_set_ack_payload(const uint8_t *data, size_t len) {
-    if (m_config.mode != YKB_ESB_MODE_PRX) {
-        return -EINVAL;
-    }
-    if (!data || len > sizeof(m_prx_ack_cache.data)) {
-        return -EMSGSIZE;
-    }
-
-    prx_set_cached_ack_from_data(data, len);
-    return 0;
-}
-
 /* ------------------------- ESB init -------------------------------- */
 
 static int esb_initialize(ykb_esb_mode_t mode) {
@@ -245,8 +204,7 @@ static int esb_initialize(ykb_esb_mode_t mode) {
 
 #if CONFIG_LIB_YKB_ESB_MPSL
     if (mode == YKB_ESB_MODE_PRX) {
-        /* Restore cached ACK payload after every init/resume */
-        prx_preload_cached_ack();
+        /* ACK payloads are loaded again once the slot is active */
         esb_start_rx();
     }
 #endif // CONFIG_LIB_YKB_ESB_MPSL
@@ -254,27 +212,107 @@ static int esb_initialize(ykb_esb_mode_t mode) {
     return 0;
 }
 
-/* -------------------- PTX msgq -> ESB TX ---------------------------- */
+/* -------------------- TX ring -> ESB TX ---------------------------- */
+
+/* PTX: loads up to PTX_BURST queued payloads into the TX FIFO and starts it.
+ * With ESB_TXMODE_MANUAL_START the radio then sends the whole FIFO back to
+ * back, so a multi-fragment transfer goes out within one timeslot.
+ *
+ * PRX: keeps PRX_ACK_DEPTH ACK payloads in the TX FIFO. The PTX picks up one
+ * with every new packet it sends, so bulk payloads stream at its polling
+ * rate. ESB attaches the next one to the ACK before its event reaches us,
+ * which is why a single loaded payload would leave every other ACK empty.
+ */
+static void tx_fill_fifo(void) {
+    k_spinlock_key_t key = k_spin_lock(&m_tx_lock);
+    bool prx = m_config.mode == YKB_ESB_MODE_PRX;
 
 #if CONFIG_LIB_YKB_ESB_MPSL
-static int ptx_kick_next_from_msgq(void) {
-    int ret;
-    static struct esb_payload tx_payload;
+    /* Sizes the coming timeslots, also while outside of one */
+    timeslot_handler_report_pending((uint16_t)esb_tx_ring_unacked(&m_tx));
+#endif // CONFIG_LIB_YKB_ESB_MPSL
 
-    /* PTX: Peek, and remove only on TX_SUCCESS */
-    if (k_msgq_peek(&m_msgq_tx_payloads, &tx_payload) != 0) {
-        return -ENOMEM;
+    if (!m_active) {
+        k_spin_unlock(&m_tx_lock, key);
+        return;
     }
 
-    ret = esb_write_payload(&tx_payload);
-    if (ret < 0) {
-        return ret;
+    if (prx && esb_tx_ring_rt_next(&m_tx) &&
+        esb_write_payload(&m_prx_rt) == 0) {
+        esb_tx_ring_rt_written(&m_tx);
     }
 
-    esb_start_tx();
-    return 0;
+    uint32_t burst = prx ? PRX_ACK_DEPTH : PTX_BURST;
+    uint32_t idx;
+
+    while (esb_tx_ring_next(&m_tx, burst, &idx)) {
+        if (esb_write_payload(&m_tx_ring[TX_RING_IDX(idx)]) < 0) {
+            break;
+        }
+        esb_tx_ring_written(&m_tx);
+    }
+
+    if (!prx && esb_tx_ring_loaded(&m_tx) > 0) {
+        /* -EBUSY: the radio is still working through the FIFO */
+        (void)esb_start_tx();
+    }
+
+    k_spin_unlock(&m_tx_lock, key);
+}
+
+/* ESB merges a TX_SUCCESS event into one still pending, so an event stands
+ * for at least one acknowledged payload, maybe more. Each event releases
+ * one, the FIFO state settles the rest once it can be read.
+ */
+static void tx_on_tx_success(void) {
+    if (m_config.mode == YKB_ESB_MODE_PTX && esb_is_idle()) {
+        /* Either the FIFO ran empty or a payload failed, the TX_FAILED
+         * event which follows then finds the retry already under way.
+         */
+        tx_flush_fifo();
+        return;
+    }
+
+    /* PRX: ESB drops the front of the FIFO once the PTX confirmed the ACK
+     * carrying it by sending a new packet.
+     */
+    k_spinlock_key_t key = k_spin_lock(&m_tx_lock);
+
+    esb_tx_ring_release(&m_tx, 1);
+
+    k_spin_unlock(&m_tx_lock, key);
+}
+
+/* Empties the TX FIFO while the radio is idle. What is left in it settles
+ * how many payloads were acknowledged, however many TX_SUCCESS events ESB
+ * merged, and the rest is marked for loading again.
+ */
+static void tx_flush_fifo(void) {
+    uint32_t left = 0;
+
+    while (esb_pop_tx() == 0) {
+        left++;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&m_tx_lock);
+
+    esb_tx_ring_flushed(&m_tx, left);
+
+    k_spin_unlock(&m_tx_lock, key);
+
+    tx_rewind();
+}
+
+/* Marks every unacknowledged payload for loading again, after the FIFO was
+ * flushed or the radio was torn down at the end of a timeslot.
+ */
+static void tx_rewind(void) {
+    k_spinlock_key_t key = k_spin_lock(&m_tx_lock);
+
+    esb_tx_ring_rewind(&m_tx);
+
+    k_spin_unlock(&m_tx_lock, key);
 }
-#endif // CONFIG_LIB_YKB_ESB_MPSL
 
 /* ------------------------- Public API ------------------------------ */
 
@@ -296,21 +334,28 @@ int ykb_esb_init(ykb_esb_config_t *cfg, ykb_esb_callback_t callback) {
     }
 
     LOG_INF("Timeslot handler init");
-    timeslot_handler_init(on_timeslot_start_stop);
+    /* The PRX cannot know when the PTX sends next, it keeps listening */
+    timeslot_handler_init(on_timeslot_start_stop,
+                          m_config.mode == YKB_ESB_MODE_PRX);
 #endif // CONFIG_LIB_YKB_ESB_MPSL
 
     return 0;
 }
 
+void ykb_esb_set_ready_callback(ykb_esb_ready_callback_t callback,
+                                void *user_ptr) {
+    /* The radio is local, nothing to wait for */
+    if (callback) {
+        callback(user_ptr);
+    }
+}
+
 /*
  * ykb_esb_send():
- *  - PTX: queue packet for normal transmit.
- *  - PRX (Pattern A): update the "latest ACK payload" cache, so that the next
- *    PTX TX will receive it as ACK payload.
- *
- * If you prefer to keep the old semantics (PRX shouldn't accept send),
- * you can return -ENOTSUP for PRX and use ykb_esb_prx_set_ack_payload()
- * instead.
+ *  - PTX: queue packet for transmit.
+ *  - PRX: queue packet as ACK payload, the PTX gets it with the ACK of one of
+ *    its next packets. Real-time ones replace the previous real-time one if
+ *    it was not loaded yet and go ahead of queued bulk ones.
  */
 int ykb_esb_send(ykb_esb_data_t *tx_packet) {
     if (!tx_packet) {
@@ -321,29 +366,30 @@ int ykb_esb_send(ykb_esb_data_t *tx_packet) {
         return -EMSGSIZE;
     }
 
-#if CONFIG_LIB_YKB_ESB_MPSL
-    if (m_config.mode == YKB_ESB_MODE_PRX) {
-        /* Overwrite cached ACK payload */
-        prx_set_cached_ack_from_data(tx_packet->data, tx_packet->len);
-        return 0;
-    }
-#endif // CONFIG_LIB_YKB_ESB_MPSL
-
-    /* PTX path */
-    struct esb_payload tx_payload;
-    tx_payload.pipe = 0;
-    tx_payload.noack = false;
-    tx_payload.length = tx_packet->len;
-    memcpy(tx_payload.data, tx_packet->data, tx_packet->len);
+    k_spinlock_key_t key = k_spin_lock(&m_tx_lock);
+    struct esb_payload *tx_payload;
+    uint32_t idx;
 
-    int ret = k_msgq_put(&m_msgq_tx_payloads, &tx_payload, K_NO_WAIT);
-    if (ret != 0) {
+    if (m_config.mode == YKB_ESB_MODE_PRX &&
+        tx_packet->cls == YKB_ESB_CLASS_RT) {
+        tx_payload = &m_prx_rt;
+        esb_tx_ring_push_rt(&m_tx);
+    } else if (!esb_tx_ring_push(&m_tx, &idx)) {
+        k_spin_unlock(&m_tx_lock, key);
         return -ENOMEM;
+    } else {
+        /* Fill the descriptor in place, only the producer moves head */
+        tx_payload = &m_tx_ring[TX_RING_IDX(idx)];
     }
 
-    if (m_active) {
-        (void)ptx_kick_next_from_msgq();
-    }
+    tx_payload->pipe = 0;
+    tx_payload->noack = false;
+    tx_payload->length = tx_packet->len;
+    memcpy(tx_payload->data, tx_packet->data, tx_packet->len);
+
+    k_spin_unlock(&m_tx_lock, key);
+
+    tx_fill_fifo();
 
     return 0;
 }
@@ -372,6 +418,8 @@ static int ykb_esb_suspend(void) {
         NRF_TIMER2->TASKS_STOP = 1;
         NRF_RADIO->INTENCLR = 0xFFFFFFFF;
 
+        /* Settles acknowledgments whose events will not come anymore */
+        tx_flush_fifo();
         esb_disable();
 
         NVIC_ClearPendingIRQ(RADIO_IRQn);
@@ -379,6 +427,7 @@ static int ykb_esb_suspend(void) {
     } else {
         /* PRX: stop RX and fully tear down if you're doing that each slot */
         esb_stop_rx();
+        tx_flush_fifo();
         esb_disable();
     }
 
@@ -401,13 +450,9 @@ static int ykb_esb_resume(void) {
         return err;
     }
 
-    /* PTX: kick TX if anything queued */
-    if (m_config.mode == YKB_ESB_MODE_PTX) {
-        (void)ptx_kick_next_from_msgq();
-    } else {
-        /* PRX: ensure cached ACK payload is loaded this slot */
-        prx_preload_cached_ack();
-    }
+    /* The FIFO did not survive the last slot, load it again */
+    tx_rewind();
+    tx_fill_fifo();
 
     return 0;
 }
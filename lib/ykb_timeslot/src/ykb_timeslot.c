@@ -11,8 +11,10 @@
 #include <zephyr/console/console.h>
 #include <zephyr/irq.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/util.h>
 #include <zephyr/types.h>
 
 #include <zephyr/logging/log.h>
@@ -20,16 +22,23 @@
 LOG_MODULE_REGISTER(ykb_timeslot, CONFIG_YKB_TIMESLOT_LOG_LEVEL);
 
 #define TIMESLOT_REQUEST_TIMEOUT_US 1000000
-#define TIMESLOT_LENGTH_US 10000
 #define TIMESLOT_EXT_MARGIN_MARGIN 1000
 #define TIMESLOT_REQ_EARLIEST_MARGIN 100
-#define TIMER_EXPIRY_US_EARLY                                                  \
-    (TIMESLOT_LENGTH_US - MPSL_TIMESLOT_EXTENSION_MARGIN_MIN_US -              \
+#define TIMER_EXPIRY_US_EARLY(length)                                          \
+    ((length) - MPSL_TIMESLOT_EXTENSION_MARGIN_MIN_US -                        \
      TIMESLOT_EXT_MARGIN_MARGIN)
-#define TIMER_EXPIRY_REQ                                                       \
-    (TIMESLOT_LENGTH_US - MPSL_TIMESLOT_EXTENSION_MARGIN_MIN_US -              \
+#define TIMER_EXPIRY_REQ(length)                                               \
+    ((length) - MPSL_TIMESLOT_EXTENSION_MARGIN_MIN_US -                        \
      TIMESLOT_REQ_EARLIEST_MARGIN)
 
+BUILD_ASSERT(CONFIG_LIB_YKB_TIMESLOT_MIN_LENGTH_US >
+                 MPSL_TIMESLOT_EXTENSION_MARGIN_MIN_US +
+                     TIMESLOT_EXT_MARGIN_MARGIN,
+             "LIB_YKB_TIMESLOT_MIN_LENGTH_US leaves no room for extending");
+BUILD_ASSERT(CONFIG_LIB_YKB_TIMESLOT_MIN_LENGTH_US <=
+                 CONFIG_LIB_YKB_TIMESLOT_MAX_LENGTH_US,
+             "LIB_YKB_TIMESLOT_MIN_LENGTH_US is above the maximum");
+
 #define MPSL_THREAD_PRIO 8
 #define STACKSIZE CONFIG_MAIN_STACK_SIZE
 
@@ -42,14 +51,32 @@ void radio_irq_handler(void);
 // Requests and callbacks to be run serialized from an SWI interrupt
 enum mpsl_timeslot_call { OPEN_SESSION, MAKE_REQUEST, CLOSE_SESSION };
 
-// Timeslot request
+// Timeslot requests, sized by the policy before every use
 static mpsl_timeslot_request_t timeslot_request_earliest = {
     .request_type = MPSL_TIMESLOT_REQ_TYPE_EARLIEST,
     .params.earliest.hfclk = MPSL_TIMESLOT_HFCLK_CFG_NO_GUARANTEE,
     .params.earliest.priority = MPSL_TIMESLOT_PRIORITY_NORMAL,
-    .params.earliest.length_us = TIMESLOT_LENGTH_US,
+    .params.earliest.length_us = CONFIG_LIB_YKB_TIMESLOT_MIN_LENGTH_US,
     .params.earliest.timeout_us = TIMESLOT_REQUEST_TIMEOUT_US};
 
+static mpsl_timeslot_request_t timeslot_request_normal = {
+    .request_type = MPSL_TIMESLOT_REQ_TYPE_NORMAL,
+    .params.normal.hfclk = MPSL_TIMESLOT_HFCLK_CFG_NO_GUARANTEE,
+    .params.normal.priority = MPSL_TIMESLOT_PRIORITY_NORMAL,
+    .params.normal.length_us = CONFIG_LIB_YKB_TIMESLOT_MIN_LENGTH_US};
+
+static ykb_timeslot_policy_t m_policy;
+static atomic_t m_pending;
+static atomic_t m_activity;
+static atomic_t m_ble_interval_us;
+
+// Length of the requested slot and of the requested extension
+static uint32_t m_request_length_us;
+static uint32_t m_extend_length_us;
+// End of the running slot, counted from its start
+static uint32_t m_slot_end_us;
+static mpsl_timeslot_request_t *m_next_request = &timeslot_request_earliest;
+
 static mpsl_timeslot_signal_return_param_t signal_callback_return_param;
 
 // Message queue for requesting MPSL API calls to non-preemptible thread
@@ -65,6 +92,54 @@ static void schedule_request(enum mpsl_timeslot_call call) {
     }
 }
 
+static void policy_input(ykb_timeslot_policy_input_t *in) {
+    in->pending = (uint16_t)atomic_get(&m_pending);
+    in->activity = 0;
+    in->ble_interval_us = (uint32_t)atomic_get(&m_ble_interval_us);
+}
+
+static void policy_decide(ykb_timeslot_policy_decision_t *decision) {
+    ykb_timeslot_policy_input_t in;
+
+    policy_input(&in);
+    in.activity = (uint16_t)MIN(atomic_clear(&m_activity), UINT16_MAX);
+
+    ykb_timeslot_policy_decide(&m_policy, &in, decision);
+}
+
+static void policy_request(ykb_timeslot_policy_decision_t *decision) {
+    ykb_timeslot_policy_input_t in;
+
+    policy_input(&in);
+
+    ykb_timeslot_policy_request(&m_policy, &in, decision);
+}
+
+// Normal requests are placed relative to the start of the running slot, so
+// they are only used from within one. Everything else asks for the earliest
+// slot.
+static mpsl_timeslot_request_t *
+prepare_request(const ykb_timeslot_policy_decision_t *decision, bool in_slot) {
+    uint8_t priority = decision->high_priority ? MPSL_TIMESLOT_PRIORITY_HIGH
+                                               : MPSL_TIMESLOT_PRIORITY_NORMAL;
+    uint64_t distance_us = (uint64_t)m_slot_end_us + decision->gap_us;
+
+    m_request_length_us = decision->length_us;
+
+    if (in_slot && decision->gap_us != 0 &&
+        distance_us <= MPSL_TIMESLOT_DISTANCE_MAX_US) {
+        timeslot_request_normal.params.normal.priority = priority;
+        timeslot_request_normal.params.normal.length_us = decision->length_us;
+        timeslot_request_normal.params.normal.distance_us =
+            (uint32_t)distance_us;
+        return &timeslot_request_normal;
+    }
+
+    timeslot_request_earliest.params.earliest.priority = priority;
+    timeslot_request_earliest.params.earliest.length_us = decision->length_us;
+    return &timeslot_request_earliest;
+}
+
 static void set_timeslot_active_status(bool active) {
     if (active) {
         if (!m_in_timeslot) {
@@ -83,7 +158,10 @@ static mpsl_timeslot_signal_return_param_t *
 mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
                        uint32_t signal_type) {
     (void)session_id; // unused parameter
-    static bool timeslot_extension_failed;
+    // The running slot is not extended any more, the next one is requested
+    // shortly before it ends
+    static bool timeslot_ending;
+    ykb_timeslot_policy_decision_t decision;
     NRF_P0->OUTSET = BIT(28);
     mpsl_timeslot_signal_return_param_t *p_ret_val = NULL;
     switch (signal_type) {
@@ -92,7 +170,9 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
             MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
         p_ret_val = &signal_callback_return_param;
 
-        timeslot_extension_failed = false;
+        timeslot_ending = false;
+        ykb_timeslot_policy_on_granted(&m_policy, m_request_length_us);
+        m_slot_end_us = m_request_length_us;
 
         // Reset the radio to make sure no configuration remains from BLE
         NVIC_ClearPendingIRQ(RADIO_IRQn);
@@ -103,10 +183,11 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
         nrf_timer_bit_width_set(MPSL_TIMER0, NRF_TIMER_BIT_WIDTH_32);
 
         nrf_timer_cc_set(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL0,
-                         TIMER_EXPIRY_US_EARLY);
+                         TIMER_EXPIRY_US_EARLY(m_request_length_us));
         nrf_timer_int_enable(MPSL_TIMER0, NRF_TIMER_INT_COMPARE0_MASK);
 
-        nrf_timer_cc_set(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL1, TIMER_EXPIRY_REQ);
+        nrf_timer_cc_set(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL1,
+                         TIMER_EXPIRY_REQ(m_request_length_us));
         nrf_timer_int_enable(MPSL_TIMER0, NRF_TIMER_INT_COMPARE1_MASK);
 
         set_timeslot_active_status(true);
@@ -117,20 +198,32 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
             nrf_timer_int_disable(MPSL_TIMER0, NRF_TIMER_INT_COMPARE0_MASK);
             nrf_timer_event_clear(MPSL_TIMER0, NRF_TIMER_EVENT_COMPARE0);
 
-            signal_callback_return_param.callback_action =
-                MPSL_TIMESLOT_SIGNAL_ACTION_EXTEND;
-            signal_callback_return_param.params.extend.length_us =
-                TIMESLOT_LENGTH_US;
+            policy_decide(&decision);
+            if (decision.extend) {
+                m_extend_length_us = decision.length_us;
+                signal_callback_return_param.callback_action =
+                    MPSL_TIMESLOT_SIGNAL_ACTION_EXTEND;
+                signal_callback_return_param.params.extend.length_us =
+                    decision.length_us;
+            } else {
+                // Nothing moved for a while, let the slot run out and come
+                // back after the gap
+                m_next_request = prepare_request(&decision, true);
+                timeslot_ending = true;
+                signal_callback_return_param.callback_action =
+                    MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
+                set_timeslot_active_status(false);
+            }
         } else if (nrf_timer_event_check(MPSL_TIMER0,
                                          NRF_TIMER_EVENT_COMPARE1)) {
             nrf_timer_int_disable(MPSL_TIMER0, NRF_TIMER_INT_COMPARE1_MASK);
             nrf_timer_event_clear(MPSL_TIMER0, NRF_TIMER_EVENT_COMPARE1);
 
-            if (timeslot_extension_failed) {
+            if (timeslot_ending) {
                 signal_callback_return_param.callback_action =
                     MPSL_TIMESLOT_SIGNAL_ACTION_REQUEST;
                 signal_callback_return_param.params.request.p_next =
-                    &timeslot_request_earliest;
+                    m_next_request;
             } else {
                 signal_callback_return_param.callback_action =
                     MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
@@ -143,18 +236,22 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
         signal_callback_return_param.callback_action =
             MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
 
+        ykb_timeslot_policy_on_extended(&m_policy, m_extend_length_us);
+        m_slot_end_us = (uint32_t)MIN(
+            (uint64_t)m_slot_end_us + m_extend_length_us, UINT32_MAX);
+
         // Set next trigger time to be the current + Timer expiry early
         uint32_t current_cc =
             nrf_timer_cc_get(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL0);
         nrf_timer_bit_width_set(MPSL_TIMER0, NRF_TIMER_BIT_WIDTH_32);
         nrf_timer_cc_set(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL0,
-                         current_cc + TIMESLOT_LENGTH_US);
+                         current_cc + m_extend_length_us);
         nrf_timer_int_enable(MPSL_TIMER0, NRF_TIMER_INT_COMPARE0_MASK);
 
         current_cc = nrf_timer_cc_get(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL1);
         nrf_timer_bit_width_set(MPSL_TIMER0, NRF_TIMER_BIT_WIDTH_32);
         nrf_timer_cc_set(MPSL_TIMER0, NRF_TIMER_CC_CHANNEL1,
-                         current_cc + TIMESLOT_LENGTH_US);
+                         current_cc + m_extend_length_us);
         nrf_timer_int_enable(MPSL_TIMER0, NRF_TIMER_INT_COMPARE1_MASK);
 
         p_ret_val = &signal_callback_return_param;
@@ -163,7 +260,10 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
     case MPSL_TIMESLOT_SIGNAL_EXTEND_FAILED:
         signal_callback_return_param.callback_action =
             MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
-        timeslot_extension_failed = true;
+        ykb_timeslot_policy_on_extend_failed(&m_policy);
+        policy_request(&decision);
+        m_next_request = prepare_request(&decision, false);
+        timeslot_ending = true;
         p_ret_val = &signal_callback_return_param;
         set_timeslot_active_status(false);
         break;
@@ -197,6 +297,7 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
             MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
         p_ret_val = &signal_callback_return_param;
         set_timeslot_active_status(false);
+        ykb_timeslot_policy_on_request_failed(&m_policy);
 
         // In this case returning SIGNAL_ACTION_REQUEST causes hardfault. We
         // have to request a new timeslot instead, from thread context.
@@ -209,6 +310,7 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
             MPSL_TIMESLOT_SIGNAL_ACTION_NONE;
         p_ret_val = &signal_callback_return_param;
         set_timeslot_active_status(false);
+        ykb_timeslot_policy_on_request_failed(&m_policy);
 
         // Request a new timeslot in this case
         schedule_request(MAKE_REQUEST);
@@ -255,6 +357,7 @@ mpsl_timeslot_callback(mpsl_timeslot_session_id_t session_id,
 static void mpsl_nonpreemptible_thread(void) {
     int err;
     enum mpsl_timeslot_call api_call = 0;
+    ykb_timeslot_policy_decision_t decision;
 
     /* Initialize to invalid session id */
     mpsl_timeslot_session_id_t session_id = 0xFFu;
@@ -271,8 +374,11 @@ static void mpsl_nonpreemptible_thread(void) {
                 }
                 break;
             case MAKE_REQUEST:
-                err = mpsl_timeslot_request(session_id,
-                                            &timeslot_request_earliest);
+                // No slot is running, the callback does not touch the
+                // policy until this request is granted
+                policy_request(&decision);
+                err = mpsl_timeslot_request(
+                    session_id, prepare_request(&decision, false));
                 if (err) {
                     LOG_ERR("Timeslot request error: %d", err);
                     k_oops();
@@ -294,12 +400,64 @@ static void mpsl_nonpreemptible_thread(void) {
     }
 }
 
-void timeslot_handler_init(timeslot_callback_t callback) {
+#if CONFIG_LIB_YKB_TIMESLOT_STATS_INTERVAL_MS > 0
+static void stats_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_stats_work, stats_work_handler);
+
+static void stats_work_handler(struct k_work *work) {
+    ykb_timeslot_policy_stats_t stats;
+
+    timeslot_handler_get_stats(&stats);
+    LOG_DBG("Slots granted %u, extended %u, failed %u, radio %u ms, "
+            "busy %u ms",
+            stats.granted, stats.extended, stats.failed,
+            (uint32_t)(stats.granted_us / 1000),
+            (uint32_t)(stats.busy_us / 1000));
+
+    k_work_schedule(&m_stats_work,
+                    K_MSEC(CONFIG_LIB_YKB_TIMESLOT_STATS_INTERVAL_MS));
+}
+#endif // CONFIG_LIB_YKB_TIMESLOT_STATS_INTERVAL_MS > 0
+
+void timeslot_handler_init(timeslot_callback_t callback, bool receiver) {
+    const ykb_timeslot_policy_config_t config = {
+        .min_length_us = CONFIG_LIB_YKB_TIMESLOT_MIN_LENGTH_US,
+        .max_length_us = CONFIG_LIB_YKB_TIMESLOT_MAX_LENGTH_US,
+        .payload_us = CONFIG_LIB_YKB_TIMESLOT_PAYLOAD_US,
+        .latency_target_us = CONFIG_LIB_YKB_TIMESLOT_LATENCY_TARGET_US,
+        .ble_margin_us = CONFIG_LIB_YKB_TIMESLOT_BLE_MARGIN_US,
+        .idle_slots = CONFIG_LIB_YKB_TIMESLOT_IDLE_SLOTS,
+        .keep_listening = receiver,
+        .escalate_after = CONFIG_LIB_YKB_TIMESLOT_ESCALATE_AFTER,
+    };
+
     m_callback = callback;
+    ykb_timeslot_policy_init(&m_policy, &config);
 
     schedule_request(OPEN_SESSION);
 
     schedule_request(MAKE_REQUEST);
+
+#if CONFIG_LIB_YKB_TIMESLOT_STATS_INTERVAL_MS > 0
+    k_work_schedule(&m_stats_work,
+                    K_MSEC(CONFIG_LIB_YKB_TIMESLOT_STATS_INTERVAL_MS));
+#endif // CONFIG_LIB_YKB_TIMESLOT_STATS_INTERVAL_MS > 0
+}
+
+void timeslot_handler_report_pending(uint16_t pending) {
+    atomic_set(&m_pending, pending);
+}
+
+void timeslot_handler_report_activity(void) { atomic_inc(&m_activity); }
+
+void timeslot_handler_set_ble_interval(uint32_t interval_us) {
+    atomic_set(&m_ble_interval_us, (atomic_val_t)interval_us);
+}
+
+// The counters are updated from the timeslot callback, a copy taken in
+// between may mix two updates. Good enough for statistics.
+void timeslot_handler_get_stats(ykb_timeslot_policy_stats_t *stats) {
+    *stats = m_policy.stats;
 }
 
 K_THREAD_DEFINE(mpsl_nonpreemptible_thread_id, STACKSIZE,
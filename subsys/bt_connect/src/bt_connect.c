@@ -22,6 +22,7 @@ LOG_MODULE_REGISTER(bt_connect, CONFIG_BT_CONNECT_LOG_LEVEL);
 
 #define BT_CONNECT_KBD_INPUT_REPORT_SIZE sizeof(hid_kb_report_t)
 #define BT_CONNECT_KBD_OUTPUT_REPORT_SIZE 1U
+#define BT_CONNECT_KBD_NKRO_INPUT_REPORT_SIZE sizeof(hid_kb_nkro_report_t)
 #define BT_CONNECT_MOUSE_INPUT_REPORT_SIZE sizeof(hid_mouse_report_t)
 #define BT_CONNECT_VENDOR_INPUT_REPORT_SIZE                                  \
     CONFIG_BT_CONNECT_MAX_VENDOR_IN_REPORT_SIZE
@@ -35,6 +36,9 @@ BT_HIDS_DEF(
 #if CONFIG_BT_CONNECT_KBD
     BT_CONNECT_KBD_INPUT_REPORT_SIZE, BT_CONNECT_KBD_OUTPUT_REPORT_SIZE,
 #endif
+#if CONFIG_BT_CONNECT_KBD_NKRO
+    BT_CONNECT_KBD_NKRO_INPUT_REPORT_SIZE,
+#endif
 #if CONFIG_BT_CONNECT_MOUSE
     BT_CONNECT_MOUSE_INPUT_REPORT_SIZE,
 #endif
@@ -73,6 +77,8 @@ static K_WORK_DELAYABLE_DEFINE(battery_level_publish_work,
 
 #if CONFIG_BT_CONNECT_KBD
 int bt_connect_keyboard_send_report(const hid_kb_report_t *report);
+int bt_connect_keyboard_send_nkro_report(const hid_kb_nkro_report_t *nkro,
+                                         const hid_kb_report_t *boot);
 #endif
 #if CONFIG_BT_CONNECT_MOUSE
 int bt_connect_mouse_send_report(const hid_mouse_report_t *report);
@@ -356,6 +362,19 @@ void bt_connect_send_kb_report(const hid_kb_report_t *report) {
 #endif
 }
 
+void bt_connect_send_kb_nkro_report(const hid_kb_nkro_report_t *nkro,
+                                    const hid_kb_report_t *boot) {
+#if CONFIG_BT_CONNECT_KBD
+    int err = bt_connect_keyboard_send_nkro_report(nkro, boot);
+    if (err) {
+        LOG_ERR("Failed to send keyboard NKRO report over BLE (%d)", err);
+    }
+#else
+    ARG_UNUSED(nkro);
+    ARG_UNUSED(boot);
+#endif
+}
+
 void bt_connect_send_mouse_report(const hid_mouse_report_t *report) {
 #if CONFIG_BT_CONNECT_MOUSE
     int err = bt_connect_mouse_send_report(report);
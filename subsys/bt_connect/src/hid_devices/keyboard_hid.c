@@ -8,7 +8,8 @@
 
 LOG_MODULE_DECLARE(bt_connect, CONFIG_BT_CONNECT_LOG_LEVEL);
 
-#if CONFIG_BT_CONNECT_MOUSE || CONFIG_BT_CONNECT_VENDOR
+#if CONFIG_BT_CONNECT_MOUSE || CONFIG_BT_CONNECT_VENDOR ||                   \
+    CONFIG_BT_CONNECT_KBD_NKRO
 #define BT_CONNECT_KBD_INPUT_REPORT_ID 1U
 #define BT_CONNECT_KBD_OUTPUT_REPORT_ID 6U
 #else
@@ -16,7 +17,14 @@ LOG_MODULE_DECLARE(bt_connect, CONFIG_BT_CONNECT_LOG_LEVEL);
 #define BT_CONNECT_KBD_OUTPUT_REPORT_ID 0U
 #endif
 
+#if CONFIG_BT_CONNECT_KBD_NKRO
+#define BT_CONNECT_KBD_NKRO_INPUT_REPORT_ID 7U
+#endif // CONFIG_BT_CONNECT_KBD_NKRO
+
 static uint8_t input_report_index;
+#if CONFIG_BT_CONNECT_KBD_NKRO
+static uint8_t nkro_input_report_index;
+#endif // CONFIG_BT_CONNECT_KBD_NKRO
 
 static const uint8_t hid_kbd_report_desc[] = {
     HID_USAGE_PAGE(HID_USAGE_GEN_DESKTOP),
@@ -62,6 +70,24 @@ static const uint8_t hid_kbd_report_desc[] = {
     HID_REPORT_COUNT(1),
     HID_OUTPUT(0x03),
 
+#if CONFIG_BT_CONNECT_KBD_NKRO
+    HID_REPORT_ID(BT_CONNECT_KBD_NKRO_INPUT_REPORT_ID),
+    HID_USAGE_PAGE(HID_USAGE_GEN_KEYBOARD),
+    HID_USAGE_MIN8(0xE0),
+    HID_USAGE_MAX8(0xE7),
+    HID_LOGICAL_MIN8(0),
+    HID_LOGICAL_MAX8(1),
+    HID_REPORT_SIZE(1),
+    HID_REPORT_COUNT(8),
+    HID_INPUT(0x02),
+
+    HID_USAGE_MIN8(0),
+    HID_USAGE_MAX8(HID_KB_NKRO_USAGE_MAX),
+    HID_REPORT_SIZE(1),
+    HID_REPORT_COUNT(HID_KB_NKRO_BITMAP_SIZE * 8U),
+    HID_INPUT(0x02),
+#endif // CONFIG_BT_CONNECT_KBD_NKRO
+
     HID_END_COLLECTION,
 };
 
@@ -104,6 +130,17 @@ static int append_kbd_hids_init(struct bt_hids_init_param *init,
     kbd_inp->id = BT_CONNECT_KBD_INPUT_REPORT_ID;
     (*input_count)++;
 
+#if CONFIG_BT_CONNECT_KBD_NKRO
+    nkro_input_report_index = *input_count;
+
+    struct bt_hids_inp_rep *nkro_inp =
+        &init->inp_rep_group_init.reports[*input_count];
+
+    nkro_inp->size = sizeof(hid_kb_nkro_report_t);
+    nkro_inp->id = BT_CONNECT_KBD_NKRO_INPUT_REPORT_ID;
+    (*input_count)++;
+#endif // CONFIG_BT_CONNECT_KBD_NKRO
+
     kbd_out->size = 1U;
     kbd_out->id = BT_CONNECT_KBD_OUTPUT_REPORT_ID;
     kbd_out->handler = hids_outp_rep_handler;
@@ -139,5 +176,48 @@ int bt_connect_keyboard_send_report(const hid_kb_report_t *report) {
     return 0;
 }
 
+#if CONFIG_BT_CONNECT_KBD_NKRO
+struct kb_nkro_reports {
+    const hid_kb_nkro_report_t *nkro;
+    const hid_kb_report_t *boot;
+};
+
+// Boot protocol is selected per peer, so the fallback is chosen per peer too
+static int send_kb_nkro_report_cb(const struct bt_connect_conn_state *state,
+                                  void *user_data) {
+    const struct kb_nkro_reports *reports = user_data;
+
+    if (state->in_boot_mode) {
+        return bt_hids_boot_kb_inp_rep_send(
+            bt_connect_hids_obj(), state->conn, (const uint8_t *)reports->boot,
+            sizeof(*reports->boot), NULL);
+    }
+
+    return bt_hids_inp_rep_send(bt_connect_hids_obj(), state->conn,
+                                nkro_input_report_index,
+                                (const uint8_t *)reports->nkro,
+                                sizeof(*reports->nkro), NULL);
+}
+#endif // CONFIG_BT_CONNECT_KBD_NKRO
+
+int bt_connect_keyboard_send_nkro_report(const hid_kb_nkro_report_t *nkro,
+                                         const hid_kb_report_t *boot) {
+    if (!nkro || !boot) {
+        return -EINVAL;
+    }
+
+#if CONFIG_BT_CONNECT_KBD_NKRO
+    struct kb_nkro_reports reports = {
+        .nkro = nkro,
+        .boot = boot,
+    };
+
+    bt_connect_foreach_conn(send_kb_nkro_report_cb, &reports);
+    return 0;
+#else
+    return bt_connect_keyboard_send_report(boot);
+#endif // CONFIG_BT_CONNECT_KBD_NKRO
+}
+
 BT_CONNECT_REGISTER_HID_REPORT(bt_connect_kbd_hid, hid_kbd_report_desc,
                                append_kbd_hids_init);
@@ -95,7 +95,7 @@ static int append_vendor_hids_init(struct bt_hids_init_param *init,
                                    uint8_t *input_count, uint8_t *output_count,
                                    uint8_t *feature_count) {
     int err = vendor_hid_protocol_init(&vendor_protocol_ctx, send_vendor_packet,
-                                       NULL);
+                                       NULL, false);
     if (err) {
         return err;
     }
@@ -0,0 +1,322 @@
+#include "kb_handler_internal.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+LOG_MODULE_DECLARE(kb_handler);
+
+#define KBH_CAL_NS "kbcal"
+#define KBH_CAL_ITEM "table"
+#define KBH_CAL_KEY KBH_CAL_NS "/" KBH_CAL_ITEM
+
+// Increment every time kbh_calibration_table_t or it's contents change
+#define KBH_CAL_TABLE_VERSION 1
+
+#define KBH_CAL_TRAVEL_MAX 1023U
+
+// Levels are kept in fixed point so slow filters do not stall on rounding
+#define KBH_CAL_Q 8U
+#define KBH_CAL_REST_BAND_Q                                                    \
+    ((uint32_t)CONFIG_KB_HANDLER_CALIBRATION_REST_BAND << KBH_CAL_Q)
+#define KBH_CAL_MIN_SPAN_Q                                                     \
+    ((uint32_t)CONFIG_KB_HANDLER_CALIBRATION_MIN_SPAN << KBH_CAL_Q)
+#define KBH_CAL_REST_SHIFT CONFIG_KB_HANDLER_CALIBRATION_REST_SHIFT
+#define KBH_CAL_DECAY_SHIFT CONFIG_KB_HANDLER_CALIBRATION_DECAY_SHIFT
+#define KBH_CAL_BOTTOM_BAND_PCT CONFIG_KB_HANDLER_CALIBRATION_BOTTOM_BAND
+#define KBH_CAL_PLATEAU_SAMPLES CONFIG_KB_HANDLER_CALIBRATION_PLATEAU_SAMPLES
+#define KBH_CAL_SAVE_DELTA CONFIG_KB_HANDLER_CALIBRATION_SAVE_DELTA
+#define KBH_CAL_SAVE_INTERVAL                                                  \
+    K_SECONDS(CONFIG_KB_HANDLER_CALIBRATION_SAVE_INTERVAL_S)
+// Coalesces the threshold updates of keys learning at the same time
+#define KBH_CAL_THRESHOLDS_DELAY K_MSEC(100)
+
+BUILD_ASSERT(CONFIG_KB_HANDLER_CALIBRATION_MIN_SPAN > 0,
+             "KB_HANDLER_CALIBRATION_MIN_SPAN should be greater than zero");
+
+typedef struct {
+    uint16_t version;
+    uint16_t rest[TOTAL_KEY_COUNT];
+    uint16_t bottom[TOTAL_KEY_COUNT];
+} kbh_calibration_table_t;
+
+static struct {
+    uint32_t rest_q[TOTAL_KEY_COUNT];
+    uint32_t bottom_q[TOTAL_KEY_COUNT];
+    // Deepest raw value of the ongoing press
+    uint16_t peak[TOTAL_KEY_COUNT];
+    // Samples of the ongoing press within the rest band below its peak
+    uint8_t plateau[TOTAL_KEY_COUNT];
+    bool active[TOTAL_KEY_COUNT];
+    bool valid[TOTAL_KEY_COUNT];
+} cal;
+
+// Levels the KScan thresholds were last converted with, KScan only has the
+// first count keys
+static struct {
+    uint16_t rest[TOTAL_KEY_COUNT];
+    uint16_t bottom[TOTAL_KEY_COUNT];
+    bool valid[TOTAL_KEY_COUNT];
+    uint16_t count;
+} converted;
+static atomic_t thresholds_stale;
+
+static kbh_calibration_table_t load_table;
+static kbh_calibration_table_t saved_table;
+static kbh_calibration_table_t save_table;
+
+static void kbh_calibration_save(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(kbh_calibration_save_work,
+                               kbh_calibration_save);
+
+static void kbh_calibration_thresholds_update(struct k_work *work) {
+    ARG_UNUSED(work);
+
+    atomic_clear(&thresholds_stale);
+    kbh_core_update_kscan_thresholds();
+}
+static K_WORK_DELAYABLE_DEFINE(kbh_calibration_thresholds_work,
+                               kbh_calibration_thresholds_update);
+
+// KScan thresholds follow the levels once they moved as much as it takes to
+// save them, not on every sample
+static void kbh_calibration_check_thresholds(uint16_t key, uint32_t rest_q,
+                                             uint32_t bottom_q) {
+    if (key >= converted.count || atomic_get(&thresholds_stale)) {
+        return;
+    }
+
+    if (converted.valid[key] &&
+        abs((int)(rest_q >> KBH_CAL_Q) - converted.rest[key]) <=
+            KBH_CAL_SAVE_DELTA &&
+        abs((int)(bottom_q >> KBH_CAL_Q) - converted.bottom[key]) <=
+            KBH_CAL_SAVE_DELTA) {
+        return;
+    }
+
+    if (atomic_cas(&thresholds_stale, 0, 1)) {
+        k_work_schedule(&kbh_calibration_thresholds_work,
+                        KBH_CAL_THRESHOLDS_DELAY);
+    }
+}
+
+uint16_t kbh_calibration_process(uint16_t key, uint16_t raw) {
+    if (key >= TOTAL_KEY_COUNT) {
+        return 0;
+    }
+
+    uint32_t raw_q = (uint32_t)raw << KBH_CAL_Q;
+
+    if (!cal.valid[key]) {
+        cal.rest_q[key] = raw_q;
+        cal.bottom_q[key] = raw_q + KBH_CAL_MIN_SPAN_Q;
+        cal.active[key] = false;
+        cal.valid[key] = true;
+    }
+
+    uint32_t rest_q = cal.rest_q[key];
+    uint32_t bottom_q = cal.bottom_q[key];
+
+    if (raw_q < rest_q + KBH_CAL_REST_BAND_Q) {
+        // Low-pass the idle level, values below it pull it down as well
+        if (raw_q >= rest_q) {
+            rest_q += (raw_q - rest_q) >> KBH_CAL_REST_SHIFT;
+        } else {
+            rest_q -= (rest_q - raw_q) >> KBH_CAL_REST_SHIFT;
+        }
+
+        // Press ended. Only a press which rested near the current
+        // bottom-out level was bottomed out, partial and rapid trigger
+        // presses say nothing about it. Let the level decay towards its
+        // depth then.
+        if (cal.active[key]) {
+            uint32_t peak_q = (uint32_t)cal.peak[key] << KBH_CAL_Q;
+            uint32_t band_q =
+                (bottom_q - rest_q) / 100U * KBH_CAL_BOTTOM_BAND_PCT;
+            uint32_t target_q = MAX(peak_q, rest_q + KBH_CAL_MIN_SPAN_Q);
+
+            if (cal.plateau[key] >= KBH_CAL_PLATEAU_SAMPLES &&
+                peak_q + band_q >= bottom_q && bottom_q > target_q) {
+                bottom_q -= (bottom_q - target_q) >> KBH_CAL_DECAY_SHIFT;
+            }
+            cal.active[key] = false;
+        }
+    } else if (!cal.active[key]) {
+        cal.peak[key] = raw;
+        cal.plateau[key] = 1;
+        cal.active[key] = true;
+    } else {
+        // A deeper value starts a new plateau, noise around it does not
+        if (raw > cal.peak[key] + CONFIG_KB_HANDLER_CALIBRATION_REST_BAND) {
+            cal.plateau[key] = 0;
+        }
+        cal.peak[key] = MAX(cal.peak[key], raw);
+        if (raw + CONFIG_KB_HANDLER_CALIBRATION_REST_BAND >= cal.peak[key] &&
+            cal.plateau[key] < UINT8_MAX) {
+            cal.plateau[key]++;
+        }
+    }
+
+    bottom_q = MAX(bottom_q, rest_q + KBH_CAL_MIN_SPAN_Q);
+    bottom_q = MAX(bottom_q, raw_q);
+
+    cal.rest_q[key] = rest_q;
+    cal.bottom_q[key] = bottom_q;
+    kbh_calibration_check_thresholds(key, rest_q, bottom_q);
+
+    if (raw_q <= rest_q) {
+        return 0;
+    }
+
+    uint32_t travel = (raw_q - rest_q) >> KBH_CAL_Q;
+    uint32_t span = (bottom_q - rest_q) >> KBH_CAL_Q;
+
+    return MIN(travel * KBH_CAL_TRAVEL_MAX / span, KBH_CAL_TRAVEL_MAX);
+}
+
+void kbh_calibration_to_raw(const uint16_t *travel, uint16_t *raw,
+                            uint16_t count) {
+    count = MIN(count, TOTAL_KEY_COUNT);
+    for (uint16_t i = 0; i < count; ++i) {
+        if (!cal.valid[i]) {
+            // Nothing to convert with before the first value
+            converted.valid[i] = false;
+            raw[i] = UINT16_MAX;
+            continue;
+        }
+
+        uint32_t rest = cal.rest_q[i] >> KBH_CAL_Q;
+        uint32_t bottom = cal.bottom_q[i] >> KBH_CAL_Q;
+        uint32_t span = bottom - rest;
+        // Lowest raw value kbh_calibration_process() maps to travel[i]
+        uint32_t level = rest + (MIN(travel[i], KBH_CAL_TRAVEL_MAX) * span +
+                                 KBH_CAL_TRAVEL_MAX - 1U) /
+                                    KBH_CAL_TRAVEL_MAX;
+
+        converted.rest[i] = rest;
+        converted.bottom[i] = bottom;
+        converted.valid[i] = true;
+        raw[i] = MIN(level, UINT16_MAX);
+    }
+    converted.count = count;
+}
+
+void kb_handler_calibration_reset(void) {
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        cal.valid[i] = false;
+    }
+}
+
+static int kbh_calibration_handler_set(const char *key, size_t len,
+                                       settings_read_cb read_cb,
+                                       void *cb_arg) {
+    if (strcmp(key, KBH_CAL_ITEM) != 0) {
+        return -ENOENT;
+    }
+
+    if (len != sizeof(load_table)) {
+        LOG_ERR("Calibration table size mismatch: got %zu, want %zu", len,
+                sizeof(load_table));
+        return -EINVAL;
+    }
+
+    ssize_t rlen = read_cb(cb_arg, &load_table, sizeof(load_table));
+    if (rlen < 0) {
+        LOG_ERR("Calibration table read_cb error: %d", (int)rlen);
+        return -EINVAL;
+    }
+
+    if ((size_t)rlen != sizeof(load_table)) {
+        LOG_ERR("Calibration table truncated: %zd", rlen);
+        return -EINVAL;
+    }
+
+    if (load_table.version != KBH_CAL_TABLE_VERSION) {
+        LOG_ERR("Calibration table version mismatch: got %u, want %u",
+                load_table.version, KBH_CAL_TABLE_VERSION);
+        return -EINVAL;
+    }
+
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        if (load_table.bottom[i] <= load_table.rest[i]) {
+            continue;
+        }
+        cal.rest_q[i] = (uint32_t)load_table.rest[i] << KBH_CAL_Q;
+        cal.bottom_q[i] = (uint32_t)load_table.bottom[i] << KBH_CAL_Q;
+        cal.active[i] = false;
+        cal.valid[i] = true;
+    }
+    memcpy(&saved_table, &load_table, sizeof(saved_table));
+
+    return 0;
+}
+
+static struct settings_handler kbh_calibration_handler = {
+    .name = KBH_CAL_NS,
+    .h_set = kbh_calibration_handler_set,
+};
+
+// Only written when a key moved noticeably, the table changes slowly but
+// constantly and flash should not be rewritten for noise
+static void kbh_calibration_save(struct k_work *work) {
+    bool changed = false;
+
+    ARG_UNUSED(work);
+
+    save_table.version = KBH_CAL_TABLE_VERSION;
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        bool valid = cal.valid[i];
+
+        save_table.rest[i] = valid ? cal.rest_q[i] >> KBH_CAL_Q : 0;
+        save_table.bottom[i] = valid ? cal.bottom_q[i] >> KBH_CAL_Q : 0;
+
+        if (abs(save_table.rest[i] - saved_table.rest[i]) >
+                KBH_CAL_SAVE_DELTA ||
+            abs(save_table.bottom[i] - saved_table.bottom[i]) >
+                KBH_CAL_SAVE_DELTA) {
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        int err = settings_save_one(KBH_CAL_KEY, &save_table,
+                                    sizeof(save_table));
+        if (err) {
+            LOG_WRN("Could not save calibration table: %d", err);
+        } else {
+            memcpy(&saved_table, &save_table, sizeof(saved_table));
+            LOG_INF("Calibration table saved.");
+        }
+    }
+
+    k_work_reschedule(&kbh_calibration_save_work, KBH_CAL_SAVE_INTERVAL);
+}
+
+int kbh_calibration_init(void) {
+    int err = settings_subsys_init();
+    if (err) {
+        LOG_ERR("settings_subsys_init: %d", err);
+        return err;
+    }
+
+    err = settings_register(&kbh_calibration_handler);
+    if (err) {
+        LOG_ERR("settings_register: %d", err);
+        return err;
+    }
+
+    err = settings_load_subtree(KBH_CAL_NS);
+    if (err) {
+        LOG_WRN("No calibration table loaded (err %d), learning from scratch",
+                err);
+    }
+
+    k_work_reschedule(&kbh_calibration_save_work, KBH_CAL_SAVE_INTERVAL);
+
+    return 0;
+}
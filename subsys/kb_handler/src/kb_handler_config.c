@@ -135,3 +135,21 @@ int kb_handler_get_default_thresholds(uint16_t *buffer) {
 
     return 0;
 }
+
+int kb_handler_get_default_rapid_trigger(kb_rapid_trigger_settings_t *buffer) {
+    if (buffer) {
+        for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+            buffer->enabled[i] = false;
+            buffer->press_sensitivity[i] =
+                CONFIG_KB_HANDLER_RAPID_TRIGGER_DEFAULT_SENSITIVITY;
+            buffer->release_sensitivity[i] =
+                CONFIG_KB_HANDLER_RAPID_TRIGGER_DEFAULT_SENSITIVITY;
+            buffer->top_deadzone[i] =
+                CONFIG_KB_HANDLER_RAPID_TRIGGER_DEFAULT_DEADZONE;
+            buffer->bottom_deadzone[i] =
+                CONFIG_KB_HANDLER_RAPID_TRIGGER_DEFAULT_DEADZONE;
+        }
+    }
+
+    return 0;
+}
@@ -2,8 +2,12 @@
 
 #include <dt-bindings/kb-handler/kb-key-codes.h>
 
+#include <lib/ykb_value_codec.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/math_extras.h>
 #include <zephyr/sys/util.h>
 
 #include <math.h>
@@ -17,27 +21,87 @@ static struct k_thread kbh_core_thread;
 
 static kb_settings_t settings_snapshot;
 static bool thread_started;
-static uint16_t values[TOTAL_KEY_COUNT];
+// Serializes KScan threshold updates with settings_snapshot changes
+static K_MUTEX_DEFINE(thresholds_lock);
 
-#define KBH_SLAVE_VALUES_CAPACITY                                              \
-    ((KEY_COUNT_SLAVE > 0U) ? KEY_COUNT_SLAVE : 1U)
+// Core thread input is shared state instead of a message queue. Producers
+// (KScan frames, splitlink) store the latest value of a key and mark it
+// dirty, store the latest pressed state and mark an edge, then wake the core
+// thread once. The core thread drains only the marked keys, so repeated
+// updates of a key coalesce instead of filling up a queue.
 
-enum kbh_thread_msg_type {
-    KBH_THREAD_MSG_KEY = 0U,
-    KBH_THREAD_MSG_VALUE,
-    KBH_THREAD_MSG_SLAVE_VALUES,
-    KBH_THREAD_MSG_SLAVE_KEYS_RESET,
-    KBH_THREAD_MSG_SETTINGS_SYNC,
+// Latest value of every key
+static uint16_t values[TOTAL_KEY_COUNT];
+// Keys whose value changed since the core thread last drained them
+static ATOMIC_DEFINE(values_dirty, TOTAL_KEY_COUNT);
+// Latest pressed state of every key
+static ATOMIC_DEFINE(keys_pressed, TOTAL_KEY_COUNT);
+// Keys with a pressed state change not yet seen by the core thread
+static ATOMIC_DEFINE(keys_edge, TOTAL_KEY_COUNT);
+// Keys pressed or released since the core thread last saw their edge, so a
+// tap which is over before then still reaches the report
+static ATOMIC_DEFINE(keys_pressed_latched, TOTAL_KEY_COUNT);
+static ATOMIC_DEFINE(keys_released_latched, TOTAL_KEY_COUNT);
+
+// Pressed state of local keys as reported by the last KScan frames
+static ATOMIC_DEFINE(frame_pressed, KEY_COUNT);
+
+enum kbh_request {
+    KBH_REQUEST_SETTINGS_SYNC = 0U,
+    KBH_REQUEST_SLAVE_KEYS_RESET,
 };
 
-struct kbh_thread_msg {
-    enum kbh_thread_msg_type type;
+static atomic_t requests;
+static atomic_t wake_pending;
+static K_SEM_DEFINE(kbh_core_wake, 0, 1);
+
+// Only used by the core thread, kept out of its stack because of the size
+static struct kbh_report_builder report_builder;
+static struct kbh_rapid_trigger rapid_trigger;
+
+static struct {
+    atomic_t values_coalesced;
+    atomic_t edges_coalesced;
+    atomic_t edges_dropped;
+    atomic_t wakeups;
+    atomic_t slave_frames_dropped;
+    atomic_t slave_edges_late;
+} kbh_stats;
+
+#if CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+// Time the oldest pending edge of every key happened at, see kbh_time_us().
+// Pending edges are processed oldest first, so a slave key pressed just
+// before a local one counts first although its event arrived later.
+static uint32_t edge_time_us[TOTAL_KEY_COUNT];
+// Time of the oldest KScan frame whose values were not drained yet, valid
+// while values_timed is set
+static uint32_t values_time_us;
+static atomic_t values_timed;
+
+struct kbh_edge {
+    uint32_t time_us;
     uint16_t key;
-    bool status;
-    uint16_t value;
-    uint16_t slave_values[KBH_SLAVE_VALUES_CAPACITY];
 };
 
+// Only used by the core thread
+static struct kbh_edge pending_edges[TOTAL_KEY_COUNT];
+static uint16_t pending_edge_count;
+// Newest local transition processed, a slave edge older than that arrived
+// too late to be ordered
+static uint32_t local_edge_us;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+// Slave values rebuilt from the splitlink value stream, before calibration
+static uint16_t slave_raw_values[KEY_COUNT_SLAVE];
+static ykb_value_codec_decoder_t slave_decoder = {
+    .values = slave_raw_values,
+    .count = KEY_COUNT_SLAVE,
+};
+// Set when the slave keys were reset, the stream restarts from a keyframe
+static atomic_t slave_decoder_reset;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
 struct kbh_runtime_state {
     kb_settings_t *settings;
     kb_mode_t active_mode;
@@ -47,96 +111,62 @@ struct kbh_runtime_state {
 
     bool pressed_keys[TOTAL_KEY_COUNT];
     uint16_t current_values[TOTAL_KEY_COUNT];
-    bool race_pressed_keys[TOTAL_KEY_COUNT];
 
     uint16_t layer1_keys[TOTAL_KEY_COUNT];
     uint16_t layer2_keys[TOTAL_KEY_COUNT];
     uint8_t layer1_keys_count;
     uint8_t layer2_keys_count;
 
+    struct kbh_report_builder *report_builder;
+    struct kbh_rapid_trigger *rapid_trigger;
     hid_kb_report_t kb_report;
     hid_kb_report_t prev_kb_report;
+    hid_kb_nkro_report_t nkro_report;
+    hid_kb_nkro_report_t prev_nkro_report;
     hid_mouse_report_t mouse_report;
     hid_mouse_report_t prev_mouse_report;
 };
 
-K_MSGQ_DEFINE(kbh_core_msgq, sizeof(struct kbh_thread_msg),
-              CONFIG_KB_HANDLER_MSGQ_SIZE, 4);
-
-static inline bool is_modifier(uint8_t hid) {
-    return (hid >= KEY_LEFTCONTROL && hid <= KEY_RIGHTGUI);
-}
-
-static inline uint8_t mod_bit(uint8_t hid) {
-    return 1U << (hid - KEY_LEFTCONTROL);
+static void kbh_core_wake_up(void) {
+    if (!atomic_set(&wake_pending, 1)) {
+        k_sem_give(&kbh_core_wake);
+    }
 }
 
-static inline uint8_t resolve_hid(const kb_settings_t *settings, uint16_t key,
-                                  bool second_layer_active,
-                                  bool third_layer_active) {
-    if (third_layer_active) {
-        return settings->mappings_layer3[key];
+static void publish_value(uint16_t key, uint16_t value) {
+    if (values[key] == value) {
+        return;
     }
-    if (second_layer_active) {
-        return settings->mappings_layer2[key];
+    values[key] = value;
+    if (atomic_test_and_set_bit(values_dirty, key)) {
+        atomic_inc(&kbh_stats.values_coalesced);
     }
-
-    return settings->mappings_layer1[key];
 }
 
-static inline bool add_key(uint8_t keys[6], uint8_t hid) {
-    for (int i = 0; i < 6; ++i) {
-        if (keys[i] == hid) {
-            return true;
-        }
+static void publish_key(uint16_t key, bool pressed, uint32_t time_us) {
+#if CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+    // A coalesced edge keeps the time of the first one, so a chattering key
+    // is not held back by the merge window forever
+    if (!atomic_test_bit(keys_edge, key)) {
+        edge_time_us[key] = time_us;
     }
-
-    for (int i = 0; i < 6; ++i) {
-        if (keys[i] == 0U) {
-            keys[i] = hid;
-            return true;
-        }
+#else
+    ARG_UNUSED(time_us);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+    atomic_set_bit_to(keys_pressed, key, pressed);
+    if (atomic_test_and_set_bit(
+            pressed ? keys_pressed_latched : keys_released_latched, key)) {
+        // Only the last press and release since the previous drain are kept
+        atomic_inc(&kbh_stats.edges_dropped);
     }
-
-    return false;
-}
-
-static void build_kb_report(hid_kb_report_t *report, kb_settings_t *settings,
-                            const bool *pressed_keys, uint16_t total_key_count,
-                            bool second_layer_active, bool third_layer_active) {
-    bool overflow = false;
-
-    report->mods = 0;
-    report->reserved = 0;
-    memset(report->keys, 0, sizeof(report->keys));
-
-    for (uint16_t i = 0; i < total_key_count; ++i) {
-        uint8_t hid;
-
-        if (!pressed_keys[i]) {
-            continue;
-        }
-
-        hid = resolve_hid(settings, i, second_layer_active, third_layer_active);
-
-        if (hid == KEY_LAYER1 || hid == KEY_LAYER2 || hid == KEY_FN ||
-            hid == KEY_NOKEY) {
-            continue;
-        }
-
-        if (is_modifier(hid)) {
-            report->mods |= mod_bit(hid);
-            continue;
-        }
-
-        if (!add_key(report->keys, hid)) {
-            overflow = true;
-        }
+    if (atomic_test_and_set_bit(keys_edge, key)) {
+        atomic_inc(&kbh_stats.edges_coalesced);
     }
+}
 
-    if (overflow && IS_ENABLED(CONFIG_KB_HANDLER_REPORT_ROLLOVER)) {
-        memset(report->keys, 0x01, sizeof(report->keys));
-    }
+static void request(enum kbh_request req) {
+    atomic_set_bit(&requests, req);
+    kbh_core_wake_up();
 }
 
 static void build_layer_keys(const kb_settings_t *settings,
@@ -185,6 +215,11 @@ static inline bool kb_reports_equal(const hid_kb_report_t *a,
     return memcmp(a, b, sizeof(*a)) == 0;
 }
 
+static inline bool nkro_reports_equal(const hid_kb_nkro_report_t *a,
+                                      const hid_kb_nkro_report_t *b) {
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
 static inline bool mouse_reports_equal(const hid_mouse_report_t *a,
                                        const hid_mouse_report_t *b) {
     return memcmp(a, b, sizeof(*a)) == 0;
@@ -287,9 +322,21 @@ static void mouseemu_value_handler(kb_settings_t *settings,
 }
 
 static inline void send_kb_report_if_changed(struct kbh_runtime_state *st) {
-    build_kb_report(&st->kb_report, st->settings, st->pressed_keys,
-                    TOTAL_KEY_COUNT, st->second_layer_active,
-                    st->third_layer_active);
+    kbh_report_get(st->report_builder, &st->kb_report);
+
+    // The boot report goes along as fallback for hosts in boot protocol
+    if (st->settings->report_mode == KB_REPORT_MODE_NKRO) {
+        kbh_report_get_nkro(st->report_builder, &st->nkro_report);
+
+        if (!nkro_reports_equal(&st->nkro_report, &st->prev_nkro_report) ||
+            !kb_reports_equal(&st->kb_report, &st->prev_kb_report)) {
+            kb_handler_transport_send_kb_nkro_report(
+                &st->nkro_report, &st->kb_report, st->settings->kbh_prio);
+            st->prev_nkro_report = st->nkro_report;
+            st->prev_kb_report = st->kb_report;
+        }
+        return;
+    }
 
     if (!kb_reports_equal(&st->kb_report, &st->prev_kb_report)) {
         kb_handler_transport_send_kb_report(&st->kb_report,
@@ -309,16 +356,18 @@ static inline void send_mouse_report_if_changed(struct kbh_runtime_state *st) {
     }
 }
 
+// Only the key pressed the deepest relative to its actuation range is
+// reported. Ratios are compared by cross multiplication to stay in integers.
 static void send_race_report_if_changed(struct kbh_runtime_state *st) {
-    double max_percentage = 0.0;
+    uint32_t best_travel = 0;
+    uint32_t best_range = 1;
     int32_t max_index = -1;
 
-    memset(st->race_pressed_keys, 0, sizeof(st->race_pressed_keys));
-
     for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
         uint16_t threshold;
         uint16_t maximum;
-        double percentage_pressed;
+        uint32_t travel;
+        uint32_t range;
 
         if (!st->pressed_keys[i]) {
             continue;
@@ -326,26 +375,28 @@ static void send_race_report_if_changed(struct kbh_runtime_state *st) {
 
         threshold = st->settings->thresholds[i];
         maximum = st->settings->maximums[i];
-        if (maximum <= threshold) {
+        if (maximum <= threshold || st->current_values[i] < threshold) {
             continue;
         }
 
-        percentage_pressed =
-            (double)(st->current_values[i] - threshold) / (maximum - threshold);
-        if (percentage_pressed > max_percentage) {
-            max_percentage = percentage_pressed;
+        travel = st->current_values[i] - threshold;
+        range = maximum - threshold;
+        if (travel * best_range > best_travel * range) {
+            best_travel = travel;
+            best_range = range;
             max_index = i;
         }
     }
 
     if (max_index >= 0) {
-        st->race_pressed_keys[max_index] = true;
+        kbh_report_single(&st->kb_report,
+                          kbh_resolve_hid(st->settings, max_index,
+                                          st->second_layer_active,
+                                          st->third_layer_active));
+    } else {
+        kbh_report_single(&st->kb_report, 0);
     }
 
-    build_kb_report(&st->kb_report, st->settings, st->race_pressed_keys,
-                    TOTAL_KEY_COUNT, st->second_layer_active,
-                    st->third_layer_active);
-
     if (!kb_reports_equal(&st->kb_report, &st->prev_kb_report)) {
         kb_handler_transport_send_kb_report(&st->kb_report,
                                             st->settings->kbh_prio);
@@ -356,19 +407,26 @@ static void send_race_report_if_changed(struct kbh_runtime_state *st) {
 static inline void reset_handler_state(struct kbh_runtime_state *st) {
     memset(st->pressed_keys, 0, sizeof(st->pressed_keys));
     memset(st->current_values, 0, sizeof(st->current_values));
-    memset(st->race_pressed_keys, 0, sizeof(st->race_pressed_keys));
+    kbh_report_reset(st->report_builder);
+    kbh_rapid_trigger_reset(st->rapid_trigger, 0, TOTAL_KEY_COUNT);
 
     st->second_layer_active = false;
     st->third_layer_active = false;
 
     memset(&st->kb_report, 0, sizeof(st->kb_report));
+    memset(&st->nkro_report, 0, sizeof(st->nkro_report));
     memset(&st->mouse_report, 0, sizeof(st->mouse_report));
 
+    // Both keyboard reports are cleared, the report mode may have changed
+    // while keys were held
     kb_handler_transport_send_kb_report(&st->kb_report, st->settings->kbh_prio);
+    kb_handler_transport_send_kb_nkro_report(&st->nkro_report, &st->kb_report,
+                                             st->settings->kbh_prio);
     kb_handler_transport_send_mouse_report(&st->mouse_report,
                                            st->settings->kbh_prio);
 
     st->prev_kb_report = st->kb_report;
+    st->prev_nkro_report = st->nkro_report;
     st->prev_mouse_report = st->mouse_report;
 }
 
@@ -393,8 +451,11 @@ static void process_key_transition(struct kbh_runtime_state *st, uint16_t key,
         return;
     }
 
-    resolved_hid = resolve_hid(st->settings, key, st->second_layer_active,
-                               st->third_layer_active);
+    bool second_layer_was_active = st->second_layer_active;
+    bool third_layer_was_active = st->third_layer_active;
+
+    resolved_hid = kbh_resolve_hid(st->settings, key, st->second_layer_active,
+                                   st->third_layer_active);
 
     if (resolved_hid == KEY_LAYER1) {
         if (!handle_layer_key(key, status, st->pressed_keys,
@@ -412,6 +473,17 @@ static void process_key_transition(struct kbh_runtime_state *st, uint16_t key,
         return;
     }
 
+    // Layer switch changes the usage of every held key
+    if (st->second_layer_active != second_layer_was_active ||
+        st->third_layer_active != third_layer_was_active) {
+        kbh_report_rebuild(st->report_builder, st->settings, st->pressed_keys,
+                           st->second_layer_active, st->third_layer_active);
+    } else if (status) {
+        kbh_report_press(st->report_builder, key, resolved_hid);
+    } else {
+        kbh_report_release(st->report_builder, key);
+    }
+
     if (st->active_mode == KB_MODE_NORMAL ||
         st->active_mode == KB_MODE_MOUSESIM) {
         send_kb_report_if_changed(st);
@@ -422,39 +494,271 @@ static void process_key_transition(struct kbh_runtime_state *st, uint16_t key,
     }
 }
 
-static void handle_slave_values(struct kbh_runtime_state *st,
-                                const uint16_t slave_values[KEY_COUNT_SLAVE]) {
-    if (KEY_COUNT_SLAVE == 0U) {
-        return;
+// Local keys follow the KScan threshold edges unless they use rapid
+// trigger or calibration, whose KScan thresholds lag behind the learned
+// levels. Slave keys are
+// derived from values here, unless the slave actuates them itself and sends
+// edges.
+static inline bool key_follows_values(const struct kbh_runtime_state *st,
+                                      uint16_t key) {
+    if (key >= KEY_COUNT) {
+        return !IS_ENABLED(CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION);
     }
 
-    memcpy(&st->current_values[KEY_COUNT], slave_values,
-           KEY_COUNT_SLAVE * sizeof(uint16_t));
+    return IS_ENABLED(CONFIG_KB_HANDLER_CALIBRATION) ||
+           st->settings->rapid_trigger.enabled[key];
+}
 
-    for (uint16_t i = KEY_COUNT; i < TOTAL_KEY_COUNT; ++i) {
-        bool was_pressed = st->pressed_keys[i];
-        st->pressed_keys[i] =
-            st->current_values[i] >= st->settings->thresholds[i];
+static void handle_analog_keys(struct kbh_runtime_state *st) {
+    kbh_rapid_trigger_update(st->rapid_trigger, st->settings,
+                             st->current_values, 0, TOTAL_KEY_COUNT);
 
-        if (was_pressed != st->pressed_keys[i]) {
-            process_key_transition(st, i, st->pressed_keys[i]);
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        bool pressed = st->rapid_trigger->pressed[i];
+
+        if (!key_follows_values(st, i) || pressed == st->pressed_keys[i]) {
+            continue;
         }
+        process_key_transition(st, i, pressed);
     }
+}
+
+static void handle_slave_keys_reset(struct kbh_runtime_state *st) {
+    if (KEY_COUNT_SLAVE == 0U) {
+        return;
+    }
+
+    for (uint16_t i = KEY_COUNT; i < TOTAL_KEY_COUNT; ++i) {
+        atomic_clear_bit(values_dirty, i);
+        atomic_clear_bit(keys_edge, i);
+        atomic_clear_bit(keys_pressed, i);
+        atomic_clear_bit(keys_pressed_latched, i);
+        atomic_clear_bit(keys_released_latched, i);
+    }
+    for (uint16_t i = KEY_COUNT; i < TOTAL_KEY_COUNT; ++i) {
+        kbh_report_release(st->report_builder, i);
+    }
+    memset(&values[KEY_COUNT], 0, KEY_COUNT_SLAVE * sizeof(uint16_t));
+    memset(&st->pressed_keys[KEY_COUNT], 0, KEY_COUNT_SLAVE * sizeof(bool));
+    memset(&st->current_values[KEY_COUNT], 0,
+           KEY_COUNT_SLAVE * sizeof(uint16_t));
+    kbh_rapid_trigger_reset(st->rapid_trigger, KEY_COUNT, KEY_COUNT_SLAVE);
 
     if (st->active_mode == KB_MODE_MOUSESIM) {
         send_mouse_report_if_changed(st);
     }
 
-    if (st->active_mode == KB_MODE_RACE) {
+    if (st->active_mode == KB_MODE_NORMAL ||
+        st->active_mode == KB_MODE_MOUSESIM) {
+        send_kb_report_if_changed(st);
+    } else if (st->active_mode == KB_MODE_RACE) {
         send_race_report_if_changed(st);
     }
 }
 
+// Copies values of the dirty keys, returns true if any value was drained
+static bool drain_values(struct kbh_runtime_state *st) {
+    bool drained = false;
+
+    for (size_t w = 0; w < ARRAY_SIZE(values_dirty); ++w) {
+        uint32_t dirty = (uint32_t)atomic_clear(&values_dirty[w]);
+
+        while (dirty) {
+            uint16_t key = w * ATOMIC_BITS + u32_count_trailing_zeros(dirty);
+            dirty &= dirty - 1;
+
+            st->current_values[key] = values[key];
+            drained = true;
+        }
+    }
+
+    return drained;
+}
+
+static void process_edge(struct kbh_runtime_state *st, uint16_t key) {
+    // Latches are taken before the state, a change landing in between is
+    // left for the next edge
+    bool was_pressed = atomic_test_and_clear_bit(keys_pressed_latched, key);
+    bool was_released = atomic_test_and_clear_bit(keys_released_latched, key);
+    bool pressed = atomic_test_bit(keys_pressed, key);
+    // The key went the other way since its last edge was seen, e.g. a tap
+    // which was over before the core thread got here
+    bool bounced = pressed ? was_released : was_pressed;
+
+    if (pressed != st->pressed_keys[key]) {
+        process_key_transition(st, key, pressed);
+        if (!bounced) {
+            return;
+        }
+    } else if (!bounced) {
+        return;
+    }
+    // Every transition sends its own report, so the tap is seen by the host
+    process_key_transition(st, key, !pressed);
+    process_key_transition(st, key, pressed);
+}
+
+#if CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+// Shortens *wait_us to when something of the given age leaves the merge
+// window, returns true while it is still inside
+static inline bool merge_window_hold(uint32_t age_us, uint32_t *wait_us) {
+#if CONFIG_KB_HANDLER_SPLITLINK_MERGE_WINDOW_US > 0
+    if ((int32_t)age_us < CONFIG_KB_HANDLER_SPLITLINK_MERGE_WINDOW_US) {
+        *wait_us = MIN(*wait_us,
+                       CONFIG_KB_HANDLER_SPLITLINK_MERGE_WINDOW_US - age_us);
+        return true;
+    }
+#else
+    ARG_UNUSED(age_us);
+    ARG_UNUSED(wait_us);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MERGE_WINDOW_US > 0
+
+    return false;
+}
+
+// Values are held back by the merge window like local edges. Returns true
+// and the time of the oldest frame once they are due.
+static bool values_due(uint32_t now, uint32_t *values_at, uint32_t *wait_us) {
+    if (!atomic_get(&values_timed)) {
+        // Slave values only, or none at all
+        *values_at = now;
+        return true;
+    }
+    if (merge_window_hold(now - values_time_us, wait_us)) {
+        return false;
+    }
+
+    *values_at = values_time_us;
+    atomic_clear(&values_timed);
+    return true;
+}
+
+// Takes the pending edges into pending_edges, oldest first. Local edges
+// still inside the merge window stay pending.
+static void collect_edges(struct kbh_runtime_state *st, uint32_t now,
+                          uint32_t *wait_us) {
+    pending_edge_count = 0;
+
+    for (size_t w = 0; w < ARRAY_SIZE(keys_edge); ++w) {
+        uint32_t edges = (uint32_t)atomic_clear(&keys_edge[w]);
+
+        while (edges) {
+            uint16_t key = w * ATOMIC_BITS + u32_count_trailing_zeros(edges);
+            edges &= edges - 1;
+
+            if (key_follows_values(st, key)) {
+                continue;
+            }
+
+            uint32_t time_us = edge_time_us[key];
+
+            if (key < KEY_COUNT && merge_window_hold(now - time_us, wait_us)) {
+                atomic_set_bit(keys_edge, key);
+                continue;
+            }
+
+            // Rarely more than a few edges, insertion keeps it simple
+            uint16_t i = pending_edge_count++;
+
+            while (i > 0 &&
+                   (int32_t)(pending_edges[i - 1].time_us - time_us) > 0) {
+                pending_edges[i] = pending_edges[i - 1];
+                i--;
+            }
+            pending_edges[i] = (struct kbh_edge){time_us, key};
+        }
+    }
+}
+
+static void note_local_time(uint32_t time_us) {
+    if ((int32_t)(time_us - local_edge_us) > 0) {
+        local_edge_us = time_us;
+    }
+}
+
+// Processes collected edges from *next on, up to the first one which did not
+// happen before *until_us. NULL processes all of them.
+static void process_edges(struct kbh_runtime_state *st, uint16_t *next,
+                          const uint32_t *until_us) {
+    for (; *next < pending_edge_count; ++*next) {
+        const struct kbh_edge *edge = &pending_edges[*next];
+
+        if (until_us && (int32_t)(edge->time_us - *until_us) >= 0) {
+            return;
+        }
+
+        if (edge->key < KEY_COUNT) {
+            note_local_time(edge->time_us);
+        } else if ((int32_t)(edge->time_us - local_edge_us) < 0) {
+            atomic_inc(&kbh_stats.slave_edges_late);
+        }
+        process_edge(st, edge->key);
+    }
+}
+
+// Merges local and slave input in the order it happened. Returns true if any
+// value was drained, *timeout is when held back input is due.
+static bool drain_input(struct kbh_runtime_state *st, k_timeout_t *timeout) {
+    uint32_t now = kbh_time_us();
+    uint32_t wait_us = UINT32_MAX;
+    uint32_t values_at;
+    uint16_t next = 0;
+
+    bool values_changed =
+        values_due(now, &values_at, &wait_us) && drain_values(st);
+
+    collect_edges(st, now, &wait_us);
+
+    if (values_changed) {
+        // Value driven keys are processed at the time of their frame
+        process_edges(st, &next, &values_at);
+        handle_analog_keys(st);
+        note_local_time(values_at);
+    }
+    process_edges(st, &next, NULL);
+
+    *timeout = wait_us == UINT32_MAX ? K_FOREVER : K_USEC(wait_us);
+
+    return values_changed;
+}
+#else
+static void drain_edges(struct kbh_runtime_state *st) {
+    for (size_t w = 0; w < ARRAY_SIZE(keys_edge); ++w) {
+        uint32_t edges = (uint32_t)atomic_clear(&keys_edge[w]);
+
+        while (edges) {
+            uint16_t key = w * ATOMIC_BITS + u32_count_trailing_zeros(edges);
+            edges &= edges - 1;
+
+            if (key_follows_values(st, key)) {
+                continue;
+            }
+            process_edge(st, key);
+        }
+    }
+}
+
+static bool drain_input(struct kbh_runtime_state *st, k_timeout_t *timeout) {
+    bool values_changed = drain_values(st);
+
+    if (values_changed) {
+        handle_analog_keys(st);
+    }
+
+    drain_edges(st);
+
+    *timeout = K_FOREVER;
+
+    return values_changed;
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+
 static void kb_handler_thread(void *a, void *b, void *c) {
-    struct kbh_thread_msg msg;
     struct kbh_runtime_state st = {
         .settings = &settings_snapshot,
         .active_mode = settings_snapshot.mode,
+        .report_builder = &report_builder,
+        .rapid_trigger = &rapid_trigger,
     };
 
     ARG_UNUSED(a);
@@ -464,64 +768,35 @@ static void kb_handler_thread(void *a, void *b, void *c) {
     rebuild_layer_cache(&st);
     reset_handler_state(&st);
 
+    k_timeout_t timeout = K_FOREVER;
+
     while (true) {
-        int err = k_msgq_get(&kbh_core_msgq, &msg, K_FOREVER);
-        if (err) {
-            LOG_ERR("k_msgq_get: %d", err);
-            continue;
-        }
+        k_sem_take(&kbh_core_wake, timeout);
+        atomic_clear(&wake_pending);
+        atomic_inc(&kbh_stats.wakeups);
+
+        atomic_val_t req = atomic_clear(&requests);
 
-        switch (msg.type) {
-        case KBH_THREAD_MSG_SETTINGS_SYNC:
+        if (req & BIT(KBH_REQUEST_SETTINGS_SYNC)) {
             st.active_mode = st.settings->mode;
             rebuild_layer_cache(&st);
             reset_handler_state(&st);
-            break;
-        case KBH_THREAD_MSG_SLAVE_KEYS_RESET:
-            if (KEY_COUNT_SLAVE == 0U) {
-                break;
-            }
-
-            memset(&st.pressed_keys[KEY_COUNT], 0,
-                   KEY_COUNT_SLAVE * sizeof(bool));
-            memset(&st.current_values[KEY_COUNT], 0,
-                   KEY_COUNT_SLAVE * sizeof(uint16_t));
-
-            if (st.active_mode == KB_MODE_MOUSESIM) {
-                send_mouse_report_if_changed(&st);
-            }
+        }
 
-            if (st.active_mode == KB_MODE_NORMAL ||
-                st.active_mode == KB_MODE_MOUSESIM) {
-                send_kb_report_if_changed(&st);
-            } else if (st.active_mode == KB_MODE_RACE) {
-                send_race_report_if_changed(&st);
-            }
-            break;
-        case KBH_THREAD_MSG_KEY:
-            process_key_transition(&st, msg.key, msg.status);
-            break;
-        case KBH_THREAD_MSG_SLAVE_VALUES:
-            handle_slave_values(&st, msg.slave_values);
-            break;
-        case KBH_THREAD_MSG_VALUE:
-            if (msg.key >= TOTAL_KEY_COUNT) {
-                LOG_WRN("Ignoring out-of-range value key %u", msg.key);
-                break;
-            }
+        if (req & BIT(KBH_REQUEST_SLAVE_KEYS_RESET)) {
+            handle_slave_keys_reset(&st);
+        }
 
-            st.current_values[msg.key] = msg.value;
+        bool values_changed = drain_input(&st, &timeout);
 
-            if (st.active_mode == KB_MODE_MOUSESIM) {
-                send_mouse_report_if_changed(&st);
-            }
-            if (st.active_mode == KB_MODE_RACE) {
-                send_race_report_if_changed(&st);
-            }
-            break;
-        default:
-            LOG_WRN("Unknown kb handler thread msg type %u", msg.type);
-            break;
+        if (!values_changed) {
+            continue;
+        }
+        if (st.active_mode == KB_MODE_MOUSESIM) {
+            send_mouse_report_if_changed(&st);
+        }
+        if (st.active_mode == KB_MODE_RACE) {
+            send_race_report_if_changed(&st);
         }
     }
 }
@@ -594,18 +869,18 @@ static void mouseemu_check(uint16_t total_key_count,
                                "button");
 }
 
-static void kb_handler_on_settings_update(const kb_settings_t *settings) {
-    struct kbh_thread_msg msg = {
-        .type = KBH_THREAD_MSG_SETTINGS_SYNC,
-    };
-
-    if (thread_started) {
-        k_thread_suspend(&kbh_core_thread);
-        k_msgq_purge(&kbh_core_msgq);
-    }
+// Thresholds are in travel units with calibration, KScan still compares raw
+// values against them. Its pressed state is used by more than this core,
+// backlight effects for one, so it gets them converted.
+static void push_kscan_thresholds(const kb_settings_t *settings) {
+#if CONFIG_KB_HANDLER_CALIBRATION
+    static uint16_t raw_thresholds[KEY_COUNT];
 
-    memcpy(&settings_snapshot, settings, sizeof(settings_snapshot));
-    mouseemu_check(TOTAL_KEY_COUNT, &settings_snapshot.mouseemu);
+    kbh_calibration_to_raw(settings->thresholds, raw_thresholds, KEY_COUNT);
+    const uint16_t *thresholds = raw_thresholds;
+#else
+    const uint16_t *thresholds = settings->thresholds;
+#endif // CONFIG_KB_HANDLER_CALIBRATION
 
     for (size_t i = 0; i < kb_handler_kscan_count(); ++i) {
         const struct device *kscan = kb_handler_get_kscan(i);
@@ -618,14 +893,42 @@ static void kb_handler_on_settings_update(const kb_settings_t *settings) {
             continue;
         }
 
-        err = kscan_set_thresholds(
-            kscan, (uint16_t *)&settings->thresholds[idx_offset]);
+        err = kscan_set_thresholds(kscan, (uint16_t *)&thresholds[idx_offset]);
         if (err) {
             LOG_ERR("Unable to set thresholds for KScan instance %s (err %d)",
                     kscan->name, err);
             continue;
         }
     }
+}
+
+#if CONFIG_KB_HANDLER_CALIBRATION
+void kbh_core_update_kscan_thresholds(void) {
+    k_mutex_lock(&thresholds_lock, K_FOREVER);
+    push_kscan_thresholds(&settings_snapshot);
+    k_mutex_unlock(&thresholds_lock);
+}
+#endif // CONFIG_KB_HANDLER_CALIBRATION
+
+static void kb_handler_on_settings_update(const kb_settings_t *settings) {
+    if (thread_started) {
+        k_thread_suspend(&kbh_core_thread);
+    }
+
+    // Pending input was produced with previous settings
+    for (size_t w = 0; w < ARRAY_SIZE(keys_edge); ++w) {
+        atomic_clear(&keys_edge[w]);
+        atomic_clear(&keys_pressed_latched[w]);
+        atomic_clear(&keys_released_latched[w]);
+        atomic_clear(&values_dirty[w]);
+    }
+
+    k_mutex_lock(&thresholds_lock, K_FOREVER);
+    memcpy(&settings_snapshot, settings, sizeof(settings_snapshot));
+    mouseemu_check(TOTAL_KEY_COUNT, &settings_snapshot.mouseemu);
+
+    push_kscan_thresholds(&settings_snapshot);
+    k_mutex_unlock(&thresholds_lock);
 
     kb_handler_impl_after_settings_update(&settings_snapshot);
 
@@ -640,9 +943,7 @@ static void kb_handler_on_settings_update(const kb_settings_t *settings) {
         thread_started = true;
     }
 
-    if (k_msgq_put(&kbh_core_msgq, &msg, K_NO_WAIT)) {
-        LOG_WRN("Event settings sync skipped");
-    }
+    request(KBH_REQUEST_SETTINGS_SYNC);
 }
 
 ON_SETTINGS_UPDATE_DEFINE(kbh_core, kb_handler_on_settings_update);
@@ -658,6 +959,13 @@ int kb_handler_core_init(void) {
     thread_started = false;
     memset(values, 0, sizeof(values));
 
+#if CONFIG_KB_HANDLER_CALIBRATION
+    err = kbh_calibration_init();
+    if (err) {
+        return err;
+    }
+#endif // CONFIG_KB_HANDLER_CALIBRATION
+
     err = kb_handler_check_kscans_ready();
     if (err) {
         return err;
@@ -672,62 +980,100 @@ int kb_handler_core_init(void) {
     return 0;
 }
 
-void kb_handler_core_handle_key_event(uint16_t key_index, bool pressed) {
-    struct kbh_thread_msg data = {
-        .type = KBH_THREAD_MSG_KEY,
-        .key = key_index,
-        .status = pressed,
-    };
-
-    if (k_msgq_put(&kbh_core_msgq, &data, K_NO_WAIT)) {
-        LOG_WRN("Key event dropped for key %u", key_index);
+void kb_handler_core_handle_key_event(uint16_t key_index, bool pressed,
+                                      uint32_t time_us) {
+    if (key_index >= TOTAL_KEY_COUNT) {
+        LOG_WRN("Ignoring out-of-range key %u", key_index);
+        return;
     }
+
+    publish_key(key_index, pressed, time_us);
+    kbh_core_wake_up();
 }
 
-void kb_handler_core_handle_value(uint16_t key_index, uint16_t value) {
-    struct kbh_thread_msg data = {
-        .type = KBH_THREAD_MSG_VALUE,
-        .key = key_index,
-        .value = value,
-    };
+void kb_handler_core_handle_frame(const struct kscan_frame *frame) {
+    if (frame->idx_offset >= KEY_COUNT) {
+        LOG_WRN("Ignoring out-of-range frame at offset %u", frame->idx_offset);
+        return;
+    }
 
-    if (key_index < TOTAL_KEY_COUNT) {
-        values[key_index] = value;
+    uint16_t count = MIN(frame->count, KEY_COUNT - frame->idx_offset);
+
+#if CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
+    if (atomic_cas(&values_timed, 0, 1)) {
+        values_time_us = kbh_ticks_to_us(frame->timestamp);
     }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_EDGE_ORDER
 
-    k_msgq_put(&kbh_core_msgq, &data, K_NO_WAIT);
-}
+    for (uint16_t i = 0; i < count; ++i) {
+        uint16_t key = frame->idx_offset + i;
 
-void kb_handler_core_handle_slave_values(const uint16_t *slave_values,
-                                         uint16_t count) {
-    struct kbh_thread_msg data = {
-        .type = KBH_THREAD_MSG_SLAVE_VALUES,
-    };
+#if CONFIG_KB_HANDLER_CALIBRATION
+        // Pressed state is derived from calibrated values by the core thread
+        publish_value(key, kbh_calibration_process(key, frame->values[i]));
+#else
+        bool pressed = kscan_frame_key_pressed(frame, i);
 
-    if (KEY_COUNT_SLAVE == 0U) {
-        return;
+        publish_value(key, frame->values[i]);
+
+        if (atomic_test_bit(frame_pressed, key) == pressed) {
+            continue;
+        }
+        atomic_set_bit_to(frame_pressed, key, pressed);
+        publish_key(key, pressed, kbh_ticks_to_us(frame->timestamp));
+#endif // CONFIG_KB_HANDLER_CALIBRATION
     }
-    if (!slave_values || count != KEY_COUNT_SLAVE) {
-        LOG_ERR("Slave values size mismatch");
-        return;
+
+    kbh_core_wake_up();
+}
+
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+int kb_handler_core_handle_slave_values(const uint8_t *data, uint16_t len) {
+    uint8_t changed[YKB_VALUE_CODEC_BITMAP_SIZE(KEY_COUNT_SLAVE)];
+
+    if (atomic_cas(&slave_decoder_reset, 1, 0)) {
+        ykb_value_codec_decoder_reset(&slave_decoder);
     }
 
-    memcpy(data.slave_values, slave_values, count * sizeof(uint16_t));
-    memcpy(&values[KEY_COUNT], slave_values, count * sizeof(uint16_t));
+    int res = ykb_value_codec_decode(&slave_decoder, data, len, changed);
+    // A lost frame or a decoder out of sync is up to the caller
+    if (res < 0 && res != YKB_VALUE_CODEC_ERROR_SEQ_GAP &&
+        res != YKB_VALUE_CODEC_ERROR_NOT_SYNCED) {
+        LOG_ERR("ykb_value_codec_decode: %d", res);
+    }
+    if (res < 0) {
+        atomic_inc(&kbh_stats.slave_frames_dropped);
+        return res;
+    }
+    if (res == 0) {
+        return res;
+    }
 
-    if (k_msgq_put(&kbh_core_msgq, &data, K_NO_WAIT)) {
-        LOG_WRN("Slave values event dropped");
+    for (uint16_t i = 0; i < KEY_COUNT_SLAVE; ++i) {
+        if (!(changed[i / 8U] & BIT(i % 8U))) {
+            continue;
+        }
+        // An actuating slave calibrates its values itself
+#if CONFIG_KB_HANDLER_CALIBRATION &&                                           \
+    !CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+        publish_value(KEY_COUNT + i, kbh_calibration_process(
+                                         KEY_COUNT + i, slave_raw_values[i]));
+#else
+        publish_value(KEY_COUNT + i, slave_raw_values[i]);
+#endif // CONFIG_KB_HANDLER_CALIBRATION &&
+       // !CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
     }
+
+    kbh_core_wake_up();
+    return res;
 }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
 
 void kb_handler_core_handle_slave_reset(void) {
-    struct kbh_thread_msg data = {
-        .type = KBH_THREAD_MSG_SLAVE_KEYS_RESET,
-    };
-
-    if (k_msgq_put(&kbh_core_msgq, &data, K_NO_WAIT)) {
-        LOG_WRN("Slave reset event dropped");
-    }
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+    atomic_set(&slave_decoder_reset, 1);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+    request(KBH_REQUEST_SLAVE_KEYS_RESET);
 }
 
 void kb_handler_core_get_values(uint16_t *out_values, uint16_t count) {
@@ -754,3 +1100,20 @@ int kb_handler_core_get_settings_snapshot(kb_settings_t *settings) {
 void kb_handler_get_values(uint16_t *values_out, uint16_t count) {
     kb_handler_core_get_values(values_out, count);
 }
+
+#if !CONFIG_KB_HANDLER_CALIBRATION
+void kb_handler_calibration_reset(void) {}
+#endif // !CONFIG_KB_HANDLER_CALIBRATION
+
+void kb_handler_get_stats(struct kb_handler_stats *stats) {
+    if (!stats) {
+        return;
+    }
+
+    stats->values_coalesced = atomic_get(&kbh_stats.values_coalesced);
+    stats->edges_coalesced = atomic_get(&kbh_stats.edges_coalesced);
+    stats->edges_dropped = atomic_get(&kbh_stats.edges_dropped);
+    stats->wakeups = atomic_get(&kbh_stats.wakeups);
+    stats->slave_frames_dropped = atomic_get(&kbh_stats.slave_frames_dropped);
+    stats->slave_edges_late = atomic_get(&kbh_stats.slave_edges_late);
+}
@@ -8,6 +8,8 @@
 
 #include <drivers/kscan.h>
 
+#include <zephyr/kernel.h>
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -23,18 +25,122 @@ int kb_handler_validate_kscan_topology(uint16_t expected_key_count);
 
 void kb_handler_transport_send_kb_report(
     hid_kb_report_t *report, enum kb_handler_transport_priority prio);
+void kb_handler_transport_send_kb_nkro_report(
+    hid_kb_nkro_report_t *nkro, hid_kb_report_t *boot,
+    enum kb_handler_transport_priority prio);
 void kb_handler_transport_send_mouse_report(
     hid_mouse_report_t *report, enum kb_handler_transport_priority prio);
 
+// Time base of key edges, µs of uptime truncated to 32 bits. Splitlink maps
+// slave timestamps onto it.
+static inline uint32_t kbh_ticks_to_us(int64_t ticks) {
+    return (uint32_t)k_ticks_to_us_floor64(ticks);
+}
+
+static inline uint32_t kbh_time_us(void) {
+    return kbh_ticks_to_us(k_uptime_ticks());
+}
+
 int kb_handler_core_init(void);
-void kb_handler_core_handle_key_event(uint16_t key_index, bool pressed);
-void kb_handler_core_handle_value(uint16_t key_index, uint16_t value);
-void kb_handler_core_handle_slave_values(const uint16_t *values,
-                                         uint16_t count);
+// time_us is when the edge happened, see kbh_time_us()
+void kb_handler_core_handle_key_event(uint16_t key_index, bool pressed,
+                                      uint32_t time_us);
+void kb_handler_core_handle_frame(const struct kscan_frame *frame);
+// Takes a lib/ykb_value_codec.h frame of slave values, returns the result of
+// ykb_value_codec_decode()
+int kb_handler_core_handle_slave_values(const uint8_t *data, uint16_t len);
 void kb_handler_core_handle_slave_reset(void);
 void kb_handler_core_get_values(uint16_t *values, uint16_t count);
 int kb_handler_core_get_settings_snapshot(kb_settings_t *settings);
 
 void kb_handler_impl_after_settings_update(const kb_settings_t *settings);
 
+static inline uint8_t kbh_resolve_hid(const kb_settings_t *settings,
+                                      uint16_t key, bool second_layer_active,
+                                      bool third_layer_active) {
+    if (third_layer_active) {
+        return settings->mappings_layer3[key];
+    }
+    if (second_layer_active) {
+        return settings->mappings_layer2[key];
+    }
+
+    return settings->mappings_layer1[key];
+}
+
+// Incremental keyboard report. Every held key remembers the usage it was
+// resolved to when pressed, so press and release only touch that usage.
+// Usages held by several keys are reference counted. Non-modifier usages
+// are kept in a press-ordered history and the report slots always hold the
+// oldest ones, the next waiting usage takes a slot once one frees up.
+// The NKRO bitmap flips a bit only when the usage reference count changes
+// between zero and non-zero, modifiers are shared with the boot report.
+struct kbh_report_builder {
+    hid_kb_report_t report;
+    hid_kb_nkro_report_t nkro;
+
+    uint8_t key_hid[TOTAL_KEY_COUNT];
+    uint8_t hid_refs[256];
+    uint8_t mod_refs[8];
+    // Report slot index + 1 of a usage, 0 if it has no slot
+    uint8_t slot_of[256];
+
+    uint8_t history_prev[256];
+    uint8_t history_next[256];
+    uint8_t history_head;
+    uint8_t history_tail;
+    uint8_t history_count;
+};
+
+void kbh_report_reset(struct kbh_report_builder *b);
+void kbh_report_press(struct kbh_report_builder *b, uint16_t key,
+                      uint8_t hid);
+void kbh_report_release(struct kbh_report_builder *b, uint16_t key);
+// Full rebuild from pressed keys, needed when the active layer changes
+void kbh_report_rebuild(struct kbh_report_builder *b,
+                        const kb_settings_t *settings, const bool *pressed_keys,
+                        bool second_layer_active, bool third_layer_active);
+// Current report, with rollover error if more usages are held than fit
+void kbh_report_get(const struct kbh_report_builder *b,
+                    hid_kb_report_t *report);
+// Current NKRO report, every held usage is reported
+void kbh_report_get_nkro(const struct kbh_report_builder *b,
+                         hid_kb_nkro_report_t *report);
+// Report containing a single usage, empty if hid is not reportable
+void kbh_report_single(hid_kb_report_t *report, uint8_t hid);
+
+// Rapid trigger state, kept as separate arrays so the update is one straight
+// loop over all keys. Only depends on settings and values, so it can run on
+// any key range and be fed recorded values.
+struct kbh_rapid_trigger {
+    // Deepest value while pressed, shallowest value while released
+    uint16_t extreme[TOTAL_KEY_COUNT];
+    // Key was actuated and has not returned to the top dead zone since
+    bool armed[TOTAL_KEY_COUNT];
+    bool pressed[TOTAL_KEY_COUNT];
+};
+
+void kbh_rapid_trigger_reset(struct kbh_rapid_trigger *rt, uint16_t first,
+                             uint16_t count);
+// Updates keys [first, first + count). Keys with rapid trigger disabled are
+// plain threshold compared.
+void kbh_rapid_trigger_update(struct kbh_rapid_trigger *rt,
+                              const kb_settings_t *settings,
+                              const uint16_t *values, uint16_t first,
+                              uint16_t count);
+
+// Per-key calibration, see CONFIG_KB_HANDLER_CALIBRATION. Every key must
+// only be processed from one context, its KScan frames or splitlink values.
+int kbh_calibration_init(void);
+// Learns from a raw value and returns it on the 0 - 1023 travel scale
+uint16_t kbh_calibration_process(uint16_t key, uint16_t raw);
+// Converts the travel thresholds of keys [0, count) to the raw values KScan
+// compares against. Keys without a value yet get UINT16_MAX. Once the levels
+// of one of them move, kbh_core_update_kscan_thresholds() is called.
+void kbh_calibration_to_raw(const uint16_t *travel, uint16_t *raw,
+                            uint16_t count);
+// Hands the current thresholds to KScan again, called once the calibration
+// of a local key moved
+void kbh_core_update_kscan_thresholds(void);
+
 #endif // KB_HANDLER_INTERNAL_H
@@ -0,0 +1,57 @@
+#include "kb_handler_internal.h"
+
+#include <zephyr/sys/util.h>
+
+#include <string.h>
+
+void kbh_rapid_trigger_reset(struct kbh_rapid_trigger *rt, uint16_t first,
+                             uint16_t count) {
+    if (first >= TOTAL_KEY_COUNT) {
+        return;
+    }
+    count = MIN(count, TOTAL_KEY_COUNT - first);
+
+    memset(&rt->extreme[first], 0, count * sizeof(rt->extreme[0]));
+    memset(&rt->armed[first], 0, count * sizeof(rt->armed[0]));
+    memset(&rt->pressed[first], 0, count * sizeof(rt->pressed[0]));
+}
+
+// Every key runs the same branch free steps so the loop stays a plain
+// sequence of compares and selects over the arrays
+void kbh_rapid_trigger_update(struct kbh_rapid_trigger *rt,
+                              const kb_settings_t *settings,
+                              const uint16_t *values, uint16_t first,
+                              uint16_t count) {
+    const kb_rapid_trigger_settings_t *rts = &settings->rapid_trigger;
+    uint32_t end = MIN((uint32_t)first + count, TOTAL_KEY_COUNT);
+
+    for (uint32_t i = first; i < end; ++i) {
+        uint32_t maximum = settings->maximums[i];
+        uint32_t bottom = maximum > rts->bottom_deadzone[i]
+                              ? maximum - rts->bottom_deadzone[i]
+                              : 0U;
+        uint32_t raw = values[i];
+        uint32_t value = MIN(raw, bottom);
+        uint32_t extreme = rt->extreme[i];
+        uint32_t peak = MAX(extreme, value);
+        uint32_t trough = MIN(extreme, value);
+        bool was_pressed = rt->pressed[i];
+        bool armed = rt->armed[i];
+
+        bool in_top = value < rts->top_deadzone[i];
+        bool release =
+            was_pressed &&
+            (in_top || value + rts->release_sensitivity[i] <= peak);
+        bool press = !was_pressed && !in_top &&
+                     (armed ? value >= trough + rts->press_sensitivity[i]
+                            : raw >= settings->thresholds[i]);
+        bool pressed = (was_pressed && !release) || press;
+
+        rt->extreme[i] = (release || press) ? value
+                         : was_pressed      ? peak
+                                            : trough;
+        rt->armed[i] = !in_top && (armed || press);
+        rt->pressed[i] = rts->enabled[i] ? pressed
+                                         : raw >= settings->thresholds[i];
+    }
+}
@@ -0,0 +1,199 @@
+#include "kb_handler_internal.h"
+
+#include <dt-bindings/kb-handler/kb-key-codes.h>
+
+#include <zephyr/sys/util.h>
+
+#include <string.h>
+
+#define KBH_REPORT_SLOTS ARRAY_SIZE(((hid_kb_report_t *)0)->keys)
+
+// KEY_NOKEY is never added to the history, so it is used as list terminator
+#define HISTORY_END KEY_NOKEY
+
+static inline bool is_modifier(uint8_t hid) {
+    return (hid >= KEY_LEFTCONTROL && hid <= KEY_RIGHTGUI);
+}
+
+static inline bool is_reportable(uint8_t hid) {
+    return hid != KEY_NOKEY && hid != KEY_LAYER1 && hid != KEY_LAYER2 &&
+           hid != KEY_FN;
+}
+
+static inline void nkro_set(struct kbh_report_builder *b, uint8_t hid,
+                            bool pressed) {
+    if (hid > HID_KB_NKRO_USAGE_MAX) {
+        return;
+    }
+    WRITE_BIT(b->nkro.bitmap[hid / 8U], hid % 8U, pressed);
+}
+
+static void history_append(struct kbh_report_builder *b, uint8_t hid) {
+    b->history_prev[hid] = b->history_tail;
+    b->history_next[hid] = HISTORY_END;
+    if (b->history_tail == HISTORY_END) {
+        b->history_head = hid;
+    } else {
+        b->history_next[b->history_tail] = hid;
+    }
+    b->history_tail = hid;
+    b->history_count++;
+}
+
+static void history_remove(struct kbh_report_builder *b, uint8_t hid) {
+    uint8_t prev = b->history_prev[hid];
+    uint8_t next = b->history_next[hid];
+
+    if (prev == HISTORY_END) {
+        b->history_head = next;
+    } else {
+        b->history_next[prev] = next;
+    }
+    if (next == HISTORY_END) {
+        b->history_tail = prev;
+    } else {
+        b->history_prev[next] = prev;
+    }
+    b->history_count--;
+}
+
+static void slot_assign(struct kbh_report_builder *b, uint8_t hid) {
+    for (uint8_t i = 0; i < KBH_REPORT_SLOTS; ++i) {
+        if (b->report.keys[i] == KEY_NOKEY) {
+            b->report.keys[i] = hid;
+            b->slot_of[hid] = i + 1;
+            return;
+        }
+    }
+}
+
+// Slots always hold the oldest held usages, so once a slot frees up the
+// first usage without a slot is at most KBH_REPORT_SLOTS steps from the head
+static void slot_refill(struct kbh_report_builder *b) {
+    uint8_t hid = b->history_head;
+
+    for (uint8_t steps = 0; hid != HISTORY_END && steps <= KBH_REPORT_SLOTS;
+         ++steps) {
+        if (!b->slot_of[hid]) {
+            slot_assign(b, hid);
+            return;
+        }
+        hid = b->history_next[hid];
+    }
+}
+
+static void usage_press(struct kbh_report_builder *b, uint8_t hid) {
+    if (is_modifier(hid)) {
+        uint8_t bit = hid - KEY_LEFTCONTROL;
+        if (b->mod_refs[bit]++ == 0) {
+            b->report.mods |= BIT(bit);
+        }
+        return;
+    }
+
+    if (b->hid_refs[hid]++ != 0) {
+        return;
+    }
+    nkro_set(b, hid, true);
+    history_append(b, hid);
+    if (b->history_count <= KBH_REPORT_SLOTS) {
+        slot_assign(b, hid);
+    }
+}
+
+static void usage_release(struct kbh_report_builder *b, uint8_t hid) {
+    if (is_modifier(hid)) {
+        uint8_t bit = hid - KEY_LEFTCONTROL;
+        if (b->mod_refs[bit] && --b->mod_refs[bit] == 0) {
+            b->report.mods &= ~BIT(bit);
+        }
+        return;
+    }
+
+    if (!b->hid_refs[hid] || --b->hid_refs[hid] != 0) {
+        return;
+    }
+    nkro_set(b, hid, false);
+    history_remove(b, hid);
+
+    uint8_t slot = b->slot_of[hid];
+    if (!slot) {
+        return;
+    }
+    b->slot_of[hid] = 0;
+    b->report.keys[slot - 1] = KEY_NOKEY;
+    if (b->history_count >= KBH_REPORT_SLOTS) {
+        slot_refill(b);
+    }
+}
+
+void kbh_report_reset(struct kbh_report_builder *b) {
+    memset(b, 0, sizeof(*b));
+    b->history_head = HISTORY_END;
+    b->history_tail = HISTORY_END;
+}
+
+void kbh_report_press(struct kbh_report_builder *b, uint16_t key,
+                      uint8_t hid) {
+    if (key >= TOTAL_KEY_COUNT || b->key_hid[key] != KEY_NOKEY ||
+        !is_reportable(hid)) {
+        return;
+    }
+
+    b->key_hid[key] = hid;
+    usage_press(b, hid);
+}
+
+void kbh_report_release(struct kbh_report_builder *b, uint16_t key) {
+    if (key >= TOTAL_KEY_COUNT || b->key_hid[key] == KEY_NOKEY) {
+        return;
+    }
+
+    uint8_t hid = b->key_hid[key];
+    b->key_hid[key] = KEY_NOKEY;
+    usage_release(b, hid);
+}
+
+void kbh_report_rebuild(struct kbh_report_builder *b,
+                        const kb_settings_t *settings, const bool *pressed_keys,
+                        bool second_layer_active, bool third_layer_active) {
+    kbh_report_reset(b);
+
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        if (!pressed_keys[i]) {
+            continue;
+        }
+        kbh_report_press(b, i,
+                         kbh_resolve_hid(settings, i, second_layer_active,
+                                         third_layer_active));
+    }
+}
+
+void kbh_report_get(const struct kbh_report_builder *b,
+                    hid_kb_report_t *report) {
+    *report = b->report;
+
+    if (IS_ENABLED(CONFIG_KB_HANDLER_REPORT_ROLLOVER) &&
+        b->history_count > KBH_REPORT_SLOTS) {
+        memset(report->keys, 0x01, sizeof(report->keys));
+    }
+}
+
+void kbh_report_get_nkro(const struct kbh_report_builder *b,
+                         hid_kb_nkro_report_t *report) {
+    *report = b->nkro;
+    report->mods = b->report.mods;
+}
+
+void kbh_report_single(hid_kb_report_t *report, uint8_t hid) {
+    memset(report, 0, sizeof(*report));
+
+    if (!is_reportable(hid)) {
+        return;
+    }
+    if (is_modifier(hid)) {
+        report->mods = BIT(hid - KEY_LEFTCONTROL);
+    } else {
+        report->keys[0] = hid;
+    }
+}
@@ -2,8 +2,11 @@
 
 #include "splitlink_handler/splitlink_handler.h"
 
+#include <lib/ykb_value_codec.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
 
 #include <string.h>
 
@@ -11,14 +14,124 @@ LOG_MODULE_DECLARE(kb_handler);
 
 static kb_settings_t splitlink_settings_tx;
 
+// Slave values are deltas, after a lost frame the slave is asked for a
+// keyframe instead of waiting for its next periodic one. A request lost on
+// the way is sent again after this long.
+#define KEYFRAME_REQUEST_RETRY_MS 20
+static int64_t keyframe_requested_at;
+static bool keyframe_requested;
+
 KSCAN_CB_DEFINE(kbh_sm) = {
-    .on_event = kb_handler_core_handle_key_event,
-    .on_new_value = kb_handler_core_handle_value,
+    .on_frame = kb_handler_core_handle_frame,
 };
 
-void splitlink_handler_values_received(uint16_t *slave_values, uint16_t count) {
-    kb_handler_core_handle_slave_values(slave_values, count);
+void splitlink_handler_values_received(
+    const uint8_t *data, uint16_t len,
+    const struct splitlink_handler_rx_time *time) {
+    ARG_UNUSED(time);
+
+    int res = kb_handler_core_handle_slave_values(data, len);
+    if (res >= 0) {
+        keyframe_requested = false;
+        return;
+    }
+    if (res != YKB_VALUE_CODEC_ERROR_SEQ_GAP &&
+        res != YKB_VALUE_CODEC_ERROR_NOT_SYNCED) {
+        return;
+    }
+
+    int64_t now = k_uptime_get();
+    if (keyframe_requested &&
+        now - keyframe_requested_at < KEYFRAME_REQUEST_RETRY_MS) {
+        return;
+    }
+    if (!keyframe_requested && res == YKB_VALUE_CODEC_ERROR_SEQ_GAP) {
+        LOG_WRN("Slave values frame lost, requesting a keyframe");
+    }
+    // A busy slot still carries the previous request
+    int err = splitlink_handler_request_keyframe();
+    if (err && err != -EBUSY) {
+        LOG_DBG("splitlink_handler_request_keyframe: %d", err);
+        return;
+    }
+    keyframe_requested = true;
+    keyframe_requested_at = now;
+}
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+// Slave keys as last handed to the core, so sync frames only produce edges
+// for keys which actually changed
+static ATOMIC_DEFINE(slave_pressed, KEY_COUNT_SLAVE);
+
+static void slave_key_set(uint16_t key, bool pressed, uint32_t time_us) {
+    if (atomic_test_bit(slave_pressed, key) == pressed) {
+        return;
+    }
+    atomic_set_bit_to(slave_pressed, key, pressed);
+    kb_handler_core_handle_key_event(KEY_COUNT + key, pressed, time_us);
+}
+
+// Master time of a slave event. Its 16 bit timestamp is extended backwards
+// from the send time of its frame, events never wait that long.
+static uint32_t event_time_us(const struct splitlink_handler_rx_time *time,
+                              uint16_t timestamp) {
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+    return time->sent_us -
+           (uint16_t)((uint16_t)time->sent_remote_us - timestamp);
+#else
+    // Without the slave clock the arrival is the best guess
+    ARG_UNUSED(timestamp);
+    return time->received_us;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+}
+
+void splitlink_handler_events_received(
+    const uint8_t *data, uint16_t len,
+    const struct splitlink_handler_rx_time *time) {
+    const struct splitlink_handler_events_header *header =
+        (const struct splitlink_handler_events_header *)data;
+    const struct splitlink_handler_event *events =
+        (const struct splitlink_handler_event *)&data[sizeof(*header)];
+
+    if (len < sizeof(*header) ||
+        len != sizeof(*header) +
+                   header->count * sizeof(struct splitlink_handler_event)) {
+        LOG_ERR("Invalid slave events frame length %u", len);
+        return;
+    }
+
+    bool sync = header->flags & SPLITLINK_HANDLER_EVENTS_FLAG_SYNC;
+    bool sync_pressed[KEY_COUNT_SLAVE] = {false};
+    uint32_t sync_time_us = time->received_us;
+
+    for (uint8_t i = 0; i < header->count; ++i) {
+        uint16_t key = events[i].key & SPLITLINK_HANDLER_EVENT_KEY_MASK;
+        bool pressed = events[i].key & SPLITLINK_HANDLER_EVENT_PRESSED;
+
+        if (key >= KEY_COUNT_SLAVE) {
+            LOG_WRN("Ignoring out-of-range slave key %u", key);
+            continue;
+        }
+        uint32_t time_us = event_time_us(time, events[i].timestamp);
+
+        LOG_DBG("Slave key %u %s at %u us", key,
+                pressed ? "pressed" : "released", time_us);
+
+        if (sync) {
+            sync_pressed[key] = pressed;
+            sync_time_us = time_us;
+        } else {
+            slave_key_set(key, pressed, time_us);
+        }
+    }
+
+    if (sync) {
+        for (uint16_t key = 0; key < KEY_COUNT_SLAVE; ++key) {
+            slave_key_set(key, sync_pressed[key], sync_time_us);
+        }
+    }
 }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
 
 void splitlink_handler_on_connect() {
     LOG_INF("SplitLink slave connected");
@@ -30,6 +143,13 @@ void splitlink_handler_on_connect() {
 
 void splitlink_handler_on_disconnect() {
     LOG_WRN("SplitLink slave disconnected");
+    keyframe_requested = false;
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    // Core releases every slave key on reset
+    for (size_t i = 0; i < ARRAY_SIZE(slave_pressed); ++i) {
+        atomic_clear(&slave_pressed[i]);
+    }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
     kb_handler_core_handle_slave_reset();
 }
 
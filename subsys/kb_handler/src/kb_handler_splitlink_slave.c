@@ -1,6 +1,13 @@
 #include "kb_handler_internal.h"
 
+#include <lib/ykb_value_codec.h>
+
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <string.h>
 
 #include "splitlink_handler/splitlink_handler.h"
 
@@ -9,37 +16,239 @@ LOG_MODULE_DECLARE(kb_handler);
 BUILD_ASSERT(KEY_COUNT_SLAVE > 0,
              "KB_HANDLER_SPLITLINK_SLAVE requires kb-handler-key-count-slave");
 
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+BUILD_ASSERT(KEY_COUNT + KEY_COUNT_SLAVE == TOTAL_KEY_COUNT,
+             "Slave actuation needs the key counts of kb_settings");
+BUILD_ASSERT(SPLITLINK_HANDLER_EVENTS_MAX <= UINT8_MAX,
+             "Events frame count is a single byte");
+
+// Laid out like the settings so the rapid trigger engine can run on it,
+// slave keys start at KEY_COUNT
+static uint16_t key_values[TOTAL_KEY_COUNT] = {0};
+static uint16_t *const values = &key_values[KEY_COUNT];
+#else
 static uint16_t values[KEY_COUNT_SLAVE] = {0};
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+
+// KScan frames of several devices may arrive from their own threads
+static K_MUTEX_DEFINE(slave_mut);
+
+// Amount of keys delivered by KScan frames since values were last sent
+static uint16_t frame_keys_counter = 0;
 
-static uint16_t new_value_counter = 0;
+// Values go out as deltas against what the master last got, see
+// lib/ykb_value_codec.h
+static ykb_value_codec_encoder_t encoder;
+static uint16_t encoder_ref[KEY_COUNT_SLAVE];
+// Set on connect and when a frame was lost, the master needs a keyframe
+// before it takes deltas again
+static atomic_t resync_pending;
 
-static void on_new_value(uint16_t idx, uint16_t value) {
-    if (idx >= KEY_COUNT_SLAVE) {
-        LOG_WRN("Ignoring out-of-range slave key value idx %u", idx);
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+// Settings last received from the master, no key is actuated before
+static kb_settings_t actuation_settings;
+static bool actuation_settings_valid;
+static struct kbh_rapid_trigger rapid_trigger;
+// Pressed state of every slave key as last queued for the master
+static bool pressed[KEY_COUNT_SLAVE];
+
+static uint8_t events_frame[SPLITLINK_HANDLER_EVENTS_MAX_SIZE];
+static uint8_t events_count;
+// Master state is unknown, the next frame carries every pressed key
+static bool events_sync_pending = true;
+// Set on connect, picked up with the slave mutex held
+static atomic_t events_resync;
+// The master extends 16 bit event timestamps backwards from the send time of
+// their frame. Events which waited longer than this for the link go out as a
+// sync frame instead, their timestamp would be read a wrap too late.
+#define EVENTS_MAX_AGE_US (UINT16_MAX / 2)
+static uint32_t events_oldest_us;
+
+static int64_t values_sent_at;
+
+static struct splitlink_handler_event *frame_events(void) {
+    return (struct splitlink_handler_event
+                *)&events_frame[sizeof(struct splitlink_handler_events_header)];
+}
+
+static void queue_event(uint16_t key, bool key_pressed, uint32_t time_us) {
+    if (events_sync_pending) {
+        // The sync frame is built from the pressed state when sent
+        return;
+    }
+    if (events_count == SPLITLINK_HANDLER_EVENTS_MAX) {
+        // Master fell behind, bring it to the current state instead
+        events_count = 0;
+        events_sync_pending = true;
         return;
     }
 
-    values[idx] = value;
+    if (events_count == 0) {
+        events_oldest_us = time_us;
+    }
+
+    struct splitlink_handler_event *event = &frame_events()[events_count++];
+
+    event->key = key | (key_pressed ? SPLITLINK_HANDLER_EVENT_PRESSED : 0U);
+    event->timestamp = (uint16_t)time_us;
+}
+
+static void send_events(uint32_t time_us) {
+    struct splitlink_handler_events_header *header =
+        (struct splitlink_handler_events_header *)events_frame;
+    uint16_t timestamp = (uint16_t)time_us;
 
-    new_value_counter++;
-    if (new_value_counter >= KEY_COUNT_SLAVE) {
-        new_value_counter = 0;
-        splitlink_handler_send_values(values, KEY_COUNT_SLAVE);
+    if (atomic_cas(&events_resync, 1, 0)) {
+        events_count = 0;
+        events_sync_pending = true;
     }
+
+    if (events_count > 0 && time_us - events_oldest_us > EVENTS_MAX_AGE_US) {
+        events_sync_pending = true;
+    }
+
+    if (events_sync_pending) {
+        events_count = 0;
+        for (uint16_t i = 0; i < KEY_COUNT_SLAVE; ++i) {
+            if (pressed[i]) {
+                frame_events()[events_count].key =
+                    i | SPLITLINK_HANDLER_EVENT_PRESSED;
+                frame_events()[events_count].timestamp = timestamp;
+                events_count++;
+            }
+        }
+        header->flags = SPLITLINK_HANDLER_EVENTS_FLAG_SYNC;
+    } else if (events_count == 0) {
+        return;
+    } else {
+        header->flags = 0;
+    }
+    header->count = events_count;
+
+    uint16_t len = sizeof(*header) +
+                   events_count * sizeof(struct splitlink_handler_event);
+    int err = splitlink_handler_send_events(events_frame, len);
+    if (err == -EBUSY) {
+        // Previous frame still on the link, pending events go with the
+        // next KScan frame
+        return;
+    }
+
+    events_count = 0;
+    events_sync_pending = err != 0;
 }
 
-static void on_event(uint16_t idx, bool pressed) {
-    if (idx >= KEY_COUNT_SLAVE) {
-        LOG_WRN("Ignoring out-of-range slave key event idx %u", idx);
+static void actuate(uint16_t first, uint16_t count, int64_t frame_ticks) {
+    if (!actuation_settings_valid) {
         return;
     }
 
-    values[idx] = pressed;
+    uint32_t time_us = kbh_ticks_to_us(frame_ticks);
+
+    kbh_rapid_trigger_update(&rapid_trigger, &actuation_settings, key_values,
+                             KEY_COUNT + first, count);
+
+    for (uint16_t key = first; key < first + count; ++key) {
+        bool key_pressed = rapid_trigger.pressed[KEY_COUNT + key];
+
+        if (key_pressed == pressed[key]) {
+            continue;
+        }
+        pressed[key] = key_pressed;
+        queue_event(key, key_pressed, time_us);
+    }
+
+    send_events(time_us);
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+
+// Encodes straight into the TX slot, so the encoder only counts frames which
+// go out. While the previous frame is still on the link nothing is encoded,
+// the next call sends whatever changed up to then. Returns -EBUSY then.
+static int send_values(void) {
+    uint8_t *buf;
+    uint16_t size;
+
+    // Not connected: the master gets a keyframe on connect anyway
+    int err = splitlink_handler_values_claim(&buf, &size);
+    if (err) {
+        return err;
+    }
+
+    if (atomic_cas(&resync_pending, 1, 0)) {
+        ykb_value_codec_encoder_resync(&encoder);
+    }
+
+    int len = ykb_value_codec_encode(&encoder, values, buf, size);
+    if (len <= 0) {
+        splitlink_handler_values_release();
+        if (len < 0) {
+            LOG_ERR("ykb_value_codec_encode: %d", len);
+        }
+        return len;
+    }
+
+    splitlink_handler_values_queue(len);
+
+    return 0;
+}
+
+void splitlink_handler_values_lost(void) {
+    atomic_set(&resync_pending, 1);
+}
+
+static void on_frame(const struct kscan_frame *frame) {
+    if (frame->idx_offset >= KEY_COUNT_SLAVE) {
+        LOG_WRN("Ignoring out-of-range slave frame at offset %u",
+                frame->idx_offset);
+        return;
+    }
+
+    uint16_t count = MIN(frame->count, KEY_COUNT_SLAVE - frame->idx_offset);
+
+    k_mutex_lock(&slave_mut, K_FOREVER);
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION && CONFIG_KB_HANDLER_CALIBRATION
+    for (uint16_t i = 0; i < count; ++i) {
+        uint16_t key = frame->idx_offset + i;
+
+        values[key] =
+            kbh_calibration_process(KEY_COUNT + key, frame->values[i]);
+    }
+#else
+    memcpy(&values[frame->idx_offset], frame->values,
+           count * sizeof(uint16_t));
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION &&
+       // CONFIG_KB_HANDLER_CALIBRATION
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    actuate(frame->idx_offset, count, frame->timestamp);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+
+    frame_keys_counter += count;
+    if (frame_keys_counter >= KEY_COUNT_SLAVE) {
+        frame_keys_counter = 0;
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+        // Keys are actuated here, values only feed analog features on the
+        // master and can go at a lower rate
+        int64_t now = k_uptime_get();
+
+        // A busy link gets the newest values with the next frame
+        if (now - values_sent_at >=
+                CONFIG_KB_HANDLER_SPLITLINK_SLAVE_VALUES_INTERVAL_MS &&
+            send_values() != -EBUSY) {
+            values_sent_at = now;
+        }
+#else
+        (void)send_values();
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    }
+
+    k_mutex_unlock(&slave_mut);
 }
 
 KSCAN_CB_DEFINE(kbh_sm) = {
-    .on_new_value = on_new_value,
-    .on_event = on_event,
+    .on_frame = on_frame,
 };
 
 void splitlink_handler_settings_received(const kb_settings_t *settings) {
@@ -47,10 +256,21 @@ void splitlink_handler_settings_received(const kb_settings_t *settings) {
     if (err) {
         LOG_ERR("kb_settings_apply: %d", err);
     }
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    k_mutex_lock(&slave_mut, K_FOREVER);
+    memcpy(&actuation_settings, settings, sizeof(actuation_settings));
+    actuation_settings_valid = true;
+    k_mutex_unlock(&slave_mut);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
 }
 
 void splitlink_handler_on_connect() {
     LOG_INF("SplitLink connected");
+    atomic_set(&resync_pending, 1);
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    atomic_set(&events_resync, 1);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
 }
 
 void splitlink_handler_on_disconnect() {
@@ -70,6 +290,19 @@ static int kb_handler_ss_init(void) {
         return err;
     }
 
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION && CONFIG_KB_HANDLER_CALIBRATION
+    err = kbh_calibration_init();
+    if (err) {
+        return err;
+    }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION &&
+       // CONFIG_KB_HANDLER_CALIBRATION
+
+    ykb_value_codec_encoder_init(
+        &encoder, encoder_ref, KEY_COUNT_SLAVE,
+        CONFIG_KB_HANDLER_SPLITLINK_VALUES_DEADBAND,
+        CONFIG_KB_HANDLER_SPLITLINK_VALUES_KEYFRAME_INTERVAL);
+
     return splitlink_handler_init();
 }
 
@@ -32,6 +32,36 @@ void kb_handler_transport_send_kb_report(
 #endif // CONFIG_BT_CONNECT_KBD && CONFIG_USB_CONNECT_KBD
 }
 
+void kb_handler_transport_send_kb_nkro_report(
+    hid_kb_nkro_report_t *nkro, hid_kb_report_t *boot,
+    enum kb_handler_transport_priority prio) {
+#if CONFIG_BT_CONNECT_KBD && CONFIG_USB_CONNECT_KBD
+    bool usb_ready = usb_connect_can_send_kb_report();
+    bool bt_ready = bt_connect_can_send_kb_report();
+    if (usb_ready && bt_ready) {
+        if (prio == KBH_TRANSPORT_PRIO_USB) {
+            usb_connect_send_kb_nkro_report(nkro, boot);
+            return;
+        }
+        if (prio == KBH_TRANSPORT_PRIO_BT) {
+            bt_connect_send_kb_nkro_report(nkro, boot);
+        }
+    } else if (usb_ready) {
+        usb_connect_send_kb_nkro_report(nkro, boot);
+    } else if (bt_ready) {
+        bt_connect_send_kb_nkro_report(nkro, boot);
+    }
+#elif CONFIG_BT_CONNECT_KBD
+    if (bt_connect_can_send_kb_report()) {
+        bt_connect_send_kb_nkro_report(nkro, boot);
+    }
+#elif CONFIG_USB_CONNECT_KBD
+    if (usb_connect_can_send_kb_report()) {
+        usb_connect_send_kb_nkro_report(nkro, boot);
+    }
+#endif // CONFIG_BT_CONNECT_KBD && CONFIG_USB_CONNECT_KBD
+}
+
 void kb_handler_transport_send_mouse_report(
     hid_mouse_report_t *report, enum kb_handler_transport_priority prio) {
 #if CONFIG_BT_CONNECT_MOUSE && CONFIG_USB_CONNECT_MOUSE
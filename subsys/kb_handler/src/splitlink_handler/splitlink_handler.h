@@ -3,18 +3,92 @@
 
 #include <subsys/kb_settings.h>
 
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+// Key events of CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION. A frame is a
+// header followed by count events in the order they happened.
+#define SPLITLINK_HANDLER_EVENT_PRESSED BIT(15)
+#define SPLITLINK_HANDLER_EVENT_KEY_MASK 0x7FFFU
+// Events of a sync frame are the currently pressed keys, every other slave
+// key is released
+#define SPLITLINK_HANDLER_EVENTS_FLAG_SYNC BIT(0)
+
+struct splitlink_handler_events_header {
+    uint8_t flags;
+    uint8_t count;
+} __packed;
+
+struct splitlink_handler_event {
+    // Slave key index, SPLITLINK_HANDLER_EVENT_PRESSED set on press
+    uint16_t key;
+    // Slave time in µs of the KScan frame the edge was seen in, the low 16
+    // bits of kbh_time_us()
+    uint16_t timestamp;
+} __packed;
+
+#define SPLITLINK_HANDLER_EVENTS_MAX CONFIG_KB_SETTINGS_KEY_COUNT_SLAVE
+#define SPLITLINK_HANDLER_EVENTS_MAX_SIZE                                      \
+    (sizeof(struct splitlink_handler_events_header) +                          \
+     SPLITLINK_HANDLER_EVENTS_MAX * sizeof(struct splitlink_handler_event))
+
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+// Slave time every real-time transfer starts with, kbh_time_us() right
+// before it is handed to the link
+#define SPLITLINK_HANDLER_TIME_SIZE sizeof(uint32_t)
+#else
+#define SPLITLINK_HANDLER_TIME_SIZE 0U
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+
+// Timing of a received real-time transfer, times of the master clock
+struct splitlink_handler_rx_time {
+    uint32_t received_us;
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+    // Slave send time as stamped and mapped onto the master clock
+    uint32_t sent_remote_us;
+    uint32_t sent_us;
+    uint32_t latency_us;
+    bool stale;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+};
+
 int splitlink_handler_init();
 
 void splitlink_handler_on_connect();
 
 void splitlink_handler_on_disconnect();
 
-void splitlink_handler_values_received(uint16_t *values, uint16_t count);
+// Values travel as frames of lib/ykb_value_codec.h
+void splitlink_handler_values_received(
+    const uint8_t *data, uint16_t len,
+    const struct splitlink_handler_rx_time *time);
+
+// Values are encoded straight into the TX slot: claim it, write at most
+// *size bytes to *buf, then queue them or release the slot again. Returns
+// -EBUSY while the previous frame is still on the link.
+int splitlink_handler_values_claim(uint8_t **buf, uint16_t *size);
+
+void splitlink_handler_values_queue(uint16_t len);
+
+void splitlink_handler_values_release(void);
+
+// A queued values frame did not make it onto the link, or the master asked
+// for a keyframe. The next values frame is a keyframe.
+void splitlink_handler_values_lost(void);
+
+// Asks the slave for a values keyframe, on the master. Returns -EBUSY while
+// the previous request is still on the link.
+int splitlink_handler_request_keyframe(void);
+
+void splitlink_handler_events_received(
+    const uint8_t *data, uint16_t len,
+    const struct splitlink_handler_rx_time *time);
 
-void splitlink_handler_send_values(uint16_t *values, uint16_t count);
+int splitlink_handler_send_events(const uint8_t *data, uint16_t len);
 
 void splitlink_handler_settings_received(const kb_settings_t *settings);
 
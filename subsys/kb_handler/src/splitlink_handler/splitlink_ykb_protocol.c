@@ -2,12 +2,20 @@
 
 #include <drivers/splitlink.h>
 
+#include <subsys/kb_handler.h>
 #include <subsys/zephyr_user_helpers.h>
 
 #define YKB_PROTOCOL_MAX_PACKET_SIZE SPLITLINK_MAX_PACKET_LENGTH
+#include <lib/ykb_chunk_sync.h>
 #include <lib/ykb_protocol.h>
+#include <lib/ykb_time_sync.h>
+#include <lib/ykb_value_codec.h>
 
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
 
 #include <stdatomic.h>
 
@@ -22,30 +30,72 @@ enum rx_slot_state {
 
 enum tx_slot_state {
     TX_SLOT_EMPTY,
+    // Claimed by a producer which is still copying its data in
+    TX_SLOT_FILLING,
+    // Owned by the TX scheduler until the last fragment is sent
     TX_SLOT_TRANSCEIVING,
 };
 
 struct rx_slot {
     struct k_work work;
     enum rx_slot_state state;
+    enum kb_handler_splitlink_class cls;
     uint8_t *data;
     uint16_t max_data_length;
 #if CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
-    uint8_t bitmap[CONFIG_KB_HANDLER_SL_BITMAP_LENGTH];
+    uint8_t *bitmap;
+    size_t bitmap_size;
 #endif // CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+#if CONFIG_KB_HANDLER_SL_ARQ
+    // Last completed transfer, repeated packets of it only get an ACK
+    bool done_valid;
+    uint8_t done_flags;
+    uint16_t done_total_len;
+#endif // CONFIG_KB_HANDLER_SL_ARQ
     ykb_protocol_rx_state_t rx;
+    // Real-time slots reassemble in rx_ctxs instead of rx and data, gen
+    // counts their transfers and delivered_gen is the last one handed on
+    uint8_t gen;
+    uint8_t delivered_gen;
     uint8_t id;
 };
 
 struct tx_slot {
-    struct k_work work;
-    enum tx_slot_state state;
+    atomic_int state;
+    enum kb_handler_splitlink_class cls;
     uint8_t *data;
     uint16_t max_data_length;
     ykb_protocol_tx_state_t tx;
+#if CONFIG_KB_HANDLER_SL_ARQ
+    // Bulk transfers go through selective repeat instead of tx
+    ykb_protocol_arq_tx_t arq;
+    ykb_protocol_arq_rtt_t rtt;
+    uint8_t *acked;
+    size_t acked_size;
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+    uint8_t seq;
+    // Cycle count when the transfer was queued
+    uint32_t queued_at;
     uint8_t id;
 };
 
+struct tx_class_stats {
+    atomic_t transfers;
+    atomic_t packets;
+    atomic_t rejected;
+    atomic_t failed;
+    atomic_t depth;
+    atomic_t max_depth;
+    atomic_t latency_total_us;
+    atomic_t latency_max_us;
+};
+
+struct rx_class_stats {
+    atomic_t transfers;
+    atomic_t dropped;
+    atomic_t evicted;
+};
+
 #define ATOMIC_STORE(var, val)                                                 \
     atomic_store_explicit(var, val, memory_order_relaxed)
 #define ATOMIC_LOAD(var) atomic_load_explicit(var, memory_order_relaxed)
@@ -53,36 +103,244 @@ static atomic_bool connected;
 
 #define VALUES_SLOT_ID 1U
 #define SETTINGS_SLOT_ID 2U
+#define EVENTS_SLOT_ID 3U
+#define MANIFEST_SLOT_ID 4U
+#define KEYFRAME_SLOT_ID 5U
+
+// The master asks for a values keyframe after it lost a frame, the request
+// carries a single reserved byte
+#define KEYFRAME_REQUEST_SIZE 1U
+
+// Settings go to the slave as patches against the manifest it reports, see
+// lib/ykb_chunk_sync.h
+#define SETTINGS_CHUNK_SIZE CONFIG_KB_HANDLER_SL_SETTINGS_CHUNK_SIZE
+#define SETTINGS_PATCH_MAX_SIZE                                                \
+    YKB_CHUNK_SYNC_PATCH_MAX_SIZE(sizeof(kb_settings_t), SETTINGS_CHUNK_SIZE)
+#define SETTINGS_MANIFEST_SIZE                                                 \
+    YKB_CHUNK_SYNC_MANIFEST_SIZE(sizeof(kb_settings_t), SETTINGS_CHUNK_SIZE)
 
-#define TX_SLOT(NAME, DATA_SIZE, ID)                                           \
+BUILD_ASSERT(SETTINGS_PATCH_MAX_SIZE <= UINT16_MAX,
+             "Settings patch does not fit a single transfer");
+
+#if CONFIG_KB_HANDLER_SL_ARQ
+BUILD_ASSERT(CONFIG_KB_HANDLER_SL_ARQ_WINDOW <= YKB_PROTOCOL_ACK_WINDOW_MAX,
+             "KB_HANDLER_SL_ARQ_WINDOW does not fit into an ACK");
+
+#define TX_SLOT_ACKED(NAME, DATA_SIZE)                                         \
+    static uint8_t NAME##_tx_slot_acked[YKB_PROTOCOL_BITMAP_SIZE(DATA_SIZE)];
+#define TX_SLOT_ACKED_INIT(NAME)                                               \
+    .acked = NAME##_tx_slot_acked,                                             \
+    .acked_size = sizeof(NAME##_tx_slot_acked),
+#else
+#define TX_SLOT_ACKED(NAME, DATA_SIZE)
+#define TX_SLOT_ACKED_INIT(NAME)
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+
+#if CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+#define RX_SLOT_BITMAP(NAME, DATA_SIZE)                                        \
+    static uint8_t NAME##_rx_slot_bitmap[YKB_PROTOCOL_BITMAP_SIZE(DATA_SIZE)];
+#define RX_SLOT_BITMAP_INIT(NAME)                                              \
+    .bitmap = NAME##_rx_slot_bitmap,                                           \
+    .bitmap_size = sizeof(NAME##_rx_slot_bitmap),
+#else
+#define RX_SLOT_BITMAP(NAME, DATA_SIZE)
+#define RX_SLOT_BITMAP_INIT(NAME)
+#endif // CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+
+#define TX_SLOT(NAME, DATA_SIZE, ID, CLASS)                                    \
     static uint8_t NAME##_tx_slot_data[DATA_SIZE] = {0};                       \
+    TX_SLOT_ACKED(NAME, DATA_SIZE)                                             \
     static struct tx_slot NAME##_tx_slot = {                                   \
         .data = NAME##_tx_slot_data,                                           \
         .max_data_length = sizeof(NAME##_tx_slot_data),                        \
+        TX_SLOT_ACKED_INIT(NAME)                                               \
         .state = TX_SLOT_EMPTY,                                                \
+        .cls = CLASS,                                                          \
         .id = ID,                                                              \
     }
 
-#define RX_SLOT(NAME, DATA_SIZE, ID)                                           \
+// Real-time RX slot, its transfers reassemble in the pool below
+#define RX_POOL_SLOT(NAME, ID)                                                 \
+    static struct rx_slot NAME##_rx_slot = {                                   \
+        .state = RX_SLOT_EMPTY,                                                \
+        .cls = KB_HANDLER_SPLITLINK_CLASS_RT,                                  \
+        .id = ID,                                                              \
+    }
+
+#define RX_SLOT(NAME, DATA_SIZE, ID, CLASS)                                    \
     static uint8_t NAME##_rx_slot_data[DATA_SIZE] = {0};                       \
+    RX_SLOT_BITMAP(NAME, DATA_SIZE)                                            \
     static struct rx_slot NAME##_rx_slot = {                                   \
         .data = NAME##_rx_slot_data,                                           \
         .max_data_length = sizeof(NAME##_rx_slot_data),                        \
+        RX_SLOT_BITMAP_INIT(NAME)                                              \
         .state = RX_SLOT_EMPTY,                                                \
+        .cls = CLASS,                                                          \
         .id = ID,                                                              \
     }
 
 #if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
-TX_SLOT(values, sizeof(uint16_t) * CONFIG_KB_SETTINGS_KEY_COUNT_SLAVE,
-        VALUES_SLOT_ID);
-RX_SLOT(settings, sizeof(kb_settings_t), SETTINGS_SLOT_ID);
+TX_SLOT(values,
+        SPLITLINK_HANDLER_TIME_SIZE +
+            YKB_VALUE_CODEC_MAX_SIZE(CONFIG_KB_SETTINGS_KEY_COUNT_SLAVE),
+        VALUES_SLOT_ID, KB_HANDLER_SPLITLINK_CLASS_RT);
+RX_SLOT(settings, SETTINGS_PATCH_MAX_SIZE, SETTINGS_SLOT_ID,
+        KB_HANDLER_SPLITLINK_CLASS_BULK);
+TX_SLOT(manifest, SETTINGS_MANIFEST_SIZE, MANIFEST_SLOT_ID,
+        KB_HANDLER_SPLITLINK_CLASS_BULK);
+RX_SLOT(keyframe, SPLITLINK_HANDLER_TIME_SIZE + KEYFRAME_REQUEST_SIZE,
+        KEYFRAME_SLOT_ID, KB_HANDLER_SPLITLINK_CLASS_RT);
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+TX_SLOT(events, SPLITLINK_HANDLER_TIME_SIZE + SPLITLINK_HANDLER_EVENTS_MAX_SIZE,
+        EVENTS_SLOT_ID, KB_HANDLER_SPLITLINK_CLASS_RT);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
 #endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 
 #if CONFIG_KB_HANDLER_SPLITLINK_MASTER
-RX_SLOT(values, sizeof(uint16_t) * CONFIG_KB_SETTINGS_KEY_COUNT_SLAVE,
-        VALUES_SLOT_ID);
-TX_SLOT(settings, sizeof(kb_settings_t), SETTINGS_SLOT_ID);
+RX_POOL_SLOT(values, VALUES_SLOT_ID);
+TX_SLOT(settings, SETTINGS_PATCH_MAX_SIZE, SETTINGS_SLOT_ID,
+        KB_HANDLER_SPLITLINK_CLASS_BULK);
+RX_SLOT(manifest, SETTINGS_MANIFEST_SIZE, MANIFEST_SLOT_ID,
+        KB_HANDLER_SPLITLINK_CLASS_BULK);
+TX_SLOT(keyframe, SPLITLINK_HANDLER_TIME_SIZE + KEYFRAME_REQUEST_SIZE,
+        KEYFRAME_SLOT_ID, KB_HANDLER_SPLITLINK_CLASS_RT);
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+RX_POOL_SLOT(events, EVENTS_SLOT_ID);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+
+// Real-time transfers reassemble in one of rx_ctxs, straight into a buffer
+// from rx_buf_slab. A completed buffer goes to the consumer as is, so the
+// next transfer can start while the previous one is still being handled.
+// Messages the driver reassembled already stay in its net_buf, the consumer
+// reads them there through a reference.
+#define RX_VALUES_MAX_SIZE                                                     \
+    YKB_VALUE_CODEC_MAX_SIZE(CONFIG_KB_SETTINGS_KEY_COUNT_SLAVE)
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+#define RX_BUF_SIZE                                                            \
+    (SPLITLINK_HANDLER_TIME_SIZE +                                             \
+     MAX(RX_VALUES_MAX_SIZE, SPLITLINK_HANDLER_EVENTS_MAX_SIZE))
+#else
+#define RX_BUF_SIZE (SPLITLINK_HANDLER_TIME_SIZE + RX_VALUES_MAX_SIZE)
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+
+// Completed transfer waiting for the consumer
+struct rx_done {
+    // Used by k_fifo
+    void *fifo_reserved;
+    struct rx_slot *slot;
+    const uint8_t *data;
+    uint32_t received_us;
+    uint16_t len;
+    uint8_t gen;
+#if CONFIG_SPLITLINK_MSG
+    // Driver buffer data points into, NULL if it points into an rx_buf
+    struct net_buf *msg;
+#endif // CONFIG_SPLITLINK_MSG
+};
+
+struct rx_buf {
+    struct rx_done done;
+    uint8_t data[RX_BUF_SIZE];
+};
+
+struct rx_ctx {
+    ykb_protocol_rx_state_t rx;
+    // NULL while the context is free
+    struct rx_buf *buf;
+    struct rx_slot *slot;
+    uint32_t started_at;
+    uint8_t gen;
+#if CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+    uint8_t bitmap[YKB_PROTOCOL_BITMAP_SIZE(RX_BUF_SIZE)];
+#endif // CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+};
+
+BUILD_ASSERT(CONFIG_KB_HANDLER_SL_RX_BUFFERS >=
+                 CONFIG_KB_HANDLER_SL_RX_CONTEXTS,
+             "KB_HANDLER_SL_RX_BUFFERS must cover KB_HANDLER_SL_RX_CONTEXTS");
+
+K_MEM_SLAB_DEFINE_STATIC(rx_buf_slab, ROUND_UP(sizeof(struct rx_buf), 4),
+                         CONFIG_KB_HANDLER_SL_RX_BUFFERS, 4);
+#if CONFIG_SPLITLINK_MSG
+K_MEM_SLAB_DEFINE_STATIC(rx_msg_slab, ROUND_UP(sizeof(struct rx_done), 4),
+                         CONFIG_KB_HANDLER_SL_RX_BUFFERS, 4);
+#endif // CONFIG_SPLITLINK_MSG
+static struct rx_ctx rx_ctxs[CONFIG_KB_HANDLER_SL_RX_CONTEXTS];
+static K_FIFO_DEFINE(rx_done_fifo);
+
+static void rx_done_work_handler(struct k_work *work);
+static K_WORK_DEFINE(rx_done_work, rx_done_work_handler);
+
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+// Slave clock mapped onto the master clock, updated from the work queue
+static ykb_time_sync_t time_sync;
+static K_MUTEX_DEFINE(time_sync_mut);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
+// Same time base as kbh_time_us()
+static inline uint32_t time_us(void) {
+    return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+// TX slots in priority order, real-time ones first
+static struct tx_slot *const tx_slots[] = {
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    &events_tx_slot,
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    &values_tx_slot,
+    &manifest_tx_slot,
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+    &keyframe_tx_slot,
+    &settings_tx_slot,
 #endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+};
+
+static struct tx_class_stats tx_stats[KB_HANDLER_SPLITLINK_CLASS_COUNT];
+static struct rx_class_stats rx_stats[KB_HANDLER_SPLITLINK_CLASS_COUNT];
+
+static void tx_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(tx_work, tx_work_handler);
+// Uptime before which no further bulk fragment goes out
+static int64_t bulk_next_at;
+
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+// Latest settings and the last manifest or summary of the slave, the slave
+// gets a patch whenever either changes
+static kb_settings_t settings_image;
+static bool settings_image_valid;
+static uint8_t slave_manifest[SETTINGS_MANIFEST_SIZE];
+// 0 while the slave has not reported its settings yet
+static uint16_t slave_manifest_len;
+static K_MUTEX_DEFINE(settings_sync_mut);
+
+static void settings_manifest_received(const uint8_t *data, uint16_t len);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+// Settings as assembled from patches, only handed on once the whole image
+// matches the hash of the master
+static kb_settings_t settings_mirror;
+static bool settings_mirror_loaded;
+
+// Set once a patch failed to apply, the master then needs the full manifest
+// instead of the summary to tell which chunks are missing
+static atomic_t settings_manifest_full;
+
+// Loading and applying settings may wait on the settings storage, so patches
+// and manifests are handled in order on a queue of their own instead of the
+// system workqueue
+static K_THREAD_STACK_DEFINE(settings_work_q_stack,
+                             CONFIG_KB_HANDLER_SL_SETTINGS_STACK_SIZE);
+static struct k_work_q settings_work_q;
+
+static void settings_patch_received(const uint8_t *data, uint16_t len);
+static void settings_manifest_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(settings_manifest_work,
+                               settings_manifest_work_handler);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 
 #if !Z_USER_HAS_PROP(kb_handler_splitlink)
 #error                                                                         \
@@ -91,10 +349,20 @@ TX_SLOT(settings, sizeof(kb_settings_t), SETTINGS_SLOT_ID);
 
 const struct device *splitlink_dev = Z_USER_DEV(kb_handler_splitlink);
 
+static inline void rx_slot_submit(struct rx_slot *slot) {
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+    if (slot->id == SETTINGS_SLOT_ID) {
+        k_work_submit_to_queue(&settings_work_q, &slot->work);
+        return;
+    }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+    k_work_submit(&slot->work);
+}
+
 static inline void rx_init(struct rx_slot *slot) {
 #if CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
     ykb_protocol_rx_init(&slot->rx, slot->data, slot->max_data_length, true,
-                         slot->bitmap, sizeof(slot->bitmap));
+                         slot->bitmap, slot->bitmap_size);
 #else
     ykb_protocol_rx_init(&slot->rx, slot->data, slot->max_data_length, false,
                          NULL, 0);
@@ -105,21 +373,26 @@ void rx_slot_work_handler(struct k_work *work) {
     struct rx_slot *slot = CONTAINER_OF(work, struct rx_slot, work);
     slot->state = RX_SLOT_PROCESSING;
 
+    atomic_inc(&rx_stats[slot->cls].transfers);
+
 #if CONFIG_KB_HANDLER_SPLITLINK_MASTER
-    if (slot->id == VALUES_SLOT_ID) {
-        uint16_t values[CONFIG_KB_SETTINGS_KEY_COUNT_SLAVE];
-        memcpy(values, slot->data, slot->rx.total_len);
-        uint16_t total_len = slot->rx.total_len;
+    if (slot->id == MANIFEST_SLOT_ID) {
+        settings_manifest_received(slot->data, slot->rx.total_len);
         ykb_protocol_rx_reset(&slot->rx);
         slot->state = RX_SLOT_EMPTY;
-        splitlink_handler_values_received(values, total_len / sizeof(uint16_t));
         return;
     }
 #endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
 #if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
     if (slot->id == SETTINGS_SLOT_ID) {
-        const kb_settings_t *settings = (const kb_settings_t *)slot->data;
-        splitlink_handler_settings_received(settings);
+        settings_patch_received(slot->data, slot->rx.total_len);
+        ykb_protocol_rx_reset(&slot->rx);
+        slot->state = RX_SLOT_EMPTY;
+        return;
+    }
+    if (slot->id == KEYFRAME_SLOT_ID) {
+        LOG_DBG("Master asked for a values keyframe");
+        splitlink_handler_values_lost();
         ykb_protocol_rx_reset(&slot->rx);
         slot->state = RX_SLOT_EMPTY;
         return;
@@ -131,33 +404,597 @@ void rx_slot_work_handler(struct k_work *work) {
     slot->state = RX_SLOT_EMPTY;
 }
 
-void tx_slot_work_handler(struct k_work *work) {
-    struct tx_slot *slot = CONTAINER_OF(work, struct tx_slot, work);
+static void tx_slot_finish(struct tx_slot *slot, bool sent) {
+    struct tx_class_stats *stats = &tx_stats[slot->cls];
+
+    if (sent) {
+        uint32_t latency_us =
+            k_cyc_to_us_floor32(k_cycle_get_32() - slot->queued_at);
+
+        atomic_inc(&stats->transfers);
+        atomic_add(&stats->latency_total_us, latency_us);
+        if (latency_us > (uint32_t)atomic_get(&stats->latency_max_us)) {
+            atomic_set(&stats->latency_max_us, latency_us);
+        }
+    } else {
+        atomic_inc(&stats->failed);
+    }
+    atomic_dec(&stats->depth);
+
+    atomic_store(&slot->state, TX_SLOT_EMPTY);
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+    if (!sent && slot->id == VALUES_SLOT_ID) {
+        splitlink_handler_values_lost();
+    }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+}
 
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC && CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+// Stamps a real-time transfer right before its first fragment goes out, so
+// time spent waiting for the slot does not count as link latency
+static inline void tx_slot_stamp(struct tx_slot *slot) {
+    if (slot->cls == KB_HANDLER_SPLITLINK_CLASS_RT &&
+        slot->tx.next_packet_idx == 0U) {
+        sys_put_le32(time_us(), slot->data);
+    }
+}
+#else
+static inline void tx_slot_stamp(struct tx_slot *slot) { ARG_UNUSED(slot); }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC &&
+       // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+
+// Sends the next fragment of a slot, returns false once the slot is done
+static bool tx_slot_send_packet(struct tx_slot *slot) {
+    ykb_protocol_packet_t packet;
+
+    tx_slot_stamp(slot);
+
+    if (!ykb_protocol_tx_build_packet(&slot->tx, &packet)) {
+        LOG_ERR("ykb_protocol_tx_build_packet failed");
+        tx_slot_finish(slot, false);
+        return false;
+    }
+
+    int err = splitlink_send(
+        splitlink_dev, (uint8_t *)&packet,
+        YKB_PROTOCOL_HEADER_SIZE +
+            ykb_protocol_payload_len_for_index(slot->tx.total_len,
+                                               packet.header.packet_idx,
+                                               slot->tx.packet_count));
+    if (err) {
+        LOG_ERR("splitlink_send: %d", err);
+        tx_slot_finish(slot, false);
+        return false;
+    }
+    atomic_inc(&tx_stats[slot->cls].packets);
+
+    if (!ykb_protocol_tx_has_more(&slot->tx)) {
+        tx_slot_finish(slot, true);
+        return false;
+    }
+
+    return true;
+}
+
+// Hands the whole transfer to the driver, which splits it into packets
+static void tx_slot_send_msg(struct tx_slot *slot) {
+    tx_slot_stamp(slot);
+
+    int err = splitlink_send_msg(splitlink_dev, slot->id,
+                                 slot->tx.type_flags_base, slot->data,
+                                 slot->tx.total_len);
+    if (err) {
+        LOG_ERR("splitlink_send_msg: %d", err);
+        tx_slot_finish(slot, false);
+        return;
+    }
+    atomic_add(&tx_stats[slot->cls].packets, slot->tx.packet_count);
+
+    tx_slot_finish(slot, true);
+}
+
+#if CONFIG_KB_HANDLER_SL_ARQ
+// Sends the next fragment the selective repeat window allows, returns false
+// when it has to wait for an ACK
+static bool tx_slot_arq_send_packet(struct tx_slot *slot, uint32_t now) {
     ykb_protocol_packet_t packet;
-    int err;
-    ykb_protocol_tx_init(&slot->tx, slot->data, slot->tx.total_len, slot->id,
-                         YKB_PROTOCOL_TYPE_DATA);
-    while (ykb_protocol_tx_has_more(&slot->tx)) {
-        if (!ykb_protocol_tx_build_packet(&slot->tx, &packet)) {
-            LOG_ERR("ykb_protocol_tx_build_packet failed");
+
+    if (!ykb_protocol_arq_tx_next(&slot->arq, now, &packet)) {
+        return false;
+    }
+
+    int err = splitlink_send(
+        splitlink_dev, (uint8_t *)&packet,
+        YKB_PROTOCOL_HEADER_SIZE +
+            ykb_protocol_payload_len_for_index(slot->arq.tx.total_len,
+                                               packet.header.packet_idx,
+                                               slot->arq.tx.packet_count));
+    if (err) {
+        // Same as a lost fragment, the next ACK or timeout brings it back
+        LOG_DBG("splitlink_send: %d", err);
+        return false;
+    }
+    atomic_inc(&tx_stats[slot->cls].packets);
+
+    return true;
+}
+
+static void on_ack_received(const ykb_protocol_packet_t *packet) {
+    for (size_t i = 0; i < ARRAY_SIZE(tx_slots); ++i) {
+        struct tx_slot *slot = tx_slots[i];
+
+        if (slot->id != packet->header.transfer_id) {
+            continue;
+        }
+
+        if (slot->cls != KB_HANDLER_SPLITLINK_CLASS_BULK ||
+            atomic_load(&slot->state) != TX_SLOT_TRANSCEIVING) {
+            return;
+        }
+
+        // Runs on the system workqueue like tx_work, so the slot is not
+        // touched concurrently
+        ykb_protocol_rx_result_t res = ykb_protocol_arq_tx_on_ack(
+            &slot->arq, packet, k_uptime_get_32());
+        if (res < 0) {
+            LOG_DBG("Stale ACK for slot %d: %d", slot->id, res);
+            return;
+        }
+
+        k_work_reschedule(&tx_work, K_NO_WAIT);
+        return;
+    }
+}
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+
+// Real-time transfers go out whole every run. Bulk fragments only go out
+// in bursts of CONFIG_KB_HANDLER_SL_BULK_BURST, so at most that many sit in
+// the link queue in front of the next real-time packet.
+static void tx_work_handler(struct k_work *work) {
+    int64_t now = k_uptime_get();
+    uint16_t bulk_budget =
+        now >= bulk_next_at ? CONFIG_KB_HANDLER_SL_BULK_BURST : 0;
+    bool bulk_sent = false;
+    bool bulk_waiting = false;
+    // Earliest retransmission timeout of a bulk transfer waiting for an ACK
+    uint32_t ack_wait_ms = UINT32_MAX;
+
+    ARG_UNUSED(work);
+
+    for (size_t i = 0; i < ARRAY_SIZE(tx_slots); ++i) {
+        struct tx_slot *slot = tx_slots[i];
+
+        if (atomic_load(&slot->state) != TX_SLOT_TRANSCEIVING) {
+            continue;
+        }
+
+        if (slot->cls == KB_HANDLER_SPLITLINK_CLASS_RT) {
+            // Only the master takes messages, see msg_ids
+            if (IS_ENABLED(CONFIG_SPLITLINK_MSG) &&
+                IS_ENABLED(CONFIG_KB_HANDLER_SPLITLINK_SLAVE)) {
+                tx_slot_send_msg(slot);
+                continue;
+            }
+            while (tx_slot_send_packet(slot)) {
+            }
+            continue;
+        }
+
+#if CONFIG_KB_HANDLER_SL_ARQ
+        uint32_t now32 = (uint32_t)now;
+
+        if (!ATOMIC_LOAD(&connected)) {
+            tx_slot_finish(slot, false);
+            continue;
+        }
+
+        ykb_protocol_arq_tx_poll(&slot->arq, now32);
+        while (bulk_budget > 0 && tx_slot_arq_send_packet(slot, now32)) {
+            bulk_budget--;
+            bulk_sent = true;
+        }
+
+        if (ykb_protocol_arq_tx_is_done(&slot->arq)) {
+            if (slot->arq.failed) {
+                LOG_WRN("Slot %d transfer failed after %u retries", slot->id,
+                        slot->arq.retries);
+            } else {
+                LOG_DBG("Slot %d sent %u fragments, %u retransmitted",
+                        slot->id, slot->arq.packets_sent,
+                        slot->arq.retransmissions);
+            }
+            tx_slot_finish(slot, slot->arq.complete);
+            continue;
+        }
+
+        uint32_t wait_ms = ykb_protocol_arq_tx_wait_ms(&slot->arq, now32);
+        if (wait_ms == 0) {
+            bulk_waiting = true;
+        } else {
+            ack_wait_ms = MIN(ack_wait_ms, wait_ms);
+        }
+#else
+        bool more = true;
+
+        while (more && bulk_budget > 0) {
+            more = tx_slot_send_packet(slot);
+            bulk_budget--;
+            bulk_sent = true;
+        }
+        bulk_waiting |= more;
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+    }
+
+    if (bulk_sent) {
+        bulk_next_at = now + CONFIG_KB_HANDLER_SL_BULK_INTERVAL_MS;
+    }
+    if (bulk_waiting) {
+        k_work_schedule(&tx_work, K_MSEC(MAX(bulk_next_at - now, 0)));
+    } else if (ack_wait_ms != UINT32_MAX) {
+        k_work_schedule(&tx_work, K_MSEC(ack_wait_ms));
+    }
+}
+
+#if CONFIG_KB_HANDLER_SL_ARQ
+// ACKs skip the queued bulk packets, a newer one tells everything an older
+// one did. One replaced before it went out costs its sender a timeout, as an
+// ACK lost on air does.
+static void rx_slot_send_ack(struct rx_slot *slot,
+                             const ykb_protocol_packet_t *ack, uint16_t len) {
+    int err = splitlink_send_rt(splitlink_dev, (uint8_t *)ack, len);
+    if (err) {
+        // The sender times out and asks again
+        LOG_DBG("ACK for slot %d: %d", slot->id, err);
+    }
+}
+
+// Bulk transfers are received out of order, errors only drop the packet,
+// the sender retransmits whatever the ACKs report missing
+static void rx_slot_arq_push(struct rx_slot *slot,
+                             const ykb_protocol_packet_t *packet) {
+    const ykb_protocol_header_t *header = &packet->header;
+    uint8_t flags = header->type_flags & ~YKB_PROTOCOL_PACKET_FLAGS;
+    bool ack_req = header->type_flags & YKB_PROTOCOL_FLAG_ACK_REQ;
+    ykb_protocol_packet_t ack;
+    uint16_t ack_len = 0;
+
+    // The sender missed the final ACK of the transfer handed on already
+    if (slot->done_valid && slot->done_flags == flags &&
+        slot->done_total_len == header->total_len &&
+        (slot->state != RX_SLOT_RECEIVING ||
+         slot->rx.type_flags_base != flags)) {
+        if (ack_req) {
+            ack_len = ykb_protocol_ack_build(
+                &ack, slot->id, flags, header->total_len,
+                header->packet_count, header->packet_count, NULL);
+            rx_slot_send_ack(slot, &ack, ack_len);
+        }
+        return;
+    }
+
+    ykb_protocol_rx_result_t res;
+
+    switch (slot->state) {
+    case RX_SLOT_EMPTY:
+        rx_init(slot);
+        slot->state = RX_SLOT_RECEIVING;
+        res = ykb_protocol_rx_push_packet(&slot->rx, packet);
+        break;
+    case RX_SLOT_RECEIVING:
+        res = ykb_protocol_rx_push_packet(&slot->rx, packet);
+        if (res == YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH) {
+            // The sender gave up on the previous transfer
+            atomic_inc(&rx_stats[slot->cls].evicted);
+            rx_init(slot);
+            res = ykb_protocol_rx_push_packet(&slot->rx, packet);
+        }
+        break;
+    default:
+        LOG_DBG("Slot %d is in progress, skipping packet", slot->id);
+        atomic_inc(&rx_stats[slot->cls].dropped);
+        return;
+    }
+
+    if (res < 0) {
+        LOG_DBG("Slot %d dropped packet %u: %d", slot->id, header->packet_idx,
+                res);
+        if (!slot->rx.active) {
+            slot->state = RX_SLOT_EMPTY;
+        }
+        return;
+    }
+
+    if (res == YKB_PROTOCOL_RX_RESULT_COMPLETE || ack_req) {
+        ack_len = ykb_protocol_rx_build_ack(&slot->rx, &ack);
+    }
+
+    if (res == YKB_PROTOCOL_RX_RESULT_COMPLETE) {
+        slot->done_valid = true;
+        slot->done_flags = flags;
+        slot->done_total_len = header->total_len;
+        slot->state = RX_SLOT_READY;
+        rx_slot_submit(slot);
+    }
+
+    if (ack_len) {
+        rx_slot_send_ack(slot, &ack, ack_len);
+    }
+}
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+static void rx_time_sample(const struct rx_slot *slot,
+                           const struct rx_done *done,
+                           struct splitlink_handler_rx_time *time) {
+    ykb_time_sync_result_t res;
+
+    time->sent_remote_us = sys_get_le32(done->data);
+
+    k_mutex_lock(&time_sync_mut, K_FOREVER);
+    ykb_time_sync_sample(&time_sync, time->sent_remote_us, done->received_us,
+                         &res);
+    k_mutex_unlock(&time_sync_mut);
+
+    time->sent_us = res.sent_us;
+    time->latency_us = res.latency_us;
+    time->stale = res.stale;
+    if (res.stale) {
+        LOG_DBG("Slot %d transfer stale, %u us late", slot->id,
+                res.latency_us);
+    }
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+
+static void rx_done_free(struct rx_done *done) {
+#if CONFIG_SPLITLINK_MSG
+    if (done->msg) {
+        net_buf_unref(done->msg);
+        k_mem_slab_free(&rx_msg_slab, done);
+        return;
+    }
+#endif // CONFIG_SPLITLINK_MSG
+    k_mem_slab_free(&rx_buf_slab, CONTAINER_OF(done, struct rx_buf, done));
+}
+
+static void rx_done_work_handler(struct k_work *work) {
+    struct rx_done *done;
+
+    ARG_UNUSED(work);
+
+    while ((done = k_fifo_get(&rx_done_fifo, K_NO_WAIT)) != NULL) {
+        struct rx_slot *slot = done->slot;
+
+        // Only ever hand on transfers newer than the last one
+        if ((int8_t)(done->gen - slot->delivered_gen) <= 0) {
+            LOG_DBG("Slot %d dropped stale transfer %u", slot->id, done->gen);
+            atomic_inc(&rx_stats[slot->cls].dropped);
+            rx_done_free(done);
+            continue;
+        }
+        slot->delivered_gen = done->gen;
+        atomic_inc(&rx_stats[slot->cls].transfers);
+
+        struct splitlink_handler_rx_time time = {
+            .received_us = done->received_us,
+        };
+
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+        if (done->len < SPLITLINK_HANDLER_TIME_SIZE) {
+            LOG_ERR("Slot %d transfer too short for its timestamp", slot->id);
+            rx_done_free(done);
+            continue;
+        }
+        rx_time_sample(slot, done, &time);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+
+        const uint8_t *data = &done->data[SPLITLINK_HANDLER_TIME_SIZE];
+        uint16_t len = done->len - SPLITLINK_HANDLER_TIME_SIZE;
+
+        if (slot->id == VALUES_SLOT_ID) {
+            splitlink_handler_values_received(data, len, &time);
+        }
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+        if (slot->id == EVENTS_SLOT_ID) {
+            splitlink_handler_events_received(data, len, &time);
+        }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+
+        rx_done_free(done);
+    }
+}
+
+static void rx_ctx_release(struct rx_ctx *ctx) {
+    if (ctx->buf) {
+        k_mem_slab_free(&rx_buf_slab, ctx->buf);
+        ctx->buf = NULL;
+    }
+}
+
+static void rx_ctx_evict(struct rx_ctx *ctx) {
+    LOG_DBG("Slot %d evicted transfer %u", ctx->slot->id, ctx->gen);
+    atomic_inc(&rx_stats[ctx->slot->cls].evicted);
+    rx_ctx_release(ctx);
+}
+
+// Oldest unfinished transfer, the first to give way to a new one
+static struct rx_ctx *rx_ctx_oldest(void) {
+    struct rx_ctx *oldest = NULL;
+    uint32_t now = k_uptime_get_32();
+
+    for (size_t i = 0; i < ARRAY_SIZE(rx_ctxs); ++i) {
+        struct rx_ctx *ctx = &rx_ctxs[i];
+
+        if (ctx->buf &&
+            (!oldest || now - ctx->started_at > now - oldest->started_at)) {
+            oldest = ctx;
+        }
+    }
+
+    return oldest;
+}
+
+// Takes a context and a buffer for a new transfer on slot, evicting the
+// oldest unfinished transfer if either ran out. Returns NULL when every
+// buffer is still with the consumer.
+static struct rx_ctx *rx_ctx_start(struct rx_slot *slot) {
+    struct rx_ctx *ctx = NULL;
+    void *buf;
+
+    for (size_t i = 0; i < ARRAY_SIZE(rx_ctxs); ++i) {
+        if (!rx_ctxs[i].buf) {
+            ctx = &rx_ctxs[i];
             break;
         }
-        err =
-            splitlink_send(splitlink_dev, (uint8_t *)&packet,
-                           YKB_PROTOCOL_HEADER_SIZE +
-                               ykb_protocol_payload_len_for_index(
-                                   slot->tx.total_len, packet.header.packet_idx,
-                                   slot->tx.packet_count));
-        if (err) {
-            LOG_ERR("splitlink_send: %d", err);
+    }
+
+    if (!ctx) {
+        ctx = rx_ctx_oldest();
+        rx_ctx_evict(ctx);
+    }
+
+    if (k_mem_slab_alloc(&rx_buf_slab, &buf, K_NO_WAIT)) {
+        struct rx_ctx *oldest = rx_ctx_oldest();
+
+        if (!oldest) {
+            return NULL;
+        }
+        rx_ctx_evict(oldest);
+        if (k_mem_slab_alloc(&rx_buf_slab, &buf, K_NO_WAIT)) {
+            return NULL;
+        }
+    }
+
+    ctx->buf = buf;
+    ctx->slot = slot;
+    ctx->started_at = k_uptime_get_32();
+    ctx->gen = ++slot->gen;
+
+#if CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+    ykb_protocol_rx_init(&ctx->rx, ctx->buf->data, sizeof(ctx->buf->data),
+                         true, ctx->bitmap, sizeof(ctx->bitmap));
+#else
+    ykb_protocol_rx_init(&ctx->rx, ctx->buf->data, sizeof(ctx->buf->data),
+                         false, NULL, 0);
+#endif // CONFIG_KB_HANDLER_SL_OUT_OF_ORDER_TRACK
+
+    return ctx;
+}
+
+static void rx_pool_push(struct rx_slot *slot,
+                         const ykb_protocol_packet_t *packet) {
+    struct rx_ctx *ctx = NULL;
+    ykb_protocol_rx_result_t res;
+
+    for (size_t i = 0; i < ARRAY_SIZE(rx_ctxs); ++i) {
+        if (rx_ctxs[i].buf && rx_ctxs[i].slot == slot) {
+            ctx = &rx_ctxs[i];
             break;
         }
     }
 
-    slot->state = TX_SLOT_EMPTY;
+    if (ctx) {
+        res = ykb_protocol_rx_push_packet(&ctx->rx, packet);
+        if (res == YKB_PROTOCOL_RX_ERROR_OUT_OF_ORDER &&
+            packet->header.packet_idx < ctx->rx.next_expected_packet_idx) {
+            // Sent again after a failed TX, already have it
+            return;
+        }
+        if (res == YKB_PROTOCOL_RX_ERROR_TRANSFER_MISMATCH ||
+            res == YKB_PROTOCOL_RX_ERROR_OUT_OF_ORDER) {
+            // A newer transfer of the slot started, the unfinished one
+            // would only be stale by the time it completes
+            rx_ctx_evict(ctx);
+            ctx = NULL;
+        }
+    }
+
+    if (!ctx) {
+        ctx = rx_ctx_start(slot);
+        if (!ctx) {
+            LOG_DBG("No RX buffer for slot %d, skipping packet", slot->id);
+            atomic_inc(&rx_stats[slot->cls].dropped);
+            return;
+        }
+        res = ykb_protocol_rx_push_packet(&ctx->rx, packet);
+    }
+
+    if (res < 0) {
+        LOG_ERR("packet transfer: %d", res);
+        atomic_inc(&rx_stats[slot->cls].dropped);
+        rx_ctx_release(ctx);
+        return;
+    }
+
+    if (res == YKB_PROTOCOL_RX_RESULT_COMPLETE) {
+        struct rx_buf *buf = ctx->buf;
+
+        buf->done = (struct rx_done){
+            .slot = slot,
+            .data = buf->data,
+            .received_us = time_us(),
+            .len = ctx->rx.total_len,
+            .gen = ctx->gen,
+        };
+        ctx->buf = NULL;
+
+        k_fifo_put(&rx_done_fifo, &buf->done);
+        k_work_submit(&rx_done_work);
+    }
 }
 
+#if CONFIG_SPLITLINK_MSG
+// Real-time transfers reassembled by the driver, they skip rx_ctxs and go
+// straight to the consumer, which reads them in the driver buffer
+static void on_msg_cb(const struct device *dev, uint8_t id,
+                      struct net_buf *msg) {
+    struct rx_slot *slot;
+    struct rx_done *done;
+
+    ARG_UNUSED(dev);
+
+    switch (id) {
+    case VALUES_SLOT_ID:
+        slot = &values_rx_slot;
+        break;
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    case EVENTS_SLOT_ID:
+        slot = &events_rx_slot;
+        break;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    default:
+        LOG_ERR("Message for unknown slot id %d", id);
+        return;
+    }
+
+    if (msg->len > RX_BUF_SIZE) {
+        LOG_ERR("Slot %d message too long: %d", id, msg->len);
+        atomic_inc(&rx_stats[slot->cls].dropped);
+        return;
+    }
+
+    if (k_mem_slab_alloc(&rx_msg_slab, (void **)&done, K_NO_WAIT)) {
+        LOG_DBG("No RX buffer for slot %d, skipping message", id);
+        atomic_inc(&rx_stats[slot->cls].dropped);
+        return;
+    }
+
+    *done = (struct rx_done){
+        .slot = slot,
+        .data = msg->data,
+        .received_us = time_us(),
+        .len = msg->len,
+        .gen = ++slot->gen,
+        .msg = net_buf_ref(msg),
+    };
+
+    k_fifo_put(&rx_done_fifo, done);
+    k_work_submit(&rx_done_work);
+}
+#endif // CONFIG_SPLITLINK_MSG
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
 static void on_receive_cb(const struct device *dev, uint8_t *data,
                           size_t data_len) {
     if (!data || data_len == 0) {
@@ -170,9 +1007,30 @@ static void on_receive_cb(const struct device *dev, uint8_t *data,
         return;
     }
 
-    ykb_protocol_packet_t packet = {0};
-    memcpy(&packet, data, data_len);
-    uint8_t id = packet.header.transfer_id;
+    // Parsed in place, data stays valid until this returns and is never
+    // read past what the header says was sent
+    const ykb_protocol_packet_t *packet = (const ykb_protocol_packet_t *)data;
+    const ykb_protocol_header_t *header = &packet->header;
+
+    uint16_t payload_len = ykb_protocol_payload_len_for_index(
+        header->total_len, header->packet_idx, header->packet_count);
+
+    if (data_len < (size_t)YKB_PROTOCOL_HEADER_SIZE + payload_len) {
+        LOG_ERR("truncated packet (%d bytes)", data_len);
+        return;
+    }
+
+    uint8_t id = header->transfer_id;
+
+    if (ykb_protocol_get_type(header->type_flags) == YKB_PROTOCOL_TYPE_ACK) {
+#if CONFIG_KB_HANDLER_SL_ARQ
+        on_ack_received(packet);
+#else
+        LOG_ERR("ACK for slot %d, check KB_HANDLER_SL_ARQ on both halves",
+                id);
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+        return;
+    }
 
     struct rx_slot *slot;
 
@@ -184,6 +1042,25 @@ static void on_receive_cb(const struct device *dev, uint8_t *data,
 #else
         LOG_ERR("Values RX is not supported on splitlink slave");
         return;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+    case EVENTS_SLOT_ID:
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER &&                                      \
+    CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+        slot = &events_rx_slot;
+        break;
+#else
+        LOG_ERR("Events RX is not supported, check "
+                "KB_HANDLER_SPLITLINK_SLAVE_ACTUATION on both halves");
+        return;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER &&
+       // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    case MANIFEST_SLOT_ID:
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+        slot = &manifest_rx_slot;
+        break;
+#else
+        LOG_ERR("Manifest RX is not supported on splitlink slave");
+        return;
 #endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
     case SETTINGS_SLOT_ID:
 #if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
@@ -192,30 +1069,54 @@ static void on_receive_cb(const struct device *dev, uint8_t *data,
 #else
         LOG_ERR("Settings RX is not supported on splitlink master");
         return;
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+    case KEYFRAME_SLOT_ID:
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+        slot = &keyframe_rx_slot;
+        break;
+#else
+        LOG_ERR("Keyframe request RX is not supported on splitlink master");
+        return;
 #endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
     default:
         LOG_ERR("Packet for unknown slot id %d", id);
         return;
     }
 
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+    if (slot->cls == KB_HANDLER_SPLITLINK_CLASS_RT) {
+        rx_pool_push(slot, packet);
+        return;
+    }
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
+#if CONFIG_KB_HANDLER_SL_ARQ
+    if (slot->cls == KB_HANDLER_SPLITLINK_CLASS_BULK) {
+        rx_slot_arq_push(slot, packet);
+        return;
+    }
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+
     ykb_protocol_rx_result_t res;
 
     switch (slot->state) {
     case RX_SLOT_EMPTY:
         rx_init(slot);
         slot->state = RX_SLOT_RECEIVING;
-        res = ykb_protocol_rx_push_packet(&slot->rx, &packet);
+        res = ykb_protocol_rx_push_packet(&slot->rx, packet);
         break;
     case RX_SLOT_RECEIVING:
-        res = ykb_protocol_rx_push_packet(&slot->rx, &packet);
+        res = ykb_protocol_rx_push_packet(&slot->rx, packet);
         break;
     default:
         LOG_ERR("Slot %d is in progress, skipping packet", id);
+        atomic_inc(&rx_stats[slot->cls].dropped);
         return;
     }
 
     if (res < 0) {
         LOG_ERR("packet transfer: %d", res);
+        atomic_inc(&rx_stats[slot->cls].dropped);
         ykb_protocol_rx_reset(&slot->rx);
         slot->state = RX_SLOT_EMPTY;
         return;
@@ -223,70 +1124,325 @@ static void on_receive_cb(const struct device *dev, uint8_t *data,
 
     if (res == YKB_PROTOCOL_RX_RESULT_COMPLETE) {
         slot->state = RX_SLOT_READY;
-        k_work_submit(&slot->work);
+        rx_slot_submit(slot);
+    }
+}
+
+// Takes a slot for its producer to fill. Nothing queues behind a busy slot,
+// its producer sends its newest data once the slot is free instead.
+static int tx_slot_claim(struct tx_slot *slot) {
+    bool con = ATOMIC_LOAD(&connected);
+    if (!con) {
+        return -ENOTCONN;
+    }
+
+    int expected = TX_SLOT_EMPTY;
+    if (!atomic_compare_exchange_strong(&slot->state, &expected,
+                                        TX_SLOT_FILLING)) {
+        LOG_DBG("Slot %d already in progress, skipping", slot->id);
+        atomic_inc(&tx_stats[slot->cls].rejected);
+        return -EBUSY;
+    }
+
+    return 0;
+}
+
+static void tx_slot_release(struct tx_slot *slot) {
+    atomic_store(&slot->state, TX_SLOT_EMPTY);
+}
+
+// Hands a filled slot to the TX scheduler
+static void tx_slot_queue(struct tx_slot *slot, uint16_t len) {
+    struct tx_class_stats *stats = &tx_stats[slot->cls];
+
+    // SEQ tells the receiver a new transfer started, even when it has the
+    // same length as an unfinished one
+    uint8_t flags = YKB_PROTOCOL_TYPE_DATA | YKB_PROTOCOL_SEQ(++slot->seq);
+
+#if CONFIG_KB_HANDLER_SL_ARQ
+    if (slot->cls == KB_HANDLER_SPLITLINK_CLASS_BULK) {
+        ykb_protocol_arq_tx_init(&slot->arq, slot->data, len, slot->id, flags,
+                                 slot->acked, slot->acked_size,
+                                 CONFIG_KB_HANDLER_SL_ARQ_WINDOW,
+                                 CONFIG_KB_HANDLER_SL_ARQ_RETRIES, &slot->rtt);
+    } else {
+        ykb_protocol_tx_init(&slot->tx, slot->data, len, slot->id, flags);
+    }
+#else
+    ykb_protocol_tx_init(&slot->tx, slot->data, len, slot->id, flags);
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+    slot->queued_at = k_cycle_get_32();
+
+    atomic_val_t depth = atomic_inc(&stats->depth) + 1;
+    if (depth > atomic_get(&stats->max_depth)) {
+        atomic_set(&stats->max_depth, depth);
+    }
+
+    atomic_store(&slot->state, TX_SLOT_TRANSCEIVING);
+
+    if (slot->cls == KB_HANDLER_SPLITLINK_CLASS_RT) {
+        // Also cuts a pending bulk pause short, the pause is enforced by
+        // bulk_next_at anyway
+        k_work_reschedule(&tx_work, K_NO_WAIT);
+    } else {
+        k_work_schedule(&tx_work, K_NO_WAIT);
     }
 }
 
+static int tx_slot_submit(struct tx_slot *slot, const uint8_t *data,
+                          uint16_t len) {
+    // Real-time transfers leave room for the send time in front
+    uint16_t offset = slot->cls == KB_HANDLER_SPLITLINK_CLASS_RT
+                          ? SPLITLINK_HANDLER_TIME_SIZE
+                          : 0U;
+
+    if (offset + len > slot->max_data_length) {
+        LOG_ERR("TX slot %d overflow (got %d, max %d)", slot->id, len,
+                slot->max_data_length - offset);
+        return -ENOMEM;
+    }
+
+    int err = tx_slot_claim(slot);
+    if (err) {
+        return err;
+    }
+
+    memcpy(&slot->data[offset], data, len);
+    tx_slot_queue(slot, offset + len);
+
+    return 0;
+}
+
 #if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
-void splitlink_handler_send_values(uint16_t *values, uint16_t count) {
-    if (!values || count == 0) {
-        LOG_ERR("splitlink_handler_send_values: values null or count 0");
+int splitlink_handler_values_claim(uint8_t **buf, uint16_t *size) {
+    struct tx_slot *slot = &values_tx_slot;
+
+    if (!buf || !size) {
+        return -EINVAL;
+    }
+
+    int err = tx_slot_claim(slot);
+    if (err) {
+        return err;
+    }
+
+    // Room for the send time in front, as in tx_slot_submit()
+    *buf = &slot->data[SPLITLINK_HANDLER_TIME_SIZE];
+    *size = slot->max_data_length - SPLITLINK_HANDLER_TIME_SIZE;
+
+    return 0;
+}
+
+void splitlink_handler_values_queue(uint16_t len) {
+    tx_slot_queue(&values_tx_slot, SPLITLINK_HANDLER_TIME_SIZE + len);
+}
+
+void splitlink_handler_values_release(void) {
+    tx_slot_release(&values_tx_slot);
+}
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+int splitlink_handler_send_events(const uint8_t *data, uint16_t len) {
+    if (!data || len == 0) {
+        LOG_ERR("splitlink_handler_send_events: data null or len 0");
+        return -EINVAL;
+    }
+
+    return tx_slot_submit(&events_tx_slot, data, len);
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+int splitlink_handler_request_keyframe(void) {
+    uint8_t request[KEYFRAME_REQUEST_SIZE] = {0};
+
+    return tx_slot_submit(&keyframe_tx_slot, request, sizeof(request));
+}
+
+// Called with settings_sync_mut held
+static void settings_sync(void) {
+    struct tx_slot *slot = &settings_tx_slot;
+
+    if (!settings_image_valid || slave_manifest_len == 0) {
         return;
     }
-    bool con = ATOMIC_LOAD(&connected);
-    if (!con) {
+
+    // A patch still on its way is answered by a manifest, which brings the
+    // next sync round
+    if (tx_slot_claim(slot)) {
         return;
     }
-    struct tx_slot *slot = &values_tx_slot;
-    if (slot->state == TX_SLOT_TRANSCEIVING) {
-        LOG_ERR("Slot %d already in progreess, skipping", slot->id);
+
+    int len = ykb_chunk_sync_patch_build(
+        (const uint8_t *)&settings_image, sizeof(settings_image),
+        SETTINGS_CHUNK_SIZE, slave_manifest, slave_manifest_len, slot->data,
+        slot->max_data_length);
+    if (len <= 0) {
+        if (len < 0) {
+            LOG_ERR("ykb_chunk_sync_patch_build: %d", len);
+        }
+        tx_slot_release(slot);
         return;
     }
-    uint16_t size_bytes = count * sizeof(uint16_t);
-    if (size_bytes > slot->max_data_length) {
-        LOG_ERR("TX slot %d overflow (got %d, max %d)", slot->id, size_bytes,
-                slot->max_data_length);
+
+    LOG_DBG("Settings patch of %d bytes", len);
+    tx_slot_queue(slot, len);
+}
+
+static void settings_manifest_received(const uint8_t *data, uint16_t len) {
+    if (len > sizeof(slave_manifest)) {
+        LOG_ERR("Settings manifest too long (%u)", len);
         return;
     }
 
-    slot->tx.total_len = size_bytes;
-    memcpy(slot->data, values, size_bytes);
-    slot->state = TX_SLOT_TRANSCEIVING;
-    k_work_submit(&slot->work);
+    k_mutex_lock(&settings_sync_mut, K_FOREVER);
+    memcpy(slave_manifest, data, len);
+    slave_manifest_len = len;
+    settings_sync();
+    k_mutex_unlock(&settings_sync_mut);
 }
-#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 
-#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
 void splitlink_handler_send_settings(const kb_settings_t *settings) {
     if (!settings) {
         LOG_ERR("splitlink_handler_send_settings: settings null");
         return;
     }
-    bool con = ATOMIC_LOAD(&connected);
-    if (!con) {
-        return;
+
+    k_mutex_lock(&settings_sync_mut, K_FOREVER);
+    memcpy(&settings_image, settings, sizeof(settings_image));
+    settings_image_valid = true;
+    settings_sync();
+    k_mutex_unlock(&settings_sync_mut);
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+// Sends the summary, which is all a master with matching settings needs, or
+// the full manifest once a patch was not enough
+static int send_settings_manifest(void) {
+    struct tx_slot *slot = &manifest_tx_slot;
+
+    int err = tx_slot_claim(slot);
+    if (err) {
+        return err;
     }
-    struct tx_slot *slot = &settings_tx_slot;
-    if (slot->state == TX_SLOT_TRANSCEIVING) {
-        LOG_ERR("Slot %d already in progress, skipping", slot->id);
-        return;
+
+    int len;
+    if (atomic_get(&settings_manifest_full)) {
+        len = ykb_chunk_sync_manifest_build(
+            (const uint8_t *)&settings_mirror, sizeof(settings_mirror),
+            SETTINGS_CHUNK_SIZE, slot->data, slot->max_data_length);
+    } else {
+        len = ykb_chunk_sync_summary_build(
+            (const uint8_t *)&settings_mirror, sizeof(settings_mirror),
+            SETTINGS_CHUNK_SIZE, slot->data, slot->max_data_length);
+    }
+    if (len < 0) {
+        LOG_ERR("Settings manifest: %d", len);
+        tx_slot_release(slot);
+        return -EINVAL;
     }
 
-    slot->tx.total_len = slot->max_data_length;
-    memcpy(slot->data, settings, sizeof(kb_settings_t));
-    slot->state = TX_SLOT_TRANSCEIVING;
-    k_work_submit(&slot->work);
+    tx_slot_queue(slot, len);
+
+    return 0;
 }
-#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+
+// kb_settings_get blocks until the stored settings are loaded, so this runs
+// on settings_work_q like the patch handling and never races with it
+static void settings_manifest_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+
+    if (!settings_mirror_loaded) {
+        int err = kb_settings_get(&settings_mirror);
+        if (err) {
+            LOG_WRN("kb_settings_get: %d, expecting full settings", err);
+        }
+        settings_mirror_loaded = true;
+    }
+
+    // The master only patches after a manifest, so a skipped one would stall
+    // the sync
+    if (send_settings_manifest() == -EBUSY) {
+        k_work_reschedule_for_queue(
+            &settings_work_q, &settings_manifest_work,
+            K_MSEC(MAX(CONFIG_KB_HANDLER_SL_BULK_INTERVAL_MS, 1)));
+    }
+}
+
+static void settings_patch_received(const uint8_t *data, uint16_t len) {
+    int err = ykb_chunk_sync_patch_apply((uint8_t *)&settings_mirror,
+                                         sizeof(settings_mirror), data, len);
+    if (err == YKB_CHUNK_SYNC_ERROR_HASH_MISMATCH) {
+        // Also the answer to a summary, the manifest below tells the master
+        // what is still missing
+        LOG_DBG("Settings patch incomplete");
+    } else if (err) {
+        LOG_WRN("ykb_chunk_sync_patch_apply: %d", err);
+    } else {
+        splitlink_handler_settings_received(&settings_mirror);
+    }
+    atomic_set(&settings_manifest_full, err != 0);
+
+    k_work_reschedule_for_queue(&settings_work_q, &settings_manifest_work,
+                                K_NO_WAIT);
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 
 #if CONFIG_KB_HANDLER_SPLITLINK_MASTER
-__weak void splitlink_handler_values_received(uint16_t *values,
-                                              uint16_t count) {}
+__weak void splitlink_handler_values_received(
+    const uint8_t *data, uint16_t len,
+    const struct splitlink_handler_rx_time *time) {}
+__weak void splitlink_handler_events_received(
+    const uint8_t *data, uint16_t len,
+    const struct splitlink_handler_rx_time *time) {}
 #endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
 #if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 __weak void splitlink_handler_settings_received(const kb_settings_t *settings) {}
 #endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 __weak void splitlink_handler_on_connect() {}
+
+void kb_handler_get_splitlink_stats(enum kb_handler_splitlink_class cls,
+                                    struct kb_handler_splitlink_stats *stats) {
+    if (!stats || cls >= KB_HANDLER_SPLITLINK_CLASS_COUNT) {
+        return;
+    }
+
+    struct tx_class_stats *s = &tx_stats[cls];
+    struct rx_class_stats *r = &rx_stats[cls];
+
+    stats->transfers = atomic_get(&s->transfers);
+    stats->packets = atomic_get(&s->packets);
+    stats->rejected = atomic_get(&s->rejected);
+    stats->failed = atomic_get(&s->failed);
+    stats->depth = atomic_get(&s->depth);
+    stats->max_depth = atomic_get(&s->max_depth);
+    stats->latency_max_us = atomic_get(&s->latency_max_us);
+    stats->latency_avg_us =
+        stats->transfers ? (uint32_t)atomic_get(&s->latency_total_us) /
+                               stats->transfers
+                         : 0;
+    stats->rx_transfers = atomic_get(&r->transfers);
+    stats->rx_dropped = atomic_get(&r->dropped);
+    stats->rx_evicted = atomic_get(&r->evicted);
+}
+
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC && CONFIG_KB_HANDLER_SPLITLINK_MASTER
+void kb_handler_get_splitlink_time_stats(
+    struct kb_handler_splitlink_time_stats *stats) {
+    if (!stats) {
+        return;
+    }
+
+    k_mutex_lock(&time_sync_mut, K_FOREVER);
+    stats->synced = time_sync.synced;
+    stats->drift_ppb = time_sync.drift_ppb;
+    stats->latency = time_sync.stats;
+    k_mutex_unlock(&time_sync_mut);
+}
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC &&
+       // CONFIG_KB_HANDLER_SPLITLINK_MASTER
 __weak void splitlink_handler_on_disconnect() {}
 
 int splitlink_handler_init() {
@@ -299,21 +1455,48 @@ int splitlink_handler_init() {
     }
 
 #if CONFIG_KB_HANDLER_SPLITLINK_MASTER
-    k_work_init(&values_rx_slot.work, rx_slot_work_handler);
-    k_work_init(&settings_tx_slot.work, tx_slot_work_handler);
+    k_work_init(&manifest_rx_slot.work, rx_slot_work_handler);
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+    ykb_time_sync_init(
+        &time_sync,
+        &(ykb_time_sync_config_t){
+            .window_us = CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC_WINDOW_MS *
+                         USEC_PER_MSEC,
+            .stale_us = CONFIG_KB_HANDLER_SPLITLINK_STALE_US,
+        });
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
 #endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
 
 #if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
     k_work_init(&settings_rx_slot.work, rx_slot_work_handler);
-    k_work_init(&values_tx_slot.work, tx_slot_work_handler);
+    k_work_init(&keyframe_rx_slot.work, rx_slot_work_handler);
+    k_work_queue_start(&settings_work_q, settings_work_q_stack,
+                       K_THREAD_STACK_SIZEOF(settings_work_q_stack),
+                       CONFIG_KB_HANDLER_SL_SETTINGS_PRIORITY,
+                       &(struct k_work_queue_config){.name = "sl_settings"});
 #endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
 
+#if CONFIG_KB_HANDLER_SL_ARQ
+    for (size_t i = 0; i < ARRAY_SIZE(tx_slots); ++i) {
+        ykb_protocol_arq_rtt_init(&tx_slots[i]->rtt,
+                                  CONFIG_KB_HANDLER_SL_ARQ_RTO_INIT_MS,
+                                  CONFIG_KB_HANDLER_SL_ARQ_RTO_MIN_MS,
+                                  CONFIG_KB_HANDLER_SL_ARQ_RTO_MAX_MS);
+    }
+#endif // CONFIG_KB_HANDLER_SL_ARQ
+
     return 0;
 }
 
 static void on_connect(const struct device *dev) {
     if (dev->data == splitlink_dev->data) {
         ATOMIC_STORE(&connected, true);
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE
+        // A reconnect with matching settings costs a single summary
+        atomic_clear(&settings_manifest_full);
+        k_work_reschedule_for_queue(&settings_work_q, &settings_manifest_work,
+                                    K_NO_WAIT);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE
         splitlink_handler_on_connect();
     }
 }
@@ -321,12 +1504,35 @@ static void on_connect(const struct device *dev) {
 static void on_disconnect(const struct device *dev) {
     if (dev->data == splitlink_dev->data) {
         ATOMIC_STORE(&connected, false);
+#if CONFIG_KB_HANDLER_SPLITLINK_MASTER
+        k_mutex_lock(&settings_sync_mut, K_FOREVER);
+        slave_manifest_len = 0;
+        k_mutex_unlock(&settings_sync_mut);
+#if CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+        // The slave may come back with a new clock
+        k_mutex_lock(&time_sync_mut, K_FOREVER);
+        ykb_time_sync_reset(&time_sync);
+        k_mutex_unlock(&time_sync_mut);
+#endif // CONFIG_KB_HANDLER_SPLITLINK_TIME_SYNC
+#endif // CONFIG_KB_HANDLER_SPLITLINK_MASTER
+#if CONFIG_KB_HANDLER_SL_ARQ
+        // Drops bulk transfers waiting for ACKs which will not come
+        k_work_reschedule(&tx_work, K_NO_WAIT);
+#endif // CONFIG_KB_HANDLER_SL_ARQ
         splitlink_handler_on_disconnect();
     }
 }
 
 SPLITLINK_CB_DEFINE(kb_handler_splitlink_ykb_protocol) = {
     .on_receive_cb = on_receive_cb,
+#if CONFIG_SPLITLINK_MSG && CONFIG_KB_HANDLER_SPLITLINK_MASTER
+    .on_msg_cb = on_msg_cb,
+#if CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+    .msg_ids = BIT(VALUES_SLOT_ID) | BIT(EVENTS_SLOT_ID),
+#else
+    .msg_ids = BIT(VALUES_SLOT_ID),
+#endif // CONFIG_KB_HANDLER_SPLITLINK_SLAVE_ACTUATION
+#endif // CONFIG_SPLITLINK_MSG && CONFIG_KB_HANDLER_SPLITLINK_MASTER
     .connect_cb = on_connect,
     .disconnect_cb = on_disconnect,
 };
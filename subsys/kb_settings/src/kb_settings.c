@@ -22,18 +22,69 @@
 LOG_MODULE_REGISTER(kb_settings, CONFIG_KB_SETTINGS_LOG_LEVEL);
 
 // Increment every time kb_settings_image_t or it's contents change
-#define KB_SETTINGS_IMAGE_VERSION 2
+#define KB_SETTINGS_IMAGE_VERSION 5
+// Last released version, see kb_settings_v2_t
+#define KB_SETTINGS_IMAGE_VERSION_V2 2
+
+// Full scale of raw values and of calibrated travel
+#define KB_SETTINGS_FULL_SCALE 1023U
+
+// Scale of thresholds, maximums and rapid trigger distances
+typedef enum {
+    KB_SETTINGS_UNITS_RAW,
+    // Calibrated travel, see CONFIG_KB_HANDLER_CALIBRATION
+    KB_SETTINGS_UNITS_TRAVEL,
+} kb_settings_units_t;
+
+#define KB_SETTINGS_UNITS                                                      \
+    (IS_ENABLED(CONFIG_KB_HANDLER_CALIBRATION) ? KB_SETTINGS_UNITS_TRAVEL      \
+                                               : KB_SETTINGS_UNITS_RAW)
 
 typedef struct {
     uint16_t version;
+    uint16_t units;
     kb_settings_t settings;
 } kb_settings_image_t;
 
+// Settings of image version 2: no rapid trigger and no report mode, key
+// values are raw
+typedef struct {
+    kb_mode_t mode;
+
+    uint16_t thresholds[TOTAL_KEY_COUNT];
+    uint16_t maximums[TOTAL_KEY_COUNT];
+
+    uint8_t mappings_layer1[TOTAL_KEY_COUNT];
+    uint8_t mappings_layer2[TOTAL_KEY_COUNT];
+    uint8_t mappings_layer3[TOTAL_KEY_COUNT];
+
+    kb_mouseemu_settings_t mouseemu;
+
+    kb_battsense_settings_t battsense;
+
+    enum kb_handler_transport_priority kbh_prio;
+
+#if CONFIG_YKB_BACKLIGHT
+    ykb_backlight_settings_t backlight;
+#endif // CONFIG_YKB_BACKLIGHT
+} kb_settings_v2_t;
+
+typedef struct {
+    uint16_t version;
+    kb_settings_v2_t settings;
+} kb_settings_image_v2_t;
+
 static kb_settings_t kb_settings;
 static bool settings_registered = false;
 static bool successfully_loaded = false;
+// Loaded image was converted and should be stored in the current format
+static bool loaded_converted = false;
 static kb_settings_t notify_snapshot;
-static kb_settings_image_t load_img;
+static union {
+    uint16_t version;
+    kb_settings_image_t img;
+    kb_settings_image_v2_t v2;
+} load_img;
 static kb_settings_image_t save_img;
 
 static K_MUTEX_DEFINE(kb_settings_mut);
@@ -53,6 +104,7 @@ static int kb_settings_load_defaults(void) {
     k_mutex_lock(&kb_settings_mut, K_FOREVER);
 
     kb_settings.mode = KB_MODE_NORMAL;
+    kb_settings.report_mode = KB_REPORT_MODE_6KRO;
 
     err = kb_handler_get_default_keymap_layer1(kb_settings.mappings_layer1);
     if (err) {
@@ -72,6 +124,11 @@ static int kb_settings_load_defaults(void) {
         goto cleanup;
     }
 
+    err = kb_handler_get_default_rapid_trigger(&kb_settings.rapid_trigger);
+    if (err) {
+        goto cleanup;
+    }
+
     uint16_t thresholds[TOTAL_KEY_COUNT];
     err = kb_handler_get_default_thresholds(thresholds);
     if (err) {
@@ -79,7 +136,7 @@ static int kb_settings_load_defaults(void) {
     }
     for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
         kb_settings.thresholds[i] = thresholds[i];
-        kb_settings.maximums[i] = 1023;
+        kb_settings.maximums[i] = KB_SETTINGS_FULL_SCALE;
     }
 
 #if CONFIG_YKB_BACKLIGHT
@@ -96,32 +153,106 @@ cleanup:
     return err;
 }
 
+// Race and mouse emulation read raw values as a fraction of the key maximum,
+// with rest at 0. Rescaling key values by the maximum keeps that fraction as
+// travel, which is the best guess before the key was ever calibrated. Raw
+// and travel share the full scale, so this converts either way.
+static void kb_settings_convert_units(kb_settings_t *settings,
+                                      uint16_t units) {
+    if (units == KB_SETTINGS_UNITS) {
+        return;
+    }
+
+    LOG_INF("Converting keyboard settings from %s units",
+            units == KB_SETTINGS_UNITS_RAW ? "raw" : "travel");
+
+    kb_rapid_trigger_settings_t *rt = &settings->rapid_trigger;
+    uint16_t *distances[] = {settings->thresholds, rt->press_sensitivity,
+                             rt->release_sensitivity, rt->top_deadzone,
+                             rt->bottom_deadzone};
+
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        uint32_t maximum = settings->maximums[i];
+
+        if (maximum == 0U || maximum == KB_SETTINGS_FULL_SCALE) {
+            settings->maximums[i] = KB_SETTINGS_FULL_SCALE;
+            continue;
+        }
+        for (size_t j = 0; j < ARRAY_SIZE(distances); ++j) {
+            distances[j][i] = MIN(distances[j][i] * KB_SETTINGS_FULL_SCALE /
+                                      maximum,
+                                  KB_SETTINGS_FULL_SCALE);
+        }
+        settings->maximums[i] = KB_SETTINGS_FULL_SCALE;
+    }
+}
+
+// Settings added since version 2 start at their defaults
+static int kb_settings_migrate_v2(kb_settings_t *settings,
+                                  const kb_settings_v2_t *old) {
+    settings->mode = old->mode;
+    memcpy(settings->thresholds, old->thresholds, sizeof(old->thresholds));
+    memcpy(settings->maximums, old->maximums, sizeof(old->maximums));
+    memcpy(settings->mappings_layer1, old->mappings_layer1,
+           sizeof(old->mappings_layer1));
+    memcpy(settings->mappings_layer2, old->mappings_layer2,
+           sizeof(old->mappings_layer2));
+    memcpy(settings->mappings_layer3, old->mappings_layer3,
+           sizeof(old->mappings_layer3));
+    settings->mouseemu = old->mouseemu;
+    settings->battsense = old->battsense;
+    settings->kbh_prio = old->kbh_prio;
+    settings->report_mode = KB_REPORT_MODE_6KRO;
+#if CONFIG_YKB_BACKLIGHT
+    settings->backlight = old->backlight;
+#endif // CONFIG_YKB_BACKLIGHT
+
+    return kb_handler_get_default_rapid_trigger(&settings->rapid_trigger);
+}
+
 int kb_settings_handler_set(const char *key, size_t len,
                             settings_read_cb read_cb, void *cb_arg) {
     if (strcmp(key, KB_SETTINGS_ITEM) != 0) {
         return -ENOENT;
     }
 
-    const size_t kb_settings_img_size = sizeof(kb_settings_image_t);
-    if (len != kb_settings_img_size) {
+    if (len != sizeof(kb_settings_image_t) &&
+        len != sizeof(kb_settings_image_v2_t)) {
         LOG_ERR("Keyboard settings image size mismatch: got %zu, want %zu", len,
-                kb_settings_img_size);
+                sizeof(kb_settings_image_t));
         return -EINVAL;
     }
 
-    ssize_t rlen = read_cb(cb_arg, &load_img, sizeof(load_img));
+    ssize_t rlen = read_cb(cb_arg, &load_img, len);
 
     if (rlen < 0) {
         LOG_ERR("Keyboard settings read_cb error: %d", (int)rlen);
         return -EINVAL;
     }
 
-    if ((size_t)rlen != sizeof(load_img)) {
+    if ((size_t)rlen != len) {
         LOG_ERR("Keyboard settings truncated: %zd", rlen);
         return -EINVAL;
     }
 
-    if (load_img.version != KB_SETTINGS_IMAGE_VERSION) {
+    uint16_t units;
+
+    if (load_img.version == KB_SETTINGS_IMAGE_VERSION &&
+        len == sizeof(load_img.img)) {
+        units = load_img.img.units;
+        if (units != KB_SETTINGS_UNITS_RAW &&
+            units != KB_SETTINGS_UNITS_TRAVEL) {
+            LOG_ERR("Keyboard settings in unknown units %u", units);
+            return -EINVAL;
+        }
+    } else if (load_img.version == KB_SETTINGS_IMAGE_VERSION_V2 &&
+               len == sizeof(load_img.v2)) {
+        units = KB_SETTINGS_UNITS_RAW;
+    } else if (load_img.version == KB_SETTINGS_IMAGE_VERSION) {
+        LOG_ERR("Keyboard settings image size mismatch: got %zu, want %zu",
+                len, sizeof(load_img.img));
+        return -EINVAL;
+    } else {
         LOG_ERR("Keyboad settings image version mismatch: got %u, want %u",
                 load_img.version, KB_SETTINGS_IMAGE_VERSION);
         return -EINVAL;
@@ -129,7 +260,22 @@ int kb_settings_handler_set(const char *key, size_t len,
 
     k_mutex_lock(&kb_settings_mut, K_FOREVER);
 
-    memcpy(&kb_settings, &load_img.settings, sizeof(kb_settings_t));
+    if (load_img.version == KB_SETTINGS_IMAGE_VERSION_V2) {
+        LOG_INF("Migrating keyboard settings from version %u",
+                load_img.version);
+        int err = kb_settings_migrate_v2(&kb_settings, &load_img.v2.settings);
+        if (err) {
+            k_mutex_unlock(&kb_settings_mut);
+            LOG_ERR("Unable to migrate keyboard settings: %d", err);
+            return err;
+        }
+    } else {
+        memcpy(&kb_settings, &load_img.img.settings, sizeof(kb_settings_t));
+    }
+    kb_settings_convert_units(&kb_settings, units);
+    loaded_converted = load_img.version != KB_SETTINGS_IMAGE_VERSION ||
+                       units != KB_SETTINGS_UNITS;
+
     memcpy(&notify_snapshot, &kb_settings, sizeof(kb_settings_t));
     successfully_loaded = true;
 
@@ -145,6 +291,7 @@ int kb_settings_handler_export(int (*export_func)(const char *name,
                                                   size_t val_len)) {
     save_img = (kb_settings_image_t){
         .version = KB_SETTINGS_IMAGE_VERSION,
+        .units = KB_SETTINGS_UNITS,
     };
     k_mutex_lock(&kb_settings_mut, K_FOREVER);
     memcpy(&save_img.settings, &kb_settings, sizeof(kb_settings_t));
@@ -166,6 +313,7 @@ static void kb_settings_save() {
     }
     save_img = (kb_settings_image_t){
         .version = KB_SETTINGS_IMAGE_VERSION,
+        .units = KB_SETTINGS_UNITS,
     };
     memcpy(&save_img.settings, &kb_settings, sizeof(kb_settings));
     int err = settings_save_one(KB_SETTINGS_KEY, &save_img, sizeof(save_img));
@@ -204,6 +352,10 @@ static int kb_settings_init(void) {
         goto load_defaults;
     }
 
+    if (loaded_converted) {
+        kb_settings_save();
+    }
+
     return 0;
 
 load_defaults:
@@ -13,6 +13,8 @@
 struct usb_connect_hid_dev {
     char *name;
     int (*init)(void);
+    // Optional, called on a USB bus reset
+    void (*reset)(void);
 };
 
 #define USB_CONNECT_REGISTER_HID_DEVICE(_name, _init_fn)                       \
@@ -21,4 +23,11 @@ struct usb_connect_hid_dev {
         .init = _init_fn,                                                      \
     }
 
+#define USB_CONNECT_REGISTER_HID_DEVICE_WITH_RESET(_name, _init_fn, _reset_fn) \
+    STRUCT_SECTION_ITERABLE(usb_connect_hid_dev, _name) = {                    \
+        .name = #_name,                                                        \
+        .init = _init_fn,                                                      \
+        .reset = _reset_fn,                                                    \
+    }
+
 #endif // HID_DEVICES_H__
@@ -6,12 +6,27 @@
 
 #include <zephyr/logging/log.h>
 
+#include <string.h>
+
 LOG_MODULE_DECLARE(usb_connect, CONFIG_USB_CONNECT_LOG_LEVEL);
 
+// With NKRO the boot compatible report and the NKRO report share the
+// interface, so both need report IDs. Boot protocol reports never carry one.
+#if CONFIG_USB_CONNECT_KBD_NKRO
+#define USB_CONNECT_KBD_REPORT_ID 1U
+#define USB_CONNECT_KBD_NKRO_REPORT_ID 2U
+#else
+#define USB_CONNECT_KBD_REPORT_ID 0U
+#define USB_CONNECT_KBD_NKRO_REPORT_ID 0U
+#endif // CONFIG_USB_CONNECT_KBD_NKRO
+
 static const uint8_t hid_kbd_report_desc[] = {
     HID_USAGE_PAGE(HID_USAGE_GEN_DESKTOP),
     HID_USAGE(HID_USAGE_GEN_DESKTOP_KEYBOARD),
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
+#if USB_CONNECT_KBD_REPORT_ID
+    HID_REPORT_ID(USB_CONNECT_KBD_REPORT_ID),
+#endif
 
     HID_USAGE_PAGE(HID_USAGE_GEN_KEYBOARD),
     HID_USAGE_MIN8(0xE0),
@@ -46,6 +61,24 @@ static const uint8_t hid_kbd_report_desc[] = {
     HID_USAGE_MAX8(101),
     HID_INPUT(0x00),
 
+#if USB_CONNECT_KBD_NKRO_REPORT_ID
+    HID_REPORT_ID(USB_CONNECT_KBD_NKRO_REPORT_ID),
+    HID_USAGE_PAGE(HID_USAGE_GEN_KEYBOARD),
+    HID_USAGE_MIN8(0xE0),
+    HID_USAGE_MAX8(0xE7),
+    HID_LOGICAL_MIN8(0),
+    HID_LOGICAL_MAX8(1),
+    HID_REPORT_SIZE(1),
+    HID_REPORT_COUNT(8),
+    HID_INPUT(0x02),
+
+    HID_USAGE_MIN8(0),
+    HID_USAGE_MAX8(HID_KB_NKRO_USAGE_MAX),
+    HID_REPORT_SIZE(1),
+    HID_REPORT_COUNT(HID_KB_NKRO_BITMAP_SIZE * 8U),
+    HID_INPUT(0x02),
+#endif // USB_CONNECT_KBD_NKRO_REPORT_ID
+
     HID_END_COLLECTION,
 };
 
@@ -133,6 +166,25 @@ static int usb_connect_init_kbd_hid(void) {
     return 0;
 }
 
+// Prepends the report ID while in report protocol, the submit call blocks
+// until the transfer is done so the stack buffer outlives it
+static int submit_report(const uint8_t id, const void *const report,
+                         const size_t len) {
+#if CONFIG_USB_CONNECT_KBD_NKRO
+    uint8_t buf[1 + sizeof(hid_kb_nkro_report_t)];
+
+    if (!ATOMIC_LOAD(&boot_mode)) {
+        buf[0] = id;
+        memcpy(&buf[1], report, len);
+        return hid_device_submit_report(hid_kbd_dev, len + 1, buf);
+    }
+#else
+    ARG_UNUSED(id);
+#endif // CONFIG_USB_CONNECT_KBD_NKRO
+
+    return hid_device_submit_report(hid_kbd_dev, len, report);
+}
+
 bool usb_connect_can_send_kb_report(void) { return ATOMIC_LOAD(&__ready); }
 
 void usb_connect_send_kb_report(const hid_kb_report_t *const report) {
@@ -142,12 +194,32 @@ void usb_connect_send_kb_report(const hid_kb_report_t *const report) {
         LOG_ERR("send_kb_report: not ready");
         return;
     }
-    int err = hid_device_submit_report(hid_kbd_dev, sizeof(hid_kb_report_t),
-                                       (const uint8_t *)report);
+    int err = submit_report(USB_CONNECT_KBD_REPORT_ID, report,
+                            sizeof(hid_kb_report_t));
     if (err) {
         LOG_ERR("send_kb_report: %d", err);
     }
     LOG_INF("send_kb_report: sent");
 }
 
+void usb_connect_send_kb_nkro_report(const hid_kb_nkro_report_t *const nkro,
+                                     const hid_kb_report_t *const boot) {
+    if (!IS_ENABLED(CONFIG_USB_CONNECT_KBD_NKRO) || ATOMIC_LOAD(&boot_mode)) {
+        usb_connect_send_kb_report(boot);
+        return;
+    }
+
+    bool ready = usb_connect_can_send_kb_report();
+    usb_connect_handle_wakeup();
+    if (!ready) {
+        LOG_ERR("send_kb_nkro_report: not ready");
+        return;
+    }
+    int err = submit_report(USB_CONNECT_KBD_NKRO_REPORT_ID, nkro,
+                            sizeof(hid_kb_nkro_report_t));
+    if (err) {
+        LOG_ERR("send_kb_nkro_report: %d", err);
+    }
+}
+
 USB_CONNECT_REGISTER_HID_DEVICE(usb_kbd, usb_connect_init_kbd_hid);
@@ -69,6 +69,10 @@ static void iface_ready(const struct device *dev, const bool ready) {
     LOG_INF("HID device %s interface is %s", dev->name,
             ready ? "ready" : "not ready");
     ATOMIC_STORE(&__ready, ready);
+
+    if (!ready) {
+        vendor_hid_protocol_reset(&vendor_protocol_ctx);
+    }
 }
 
 static int get_report(const struct device *dev, const uint8_t type,
@@ -79,12 +83,23 @@ static int get_report(const struct device *dev, const uint8_t type,
         return -ENOTSUP;
     }
 
+    if (type == HID_REPORT_TYPE_FEATURE) {
+        memset(buf, 0, len);
+        buf[0] = vendor_hid_protocol_get_framing(&vendor_protocol_ctx);
+        return len;
+    }
+
     return 0;
 }
 
 static int set_report(const struct device *dev, const uint8_t type,
                       const uint8_t id, const uint16_t len,
                       const uint8_t *const buf) {
+    if (type == HID_REPORT_TYPE_FEATURE && len >= 1) {
+        // Byte 0 selects the framing, see enum vendor_hid_framing
+        return vendor_hid_protocol_set_framing(&vendor_protocol_ctx, buf[0]);
+    }
+
     if (type != HID_REPORT_TYPE_OUTPUT) {
         LOG_WRN("Unsupported report type");
         return -ENOTSUP;
@@ -140,7 +155,7 @@ static int usb_connect_init_vendor_hid(void) {
     }
 
     err = vendor_hid_protocol_init(&vendor_protocol_ctx, usb_vendor_send_packet,
-                                   NULL);
+                                   NULL, true);
     if (err) {
         LOG_ERR("vendor_hid_protocol_init: %d", err);
         return err;
@@ -156,4 +171,11 @@ static int usb_connect_init_vendor_hid(void) {
     return 0;
 }
 
-USB_CONNECT_REGISTER_HID_DEVICE(usb_vendor, usb_connect_init_vendor_hid);
+// The host after a bus reset may be another one
+static void usb_connect_reset_vendor_hid(void) {
+    vendor_hid_protocol_reset(&vendor_protocol_ctx);
+}
+
+USB_CONNECT_REGISTER_HID_DEVICE_WITH_RESET(usb_vendor,
+                                           usb_connect_init_vendor_hid,
+                                           usb_connect_reset_vendor_hid);
@@ -18,6 +18,14 @@ static void msg_cb(struct usbd_context *const usbd_ctx,
         LOG_INF("Configuration value %d", msg->status);
     }
 
+    if (msg->type == USBD_MSG_RESET) {
+        STRUCT_SECTION_FOREACH(usb_connect_hid_dev, hid_dev) {
+            if (hid_dev->reset) {
+                hid_dev->reset();
+            }
+        }
+    }
+
     if (msg->type == USBD_MSG_RESUME) {
         STRUCT_SECTION_FOREACH(usb_connect_cb, callback) {
             if (callback->on_connect)
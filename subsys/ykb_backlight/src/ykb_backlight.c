@@ -140,29 +140,23 @@ static void ykb_backlight_thread_handler(void *a, void *b, void *c) {
     }
 }
 
-static void kscan_on_event(uint16_t index, bool value) {
-    if (!layout || index >= layout->key_count) {
+static void kscan_on_frame(const struct kscan_frame *frame) {
+    if (!layout || frame->idx_offset >= layout->key_count) {
         return;
     }
 
-    k_mutex_lock(&ykb_bl_mut, K_FOREVER);
-    pressed[index] = value;
-    k_mutex_unlock(&ykb_bl_mut);
-}
-
-static void kscan_on_value_changed(uint16_t index, uint16_t value) {
-    if (!layout || index >= layout->key_count) {
-        return;
-    }
+    uint16_t count = MIN(frame->count, layout->key_count - frame->idx_offset);
 
     k_mutex_lock(&ykb_bl_mut, K_FOREVER);
-    press[index] = value;
+    for (uint16_t i = 0; i < count; ++i) {
+        press[frame->idx_offset + i] = frame->values[i];
+        pressed[frame->idx_offset + i] = kscan_frame_key_pressed(frame, i);
+    }
     k_mutex_unlock(&ykb_bl_mut);
 }
 
 KSCAN_CB_DEFINE(ykb_backlight) = {
-    .on_event = kscan_on_event,
-    .on_new_value = kscan_on_value_changed,
+    .on_frame = kscan_on_frame,
 };
 
 static bool init_success = false;
@@ -0,0 +1,201 @@
+#include <drivers/kscan.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/adc/adc_emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+// The ADC emulator stands in for the hall sensors. Its value callback reads
+// the select lines the mux driver set on the GPIO emulator, so every
+// conversion returns the voltage of the key the muxes point at right then.
+// A sample taken before the muxes switched, or stored for the wrong key,
+// shows up as a value of another key.
+
+#define KSCAN_NODE DT_NODELABEL(kscan0)
+#define ADC_NODE DT_NODELABEL(adc0)
+
+#define MUX_COUNT DT_PROP_LEN(KSCAN_NODE, muxes)
+#define MUX_CHANNELS 4
+#define MUX_SEL_COUNT 2
+#define KEY_COUNT (MUX_COUNT * MUX_CHANNELS)
+
+#define ADC_REF_MV DT_PROP(ADC_NODE, ref_internal_mv)
+#define ADC_RESOLUTION 10
+// adc_emul and the expected value round differently
+#define ADC_TOLERANCE 2
+
+// Frames waited for after every input change: the one in progress may have
+// sampled part of the keys before the change
+#define SETTLE_FRAMES 3
+
+#define SEL_SPEC_AND_COMMA(node_id, prop, idx)                                 \
+    GPIO_DT_SPEC_GET_BY_IDX(node_id, prop, idx),
+
+#define MUX_SEL_AND_COMMA(node_id, prop, idx)                                  \
+    {DT_FOREACH_PROP_ELEM(DT_PHANDLE_BY_IDX(node_id, prop, idx), sel_gpios,    \
+                          SEL_SPEC_AND_COMMA)},
+
+#define MUX_ADC_CHANNEL_AND_COMMA(node_id, prop, idx)                          \
+    DT_IO_CHANNELS_INPUT_BY_IDX(node_id, idx),
+
+static const struct gpio_dt_spec mux_sel[MUX_COUNT][MUX_SEL_COUNT] = {
+    DT_FOREACH_PROP_ELEM(KSCAN_NODE, muxes, MUX_SEL_AND_COMMA)};
+static const uint8_t mux_adc_channel[MUX_COUNT] = {
+    DT_FOREACH_PROP_ELEM(KSCAN_NODE, io_channels, MUX_ADC_CHANNEL_AND_COMMA)};
+
+static const struct device *const kscan = DEVICE_DT_GET(KSCAN_NODE);
+static const struct device *const adc = DEVICE_DT_GET(ADC_NODE);
+
+// Added to every key voltage, lets a test move all inputs at once
+static atomic_t input_offset_mv;
+
+static atomic_t frames_wanted;
+static K_SEM_DEFINE(frame_sem, 0, 1);
+static uint16_t frame_values[KEY_COUNT];
+static uint32_t frame_pressed[KSCAN_BITMAP_WORDS(KEY_COUNT)];
+
+// Unique voltage of every key
+static uint32_t key_mv(uint16_t mux, uint16_t chan) {
+    return 200U + 400U * mux + 100U * chan + atomic_get(&input_offset_mv);
+}
+
+static uint16_t mv_to_raw(uint32_t mv) {
+    return (uint16_t)(((uint64_t)mv * BIT_MASK(ADC_RESOLUTION)) / ADC_REF_MV);
+}
+
+static int key_value(const struct device *dev, unsigned int chan, void *data,
+                     uint32_t *result) {
+    uint16_t mux = (uint16_t)(uintptr_t)data;
+    uint16_t selected = 0;
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(chan);
+
+    for (uint16_t i = 0; i < MUX_SEL_COUNT; ++i) {
+        int level = gpio_emul_output_get(mux_sel[mux][i].port,
+                                         mux_sel[mux][i].pin);
+        if (level < 0) {
+            return level;
+        }
+        selected |= (uint16_t)level << i;
+    }
+
+    *result = key_mv(mux, selected);
+    return 0;
+}
+
+static void on_frame(const struct kscan_frame *frame) {
+    if (frame->count != KEY_COUNT || atomic_get(&frames_wanted) <= 0) {
+        return;
+    }
+
+    if (atomic_dec(&frames_wanted) == 1) {
+        memcpy(frame_values, frame->values, sizeof(frame_values));
+        memcpy(frame_pressed, frame->pressed_bitmap, sizeof(frame_pressed));
+        k_sem_give(&frame_sem);
+    }
+}
+
+KSCAN_CB_DEFINE(kscan_muxes_test) = {
+    .on_frame = on_frame,
+};
+
+// Captures the last of count frames into frame_values and frame_pressed
+static void wait_frames(int count) {
+    k_sem_reset(&frame_sem);
+    atomic_set(&frames_wanted, count);
+    zassert_ok(k_sem_take(&frame_sem, K_SECONDS(5)), "no KScan frame");
+}
+
+static void assert_key_values(const uint16_t *values) {
+    for (uint16_t mux = 0; mux < MUX_COUNT; ++mux) {
+        for (uint16_t chan = 0; chan < MUX_CHANNELS; ++chan) {
+            uint16_t key = mux * MUX_CHANNELS + chan;
+
+            zassert_within(values[key], mv_to_raw(key_mv(mux, chan)),
+                           ADC_TOLERANCE, "key %u (mux %u, channel %u): %u",
+                           key, mux, chan, values[key]);
+        }
+    }
+}
+
+static void *kscan_muxes_setup(void) {
+    zassert_true(device_is_ready(kscan), "KScan not ready");
+    zassert_true(device_is_ready(adc), "ADC not ready");
+
+    for (uint16_t mux = 0; mux < MUX_COUNT; ++mux) {
+        zassert_ok(adc_emul_value_func_set(adc, mux_adc_channel[mux],
+                                           key_value,
+                                           (void *)(uintptr_t)mux));
+    }
+
+    return NULL;
+}
+
+static void kscan_muxes_before(void *fixture) {
+    uint16_t thresholds[KEY_COUNT];
+
+    ARG_UNUSED(fixture);
+
+    atomic_set(&input_offset_mv, 0);
+    for (uint16_t i = 0; i < KEY_COUNT; ++i) {
+        thresholds[i] = UINT16_MAX;
+    }
+    zassert_ok(kscan_set_thresholds(kscan, thresholds));
+    wait_frames(SETTLE_FRAMES);
+}
+
+ZTEST(kscan_muxes, test_key_amount) {
+    zassert_equal(kscan_get_key_amount(kscan), KEY_COUNT);
+    zassert_equal(kscan_get_idx_offset(kscan), 0);
+}
+
+ZTEST(kscan_muxes, test_frame_values_match_inputs) {
+    wait_frames(1);
+    assert_key_values(frame_values);
+}
+
+ZTEST(kscan_muxes, test_get_values_match_inputs) {
+    uint16_t values[KEY_COUNT];
+
+    zassert_ok(kscan_get_values(kscan, values));
+    assert_key_values(values);
+}
+
+ZTEST(kscan_muxes, test_values_follow_inputs) {
+    atomic_set(&input_offset_mv, 150);
+    wait_frames(SETTLE_FRAMES);
+    assert_key_values(frame_values);
+}
+
+ZTEST(kscan_muxes, test_pressed_follows_thresholds) {
+    // Halfway between two key voltages, so no key sits on it
+    const uint16_t threshold = mv_to_raw(650);
+    uint16_t thresholds[KEY_COUNT];
+
+    for (uint16_t i = 0; i < KEY_COUNT; ++i) {
+        thresholds[i] = threshold;
+    }
+    zassert_ok(kscan_set_thresholds(kscan, thresholds));
+    wait_frames(SETTLE_FRAMES);
+
+    for (uint16_t mux = 0; mux < MUX_COUNT; ++mux) {
+        for (uint16_t chan = 0; chan < MUX_CHANNELS; ++chan) {
+            uint16_t key = mux * MUX_CHANNELS + chan;
+            bool pressed = (frame_pressed[key / 32] & BIT(key % 32)) != 0;
+
+            zassert_equal(pressed, key_mv(mux, chan) > 650,
+                          "key %u pressed %d", key, pressed);
+        }
+    }
+}
+
+ZTEST_SUITE(kscan_muxes, NULL, kscan_muxes_setup, kscan_muxes_before, NULL,
+            NULL);
@@ -0,0 +1,214 @@
+#include "host_test.h"
+
+#include <lib/ykb_protocol.h>
+
+#include <string.h>
+
+// TRANSFERS settings sized bulk transfers in a row, sharing one RTO
+// estimator like a splitlink slot, over a link carrying BURST packets per ms
+// each way with DELAY_MS latency and independent losses in both directions.
+// Reordered packets are held REORDER_MS longer, so the next ones overtake.
+#define TRANSFER_SIZE 4096u
+#define TRANSFERS 16u
+#define BURST 2u
+#define DELAY_MS 2u
+#define REORDER_MS 3u
+#define LIMIT_MS 60000u
+
+// Defaults of the splitlink bulk ARQ
+#define RTO_INIT_MS 50u
+#define RTO_MIN_MS 4u
+#define RTO_MAX_MS 500u
+#define RETRIES 10u
+
+#define IN_FLIGHT_MAX (BURST * (DELAY_MS + REORDER_MS + 1u))
+
+struct channel {
+    ykb_protocol_packet_t packets[IN_FLIGHT_MAX];
+    uint32_t arrives_at[IN_FLIGHT_MAX];
+    uint32_t count;
+    uint32_t loss_permille;
+    uint32_t reorder_permille;
+    uint32_t rng;
+};
+
+struct result {
+    uint32_t elapsed_ms;
+    uint32_t packets_sent;
+    uint32_t retransmissions;
+    bool complete;
+};
+
+static uint8_t tx_data[TRANSFER_SIZE];
+static uint8_t rx_data[TRANSFER_SIZE];
+static uint8_t acked[YKB_PROTOCOL_BITMAP_SIZE(TRANSFER_SIZE)];
+static uint8_t received[YKB_PROTOCOL_BITMAP_SIZE(TRANSFER_SIZE)];
+
+static void channel_send(struct channel *ch, const ykb_protocol_packet_t *p,
+                         uint32_t now_ms) {
+    if (host_test_rand(&ch->rng) % 1000u < ch->loss_permille) {
+        return;
+    }
+    CHECK(ch->count < IN_FLIGHT_MAX);
+    ch->packets[ch->count] = *p;
+    ch->arrives_at[ch->count] = now_ms + DELAY_MS;
+    if (host_test_rand(&ch->rng) % 1000u < ch->reorder_permille) {
+        ch->arrives_at[ch->count] += REORDER_MS;
+    }
+    ch->count++;
+}
+
+// Takes the packet which arrives first, in sending order among those
+// arriving together
+static bool channel_receive(struct channel *ch, ykb_protocol_packet_t *p,
+                            uint32_t now_ms) {
+    uint32_t first = 0u;
+
+    for (uint32_t i = 1u; i < ch->count; ++i) {
+        if (ch->arrives_at[i] < ch->arrives_at[first]) {
+            first = i;
+        }
+    }
+    if (ch->count == 0u || ch->arrives_at[first] > now_ms) {
+        return false;
+    }
+    *p = ch->packets[first];
+    ch->count--;
+    memmove(&ch->packets[first], &ch->packets[first + 1u],
+            (ch->count - first) * sizeof(ch->packets[0]));
+    memmove(&ch->arrives_at[first], &ch->arrives_at[first + 1u],
+            (ch->count - first) * sizeof(ch->arrives_at[0]));
+    return true;
+}
+
+static bool run_transfer(struct channel *to_rx, struct channel *to_tx,
+                         ykb_protocol_arq_rtt_t *rtt, uint16_t window,
+                         uint8_t id, uint32_t *now, struct result *result) {
+    ykb_protocol_arq_tx_t arq;
+    ykb_protocol_rx_state_t rx;
+    ykb_protocol_packet_t packet;
+    uint32_t end = *now + LIMIT_MS;
+
+    CHECK(ykb_protocol_arq_tx_init(&arq, tx_data, TRANSFER_SIZE, id,
+                                   YKB_PROTOCOL_SEQ(1), acked, sizeof(acked),
+                                   window, RETRIES, rtt));
+    ykb_protocol_rx_init(&rx, rx_data, sizeof(rx_data), true, received,
+                         sizeof(received));
+    memset(rx_data, 0, sizeof(rx_data));
+    // Leftovers of the previous transfer are of no use to this one
+    to_rx->count = 0u;
+    to_tx->count = 0u;
+
+    for (; *now < end && !ykb_protocol_arq_tx_is_done(&arq); ++*now) {
+        // Receiver acknowledges polls and the completion, like splitlink
+        while (channel_receive(to_rx, &packet, *now)) {
+            bool ack_req = (packet.header.type_flags &
+                            YKB_PROTOCOL_FLAG_ACK_REQ) != 0u;
+            ykb_protocol_rx_result_t res =
+                ykb_protocol_rx_push_packet(&rx, &packet);
+            ykb_protocol_packet_t ack;
+
+            CHECK(res >= 0);
+            if ((res == YKB_PROTOCOL_RX_RESULT_COMPLETE || ack_req) &&
+                ykb_protocol_rx_build_ack(&rx, &ack) > 0u) {
+                channel_send(to_tx, &ack, *now);
+            }
+        }
+
+        while (channel_receive(to_tx, &packet, *now)) {
+            CHECK(ykb_protocol_arq_tx_on_ack(&arq, &packet, *now) >= 0);
+        }
+
+        ykb_protocol_arq_tx_poll(&arq, *now);
+        for (uint32_t n = 0; n < BURST; ++n) {
+            if (!ykb_protocol_arq_tx_next(&arq, *now, &packet)) {
+                break;
+            }
+            channel_send(to_rx, &packet, *now);
+        }
+    }
+
+    result->packets_sent += arq.packets_sent;
+    result->retransmissions += arq.retransmissions;
+    if (arq.complete) {
+        CHECK(ykb_protocol_rx_is_complete(&rx));
+        CHECK(memcmp(tx_data, rx_data, TRANSFER_SIZE) == 0);
+    }
+    return arq.complete;
+}
+
+static struct result run_link(uint16_t window, uint32_t loss_permille,
+                              uint32_t reorder_permille) {
+    struct channel to_rx = {.loss_permille = loss_permille,
+                            .reorder_permille = reorder_permille,
+                            .rng = 0x2545F491u};
+    struct channel to_tx = {.loss_permille = loss_permille,
+                            .reorder_permille = reorder_permille,
+                            .rng = 0x9E3779B9u};
+    ykb_protocol_arq_rtt_t rtt;
+    struct result result = {.complete = true};
+    uint32_t now = 0;
+
+    ykb_protocol_arq_rtt_init(&rtt, RTO_INIT_MS, RTO_MIN_MS, RTO_MAX_MS);
+    for (uint32_t i = 0; i < TRANSFERS && result.complete; ++i) {
+        result.complete = run_transfer(&to_rx, &to_tx, &rtt, window,
+                                       (uint8_t)(i + 1u), &now, &result);
+    }
+    result.elapsed_ms = now;
+    return result;
+}
+
+int main(void) {
+    static const uint32_t losses[] = {0, 50, 100, 200, 300};
+    static const uint32_t reorders[] = {0, 100};
+    uint32_t rng = 0x12345678u;
+    double lossless = 0.0;
+
+    for (uint32_t i = 0; i < TRANSFER_SIZE; ++i) {
+        tx_data[i] = (uint8_t)host_test_rand(&rng);
+    }
+
+    printf("link capacity %.1f kB/s\n",
+           (double)(BURST * YKB_PROTOCOL_MAX_PAYLOAD_SIZE));
+    for (size_t r = 0; r < sizeof(reorders) / sizeof(reorders[0]); ++r) {
+        for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); ++i) {
+            struct result sr = run_link(32, losses[i], reorders[r]);
+            struct result sw = run_link(1, losses[i], reorders[r]);
+
+            CHECK(sr.complete);
+            CHECK(sw.complete);
+
+            // Bytes per ms are kB/s
+            double sr_goodput =
+                (double)TRANSFER_SIZE * TRANSFERS / sr.elapsed_ms;
+            double sw_goodput =
+                (double)TRANSFER_SIZE * TRANSFERS / sw.elapsed_ms;
+
+            printf("loss %2u%% reorder %2u%%: window 32 %5.1f kB/s "
+                   "(%4u resent), stop-and-wait %5.1f kB/s (%4u resent)\n",
+                   losses[i] / 10u, reorders[r] / 10u, sr_goodput,
+                   sr.retransmissions, sw_goodput, sw.retransmissions);
+
+            if (losses[i] == 0u && reorders[r] == 0u) {
+                lossless = sr_goodput;
+                // Every packet sent once
+                CHECK_EQ(sr.packets_sent,
+                         YKB_PROTOCOL_PACKET_COUNT(TRANSFER_SIZE) * TRANSFERS);
+            } else if (losses[i] == 0u) {
+                // A late packet is resent at most once, spuriously
+                CHECK(sr.retransmissions * 1000u <=
+                      YKB_PROTOCOL_PACKET_COUNT(TRANSFER_SIZE) * TRANSFERS *
+                          reorders[r]);
+            }
+            CHECK(sr_goodput > 2.0 * sw_goodput);
+            // Every packet takes 1/(1-p) sends on average, which bounds the
+            // goodput at lossless * (1 - p). Losses should cost
+            // retransmissions rather than stalls of a whole backed off RTO
+            // each, and reordering only the odd spurious retransmission.
+            CHECK(sr_goodput * 1000.0 >
+                  lossless * (double)(1000u - losses[i]) * 0.4);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
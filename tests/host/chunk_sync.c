@@ -0,0 +1,148 @@
+#include "host_test.h"
+
+#include <lib/ykb_chunk_sync.h>
+
+#include <string.h>
+
+// Roughly a settings image, with the default settings chunk size
+#define IMAGE_SIZE 1400u
+#define CHUNK_SIZE 128u
+
+struct edit {
+    const char *name;
+    uint32_t offsets[4];
+    uint32_t lens[4];
+};
+
+static const struct edit edits[] = {
+    {"no change", {0}, {0}},
+    {"one threshold", {10}, {2}},
+    {"one key mapping", {500}, {1}},
+    {"two key mappings swapped", {300, 900}, {1, 1}},
+    {"all thresholds", {8}, {240}},
+    {"scattered bytes", {20, 400, 800, 1399}, {1, 3, 2, 1}},
+};
+
+static uint8_t master[IMAGE_SIZE];
+static uint8_t slave[IMAGE_SIZE];
+// Slave messages and master answers
+static uint8_t req[YKB_CHUNK_SYNC_MANIFEST_SIZE(IMAGE_SIZE, CHUNK_SIZE)];
+static uint8_t msg[YKB_CHUNK_SYNC_PATCH_MAX_SIZE(IMAGE_SIZE, CHUNK_SIZE)];
+
+// Runs the exchange of the settings sync: the slave offers a summary, a
+// mismatch is answered with an empty patch and the slave follows up with its
+// full manifest. Returns the bytes sent by both peers.
+static uint32_t sync_images(void) {
+    uint32_t bytes = 0;
+    int len;
+
+    len = ykb_chunk_sync_summary_build(slave, IMAGE_SIZE, CHUNK_SIZE, req,
+                                       sizeof(req));
+    CHECK_EQ(len, YKB_CHUNK_SYNC_SUMMARY_SIZE);
+    bytes += (uint32_t)len;
+
+    len = ykb_chunk_sync_patch_build(master, IMAGE_SIZE, CHUNK_SIZE, req,
+                                     (uint32_t)len, msg, sizeof(msg));
+    CHECK(len >= 0);
+    if (len == 0) {
+        return bytes;
+    }
+    bytes += (uint32_t)len;
+    CHECK_EQ(ykb_chunk_sync_patch_apply(slave, IMAGE_SIZE, msg, (uint32_t)len),
+             YKB_CHUNK_SYNC_ERROR_HASH_MISMATCH);
+
+    len = ykb_chunk_sync_manifest_build(slave, IMAGE_SIZE, CHUNK_SIZE, req,
+                                        sizeof(req));
+    CHECK_EQ(len, YKB_CHUNK_SYNC_MANIFEST_SIZE(IMAGE_SIZE, CHUNK_SIZE));
+    bytes += (uint32_t)len;
+
+    len = ykb_chunk_sync_patch_build(master, IMAGE_SIZE, CHUNK_SIZE, req,
+                                     (uint32_t)len, msg, sizeof(msg));
+    CHECK(len > 0);
+    bytes += (uint32_t)len;
+    CHECK_EQ(ykb_chunk_sync_patch_apply(slave, IMAGE_SIZE, msg, (uint32_t)len),
+             0);
+
+    return bytes;
+}
+
+static void test_typical_edits(void) {
+    uint32_t rng = 0x2545F491u;
+    uint32_t full;
+
+    for (uint32_t i = 0; i < IMAGE_SIZE; ++i) {
+        master[i] = (uint8_t)host_test_rand(&rng);
+    }
+
+    // Sending the whole image, as without a manifest
+    full = (uint32_t)ykb_chunk_sync_patch_build(master, IMAGE_SIZE, CHUNK_SIZE,
+                                                NULL, 0, msg, sizeof(msg));
+    CHECK_EQ(full, YKB_CHUNK_SYNC_PATCH_MAX_SIZE(IMAGE_SIZE, CHUNK_SIZE));
+    printf("%-26s %5u bytes\n", "whole image", full);
+
+    for (size_t e = 0; e < sizeof(edits) / sizeof(edits[0]); ++e) {
+        const struct edit *edit = &edits[e];
+        uint32_t changed = 0;
+
+        memcpy(slave, master, IMAGE_SIZE);
+        for (size_t i = 0; i < 4 && edit->lens[i] > 0; ++i) {
+            for (uint32_t j = 0; j < edit->lens[i]; ++j) {
+                master[edit->offsets[i] + j] ^= 0x5Au;
+            }
+            // Chunks the edit touches
+            changed += 1u + (edit->offsets[i] + edit->lens[i] - 1u) /
+                                CHUNK_SIZE -
+                       edit->offsets[i] / CHUNK_SIZE;
+        }
+
+        uint32_t bytes = sync_images();
+        CHECK(memcmp(master, slave, IMAGE_SIZE) == 0);
+        printf("%-26s %5u bytes, %u chunks\n", edit->name, bytes, changed);
+
+        if (changed == 0) {
+            CHECK_EQ(bytes, YKB_CHUNK_SYNC_SUMMARY_SIZE);
+        } else {
+            // Summary, empty patch, manifest, and a patch of the chunks
+            uint32_t expected =
+                2u * YKB_CHUNK_SYNC_SUMMARY_SIZE +
+                YKB_CHUNK_SYNC_MANIFEST_SIZE(IMAGE_SIZE, CHUNK_SIZE) +
+                sizeof(ykb_chunk_sync_patch_header_t) +
+                changed * (sizeof(uint16_t) + CHUNK_SIZE);
+            CHECK(bytes <= expected);
+        }
+        if (changed <= 2) {
+            CHECK(bytes * 3u < full);
+        }
+    }
+}
+
+static void test_malformed_patch(void) {
+    int len;
+
+    memcpy(slave, master, IMAGE_SIZE);
+    master[0] ^= 0xFFu;
+    len = ykb_chunk_sync_patch_build(master, IMAGE_SIZE, CHUNK_SIZE, NULL, 0,
+                                     msg, sizeof(msg));
+    CHECK(len > 0);
+
+    CHECK_EQ(ykb_chunk_sync_patch_apply(slave, IMAGE_SIZE, msg,
+                                        (uint32_t)len - 1u),
+             YKB_CHUNK_SYNC_ERROR_BAD_LENGTH);
+    CHECK_EQ(ykb_chunk_sync_patch_apply(slave, IMAGE_SIZE - 1u, msg,
+                                        (uint32_t)len),
+             YKB_CHUNK_SYNC_ERROR_IMAGE_MISMATCH);
+
+    // First chunk index of the patch out of range
+    uint16_t index = 0xFFFFu;
+    memcpy(&msg[sizeof(ykb_chunk_sync_patch_header_t)], &index,
+           sizeof(index));
+    CHECK_EQ(ykb_chunk_sync_patch_apply(slave, IMAGE_SIZE, msg, (uint32_t)len),
+             YKB_CHUNK_SYNC_ERROR_BAD_INDEX);
+}
+
+int main(void) {
+    test_typical_edits();
+    test_malformed_patch();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+#include "host_test.h"
+
+// Built once per backend, see CMakeLists.txt
+#include <lib/ykb_protocol.h>
+
+#include <string.h>
+
+#define BUFFER_SIZE 4096u
+#define BENCH_BYTES (16u * 1024u * 1024u)
+
+static const char *const backend_names[] = {
+    [YKB_PROTOCOL_CRC16_BITWISE] = "bitwise",
+    [YKB_PROTOCOL_CRC16_NIBBLE] = "nibble",
+    [YKB_PROTOCOL_CRC16_SLICING_4] = "slicing-4",
+    [YKB_PROTOCOL_CRC16_SLICING_8] = "slicing-8",
+};
+
+static uint8_t buffer[BUFFER_SIZE];
+
+// CRC-16/MODBUS check value
+static void test_check_value(void) {
+    static const uint8_t check[] = "123456789";
+
+    CHECK_EQ(ykb_protocol_crc16(check, sizeof(check) - 1u), 0x4B37);
+    CHECK_EQ(ykb_protocol_crc16(check, 0), 0xFFFF);
+    CHECK_EQ(ykb_protocol_crc16(NULL, 16), 0xFFFF);
+}
+
+// Every length and alignment the slicing loop and its tail can see
+static void test_matches_bitwise(void) {
+    for (uint32_t offset = 0; offset < 8u; ++offset) {
+        for (uint32_t len = 0; len <= 96u; ++len) {
+            const uint8_t *data = &buffer[offset];
+
+            CHECK_EQ(ykb_protocol_crc16(data, len),
+                     ykb_protocol_crc16_update_bitwise(0xFFFFu, data, len));
+        }
+    }
+
+    CHECK_EQ(ykb_protocol_crc16(buffer, BUFFER_SIZE),
+             ykb_protocol_crc16_update_bitwise(0xFFFFu, buffer, BUFFER_SIZE));
+}
+
+// A CRC continued over pieces equals the one over the whole buffer
+static void test_incremental(void) {
+    uint16_t whole = ykb_protocol_crc16(buffer, BUFFER_SIZE);
+    uint32_t rng = 0x9E3779B9u;
+    uint16_t crc = 0xFFFFu;
+    uint32_t pos = 0;
+
+    while (pos < BUFFER_SIZE) {
+        uint32_t len = host_test_rand(&rng) % 40u;
+
+        if (len > BUFFER_SIZE - pos) {
+            len = BUFFER_SIZE - pos;
+        }
+        crc = ykb_protocol_crc16_update(crc, &buffer[pos], len);
+        pos += len;
+    }
+    CHECK_EQ(crc, whole);
+}
+
+static double bench_mb_s(uint16_t (*update)(uint16_t, const uint8_t *,
+                                            size_t)) {
+    uint16_t crc = 0xFFFFu;
+    uint64_t start = host_test_time_ns();
+
+    for (uint32_t done = 0; done < BENCH_BYTES; done += BUFFER_SIZE) {
+        crc = update(crc, buffer, BUFFER_SIZE);
+    }
+
+    uint64_t ns = host_test_time_ns() - start;
+    // Keeps the loop from being optimized out
+    buffer[0] ^= (uint8_t)crc;
+
+    return (double)BENCH_BYTES * 1000.0 / (double)ns;
+}
+
+int main(void) {
+    uint32_t rng = 0x2545F491u;
+
+    for (uint32_t i = 0; i < BUFFER_SIZE; ++i) {
+        buffer[i] = (uint8_t)host_test_rand(&rng);
+    }
+
+    test_check_value();
+    test_matches_bitwise();
+    test_incremental();
+
+    printf("%s: %.1f MB/s, bitwise %.1f MB/s\n",
+           backend_names[YKB_PROTOCOL_CRC16_BACKEND],
+           bench_mb_s(ykb_protocol_crc16_update),
+           bench_mb_s(ykb_protocol_crc16_update_bitwise));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+#include "host_test.h"
+
+#include <esb_ipc.h>
+
+// The net core side of the event path is the ring and batch of esb_ipc.h, as
+// evt_put() and evt_send_work_handler() in 53_net/esb_53.c use them. The app
+// core side is evt_ept_recv() in 53_app/esb_53.c over the real walker.
+
+// Kconfig defaults of LIB_YKB_ESB_IPC_*
+#define RING_SIZE 2048u
+#define BATCH_SIZE 480u
+#define BATCH_EVENTS 16u
+// LIB_YKB_ESB_MSG_MAX_SIZE and ESB_MAX_PAYLOAD_LENGTH
+#define PAYLOAD_MAX 256u
+
+#define EVENTS 200000u
+// Every payload carries its event number, then a pattern derived from it
+#define PAYLOAD_MIN 4u
+
+struct net_core {
+    uint8_t ring_buf[RING_SIZE];
+    struct esb_ipc_ring ring;
+    uint8_t batch_buf[BATCH_SIZE];
+    struct esb_ipc_batch batch;
+};
+
+struct app_core {
+    uint16_t seq;
+    uint32_t next_event;
+    uint32_t received;
+    uint32_t dropped;
+    uint32_t batches;
+    uint32_t lost_batches;
+};
+
+static struct net_core net;
+static struct app_core app;
+
+static uint8_t payload_byte(uint32_t event, uint32_t i) {
+    return (uint8_t)(event * 31u + i);
+}
+
+static uint16_t payload_len(uint32_t event) {
+    // Mostly short ESB packets, now and then a reassembled message
+    if (event % 50u == 0u) {
+        return (uint16_t)(PAYLOAD_MAX - event % 64u);
+    }
+    return (uint16_t)(PAYLOAD_MIN + event % 29u);
+}
+
+static void evt_put(uint32_t event) {
+    uint8_t payload[PAYLOAD_MAX];
+    struct esb_ipc_evt_hdr hdr = {
+        .type = (uint8_t)(event % 4u),
+        .id = (uint8_t)event,
+        .len = payload_len(event),
+    };
+
+    memcpy(payload, &event, sizeof(event));
+    for (uint32_t i = sizeof(event); i < hdr.len; ++i) {
+        payload[i] = payload_byte(event, i);
+    }
+    esb_ipc_ring_put(&net.ring, &hdr, payload);
+}
+
+// Returns the events the batch carried
+static uint8_t evt_ept_recv(const uint8_t *batch, size_t len) {
+    struct esb_ipc_batch_hdr batch_hdr;
+    struct esb_ipc_evt_hdr hdr;
+    const uint8_t *payload;
+    size_t pos = sizeof(batch_hdr);
+    uint8_t count = 0;
+
+    CHECK(len >= sizeof(batch_hdr));
+    memcpy(&batch_hdr, batch, sizeof(batch_hdr));
+    // A doorbell for nothing
+    CHECK(batch_hdr.count != 0u || batch_hdr.dropped != 0u);
+    app.lost_batches += (uint16_t)(batch_hdr.seq - app.seq);
+    app.seq = batch_hdr.seq + 1u;
+    app.dropped += batch_hdr.dropped;
+    app.batches++;
+
+    while (esb_ipc_batch_next(batch, len, &pos, &hdr, &payload)) {
+        uint32_t event;
+
+        CHECK(hdr.len >= sizeof(event));
+        memcpy(&event, payload, sizeof(event));
+        // In order, the only gaps are reported drops
+        CHECK(event >= app.next_event);
+        CHECK_EQ(hdr.len, payload_len(event));
+        CHECK_EQ(hdr.type, event % 4u);
+        CHECK_EQ(hdr.id, (uint8_t)event);
+        for (uint32_t i = sizeof(event); i < hdr.len; ++i) {
+            CHECK_EQ(payload[i], payload_byte(event, i));
+        }
+        app.next_event = event + 1u;
+        app.received++;
+        count++;
+    }
+
+    CHECK_EQ(count, batch_hdr.count);
+    CHECK_EQ(pos, len);
+    return count;
+}
+
+// One run of the send work. ipc_busy_permille of the sends find no IPC
+// buffer, the batch is kept for the next run.
+static void evt_send_work(uint32_t max_batches, uint32_t ipc_busy_permille,
+                          uint32_t *rng) {
+    for (uint32_t n = 0; n < max_batches; ++n) {
+        if (!esb_ipc_batch_ready(&net.batch, &net.ring)) {
+            return;
+        }
+        if (host_test_rand(rng) % 1000u < ipc_busy_permille) {
+            return;
+        }
+
+        evt_ept_recv(net.batch.buf, net.batch.len);
+        esb_ipc_batch_sent(&net.batch);
+    }
+}
+
+static void net_init(void) {
+    esb_ipc_ring_init(&net.ring, net.ring_buf, sizeof(net.ring_buf));
+    esb_ipc_batch_init(&net.batch, net.batch_buf, sizeof(net.batch_buf),
+                       BATCH_EVENTS);
+}
+
+// Events come in bursts of burst every tick, the work sends up to
+// max_batches batches per tick
+
+static void run(const char *name, uint32_t burst, uint32_t max_batches,
+                uint32_t ipc_busy_permille) {
+    uint32_t rng = 0x2545F491u;
+    uint32_t event = 0;
+
+    net_init();
+    memset(&app, 0, sizeof(app));
+
+    while (event < EVENTS) {
+        for (uint32_t i = 0; i < burst && event < EVENTS; ++i) {
+            evt_put(event++);
+        }
+        evt_send_work(max_batches, ipc_busy_permille, &rng);
+    }
+    while (net.batch.len != 0u || net.ring.tail != net.ring.head ||
+           net.ring.dropped != 0u) {
+        evt_send_work(UINT32_MAX, ipc_busy_permille, &rng);
+    }
+
+    printf("%-8s %6u received, %6u dropped, %.1f events per batch\n", name,
+           app.received, app.dropped, (double)app.received / app.batches);
+    CHECK_EQ(app.lost_batches, 0);
+    CHECK_EQ(app.received + app.dropped, EVENTS);
+}
+
+static void test_malformed(void) {
+    struct esb_ipc_evt_hdr hdr;
+    const uint8_t *payload;
+    size_t pos;
+
+    net_init();
+    evt_put(0);
+    evt_put(1);
+    CHECK(esb_ipc_batch_ready(&net.batch, &net.ring));
+
+    // Cut inside the second payload, the first event still comes out
+    pos = sizeof(struct esb_ipc_batch_hdr);
+    CHECK(esb_ipc_batch_next(net.batch.buf, net.batch.len - 1u, &pos, &hdr,
+                             &payload));
+    CHECK(!esb_ipc_batch_next(net.batch.buf, net.batch.len - 1u, &pos, &hdr,
+                              &payload));
+
+    // Cut inside the second header
+    pos = sizeof(struct esb_ipc_batch_hdr) + sizeof(hdr) + payload_len(0);
+    CHECK(!esb_ipc_batch_next(net.batch.buf, pos + 1u, &pos, &hdr, &payload));
+
+    // A length past the end of the batch
+    hdr.len = UINT16_MAX;
+    memcpy(&net.batch.buf[sizeof(struct esb_ipc_batch_hdr)], &hdr, sizeof(hdr));
+    pos = sizeof(struct esb_ipc_batch_hdr);
+    CHECK(!esb_ipc_batch_next(net.batch.buf, net.batch.len, &pos, &hdr,
+                              &payload));
+}
+
+int main(void) {
+    test_malformed();
+
+    // About ten times the ESB packet rate, the IPC now and then busy
+    run("paced", 8, 4, 100);
+    CHECK_EQ(app.dropped, 0);
+    // The work falls behind, the ring overflows
+    run("flood", 64, 1, 300);
+    CHECK(app.dropped > 0u);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+#include "host_test.h"
+
+#include <esb_tx_ring.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+// PRX ACK payloads of ykb_esb.c, tx_fill_fifo(), tx_on_tx_success(),
+// tx_flush_fifo() and ykb_esb_send(), on the real ring bookkeeping against
+// a model of the NCS ESB PRX:
+// - the PTX sends one packet per step, a new PID once it got an ACK
+// - the PRX attaches the front of its TX FIFO to every ACK, and drops it
+//   with a TX_SUCCESS event once a new PID confirms that ACK got through
+// - TX_SUCCESS events not handled yet merge into one
+// - the end of a timeslot tears the radio down, the FIFO is flushed
+// Packets and ACKs are lost at random.
+
+// Kconfig defaults of LIB_YKB_ESB_TX_QUEUE_SIZE, LIB_YKB_ESB_PRX_ACK_DEPTH
+// and ESB_TX_FIFO_SIZE
+#define RING_SIZE 16u
+#define ACK_DEPTH 2u
+#define FIFO_SIZE 8u
+
+#define STEPS 200000u
+#define LOSS_PERMILLE 100u
+// Steps in which the event handler does not get to run. Should a second
+// TX_SUCCESS merge into the pending one, the ring counts a payload as loaded
+// which already went out, and ACKs go out empty once the FIFO runs dry,
+// until the end of the timeslot flushes the FIFO and settles the count.
+#define HANDLER_LATE_PERMILLE 1u
+#define TIMESLOT_STEPS 997u
+
+struct payload {
+    bool rt;
+    uint32_t seq;
+};
+
+// ESB PRX, payloads are copied into its FIFO
+struct radio {
+    struct payload fifo[FIFO_SIZE];
+    uint32_t fifo_count;
+    bool ack_had_payload;
+    uint32_t last_pid;
+    bool tx_success_pending;
+    bool rx_pending;
+    // An event was lost to a merge since the last timeslot
+    bool merged;
+};
+
+// ykb_esb.c
+struct prx {
+    struct payload ring[RING_SIZE];
+    struct payload rt;
+    struct esb_tx_ring tx;
+    bool active;
+};
+
+// Splitlink on the PTX, receiving the ACK payloads
+struct ptx {
+    uint32_t pid;
+    uint32_t bulk_next;
+    uint32_t bulk_duplicates;
+    uint32_t rt_last;
+    bool rt_seen;
+};
+
+static struct radio radio;
+static struct prx prx;
+static struct ptx ptx;
+static uint32_t rng = 0xC0FFEEu;
+
+static bool chance(uint32_t permille) {
+    return host_test_rand(&rng) % 1000u < permille;
+}
+
+static bool esb_write_payload(const struct payload *p) {
+    if (radio.fifo_count == FIFO_SIZE) {
+        return false;
+    }
+    radio.fifo[radio.fifo_count++] = *p;
+    return true;
+}
+
+static bool esb_pop_tx(void) {
+    if (radio.fifo_count == 0u) {
+        return false;
+    }
+    // Pops the entry written last, like the NCS driver
+    radio.fifo_count--;
+    return true;
+}
+
+static void tx_fill_fifo(void) {
+    uint32_t idx;
+
+    if (!prx.active) {
+        return;
+    }
+    if (esb_tx_ring_rt_next(&prx.tx) && esb_write_payload(&prx.rt)) {
+        esb_tx_ring_rt_written(&prx.tx);
+    }
+    while (esb_tx_ring_next(&prx.tx, ACK_DEPTH, &idx)) {
+        if (!esb_write_payload(&prx.ring[idx % RING_SIZE])) {
+            break;
+        }
+        esb_tx_ring_written(&prx.tx);
+    }
+}
+
+static void tx_flush_fifo(void) {
+    uint32_t left = 0;
+
+    while (esb_pop_tx()) {
+        left++;
+    }
+    esb_tx_ring_flushed(&prx.tx, left);
+    esb_tx_ring_rewind(&prx.tx);
+}
+
+static bool send(bool rt, uint32_t seq) {
+    uint32_t idx;
+    struct payload *p;
+
+    if (rt) {
+        p = &prx.rt;
+        esb_tx_ring_push_rt(&prx.tx);
+    } else if (!esb_tx_ring_push(&prx.tx, &idx)) {
+        return false;
+    } else {
+        p = &prx.ring[idx % RING_SIZE];
+    }
+    p->rt = rt;
+    p->seq = seq;
+    tx_fill_fifo();
+    return true;
+}
+
+static void event_handler(void) {
+    if (radio.tx_success_pending) {
+        radio.tx_success_pending = false;
+        esb_tx_ring_release(&prx.tx, 1);
+        tx_fill_fifo();
+    }
+    if (radio.rx_pending) {
+        radio.rx_pending = false;
+        tx_fill_fifo();
+    }
+}
+
+static void ptx_receive(const struct payload *p, uint32_t *bulk_delivered) {
+    if (p->rt) {
+        // Latest wins, but never an older one after a newer one
+        CHECK(!ptx.rt_seen || p->seq >= ptx.rt_last);
+        ptx.rt_last = p->seq;
+        ptx.rt_seen = true;
+        return;
+    }
+    // In order and without loss, duplicates are dropped by the receiver
+    CHECK(p->seq <= ptx.bulk_next);
+    if (p->seq < ptx.bulk_next) {
+        ptx.bulk_duplicates++;
+        return;
+    }
+    ptx.bulk_next++;
+    (*bulk_delivered)++;
+}
+
+// One packet from the PTX and its ACK
+static void exchange(uint32_t *bulk_delivered) {
+    struct payload ack;
+    bool ack_has_payload;
+
+    if (!prx.active || chance(LOSS_PERMILLE)) {
+        return;
+    }
+
+    if (ptx.pid != radio.last_pid) {
+        // A new PID confirms the previous ACK got through
+        if (radio.ack_had_payload) {
+            memmove(&radio.fifo[0], &radio.fifo[1],
+                    (radio.fifo_count - 1u) * sizeof(radio.fifo[0]));
+            radio.fifo_count--;
+            radio.merged |= radio.tx_success_pending;
+            radio.tx_success_pending = true;
+        }
+        radio.last_pid = ptx.pid;
+    }
+    radio.rx_pending = true;
+
+    ack_has_payload = radio.fifo_count > 0u;
+    if (ack_has_payload) {
+        ack = radio.fifo[0];
+    }
+    radio.ack_had_payload = ack_has_payload;
+
+    if (chance(LOSS_PERMILLE)) {
+        return;
+    }
+    ptx.pid++;
+    if (ack_has_payload) {
+        ptx_receive(&ack, bulk_delivered);
+    }
+}
+
+// ykb_esb_suspend() and ykb_esb_resume()
+static void timeslot_end(void) {
+    event_handler();
+    prx.active = false;
+    tx_flush_fifo();
+    radio.ack_had_payload = false;
+    radio.last_pid = UINT32_MAX;
+    radio.merged = false;
+    prx.active = true;
+    tx_fill_fifo();
+}
+
+int main(void) {
+    uint32_t bulk_sent = 0;
+    uint32_t rt_sent = 0;
+    uint32_t rt_bulk_ahead = 0;
+    uint32_t rt_bulk_ahead_max = 0;
+    uint32_t merges = 0;
+    uint32_t step;
+
+    esb_tx_ring_init(&prx.tx, RING_SIZE);
+    prx.active = true;
+    radio.last_pid = UINT32_MAX;
+
+    for (step = 0; step < STEPS; ++step) {
+        uint32_t bulk_delivered = 0;
+
+        // Settings transfers keep the bulk queue busy, real-time payloads
+        // come now and then
+        while (chance(400) && send(false, bulk_sent)) {
+            bulk_sent++;
+        }
+        if (chance(20)) {
+            send(true, rt_sent++);
+            rt_bulk_ahead = 0;
+        }
+
+        exchange(&bulk_delivered);
+        if (!chance(HANDLER_LATE_PERMILLE)) {
+            event_handler();
+        }
+
+        // How many new bulk payloads overtook the latest real-time one. It
+        // waits for those ahead of an older one still in the FIFO, and for
+        // those loaded behind that. Until the end of the timeslot settles
+        // a merged event, the ring counts one payload too many as loaded.
+        if (radio.merged) {
+            merges++;
+            rt_bulk_ahead = 0;
+        } else if (rt_sent > 0u && ptx.rt_last + 1u != rt_sent) {
+            rt_bulk_ahead += bulk_delivered;
+            if (rt_bulk_ahead > rt_bulk_ahead_max) {
+                rt_bulk_ahead_max = rt_bulk_ahead;
+            }
+        }
+
+        if (step % TIMESLOT_STEPS == TIMESLOT_STEPS - 1u) {
+            timeslot_end();
+        }
+    }
+
+    // Drain whatever is still queued, until the last ACK is confirmed too
+    for (; step < 2u * STEPS && esb_tx_ring_unacked(&prx.tx) > 0u; ++step) {
+        uint32_t bulk_delivered = 0;
+
+        exchange(&bulk_delivered);
+        event_handler();
+        if (step % TIMESLOT_STEPS == TIMESLOT_STEPS - 1u) {
+            timeslot_end();
+        }
+    }
+
+    printf("%u bulk payloads (%u duplicates), %u real-time, %u steps\n",
+           bulk_sent, ptx.bulk_duplicates, rt_sent, step);
+    printf("at most %u bulk payloads overtook a real-time one, %u steps "
+           "behind a merged event\n",
+           rt_bulk_ahead_max, merges);
+
+    CHECK(bulk_sent > STEPS / 4u);
+    CHECK_EQ(ptx.bulk_next, bulk_sent);
+    CHECK(ptx.rt_seen);
+    CHECK_EQ(ptx.rt_last + 1u, rt_sent);
+    CHECK_EQ(esb_tx_ring_unacked(&prx.tx), 0u);
+    CHECK(rt_bulk_ahead_max <= 2u * ACK_DEPTH);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+#include "host_test.h"
+
+#include <lib/ykb_time_sync.h>
+
+// The slave hands a transfer to the link every ms. Its crystal runs
+// DRIFT_PPM slow, each transfer takes TRIP_MIN_US plus queueing jitter, and
+// one in OUTLIER_EVERY is held back OUTLIER_US. The master clock starts
+// shortly before it wraps.
+#define PERIOD_US 1000u
+#define DRIFT_PPM 40
+#define TRIP_MIN_US 300u
+#define OUTLIER_EVERY 100u
+#define OUTLIER_US 25000u
+#define LOCAL_START_US (UINT32_MAX - 5000000u)
+#define PHASE_US 20000000u
+
+// Kconfig defaults of KB_HANDLER_SPLITLINK_TIME_SYNC
+#define WINDOW_US 1000000u
+#define STALE_US 20000u
+
+// Windows until the fit spans all its points
+#define SETTLE_US (YKB_TIME_SYNC_POINTS * WINDOW_US)
+#define DRIFT_TOLERANCE_PPB 2000
+#define MAPPING_TOLERANCE_US 20
+
+struct phase_result {
+    uint32_t outliers;
+    uint32_t stale;
+    int32_t max_error_us;
+};
+
+// Mostly short queueing delays with now and then a longer one, the lower
+// envelope stays at TRIP_MIN_US
+static uint32_t jitter_us(uint32_t *rng) {
+    uint32_t jitter = host_test_rand(rng) % 200u;
+
+    if (host_test_rand(rng) % 8u == 0u) {
+        jitter += host_test_rand(rng) % 2000u;
+    }
+    return jitter;
+}
+
+// Runs duration_us of master time starting at local_start_us, with the slave
+// clock at remote_start_us then
+static struct phase_result run_phase(ykb_time_sync_t *ts,
+                                     uint32_t local_start_us,
+                                     uint32_t remote_start_us,
+                                     uint32_t duration_us, uint32_t *rng) {
+    struct phase_result result = {0};
+    uint32_t n = 0;
+
+    for (uint64_t t = 0; t < duration_us; t += PERIOD_US, ++n) {
+        ykb_time_sync_result_t res;
+        uint32_t sent_local = local_start_us + (uint32_t)t;
+        uint32_t remote =
+            remote_start_us + (uint32_t)(t - t * DRIFT_PPM / 1000000u);
+        uint32_t trip = TRIP_MIN_US + jitter_us(rng);
+        bool outlier = n % OUTLIER_EVERY == OUTLIER_EVERY - 1u;
+
+        if (outlier) {
+            trip += OUTLIER_US;
+        }
+
+        ykb_time_sync_sample(ts, remote, sent_local + trip, &res);
+        if (t < SETTLE_US) {
+            continue;
+        }
+
+        // Mapped times are early by the shortest trip
+        int32_t error = (int32_t)(res.sent_us - (sent_local + TRIP_MIN_US));
+        if (error < 0) {
+            error = -error;
+        }
+        if (error > result.max_error_us) {
+            result.max_error_us = error;
+        }
+
+        CHECK_EQ(res.stale, outlier);
+        result.outliers += outlier;
+        result.stale += res.stale;
+    }
+
+    return result;
+}
+
+static void test_drift_and_restart(void) {
+    ykb_time_sync_t ts;
+    uint32_t rng = 0x2545F491u;
+    struct phase_result r;
+
+    ykb_time_sync_init(&ts, &(ykb_time_sync_config_t){
+                                .window_us = WINDOW_US,
+                                .stale_us = STALE_US,
+                            });
+
+    // The slave booted 3 s before the master
+    r = run_phase(&ts, LOCAL_START_US, 3000000u, PHASE_US, &rng);
+    printf("drift %.2f ppm, mapping error up to %d us, %u of %u outliers "
+           "stale\n",
+           ts.drift_ppb / 1000.0, r.max_error_us, r.stale, r.outliers);
+    CHECK(ts.synced);
+    CHECK(ts.drift_ppb > DRIFT_PPM * 1000 - DRIFT_TOLERANCE_PPB &&
+          ts.drift_ppb < DRIFT_PPM * 1000 + DRIFT_TOLERANCE_PPB);
+    CHECK(r.max_error_us <= MAPPING_TOLERANCE_US);
+    CHECK_EQ(ts.stats.resets, 0);
+    CHECK(ts.stats.latency_min_us < 200u);
+    CHECK(ts.stats.latency_max_us >= OUTLIER_US);
+
+    // The slave restarts, its clock starts over from 0
+    r = run_phase(&ts, LOCAL_START_US + PHASE_US, 0, PHASE_US, &rng);
+    printf("after restart: drift %.2f ppm, mapping error up to %d us\n",
+           ts.drift_ppb / 1000.0, r.max_error_us);
+    CHECK_EQ(ts.stats.resets, 1);
+    CHECK(ts.drift_ppb > DRIFT_PPM * 1000 - DRIFT_TOLERANCE_PPB &&
+          ts.drift_ppb < DRIFT_PPM * 1000 + DRIFT_TOLERANCE_PPB);
+    CHECK(r.max_error_us <= MAPPING_TOLERANCE_US);
+}
+
+// Without drift a single window already maps exactly
+static void test_first_window(void) {
+    ykb_time_sync_t ts;
+    ykb_time_sync_result_t res;
+
+    ykb_time_sync_init(&ts, &(ykb_time_sync_config_t){
+                                .window_us = WINDOW_US,
+                                .stale_us = STALE_US,
+                            });
+
+    ykb_time_sync_sample(&ts, 1000, 51000 + TRIP_MIN_US + 500u, &res);
+    CHECK_EQ(res.latency_us, 0);
+    ykb_time_sync_sample(&ts, 2000, 52000 + TRIP_MIN_US, &res);
+    CHECK_EQ(res.latency_us, 0);
+    CHECK_EQ(res.sent_us, 52000 + TRIP_MIN_US);
+
+    // A slower transfer is late by its extra trip
+    ykb_time_sync_sample(&ts, 3000, 53000 + TRIP_MIN_US + 700u, &res);
+    CHECK_EQ(res.latency_us, 700);
+    CHECK(!res.stale);
+
+    ykb_time_sync_sample(&ts, 4000, 54000 + TRIP_MIN_US + STALE_US + 1u,
+                         &res);
+    CHECK(res.stale);
+    CHECK_EQ(ts.stats.stale, 1);
+    CHECK_EQ(ts.stats.samples, 4);
+}
+
+static void test_buckets(void) {
+    CHECK_EQ(ykb_time_sync_bucket(0), 0);
+    CHECK_EQ(ykb_time_sync_bucket(YKB_TIME_SYNC_BUCKET0_US - 1u), 0);
+    CHECK_EQ(ykb_time_sync_bucket(YKB_TIME_SYNC_BUCKET0_US), 1);
+    CHECK_EQ(ykb_time_sync_bucket(YKB_TIME_SYNC_BUCKET0_US * 4u), 3);
+    CHECK_EQ(ykb_time_sync_bucket(UINT32_MAX), YKB_TIME_SYNC_BUCKETS - 1);
+}
+
+int main(void) {
+    test_buckets();
+    test_first_window();
+    test_drift_and_restart();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+#include "host_test.h"
+
+#include <lib/ykb_timeslot_policy.h>
+
+// The model steps through 10 s of typing in STEP_US steps. A key event every
+// 60 to 180 ms queues one payload. Every BLE connection event takes the radio
+// for BLE_EVENT_US at the start of its interval and always wins against the
+// split link.
+#define STEP_US 50u
+#define DURATION_US 10000000u
+#define KEY_GAP_MIN_US 60000u
+#define KEY_GAP_SPAN_US 120000u
+#define BLE_EVENT_US 1500u
+#define QUEUE_SIZE 64u
+
+// Kconfig defaults of LIB_YKB_TIMESLOT
+static const ykb_timeslot_policy_config_t adaptive = {
+    .min_length_us = 3000,
+    .max_length_us = 10000,
+    .payload_us = 1000,
+    .latency_target_us = 4000,
+    .ble_margin_us = 2500,
+    .idle_slots = 4,
+    .keep_listening = false,
+    .escalate_after = 3,
+};
+
+// What the link did before the policy: 10 ms slots extended for as long as
+// MPSL allows
+static const ykb_timeslot_policy_config_t fixed = {
+    .min_length_us = 10000,
+    .max_length_us = 10000,
+    .payload_us = 1000,
+    .latency_target_us = 0,
+    .ble_margin_us = 0,
+    .idle_slots = UINT8_MAX,
+    .keep_listening = true,
+    .escalate_after = 0,
+};
+
+struct model_result {
+    uint32_t queued;
+    uint32_t sent;
+    // Key events which found the ESB queue full
+    uint32_t dropped;
+    uint32_t avg_latency_us;
+    uint32_t max_latency_us;
+    // Share of the time the radio was held, in permille
+    uint32_t held_permille;
+    uint16_t utilization;
+};
+
+static bool overlaps_ble(uint32_t start, uint32_t length, uint32_t interval) {
+    if (interval == 0u) {
+        return false;
+    }
+
+    // Connection events starting in or right before the window
+    uint32_t event = start - start % interval;
+
+    for (; event < start + length; event += interval) {
+        if (event + BLE_EVENT_US > start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static struct model_result run_model(const ykb_timeslot_policy_config_t *cfg,
+                                     uint32_t ble_interval_us) {
+    ykb_timeslot_policy_t policy;
+    ykb_timeslot_policy_input_t in = {.ble_interval_us = ble_interval_us};
+    ykb_timeslot_policy_decision_t decision;
+    struct model_result result = {0};
+    uint32_t queue[QUEUE_SIZE];
+    uint32_t head = 0;
+    uint32_t rng = 0x2545F491u;
+    uint32_t next_key_us = KEY_GAP_MIN_US;
+    uint64_t latency_sum = 0;
+    bool in_slot = false;
+    uint32_t slot_end_us = 0;
+    uint32_t busy_until_us = 0;
+    // Pending request: when it starts, and whether it is a periodic normal
+    // request which is blocked rather than delayed by BLE
+    uint32_t request_at_us = 0;
+    uint32_t request_length_us;
+    bool request_normal = false;
+
+    ykb_timeslot_policy_init(&policy, cfg);
+    ykb_timeslot_policy_request(&policy, &in, &decision);
+    request_length_us = decision.length_us;
+
+    for (uint32_t t = 0; t < DURATION_US; t += STEP_US) {
+        if (t >= next_key_us) {
+            if (in.pending < QUEUE_SIZE) {
+                queue[(head + in.pending) % QUEUE_SIZE] = t;
+                in.pending++;
+                result.queued++;
+            } else {
+                result.dropped++;
+            }
+            next_key_us += KEY_GAP_MIN_US +
+                           host_test_rand(&rng) % KEY_GAP_SPAN_US;
+        }
+
+        if (!in_slot && t >= request_at_us) {
+            if (!overlaps_ble(t, request_length_us, ble_interval_us)) {
+                ykb_timeslot_policy_on_granted(&policy, request_length_us);
+                in_slot = true;
+                slot_end_us = t + request_length_us;
+            } else if (request_normal) {
+                // Blocked, the link asks for the earliest slot instead
+                ykb_timeslot_policy_on_request_failed(&policy);
+                ykb_timeslot_policy_request(&policy, &in, &decision);
+                request_length_us = decision.length_us;
+                request_normal = false;
+            }
+        }
+
+        if (in_slot && in.pending != 0u && t >= busy_until_us &&
+            t + cfg->payload_us <= slot_end_us) {
+            uint32_t latency = t + cfg->payload_us - queue[head];
+
+            busy_until_us = t + cfg->payload_us;
+            latency_sum += latency;
+            if (latency > result.max_latency_us) {
+                result.max_latency_us = latency;
+            }
+            head = (head + 1u) % QUEUE_SIZE;
+            in.pending--;
+            in.activity++;
+            result.sent++;
+        }
+
+        if (in_slot && t + STEP_US >= slot_end_us) {
+            ykb_timeslot_policy_decide(&policy, &in, &decision);
+            in.activity = 0;
+
+            if (decision.extend &&
+                !overlaps_ble(slot_end_us, decision.length_us,
+                              ble_interval_us)) {
+                ykb_timeslot_policy_on_extended(&policy, decision.length_us);
+                slot_end_us += decision.length_us;
+                continue;
+            }
+
+            if (decision.extend) {
+                ykb_timeslot_policy_on_extend_failed(&policy);
+                ykb_timeslot_policy_request(&policy, &in, &decision);
+            }
+            in_slot = false;
+            request_at_us = slot_end_us + decision.gap_us;
+            request_length_us = decision.length_us;
+            request_normal = decision.gap_us != 0u;
+        }
+    }
+
+    if (result.sent != 0u) {
+        result.avg_latency_us = (uint32_t)(latency_sum / result.sent);
+    }
+    result.held_permille =
+        (uint32_t)(policy.stats.granted_us * 1000u / DURATION_US);
+    result.utilization = ykb_timeslot_policy_utilization(&policy.stats);
+    return result;
+}
+
+static void print_result(const char *name, uint32_t ble_interval_us,
+                         const struct model_result *r) {
+    printf("%-14s BLE %5u us: %3u/%3u sent, %3u.%u%% held, "
+           "%u%% busy, latency avg %5u us, max %6u us\n",
+           name, ble_interval_us, r->sent, r->queued + r->dropped,
+           r->held_permille / 10u, r->held_permille % 10u,
+           r->utilization / 10u, r->avg_latency_us, r->max_latency_us);
+}
+
+static void test_length(void) {
+    ykb_timeslot_policy_t policy;
+    ykb_timeslot_policy_input_t in = {0};
+
+    ykb_timeslot_policy_init(&policy, &adaptive);
+    CHECK_EQ(ykb_timeslot_policy_length(&policy, &in), 3000);
+
+    in.pending = 4;
+    CHECK_EQ(ykb_timeslot_policy_length(&policy, &in), 7000);
+
+    in.pending = 100;
+    CHECK_EQ(ykb_timeslot_policy_length(&policy, &in), 10000);
+
+    // Leaves BLE its margin in every connection interval
+    in.ble_interval_us = 7500;
+    CHECK_EQ(ykb_timeslot_policy_length(&policy, &in), 5000);
+
+    // But never goes below the minimum
+    in.ble_interval_us = 4000;
+    CHECK_EQ(ykb_timeslot_policy_length(&policy, &in), 3000);
+}
+
+static void test_idle(void) {
+    ykb_timeslot_policy_t policy;
+    ykb_timeslot_policy_input_t in = {0};
+    ykb_timeslot_policy_decision_t decision;
+    ykb_timeslot_policy_config_t listening = adaptive;
+
+    ykb_timeslot_policy_init(&policy, &adaptive);
+    for (uint32_t n = 1; n < adaptive.idle_slots; ++n) {
+        ykb_timeslot_policy_decide(&policy, &in, &decision);
+        CHECK(decision.extend);
+    }
+    ykb_timeslot_policy_decide(&policy, &in, &decision);
+    CHECK(!decision.extend);
+    CHECK_EQ(decision.gap_us, adaptive.latency_target_us);
+
+    // Activity extends again right away
+    in.activity = 1;
+    ykb_timeslot_policy_decide(&policy, &in, &decision);
+    CHECK(decision.extend);
+
+    listening.keep_listening = true;
+    ykb_timeslot_policy_init(&policy, &listening);
+    in.activity = 0;
+    for (uint32_t n = 0; n < 100u; ++n) {
+        ykb_timeslot_policy_decide(&policy, &in, &decision);
+        CHECK(decision.extend);
+    }
+}
+
+static void test_escalation(void) {
+    ykb_timeslot_policy_t policy;
+    ykb_timeslot_policy_input_t in = {0};
+    ykb_timeslot_policy_decision_t decision;
+
+    ykb_timeslot_policy_init(&policy, &adaptive);
+    for (uint32_t n = 0; n < adaptive.escalate_after; ++n) {
+        ykb_timeslot_policy_request(&policy, &in, &decision);
+        CHECK(!decision.high_priority);
+        ykb_timeslot_policy_on_request_failed(&policy);
+    }
+    ykb_timeslot_policy_request(&policy, &in, &decision);
+    CHECK(decision.high_priority);
+
+    // Failed extensions do not count, a granted slot starts over
+    ykb_timeslot_policy_on_granted(&policy, decision.length_us);
+    ykb_timeslot_policy_on_extend_failed(&policy);
+    ykb_timeslot_policy_request(&policy, &in, &decision);
+    CHECK(!decision.high_priority);
+    CHECK_EQ(policy.stats.failed, adaptive.escalate_after + 1u);
+}
+
+static void test_model(void) {
+    static const uint32_t ble_intervals[] = {0, 7500, 30000};
+    ykb_timeslot_policy_config_t listening = adaptive;
+
+    listening.keep_listening = true;
+
+    for (size_t i = 0; i < sizeof(ble_intervals) / sizeof(ble_intervals[0]);
+         ++i) {
+        uint32_t ble = ble_intervals[i];
+        struct model_result f = run_model(&fixed, ble);
+        struct model_result a = run_model(&adaptive, ble);
+        struct model_result l = run_model(&listening, ble);
+
+        print_result("fixed 10 ms", ble, &f);
+        print_result("adaptive", ble, &a);
+        print_result("keep listening", ble, &l);
+
+        // Everything typed goes out, a key event at the very end may not
+        CHECK(a.dropped == 0u && a.sent + 1u >= a.queued);
+        CHECK(l.dropped == 0u && l.sent + 1u >= l.queued);
+        // The idle link gives up about half of the radio
+        CHECK(a.held_permille < 700u);
+        CHECK(a.held_permille < f.held_permille || f.sent == 0u);
+        // Waits for the gap and a connection event at most
+        CHECK(a.max_latency_us < adaptive.latency_target_us +
+                                     adaptive.max_length_us + BLE_EVENT_US +
+                                     (ble != 0u ? ble : 0u));
+        // A listening receiver holds all the radio BLE leaves it
+        CHECK(l.held_permille > a.held_permille);
+    }
+}
+
+int main(void) {
+    test_length();
+    test_idle();
+    test_escalation();
+    test_model();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include "host_test.h"
+
+#include <lib/ykb_value_codec.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+// Not a multiple of 8, so the last bitmap byte has unused bits
+#define KEY_COUNT 42
+#define SWEEPS 10000
+#define KEYFRAME_INTERVAL 64
+
+static uint16_t enc_ref[KEY_COUNT];
+static uint16_t dec_values[KEY_COUNT];
+static uint8_t frame[YKB_VALUE_CODEC_MAX_SIZE(KEY_COUNT)];
+
+// Resting keys with sensor noise, a few of them travelling at a time
+static void next_sweep(uint16_t *values, uint32_t *rng) {
+    for (uint16_t i = 0; i < KEY_COUNT; ++i) {
+        uint32_t r = host_test_rand(rng);
+
+        if (r % 16u == 0u) {
+            values[i] = (uint16_t)(host_test_rand(rng) % 1100u);
+        } else if (values[i] < 600u) {
+            values[i] = (uint16_t)(500u + r % 5u);
+        }
+    }
+}
+
+static uint16_t clamped(uint16_t value) {
+    return value > YKB_VALUE_CODEC_VALUE_MAX ? YKB_VALUE_CODEC_VALUE_MAX
+                                             : value;
+}
+
+static void test_round_trip(uint16_t deadband) {
+    ykb_value_codec_encoder_t enc;
+    ykb_value_codec_decoder_t dec;
+    uint16_t values[KEY_COUNT] = {0};
+    uint32_t rng = 0x2545F491u;
+    uint64_t bytes = 0;
+
+    ykb_value_codec_encoder_init(&enc, enc_ref, KEY_COUNT, deadband,
+                                 KEYFRAME_INTERVAL);
+    ykb_value_codec_decoder_init(&dec, dec_values, KEY_COUNT);
+
+    for (uint32_t n = 0; n < SWEEPS; ++n) {
+        next_sweep(values, &rng);
+
+        int len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+        CHECK(len >= 0);
+        if (len > 0) {
+            bytes += (uint64_t)len;
+            CHECK(ykb_value_codec_decode(&dec, frame, (uint16_t)len, NULL) >=
+                  0);
+        }
+
+        for (uint16_t i = 0; i < KEY_COUNT; ++i) {
+            uint16_t v = clamped(values[i]);
+            uint16_t diff = v > dec_values[i] ? v - dec_values[i]
+                                              : dec_values[i] - v;
+            CHECK(diff <= deadband);
+        }
+    }
+
+    printf("deadband %u: %.1f bytes per sweep, %u raw\n", deadband,
+           (double)bytes / SWEEPS, KEY_COUNT * 2u);
+}
+
+// A lost delta desyncs the decoder until the next keyframe
+static void test_seq_gap(void) {
+    ykb_value_codec_encoder_t enc;
+    ykb_value_codec_decoder_t dec;
+    uint16_t values[KEY_COUNT] = {0};
+    int len;
+
+    ykb_value_codec_encoder_init(&enc, enc_ref, KEY_COUNT, 0, 0);
+    ykb_value_codec_decoder_init(&dec, dec_values, KEY_COUNT);
+
+    len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+    CHECK_EQ(len, YKB_VALUE_CODEC_KEYFRAME_SIZE(KEY_COUNT));
+    CHECK(ykb_value_codec_decode(&dec, frame, (uint16_t)len, NULL) >= 0);
+
+    // Lost
+    values[3] = 700;
+    CHECK(ykb_value_codec_encode(&enc, values, frame, sizeof(frame)) > 0);
+
+    values[5] = 800;
+    len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+    CHECK_EQ(ykb_value_codec_decode(&dec, frame, (uint16_t)len, NULL),
+             YKB_VALUE_CODEC_ERROR_SEQ_GAP);
+    CHECK_EQ(dec_values[5], 0);
+
+    values[7] = 900;
+    len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+    CHECK_EQ(ykb_value_codec_decode(&dec, frame, (uint16_t)len, NULL),
+             YKB_VALUE_CODEC_ERROR_NOT_SYNCED);
+
+    ykb_value_codec_encoder_resync(&enc);
+    len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+    CHECK_EQ(ykb_value_codec_decode(&dec, frame, (uint16_t)len, NULL), 3);
+    CHECK(memcmp(values, dec_values, sizeof(values)) == 0);
+}
+
+static void test_malformed(void) {
+    ykb_value_codec_encoder_t enc;
+    ykb_value_codec_decoder_t dec;
+    uint16_t values[KEY_COUNT] = {0};
+    int len;
+
+    ykb_value_codec_encoder_init(&enc, enc_ref, KEY_COUNT, 0, 0);
+    ykb_value_codec_decoder_init(&dec, dec_values, KEY_COUNT);
+
+    CHECK_EQ(ykb_value_codec_encode(&enc, values, frame, sizeof(frame) - 1),
+             YKB_VALUE_CODEC_ERROR_BUFFER_TOO_SMALL);
+
+    len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+    CHECK_EQ(ykb_value_codec_decode(&dec, frame, (uint16_t)len - 1, NULL),
+             YKB_VALUE_CODEC_ERROR_BAD_LENGTH);
+    CHECK(ykb_value_codec_decode(&dec, frame, (uint16_t)len, NULL) >= 0);
+
+    values[0] = 100;
+    len = ykb_value_codec_encode(&enc, values, frame, sizeof(frame));
+    CHECK(len > 0);
+
+    // Marks a key past the last one
+    uint8_t bad[sizeof(frame)];
+    memcpy(bad, frame, (size_t)len);
+    bad[YKB_VALUE_CODEC_HEADER_SIZE + YKB_VALUE_CODEC_BITMAP_SIZE(KEY_COUNT) -
+        1] |= 0x80u;
+    CHECK_EQ(ykb_value_codec_decode(&dec, bad, (uint16_t)len, NULL),
+             YKB_VALUE_CODEC_ERROR_BAD_BITMAP);
+
+    uint8_t changed[YKB_VALUE_CODEC_BITMAP_SIZE(KEY_COUNT)];
+    CHECK_EQ(ykb_value_codec_decode(&dec, frame, (uint16_t)len, changed), 1);
+    CHECK_EQ(changed[0], 0x01);
+    CHECK_EQ(dec_values[0], 100);
+}
+
+int main(void) {
+    test_round_trip(0);
+    test_round_trip(4);
+    test_seq_gap();
+    test_malformed();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#include "kb_handler_internal.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+LOG_MODULE_REGISTER(kb_handler);
+
+// Travel scale value a key actuates at, half way down
+#define ACTUATION 512
+// Samples of a press from the top to the bottom and back
+#define STROKE_STEPS 20
+#define IDLE_SAMPLES 50
+#define BOTTOM_SAMPLES 6
+// Presses the calibration may take to learn a key from scratch
+#define LEARN_PRESSES 3
+// Allowed deviation of the actuation point, in stroke steps
+#define ACTUATION_TOLERANCE 1
+
+#define KEY 0
+
+// Sensor of one key: raw values between rest and rest + span over its
+// travel, with a little deterministic noise on top
+struct sensor {
+    uint32_t rest;
+    uint32_t span;
+    uint32_t noise_idx;
+};
+
+static const int8_t noise[] = {0, 3, -2, 1, -3, 2, -1, 0, 2, -2};
+
+static atomic_t kscan_updates;
+
+void kbh_core_update_kscan_thresholds(void) {
+    atomic_inc(&kscan_updates);
+}
+
+static uint16_t sample(struct sensor *s, uint32_t step) {
+    int32_t raw = (int32_t)(s->rest + s->span * step / STROKE_STEPS) +
+                  noise[s->noise_idx++ % ARRAY_SIZE(noise)];
+
+    return (uint16_t)CLAMP(raw, 0, UINT16_MAX);
+}
+
+// Replays a press down to depth steps and back up. Returns the step the
+// calibrated value first reached ACTUATION at, -1 if it did not.
+static int press(struct sensor *s, uint32_t depth) {
+    int actuated = -1;
+
+    for (uint32_t i = 0; i < IDLE_SAMPLES; ++i) {
+        kbh_calibration_process(KEY, sample(s, 0));
+    }
+    for (uint32_t step = 1; step <= depth; ++step) {
+        uint16_t travel = kbh_calibration_process(KEY, sample(s, step));
+        if (actuated < 0 && travel >= ACTUATION) {
+            actuated = step;
+        }
+    }
+    for (uint32_t i = 0; i < BOTTOM_SAMPLES; ++i) {
+        kbh_calibration_process(KEY, sample(s, depth));
+    }
+    for (uint32_t step = depth; step-- > 0;) {
+        kbh_calibration_process(KEY, sample(s, step));
+    }
+
+    return actuated;
+}
+
+static void assert_actuation_stable(struct sensor *s, uint32_t presses,
+                                    int32_t rest_drift, int32_t span_drift) {
+    uint32_t rest = s->rest;
+    uint32_t span = s->span;
+
+    for (uint32_t n = 0; n < presses; ++n) {
+        s->rest = rest + rest_drift * (int32_t)n / (int32_t)presses;
+        s->span = span + span_drift * (int32_t)n / (int32_t)presses;
+
+        int actuated = press(s, STROKE_STEPS);
+        if (n < LEARN_PRESSES) {
+            continue;
+        }
+        zassert_within(actuated, STROKE_STEPS / 2, ACTUATION_TOLERANCE,
+                       "press %u (rest %u, span %u) actuated at step %d", n,
+                       s->rest, s->span, actuated);
+    }
+}
+
+static void calibration_before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    kb_handler_calibration_reset();
+}
+
+ZTEST(kbh_calibration, test_travel_scale) {
+    struct sensor s = {.rest = 500, .span = 1000};
+
+    for (uint32_t n = 0; n < LEARN_PRESSES; ++n) {
+        press(&s, STROKE_STEPS);
+    }
+    zassert_within(kbh_calibration_process(KEY, 500), 0, 8);
+    zassert_within(kbh_calibration_process(KEY, 1000), 512, 16);
+    zassert_within(kbh_calibration_process(KEY, 1500), 1023, 8);
+    zassert_equal(kbh_calibration_process(KEY, 1600), 1023);
+}
+
+// Rest level and range drift up, as a sensor warming up
+ZTEST(kbh_calibration, test_drift_up) {
+    struct sensor s = {.rest = 500, .span = 1000};
+
+    assert_actuation_stable(&s, 300, 100, 80);
+}
+
+// Range shrinks below the learned bottom-out level, which has to decay
+ZTEST(kbh_calibration, test_drift_down) {
+    struct sensor s = {.rest = 600, .span = 1000};
+
+    assert_actuation_stable(&s, 300, -100, -80);
+}
+
+// Partial and rapid trigger presses say nothing about the bottom-out level
+ZTEST(kbh_calibration, test_partial_presses_keep_range) {
+    struct sensor s = {.rest = 500, .span = 1000};
+
+    for (uint32_t n = 0; n < LEARN_PRESSES; ++n) {
+        press(&s, STROKE_STEPS);
+    }
+    for (uint32_t n = 0; n < 500; ++n) {
+        press(&s, STROKE_STEPS * 7 / 10);
+    }
+    zassert_within(press(&s, STROKE_STEPS), STROKE_STEPS / 2,
+                   ACTUATION_TOLERANCE);
+}
+
+// KScan gets raw thresholds, which have to sit where the calibrated values
+// actuate and follow the levels as they drift
+ZTEST(kbh_calibration, test_raw_thresholds) {
+    struct sensor s = {.rest = 500, .span = 1000};
+    uint16_t travel[KEY + 1] = {[KEY] = ACTUATION};
+    uint16_t raw[KEY + 1];
+    atomic_val_t updates;
+
+    kbh_calibration_to_raw(travel, raw, ARRAY_SIZE(raw));
+    zassert_equal(raw[KEY], UINT16_MAX, "unlearned key got %u", raw[KEY]);
+
+    for (uint32_t n = 0; n < LEARN_PRESSES; ++n) {
+        press(&s, STROKE_STEPS);
+    }
+    // Updates are coalesced on the system workqueue
+    k_sleep(K_MSEC(200));
+    updates = atomic_get(&kscan_updates);
+    zassert_true(updates > 0);
+    kbh_calibration_to_raw(travel, raw, ARRAY_SIZE(raw));
+    zassert_within(raw[KEY], s.rest + s.span / 2, s.span / STROKE_STEPS);
+
+    // Nothing moved since the conversion
+    press(&s, STROKE_STEPS);
+    k_sleep(K_MSEC(200));
+    zassert_equal(atomic_get(&kscan_updates), updates);
+
+    s.rest += 100;
+    for (uint32_t n = 0; n < LEARN_PRESSES; ++n) {
+        press(&s, STROKE_STEPS);
+    }
+    k_sleep(K_MSEC(200));
+    zassert_true(atomic_get(&kscan_updates) > updates);
+    kbh_calibration_to_raw(travel, raw, ARRAY_SIZE(raw));
+    zassert_within(raw[KEY], s.rest + s.span / 2, s.span / STROKE_STEPS);
+}
+
+ZTEST_SUITE(kbh_calibration, NULL, NULL, calibration_before, NULL, NULL);
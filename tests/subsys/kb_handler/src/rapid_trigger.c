@@ -0,0 +1,171 @@
+#include "kb_handler_internal.h"
+
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+#define THRESHOLD 400
+#define MAXIMUM 1000
+#define SENSITIVITY 25
+#define DEADZONE 20
+
+struct edge {
+    uint16_t frame;
+    bool pressed;
+};
+
+// Recorded travel of one key, one value per frame
+static const uint16_t trace[] = {
+    // Pressed by the threshold
+    0, 100, 200, 300, 390, 400, 500, 600,
+    // Released SENSITIVITY above the deepest point, pressed again
+    // SENSITIVITY below the shallowest one
+    590, 580, 575, 570, 560, 580, 585, 700,
+    // Bottom dead zone clamps the depth to MAXIMUM - DEADZONE
+    1000, 990, 970, 960, 955, 950,
+    // Top dead zone disarms, the threshold applies again
+    10, 390, 410,
+};
+
+static const struct edge trace_edges[] = {
+    {5, true}, {10, false}, {14, true}, {20, false}, {24, true},
+};
+
+static kb_settings_t settings;
+static struct kbh_rapid_trigger rt;
+static uint16_t values[TOTAL_KEY_COUNT];
+
+static void *rapid_trigger_setup(void) {
+    kb_rapid_trigger_settings_t *rts = &settings.rapid_trigger;
+
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        settings.thresholds[i] = THRESHOLD;
+        settings.maximums[i] = MAXIMUM;
+        rts->enabled[i] = true;
+        rts->press_sensitivity[i] = SENSITIVITY;
+        rts->release_sensitivity[i] = SENSITIVITY;
+        rts->top_deadzone[i] = DEADZONE;
+        rts->bottom_deadzone[i] = DEADZONE;
+    }
+    return NULL;
+}
+
+static void rapid_trigger_before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    kbh_rapid_trigger_reset(&rt, 0, TOTAL_KEY_COUNT);
+    memset(values, 0, sizeof(values));
+}
+
+// Replays the trace on key, delayed by delay frames, and checks every edge
+// of the key happens on the expected frame
+static void assert_replay(uint16_t key, uint16_t delay) {
+    size_t next_edge = 0;
+    bool was_pressed = false;
+
+    for (uint16_t frame = 0; frame < delay + ARRAY_SIZE(trace); ++frame) {
+        values[key] = frame < delay ? 0 : trace[frame - delay];
+        kbh_rapid_trigger_update(&rt, &settings, values, 0, TOTAL_KEY_COUNT);
+
+        if (rt.pressed[key] == was_pressed) {
+            continue;
+        }
+        was_pressed = rt.pressed[key];
+
+        zassert_true(next_edge < ARRAY_SIZE(trace_edges),
+                     "key %u: extra edge at frame %u", key, frame);
+        zassert_equal(frame, trace_edges[next_edge].frame + delay,
+                      "key %u: edge %zu", key, next_edge);
+        zassert_equal(was_pressed, trace_edges[next_edge].pressed);
+        next_edge++;
+    }
+    zassert_equal(next_edge, ARRAY_SIZE(trace_edges), "key %u: edges missed",
+                  key);
+}
+
+ZTEST(kbh_rapid_trigger, test_replay) {
+    assert_replay(0, 0);
+}
+
+ZTEST(kbh_rapid_trigger, test_replay_last_key) {
+    assert_replay(TOTAL_KEY_COUNT - 1, 3);
+}
+
+// Every key runs its own trace shifted in time, keys must not affect each
+// other
+ZTEST(kbh_rapid_trigger, test_replay_all_keys) {
+    uint16_t frames = TOTAL_KEY_COUNT + ARRAY_SIZE(trace);
+    size_t next_edge[TOTAL_KEY_COUNT] = {0};
+    bool was_pressed[TOTAL_KEY_COUNT] = {false};
+
+    for (uint16_t frame = 0; frame < frames; ++frame) {
+        for (uint16_t key = 0; key < TOTAL_KEY_COUNT; ++key) {
+            bool started =
+                frame >= key && (size_t)(frame - key) < ARRAY_SIZE(trace);
+            values[key] = started ? trace[frame - key] : values[key];
+        }
+        kbh_rapid_trigger_update(&rt, &settings, values, 0, TOTAL_KEY_COUNT);
+
+        for (uint16_t key = 0; key < TOTAL_KEY_COUNT; ++key) {
+            if (rt.pressed[key] == was_pressed[key]) {
+                continue;
+            }
+            was_pressed[key] = rt.pressed[key];
+
+            zassert_true(next_edge[key] < ARRAY_SIZE(trace_edges),
+                         "key %u: extra edge at frame %u", key, frame);
+
+            const struct edge *edge = &trace_edges[next_edge[key]++];
+            zassert_equal(frame, edge->frame + key, "key %u", key);
+            zassert_equal(was_pressed[key], edge->pressed, "key %u", key);
+        }
+    }
+
+    for (uint16_t key = 0; key < TOTAL_KEY_COUNT; ++key) {
+        zassert_equal(next_edge[key], ARRAY_SIZE(trace_edges), "key %u",
+                      key);
+    }
+}
+
+ZTEST(kbh_rapid_trigger, test_noise_below_sensitivity) {
+    static const int8_t noise[] = {0, 12, -12, 7, -5, 12, -11, 3};
+
+    values[0] = 600;
+    kbh_rapid_trigger_update(&rt, &settings, values, 0, 1);
+    zassert_true(rt.pressed[0]);
+
+    // Peak to peak noise stays below SENSITIVITY
+    for (uint16_t frame = 0; frame < 1000; ++frame) {
+        values[0] = 600 + noise[frame % ARRAY_SIZE(noise)];
+        kbh_rapid_trigger_update(&rt, &settings, values, 0, 1);
+        zassert_true(rt.pressed[0], "released by noise at frame %u", frame);
+    }
+}
+
+ZTEST(kbh_rapid_trigger, test_disabled_key_uses_threshold) {
+    settings.rapid_trigger.enabled[1] = false;
+
+    for (size_t frame = 0; frame < ARRAY_SIZE(trace); ++frame) {
+        values[1] = trace[frame];
+        kbh_rapid_trigger_update(&rt, &settings, values, 0, TOTAL_KEY_COUNT);
+        zassert_equal(rt.pressed[1], trace[frame] >= THRESHOLD, "frame %zu",
+                      frame);
+    }
+
+    settings.rapid_trigger.enabled[1] = true;
+}
+
+ZTEST(kbh_rapid_trigger, test_update_range) {
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        values[i] = 600;
+    }
+    kbh_rapid_trigger_update(&rt, &settings, values, 2, 3);
+
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        zassert_equal(rt.pressed[i], i >= 2 && i < 5, "key %u", i);
+    }
+}
+
+ZTEST_SUITE(kbh_rapid_trigger, NULL, rapid_trigger_setup,
+            rapid_trigger_before, NULL, NULL);
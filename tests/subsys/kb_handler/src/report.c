@@ -0,0 +1,214 @@
+#include "kb_handler_internal.h"
+
+#include <dt-bindings/kb-handler/kb-key-codes.h>
+
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+#include <time.h>
+
+#define REPORT_SLOTS ARRAY_SIZE(((hid_kb_report_t *)0)->keys)
+
+#define CHECK_TRANSITIONS 20000
+#define BENCH_TRANSITIONS 200000
+// Keys held at once by the generated typing
+#define MAX_HELD 10
+
+static kb_settings_t settings;
+static struct kbh_report_builder builder;
+static bool pressed[TOTAL_KEY_COUNT];
+static uint16_t held;
+static uint32_t rng_state;
+
+// The builder replaced by the incremental one: a full rescan of all keys
+// with a linear slot search, run on every transition
+static void rescan_build(hid_kb_report_t *report, const bool *pressed_keys,
+                         uint16_t key_count) {
+    bool overflow = false;
+
+    memset(report, 0, sizeof(*report));
+
+    for (uint16_t i = 0; i < key_count; ++i) {
+        if (!pressed_keys[i]) {
+            continue;
+        }
+
+        uint8_t hid = kbh_resolve_hid(&settings, i, false, false);
+        if (hid == KEY_LAYER1 || hid == KEY_LAYER2 || hid == KEY_FN ||
+            hid == KEY_NOKEY) {
+            continue;
+        }
+        if (hid >= KEY_LEFTCONTROL && hid <= KEY_RIGHTGUI) {
+            report->mods |= BIT(hid - KEY_LEFTCONTROL);
+            continue;
+        }
+
+        bool added = false;
+        for (uint8_t j = 0; j < REPORT_SLOTS && !added; ++j) {
+            if (report->keys[j] == hid) {
+                added = true;
+            } else if (report->keys[j] == KEY_NOKEY) {
+                report->keys[j] = hid;
+                added = true;
+            }
+        }
+        overflow |= !added;
+    }
+
+    if (overflow && IS_ENABLED(CONFIG_KB_HANDLER_REPORT_ROLLOVER)) {
+        memset(report->keys, 0x01, sizeof(report->keys));
+    }
+}
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Toggles a random key, releases only once MAX_HELD keys are held
+static uint16_t next_transition(uint16_t key_count) {
+    for (;;) {
+        uint16_t key = rng_next() % key_count;
+
+        if (pressed[key] || held < MAX_HELD) {
+            pressed[key] = !pressed[key];
+            held = pressed[key] ? held + 1 : held - 1;
+            return key;
+        }
+    }
+}
+
+static void apply_transition(uint16_t key) {
+    if (pressed[key]) {
+        kbh_report_press(&builder, key, settings.mappings_layer1[key]);
+    } else {
+        kbh_report_release(&builder, key);
+    }
+}
+
+// Report slots are filled in a different order, compare them as sets
+static void assert_same_keys(const hid_kb_report_t *a,
+                             const hid_kb_report_t *b) {
+    for (uint8_t i = 0; i < REPORT_SLOTS; ++i) {
+        bool found = false;
+
+        for (uint8_t j = 0; j < REPORT_SLOTS && !found; ++j) {
+            found = a->keys[i] == b->keys[j];
+        }
+        zassert_true(found, "usage 0x%02x missing", a->keys[i]);
+    }
+}
+
+static uint64_t host_time_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void *report_setup(void) {
+    // Modifiers on the first keys, the rest share 64 usages so some usages
+    // are held by several keys
+    for (uint16_t i = 0; i < TOTAL_KEY_COUNT; ++i) {
+        settings.mappings_layer1[i] =
+            i < 8 ? KEY_LEFTCONTROL + i : KEY_A + (i - 8) % 64;
+    }
+    return NULL;
+}
+
+static void report_before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    kbh_report_reset(&builder);
+    memset(pressed, 0, sizeof(pressed));
+    held = 0;
+    rng_state = 0x2545F491;
+}
+
+ZTEST(kbh_report, test_matches_rescan) {
+    hid_kb_report_t expected;
+    hid_kb_report_t report;
+    hid_kb_nkro_report_t nkro;
+
+    for (uint32_t n = 0; n < CHECK_TRANSITIONS; ++n) {
+        apply_transition(next_transition(TOTAL_KEY_COUNT));
+
+        rescan_build(&expected, pressed, TOTAL_KEY_COUNT);
+        kbh_report_get(&builder, &report);
+        zassert_equal(report.mods, expected.mods, "transition %u", n);
+        assert_same_keys(&report, &expected);
+        assert_same_keys(&expected, &report);
+
+        kbh_report_get_nkro(&builder, &nkro);
+        zassert_equal(nkro.mods, expected.mods);
+        for (uint16_t hid = KEY_A; hid < KEY_A + 64; ++hid) {
+            bool held_usage = false;
+
+            for (uint16_t i = 8; i < TOTAL_KEY_COUNT && !held_usage; ++i) {
+                held_usage = pressed[i] && settings.mappings_layer1[i] == hid;
+            }
+            zassert_equal((nkro.bitmap[hid / 8] & BIT(hid % 8)) != 0,
+                          held_usage, "NKRO usage 0x%02x", hid);
+        }
+    }
+}
+
+ZTEST(kbh_report, test_oldest_usages_keep_slots) {
+    hid_kb_report_t report;
+
+    // Seven usages, the first six pressed keep their slots
+    for (uint16_t key = 8; key < 8 + REPORT_SLOTS + 1; ++key) {
+        kbh_report_press(&builder, key, settings.mappings_layer1[key]);
+    }
+    kbh_report_release(&builder, 9);
+    kbh_report_get(&builder, &report);
+
+    for (uint8_t i = 0; i < REPORT_SLOTS; ++i) {
+        zassert_not_equal(report.keys[i], settings.mappings_layer1[9]);
+        zassert_not_equal(report.keys[i], 0x01, "unexpected rollover");
+    }
+    zassert_true(memchr(report.keys, settings.mappings_layer1[8 + REPORT_SLOTS],
+                        sizeof(report.keys)) != NULL,
+                 "waiting usage did not take the free slot");
+}
+
+// Time per transition including fetching the report, for 30, 60 and 120
+// key layouts. Printed only, host timings are too noisy to assert on.
+ZTEST(kbh_report, test_bench_transition) {
+    static const uint16_t layouts[] = {30, 60, 120};
+    hid_kb_report_t report;
+
+    for (uint8_t l = 0; l < ARRAY_SIZE(layouts); ++l) {
+        uint16_t key_count = layouts[l];
+        uint64_t start;
+        uint64_t rescan_ns;
+        uint64_t incremental_ns;
+
+        report_before(NULL);
+        start = host_time_ns();
+        for (uint32_t n = 0; n < BENCH_TRANSITIONS; ++n) {
+            next_transition(key_count);
+            rescan_build(&report, pressed, key_count);
+        }
+        rescan_ns = host_time_ns() - start;
+
+        report_before(NULL);
+        start = host_time_ns();
+        for (uint32_t n = 0; n < BENCH_TRANSITIONS; ++n) {
+            apply_transition(next_transition(key_count));
+            kbh_report_get(&builder, &report);
+        }
+        incremental_ns = host_time_ns() - start;
+
+        TC_PRINT("%3u keys: rescan %llu ns, incremental %llu ns per "
+                 "transition\n",
+                 key_count,
+                 (unsigned long long)(rescan_ns / BENCH_TRANSITIONS),
+                 (unsigned long long)(incremental_ns / BENCH_TRANSITIONS));
+    }
+}
+
+ZTEST_SUITE(kbh_report, NULL, report_setup, report_before, NULL, NULL);